@@ -0,0 +1,523 @@
+/* * End-to-end benchmark for output/analyzer
+ * Streams a synthetic workload through chains of several lengths and queue
+ * sizes and reports throughput and per-line latency, optionally against a
+ * stored baseline.
+ */
+#include "workload.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_CONFIGS 32
+#define MAX_BASELINE 256
+#define MAX_STAGES 256                  /* Longest chain --chains accepts */
+#define WRITE_CHUNK (64 * 1024)         /* Bytes written per call when not paced */
+#define RESULT_FORMAT "stages=%d queue=%d lines_per_s=%lf mb_per_s=%lf p50_us=%lf p99_us=%lf p999_us=%lf"
+
+/* Transforms cycled through to build a chain; every chain ends in logger */
+static const char* const transforms[] = { "uppercaser", "rotator", "flipper" };
+
+/**
+ * Benchmark settings
+ */
+typedef struct {
+    const char* analyzer;
+    workload_spec_t workload;
+    int chains[MAX_CONFIGS];
+    int num_chains;
+    int queues[MAX_CONFIGS];
+    int num_queues;
+    int runs;
+    double rate;                /* Lines per second, 0 for as fast as possible */
+    const char* flush;
+    const char* baseline;
+    int save;
+    double threshold;           /* Allowed regression, percent */
+} bench_options_t;
+
+/**
+ * Result of one configuration
+ */
+typedef struct {
+    int stages;
+    int queue;
+    double lines_per_s;
+    double mb_per_s;
+    double p50_us;
+    double p99_us;
+    double p999_us;
+} bench_result_t;
+
+/**
+ * State shared with the thread reading the analyzer's output
+ */
+typedef struct {
+    int fd;
+    double* received;           /* Arrival time of each line's final printout */
+    size_t expected;
+    size_t count;
+} reader_state_t;
+
+double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_usage(void) {
+    printf("Usage: pipeline_bench [options]\n"
+           "Options:\n"
+           "  --analyzer <path>   Analyzer binary (default output/analyzer)\n"
+           "  --lines <n>         Lines per run (default 200000)\n"
+           "  --lengths <dist>    fixed:N, uniform:MIN-MAX or exp:MEAN (default uniform:8-128)\n"
+           "  --charset <set>     lower, alpha, alnum, printable or literal characters (default alnum)\n"
+           "  --seed <n>          Workload seed (default 1)\n"
+           "  --chains <list>     Comma-separated chain lengths (default 2,4,8)\n"
+           "  --queues <list>     Comma-separated queue sizes (default 16,256)\n"
+           "  --runs <n>          Runs per configuration; the median is reported (default 3)\n"
+           "  --rate <n>          Offered load in lines/s, 0 = as fast as possible (default 0)\n"
+           "  --flush <policy>    Analyzer --flush policy (default line)\n"
+           "  --baseline <file>   Baseline to compare against (default bench/baseline.txt)\n"
+           "  --save              Store this run's results as the baseline\n"
+           "  --threshold <pct>   Flag regressions larger than this (default 10)\n"
+           "  --print-workload    Write the workload to stdout and exit\n");
+}
+
+/* Parse "a,b,c" into positive integers; returns the count, 0 on error */
+int parse_list(const char* text, int* out) {
+    int count = 0;
+    const char* pos = text;
+    while (*pos && count < MAX_CONFIGS) {
+        char* end;
+        long value = strtol(pos, &end, 10);
+        if (end == pos || value <= 0 || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        out[count++] = (int)value;
+        pos = *end == ',' ? end + 1 : end;
+    }
+    return *pos ? 0 : count;
+}
+
+/* Reader thread: timestamp every "[logger] " line, i.e. every line leaving the chain */
+void* read_output(void* arg) {
+    reader_state_t* state = (reader_state_t*)arg;
+    static const char marker[] = "[logger] ";
+    char buf[WRITE_CHUNK];
+    int at_line_start = 1;
+    size_t matched = 0;     /* Bytes of marker matched at the start of the current line */
+    ssize_t n;
+
+    while ((n = read(state->fd, buf, sizeof(buf))) > 0) {
+        double now = now_sec();
+        for (ssize_t i = 0; i < n; i++) {
+            if (at_line_start || matched > 0) {
+                if (buf[i] == marker[matched]) {
+                    matched++;
+                    if (matched == sizeof(marker) - 1) {
+                        if (state->count < state->expected) {
+                            state->received[state->count] = now;
+                        }
+                        state->count++;
+                        matched = 0;
+                    }
+                } else {
+                    matched = 0;
+                }
+                at_line_start = 0;
+            }
+            if (buf[i] == '\n') {
+                at_line_start = 1;
+                matched = 0;
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Write all of buf, retrying on short writes */
+int write_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        buf += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Start the analyzer with the given chain; returns its pid or -1 */
+pid_t start_analyzer(const bench_options_t* opts, int stages, int queue,
+                     int* to_child, int* from_child) {
+    int in_pipe[2], out_pipe[2];
+    if (pipe(in_pipe) != 0) {
+        return -1;
+    }
+    if (pipe(out_pipe) != 0) {
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        return -1;
+    }
+
+    char queue_arg[16];
+    snprintf(queue_arg, sizeof(queue_arg), "%d", queue);
+    const char* argv[5 + MAX_STAGES];
+    int argc = 0;
+    argv[argc++] = opts->analyzer;
+    argv[argc++] = "--flush";
+    argv[argc++] = opts->flush;
+    argv[argc++] = queue_arg;
+    for (int i = 0; i < stages - 1; i++) {
+        argv[argc++] = transforms[i % (sizeof(transforms) / sizeof(transforms[0]))];
+    }
+    argv[argc++] = "logger";
+    argv[argc] = NULL;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(in_pipe[0], STDIN_FILENO);
+        dup2(out_pipe[1], STDOUT_FILENO);
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        close(out_pipe[1]);
+        execv(opts->analyzer, (char* const*)argv);
+        perror("execv");
+        _exit(127);
+    }
+
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    if (pid < 0) {
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        return -1;
+    }
+    *to_child = in_pipe[1];
+    *from_child = out_pipe[0];
+    return pid;
+}
+
+int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Value at a fraction of a sorted array (nearest rank) */
+double percentile(const double* sorted, size_t count, double fraction) {
+    size_t rank = (size_t)(fraction * (double)count + 0.999999);
+    if (rank == 0) {
+        rank = 1;
+    }
+    return sorted[(rank > count ? count : rank) - 1];
+}
+
+/* Stream the workload through one chain once */
+const char* run_once(const bench_options_t* opts, const workload_t* work, int stages,
+                     int queue, bench_result_t* result) {
+    double* sent = malloc(sizeof(double) * work->lines);
+    double* received = malloc(sizeof(double) * work->lines);
+    if (!sent || !received) {
+        free(sent);
+        free(received);
+        return "Failed to allocate memory for timestamps";
+    }
+
+    int to_child, from_child;
+    pid_t pid = start_analyzer(opts, stages, queue, &to_child, &from_child);
+    if (pid < 0) {
+        free(sent);
+        free(received);
+        return "Failed to start analyzer";
+    }
+
+    reader_state_t state = { from_child, received, work->lines, 0 };
+    pthread_t reader;
+    pthread_create(&reader, NULL, read_output, &state);
+
+    /*
+     * Unpaced, lines go out in large writes and share the send time of
+     * their write; paced, each line is written on its own schedule
+     */
+    const char* err = NULL;
+    double start = now_sec();
+    size_t line = 0;
+    while (line < work->lines && !err) {
+        size_t last = line + 1;
+        if (opts->rate > 0) {
+            double due = start + line / opts->rate;
+            double wait = due - now_sec();
+            if (wait > 0) {
+                struct timespec ts = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+                nanosleep(&ts, NULL);
+            }
+        } else {
+            while (last < work->lines &&
+                   work->offsets[last + 1] - work->offsets[line] <= WRITE_CHUNK) {
+                last++;
+            }
+        }
+
+        double now = now_sec();
+        for (size_t i = line; i < last; i++) {
+            sent[i] = now;
+        }
+        if (write_all(to_child, work->data + work->offsets[line],
+                      work->offsets[last] - work->offsets[line]) != 0) {
+            err = "Failed to write to analyzer";
+        }
+        line = last;
+    }
+    if (!err && write_all(to_child, "<END>\n", 6) != 0) {
+        err = "Failed to write to analyzer";
+    }
+    close(to_child);
+
+    pthread_join(reader, NULL);
+    close(from_child);
+    int status;
+    waitpid(pid, &status, 0);
+
+    if (!err && (!WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+        err = "Analyzer failed";
+    }
+    if (!err && state.count != work->lines) {
+        err = "Analyzer lost lines";
+    }
+
+    if (!err) {
+        double elapsed = received[work->lines - 1] - sent[0];
+        for (size_t i = 0; i < work->lines; i++) {
+            sent[i] = (received[i] - sent[i]) * 1e6;
+        }
+        qsort(sent, work->lines, sizeof(double), compare_double);
+
+        result->stages = stages;
+        result->queue = queue;
+        result->lines_per_s = work->lines / elapsed;
+        result->mb_per_s = work->size / elapsed / 1e6;
+        result->p50_us = percentile(sent, work->lines, 0.50);
+        result->p99_us = percentile(sent, work->lines, 0.99);
+        result->p999_us = percentile(sent, work->lines, 0.999);
+    }
+
+    free(sent);
+    free(received);
+    return err;
+}
+
+int compare_throughput(const void* a, const void* b) {
+    double x = ((const bench_result_t*)a)->lines_per_s;
+    double y = ((const bench_result_t*)b)->lines_per_s;
+    return (x > y) - (x < y);
+}
+
+/* Load a baseline file; returns the number of results read */
+int load_baseline(const char* path, bench_result_t* out) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    int count = 0;
+    char line[512];
+    while (count < MAX_BASELINE && fgets(line, sizeof(line), file)) {
+        bench_result_t* r = &out[count];
+        if (sscanf(line, RESULT_FORMAT, &r->stages, &r->queue, &r->lines_per_s, &r->mb_per_s,
+                   &r->p50_us, &r->p99_us, &r->p999_us) == 7) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+int main(int argc, char* argv[]) {
+    bench_options_t opts = {
+        .analyzer = "output/analyzer",
+        .workload = { 200000, WORKLOAD_LEN_UNIFORM, 8, 128, NULL, 1 },
+        .chains = { 2, 4, 8 },
+        .num_chains = 3,
+        .queues = { 16, 256 },
+        .num_queues = 2,
+        .runs = 3,
+        .rate = 0,
+        .flush = "line",
+        .baseline = "bench/baseline.txt",
+        .save = 0,
+        .threshold = 10,
+    };
+    const char* charset = "alnum";
+    int print_workload = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = 1;
+        if (strcmp(argv[i], "--save") == 0) {
+            opts.save = 1;
+            continue;
+        }
+        if (strcmp(argv[i], "--print-workload") == 0) {
+            print_workload = 1;
+            continue;
+        }
+        if (!value) {
+            ok = 0;
+        } else if (strcmp(argv[i], "--analyzer") == 0) {
+            opts.analyzer = value;
+        } else if (strcmp(argv[i], "--lines") == 0) {
+            opts.workload.lines = strtoul(value, NULL, 10);
+            ok = opts.workload.lines > 0;
+        } else if (strcmp(argv[i], "--lengths") == 0) {
+            const char* err = workload_parse_lengths(value, &opts.workload);
+            if (err) {
+                fprintf(stderr, "Error: --lengths: %s.\n", err);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--charset") == 0) {
+            charset = value;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            opts.workload.seed = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[i], "--chains") == 0) {
+            opts.num_chains = parse_list(value, opts.chains);
+            ok = opts.num_chains > 0;
+            for (int c = 0; c < opts.num_chains; c++) {
+                ok = ok && opts.chains[c] <= MAX_STAGES;
+            }
+        } else if (strcmp(argv[i], "--queues") == 0) {
+            opts.num_queues = parse_list(value, opts.queues);
+            ok = opts.num_queues > 0;
+        } else if (strcmp(argv[i], "--runs") == 0) {
+            opts.runs = atoi(value);
+            ok = opts.runs > 0;
+        } else if (strcmp(argv[i], "--rate") == 0) {
+            opts.rate = atof(value);
+            ok = opts.rate >= 0;
+        } else if (strcmp(argv[i], "--flush") == 0) {
+            opts.flush = value;
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            opts.baseline = value;
+        } else if (strcmp(argv[i], "--threshold") == 0) {
+            opts.threshold = atof(value);
+            ok = opts.threshold >= 0;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Invalid option %s.\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+        i++;
+    }
+
+    opts.workload.charset = workload_charset(charset);
+    if (!opts.workload.charset) {
+        fprintf(stderr, "Error: --charset must not be empty or contain a newline.\n");
+        return 1;
+    }
+
+    workload_t work;
+    const char* err = workload_generate(&opts.workload, &work);
+    if (err) {
+        fprintf(stderr, "Error: %s\n", err);
+        return 1;
+    }
+    if (print_workload) {
+        int failed = write_all(STDOUT_FILENO, work.data, work.size) != 0;
+        workload_free(&work);
+        return failed;
+    }
+
+    /* A reader that exits early must not kill the benchmark */
+    signal(SIGPIPE, SIG_IGN);
+
+    static bench_result_t baseline[MAX_BASELINE];
+    int baseline_count = opts.save ? 0 : load_baseline(opts.baseline, baseline);
+
+    printf("workload: %zu lines, %.1f MB, flush %s, %s\n", work.lines, work.size / 1e6,
+           opts.flush, opts.rate > 0 ? "paced" : "unpaced");
+    printf("%6s %6s %12s %9s %10s %10s %10s  %s\n", "stages", "queue", "lines/s", "MB/s",
+           "p50_us", "p99_us", "p999_us", baseline_count ? "vs baseline" : "");
+
+    bench_result_t results[MAX_CONFIGS * MAX_CONFIGS];
+    int result_count = 0;
+    int regressions = 0;
+    bench_result_t* runs = malloc(sizeof(bench_result_t) * opts.runs);
+    if (!runs) {
+        workload_free(&work);
+        return 1;
+    }
+
+    for (int c = 0; c < opts.num_chains; c++) {
+        for (int q = 0; q < opts.num_queues; q++) {
+            for (int r = 0; r < opts.runs; r++) {
+                err = run_once(&opts, &work, opts.chains[c], opts.queues[q], &runs[r]);
+                if (err) {
+                    fprintf(stderr, "Error: %d stages, queue %d: %s\n",
+                            opts.chains[c], opts.queues[q], err);
+                    free(runs);
+                    workload_free(&work);
+                    return 1;
+                }
+            }
+
+            /* Report the run with the median throughput */
+            qsort(runs, opts.runs, sizeof(bench_result_t), compare_throughput);
+            bench_result_t* res = &results[result_count++];
+            *res = runs[opts.runs / 2];
+            printf("%6d %6d %12.0f %9.2f %10.1f %10.1f %10.1f", res->stages, res->queue,
+                   res->lines_per_s, res->mb_per_s, res->p50_us, res->p99_us, res->p999_us);
+
+            for (int b = 0; b < baseline_count; b++) {
+                if (baseline[b].stages != res->stages || baseline[b].queue != res->queue) {
+                    continue;
+                }
+                double tput = (res->lines_per_s / baseline[b].lines_per_s - 1) * 100;
+                double p99 = (res->p99_us / baseline[b].p99_us - 1) * 100;
+                int regressed = tput < -opts.threshold || p99 > opts.threshold;
+                regressions += regressed;
+                printf("  %+6.1f%% lines/s %+6.1f%% p99%s", tput, p99,
+                       regressed ? "  REGRESSION" : "");
+                break;
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    free(runs);
+    workload_free(&work);
+
+    if (opts.save) {
+        FILE* file = fopen(opts.baseline, "w");
+        if (!file) {
+            fprintf(stderr, "Error: Cannot write baseline %s.\n", opts.baseline);
+            return 1;
+        }
+        for (int i = 0; i < result_count; i++) {
+            bench_result_t* res = &results[i];
+            fprintf(file, "stages=%d queue=%d lines_per_s=%.0f mb_per_s=%.3f p50_us=%.1f "
+                    "p99_us=%.1f p999_us=%.1f\n", res->stages, res->queue, res->lines_per_s,
+                    res->mb_per_s, res->p50_us, res->p99_us, res->p999_us);
+        }
+        fclose(file);
+        printf("Baseline saved to %s\n", opts.baseline);
+    }
+
+    if (regressions > 0) {
+        printf("%d configuration(s) regressed by more than %.0f%%\n", regressions, opts.threshold);
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include "workload.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Longest line the exponential distribution may draw unless capped lower */
+#define WORKLOAD_EXP_CAP (1UL << 20)
+
+/* xorshift64*: fast, and reproducible across platforms for a given seed */
+static unsigned long long next_random(unsigned long long* state) {
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/* Parse a positive size; returns 0 on failure */
+static size_t parse_size(const char* text, char** end) {
+    if (*text < '0' || *text > '9') {
+        return 0;
+    }
+    return (size_t)strtoull(text, end, 10);
+}
+
+const char* workload_parse_lengths(const char* spec, workload_spec_t* out) {
+    char* end = NULL;
+
+    if (strncmp(spec, "fixed:", 6) == 0) {
+        out->kind = WORKLOAD_LEN_FIXED;
+        out->a = parse_size(spec + 6, &end);
+        out->b = out->a;
+    } else if (strncmp(spec, "uniform:", 8) == 0) {
+        out->kind = WORKLOAD_LEN_UNIFORM;
+        out->a = parse_size(spec + 8, &end);
+        if (out->a == 0 || *end != '-') {
+            return "length distribution must be fixed:N, uniform:MIN-MAX or exp:MEAN";
+        }
+        out->b = parse_size(end + 1, &end);
+        if (out->b < out->a) {
+            return "uniform lengths need MIN <= MAX";
+        }
+    } else if (strncmp(spec, "exp:", 4) == 0) {
+        out->kind = WORKLOAD_LEN_EXP;
+        out->a = parse_size(spec + 4, &end);
+        out->b = WORKLOAD_EXP_CAP;
+    } else {
+        return "length distribution must be fixed:N, uniform:MIN-MAX or exp:MEAN";
+    }
+
+    if (out->a == 0 || !end || *end != '\0') {
+        return "length distribution must be fixed:N, uniform:MIN-MAX or exp:MEAN";
+    }
+    return NULL;
+}
+
+const char* workload_charset(const char* name) {
+    if (strcmp(name, "lower") == 0) {
+        return "abcdefghijklmnopqrstuvwxyz";
+    }
+    if (strcmp(name, "alpha") == 0) {
+        return "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    }
+    if (strcmp(name, "alnum") == 0) {
+        return "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+    }
+    if (strcmp(name, "printable") == 0) {
+        return " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+               "[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~";
+    }
+    if (*name == '\0' || strchr(name, '\n')) {
+        return NULL;
+    }
+    return name;
+}
+
+/* Draw one line length */
+static size_t draw_length(const workload_spec_t* spec, unsigned long long* state) {
+    switch (spec->kind) {
+    case WORKLOAD_LEN_UNIFORM:
+        return spec->a + (size_t)(next_random(state) % (spec->b - spec->a + 1));
+    case WORKLOAD_LEN_EXP: {
+        /* Inverse transform sampling; u in (0, 1] */
+        double u = ((next_random(state) >> 11) + 1) * (1.0 / 9007199254740992.0);
+        size_t len = (size_t)(-log(u) * (double)spec->a) + 1;
+        return len < spec->b ? len : spec->b;
+    }
+    default:
+        return spec->a;
+    }
+}
+
+const char* workload_generate(const workload_spec_t* spec, workload_t* out) {
+    size_t set_len = strlen(spec->charset);
+    unsigned long long state = spec->seed ? spec->seed : 0x9E3779B97F4A7C15ULL;
+
+    memset(out, 0, sizeof(*out));
+    out->offsets = malloc(sizeof(size_t) * (spec->lines + 1));
+    if (!out->offsets) {
+        return "Failed to allocate memory for workload";
+    }
+
+    /* Lengths first, so the text is allocated once */
+    size_t size = 0;
+    for (size_t i = 0; i < spec->lines; i++) {
+        out->offsets[i] = size;
+        size += draw_length(spec, &state) + 1;
+    }
+    out->offsets[spec->lines] = size;
+
+    out->data = malloc(size ? size : 1);
+    if (!out->data) {
+        free(out->offsets);
+        out->offsets = NULL;
+        return "Failed to allocate memory for workload";
+    }
+
+    for (size_t i = 0; i < spec->lines; i++) {
+        char* line = out->data + out->offsets[i];
+        size_t len = out->offsets[i + 1] - out->offsets[i] - 1;
+        for (size_t j = 0; j < len; j++) {
+            line[j] = spec->charset[next_random(&state) % set_len];
+        }
+        line[len] = '\n';
+
+        /* The shutdown marker would end the run early */
+        if (len == 5 && memcmp(line, "<END>", 5) == 0) {
+            line[0] = spec->charset[0] == '<' ? '>' : spec->charset[0];
+        }
+    }
+
+    out->size = size;
+    out->lines = spec->lines;
+    return NULL;
+}
+
+void workload_free(workload_t* workload) {
+    free(workload->data);
+    free(workload->offsets);
+    memset(workload, 0, sizeof(*workload));
+}
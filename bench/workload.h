@@ -0,0 +1,71 @@
+/* */
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stddef.h>
+
+/**
+ * How line lengths are drawn
+ */
+typedef enum
+{
+    WORKLOAD_LEN_FIXED = 0,     /* Every line is `a` bytes */
+    WORKLOAD_LEN_UNIFORM = 1,   /* Uniform in [a, b] */
+    WORKLOAD_LEN_EXP = 2        /* Exponential with mean `a`, at least 1, at most b */
+} workload_len_kind_t;
+
+/**
+ * Parameters of a synthetic workload
+ */
+typedef struct
+{
+    size_t lines;               /* Number of lines */
+    workload_len_kind_t kind;   /* */
+    size_t a;                   /* See workload_len_kind_t */
+    size_t b;                   /* */
+    const char* charset;        /* Characters lines are made of (no '\n') */
+    unsigned long seed;         /* Same seed, same workload */
+} workload_spec_t;
+
+/**
+ * Generated lines, stored back to back with their '\n'
+ */
+typedef struct
+{
+    char* data;                 /* All lines, each ending in '\n' */
+    size_t size;                /* Bytes in data */
+    size_t* offsets;            /* Start of line i; offsets[lines] == size */
+    size_t lines;               /* */
+} workload_t;
+
+/**
+ * Parse a length distribution: "fixed:N", "uniform:MIN-MAX" or "exp:MEAN"
+ * @param spec Distribution text
+ * @param out Receives kind, a and b
+ * @return NULL on success, error message on failure
+ */
+const char* workload_parse_lengths(const char* spec, workload_spec_t* out); /* */
+
+/**
+ * Resolve a character set name: "lower", "alpha", "alnum" or "printable".
+ * Any other text is taken literally as the set of characters to use.
+ * @param name Set name or literal characters
+ * @return The characters, or NULL if the set is empty or contains '\n'
+ */
+const char* workload_charset(const char* name); /* */
+
+/**
+ * Generate a workload. Lines never read "<END>".
+ * @param spec Parameters
+ * @param out Receives the lines; release with workload_free
+ * @return NULL on success, error message on failure
+ */
+const char* workload_generate(const workload_spec_t* spec, workload_t* out); /* */
+
+/**
+ * Free a generated workload
+ * @param workload Lines from workload_generate
+ */
+void workload_free(workload_t* workload); /* */
+
+#endif // WORKLOAD_H
@@ -30,13 +30,13 @@ mkdir -p output
 # --- Build Main Application ---
 print_status "Building main application: analyzer"
 # Use gcc-13 as specified in the PDF, and link against libdl (-ldl)
-gcc-13 -Wall -Werror -o output/analyzer main.c -ldl -pthread || {
+gcc-13 -Wall -Werror -o output/analyzer main.c plugins/output_sink.c plugins/stage_metrics.c plugins/buffer_pool.c plugins/cpu_topology.c plugins/queue_tuner.c plugins/stage_graph.c plugins/pipeline_server.c plugins/input_reader.c plugins/simd/text_kernels.c plugins/sync/executor.c -ldl -pthread || {
     print_error "Failed to build main application"
     exit 1
 }
 
 # --- Define common source files for all plugins ---
-COMMON_SOURCES="plugins/plugin_common.c plugins/sync/monitor.c plugins/sync/consumer_producer.c"
+COMMON_SOURCES="plugins/plugin_common.c plugins/sync/monitor.c plugins/sync/consumer_producer.c plugins/sync/reorder_buffer.c plugins/sync/executor.c plugins/simd/text_kernels.c plugins/output_sink.c plugins/buffer_pool.c plugins/cpu_topology.c"
 
 # --- Build Plugins ---
 PLUGINS="logger typewriter uppercaser rotator flipper expander"
@@ -58,3 +58,32 @@ for plugin_name in $PLUGINS; do
 done
 
 print_status "Build complete. All binaries are in the 'output/' directory."
+
+# --- Benchmark target: ./build.sh bench [pipeline_bench options] ---
+if [ "$1" = "bench" ]; then
+    shift
+    print_status "Building benchmark: pipeline_bench"
+    gcc-13 -Wall -Werror -O2 -o output/pipeline_bench \
+        bench/pipeline_bench.c bench/workload.c -lm -pthread || {
+        print_error "Failed to build pipeline_bench"
+        exit 1
+    }
+
+    print_status "Running benchmark"
+    ./output/pipeline_bench "$@"
+fi
+
+# --- Queue microbenchmark: ./build.sh queue-bench [consumer_producer_bench options] ---
+if [ "$1" = "queue-bench" ]; then
+    shift
+    print_status "Building benchmark: consumer_producer_bench"
+    gcc-13 -Wall -Werror -O2 -o output/consumer_producer_bench \
+        plugins/sync/consumer_producer_bench.c plugins/sync/consumer_producer.c \
+        plugins/sync/monitor.c -pthread || {
+        print_error "Failed to build consumer_producer_bench"
+        exit 1
+    }
+
+    print_status "Running queue benchmark"
+    ./output/consumer_producer_bench "$@"
+fi
@@ -4,8 +4,26 @@
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "plugins/plugin_sdk.h"
+#include "plugins/output_sink.h"
+#include "plugins/stage_metrics.h"
+#include "plugins/buffer_pool.h"
+#include "plugins/cpu_topology.h"
+#include "plugins/queue_tuner.h"
+#include "plugins/stage_graph.h"
+#include "plugins/pipeline_server.h"
+#include "plugins/input_reader.h"
+#include "plugins/simd/text_kernels.h"
+#include "plugins/sync/executor.h"
+
+/* Lines handed to the first stage per call when reading a mapped file */
+#define INPUT_BATCH 64
 
 /* Function pointer types for dlsym */
 typedef const char* (*plugin_init_func_t)(int);
@@ -13,6 +31,67 @@ typedef const char* (*plugin_fini_func_t)(void);
 typedef const char* (*plugin_place_work_func_t)(const char*);
 typedef void (*plugin_attach_func_t)(const char* (*)(const char*));
 typedef const char* (*plugin_wait_finished_func_t)(void);
+typedef const char* (*plugin_place_work_many_func_t)(const char* const*, int);
+typedef void (*plugin_attach_many_func_t)(const char* (*)(const char* const*, int));
+typedef const char* (*plugin_set_option_func_t)(const char*, const char*);
+typedef const char* (*plugin_place_work_move_func_t)(char* const*, int);
+typedef void (*plugin_attach_move_func_t)(const char* (*)(char* const*, int));
+typedef const char* (*plugin_transform_func_t)(const char*);
+typedef void (*plugin_transform_inplace_func_t)(char*);
+typedef int (*plugin_is_stateless_func_t)(void);
+typedef const char* (*plugin_fuse_func_t)(plugin_transform_func_t, plugin_transform_inplace_func_t);
+typedef int (*plugin_is_pure_func_t)(void);
+typedef void (*plugin_attach_output_func_t)(output_sink_t*, int);
+typedef const char* (*plugin_get_metrics_func_t)(stage_metrics_t*);
+typedef void (*plugin_attach_pool_func_t)(buffer_pool_t*);
+typedef const char* (*plugin_resize_queue_func_t)(int);
+
+/* Instance ABI (see plugin_sdk.h) */
+typedef void* (*plugin_create_func_t)(void);
+typedef void (*plugin_destroy_func_t)(void*);
+typedef const char* (*plugin_instance_init_func_t)(void*, int);
+typedef const char* (*plugin_instance_call_func_t)(void*);
+typedef const char* (*plugin_instance_place_work_func_t)(void*, const char*);
+typedef const char* (*plugin_instance_place_work_many_func_t)(void*, const char* const*, int);
+typedef const char* (*plugin_instance_place_work_move_func_t)(void*, char* const*, int);
+typedef const char* (*plugin_instance_place_work_slices_func_t)(void*, char* const*, const size_t*, int);
+typedef void (*plugin_instance_attach_func_t)(void*, const plugin_link_t*);
+typedef const char* (*plugin_instance_set_option_func_t)(void*, const char*, const char*);
+typedef void (*plugin_instance_attach_output_func_t)(void*, output_sink_t*, int);
+typedef void (*plugin_instance_attach_executor_func_t)(void*, executor_t*);
+typedef char* (*plugin_instance_process_slice_func_t)(void*, char*, size_t, size_t*);
+typedef const char* (*plugin_instance_get_metrics_func_t)(void*, stage_metrics_t*);
+typedef const char* (*plugin_instance_resize_queue_func_t)(void*, int);
+typedef const char* (*plugin_instance_transform_func_t)(void*, const char*);
+typedef void (*plugin_instance_transform_inplace_func_t)(void*, char*);
+typedef const char* (*plugin_instance_fuse_func_t)(void*, void*, plugin_instance_transform_func_t,
+                                                   plugin_instance_transform_inplace_func_t);
+typedef const char* (*plugin_instance_transform_slice_func_t)(void*, const char*, size_t, size_t*);
+typedef void (*plugin_instance_transform_inplace_slice_func_t)(void*, char*, size_t);
+typedef const char* (*plugin_instance_fuse_slices_func_t)(void*, void*, plugin_instance_transform_func_t,
+                                                          plugin_instance_transform_inplace_func_t,
+                                                          plugin_instance_transform_slice_func_t,
+                                                          plugin_instance_transform_inplace_slice_func_t);
+
+/*
+ * Entry points of one stage in instance form, each called with the stage's
+ * instance. For a plugin with only the global ABI they are the adapters
+ * below and the instance is its plugin_handle_t.
+ */
+typedef struct {
+    plugin_instance_init_func_t init;
+    plugin_instance_call_func_t fini;
+    plugin_instance_call_func_t wait_finished;
+    plugin_instance_place_work_func_t place_work;
+    /* Optional, NULL when the plugin does not provide them */
+    plugin_instance_place_work_many_func_t place_work_many;
+    plugin_instance_place_work_move_func_t place_work_move;
+    plugin_instance_place_work_slices_func_t place_work_slices;
+    plugin_instance_set_option_func_t set_option;
+    plugin_instance_attach_output_func_t attach_output;
+    plugin_instance_get_metrics_func_t get_metrics;
+    plugin_instance_resize_queue_func_t resize_queue;
+} plugin_ops_t;
 
 /* Store loaded plugin info */
 typedef struct {
@@ -21,6 +100,43 @@ typedef struct {
     plugin_place_work_func_t place_work;
     plugin_attach_func_t attach;
     plugin_wait_finished_func_t wait_finished;
+    /* Optional entry points, NULL when the plugin does not export them */
+    plugin_place_work_many_func_t place_work_many;
+    plugin_attach_many_func_t attach_many;
+    plugin_set_option_func_t set_option;
+    plugin_place_work_move_func_t place_work_move;
+    plugin_attach_move_func_t attach_move;
+    plugin_transform_func_t transform;
+    plugin_transform_inplace_func_t transform_inplace;
+    plugin_is_stateless_func_t is_stateless;
+    plugin_fuse_func_t fuse;
+    plugin_is_pure_func_t is_pure;
+    plugin_attach_output_func_t attach_output;
+    plugin_get_metrics_func_t get_metrics;
+    plugin_attach_pool_func_t attach_pool;
+    plugin_resize_queue_func_t resize_queue;
+    /* Instance ABI entry points beyond plugin_ops_t (instance mode only) */
+    plugin_destroy_func_t destroy;
+    plugin_instance_attach_func_t instance_attach;
+    plugin_instance_fuse_func_t instance_fuse;
+    plugin_instance_transform_func_t instance_transform;
+    plugin_instance_transform_inplace_func_t instance_transform_inplace;
+    plugin_instance_fuse_slices_func_t instance_fuse_slices;
+    plugin_instance_transform_slice_func_t instance_transform_slice;
+    plugin_instance_transform_inplace_slice_func_t instance_transform_inplace_slice;
+    plugin_instance_attach_executor_func_t attach_executor;  /* Optional */
+    plugin_instance_process_slice_func_t process_slice;     /* Optional, for --inline */
+    plugin_ops_t ops;
+    void* instance;     /* First argument of every ops call */
+    int instanced;      /* Runs through the instance ABI */
+    int workers;    /* Consumer threads for this stage (name@N), 1 by default */
+    const char* cpus;   /* CPU list for the stage's threads (name:cpu=<list>), NULL if unset */
+    int queue_size;     /* Capacity of the stage's queue (name:q=N), 0 for the common queue_size */
+    int inputs;         /* Plugins feeding this one in the topology */
+    int chained;        /* Fed only by the previous plugin, which feeds nothing else */
+    int merge_any;      /* Fan-in passes items on as they come (name:merge=any) */
+    int fused;      /* Runs inside an earlier plugin's stage, has no thread or queue */
+    int scheduled;  /* Runs as a task of the --executor pool, has no thread of its own */
     char* name;
     void* handle;
     char* so_path;
@@ -28,10 +144,46 @@ typedef struct {
 
 /* Print usage information */
 void print_usage(void) {
-    printf("Usage: ./analyzer <queue_size> <plugin1> <plugin2> ... <pluginN>\n"
+    printf("Usage: ./analyzer [options] <queue_size> <plugin1> <plugin2> ... <pluginN>\n"
            "Arguments:\n"
            "  queue_size   Maximum number of items in each plugin's queue\n"
            "  plugin1..N   Names of plugins to load (without .so extension)\n"
+           "               name@N runs N worker threads on that stage, keeping input order\n"
+           "               (only for plugins without side effects)\n"
+           "               name:cpu=<list> pins that stage's threads to the listed CPUs\n"
+           "               name:q=<n> gives that stage a queue of n items instead of queue_size\n"
+           "               a -> {b, c -> d} -> e feeds a's output to both branches and\n"
+           "               both branches' output to e (quote it for the shell)\n"
+           "               name:merge=any lets a stage with several inputs take items as\n"
+           "               they come instead of in input order (merge=ordered)\n"
+           "Options:\n"
+           "  --batch <n>  Maximum items a stage drains and forwards at once (default 64)\n"
+           "  --fuse       Run consecutive stateless plugins in one thread without queues\n"
+           "  --inline     Run every line through the whole chain on the reading thread,\n"
+           "               calling each plugin directly; no queues or stage threads\n"
+           "  --input <f>  Read lines from file f (memory-mapped) instead of STDIN\n"
+           "  --flush <p>  When printouts are written: line, size:<bytes> or time:<ms>\n"
+           "               (default line on a terminal, size:65536 otherwise)\n"
+           "  --type-rate <n>  Characters per second typed by typewriter (default 10,\n"
+           "               0 prints lines at once)\n"
+           "  --metrics <f>  Write per-stage metrics (table and JSON) to file f, or - for\n"
+           "               stderr, at shutdown and on SIGUSR1\n"
+           "  --wait <s>   How stages wait on their queues: park (default), spin, or\n"
+           "               spin:<spins>[:<yields>] to poll before sleeping\n"
+           "  --pool <m>   Line buffer pool: on (default), off (malloc) or huge (backed\n"
+           "               by huge pages)\n"
+           "  --queue-budget <n>  Resize queues while running: grow those whose producers\n"
+           "               block, shrink idle ones, holding at most n items in all queues\n"
+           "  --pin <p>    Pin the reader and every stage's threads to one CPU each: auto\n"
+           "               (adjacent stages on cores sharing a cache) or a CPU list\n"
+           "               such as 0,2,4-7, used in chain order\n"
+           "  --executor <n>  Run the stages as tasks of a pool of n threads (auto: one\n"
+           "               per CPU) instead of a thread each, keeping each stage's order\n"
+           "  --serve <s>  Keep the pipeline running and take input from clients of the\n"
+           "               Unix socket s, one after another, until SIGINT or SIGTERM\n"
+           "Client:\n"
+           "  ./analyzer --connect <s>  Send STDIN to the pipeline serving socket s and\n"
+           "               print its output\n"
            "Available plugins:\n"
            "  logger       Logs all strings that pass through\n"
            "  typewriter   Simulates typewriter effect with delays\n"
@@ -92,6 +244,646 @@ cleanup:
     return ret;
 }
 
+/* Global-ABI adapters: the instance is the plugin_handle_t itself */
+static const char* legacy_init(void* h, int queue_size) {
+    return ((plugin_handle_t*)h)->init(queue_size);
+}
+static const char* legacy_fini(void* h) {
+    return ((plugin_handle_t*)h)->fini();
+}
+static const char* legacy_wait_finished(void* h) {
+    return ((plugin_handle_t*)h)->wait_finished();
+}
+static const char* legacy_place_work(void* h, const char* str) {
+    return ((plugin_handle_t*)h)->place_work(str);
+}
+static const char* legacy_place_work_many(void* h, const char* const* items, int count) {
+    return ((plugin_handle_t*)h)->place_work_many(items, count);
+}
+static const char* legacy_place_work_move(void* h, char* const* items, int count) {
+    return ((plugin_handle_t*)h)->place_work_move(items, count);
+}
+static const char* legacy_set_option(void* h, const char* key, const char* value) {
+    return ((plugin_handle_t*)h)->set_option(key, value);
+}
+static void legacy_attach_output(void* h, output_sink_t* sink, int stage) {
+    ((plugin_handle_t*)h)->attach_output(sink, stage);
+}
+static const char* legacy_get_metrics(void* h, stage_metrics_t* metrics) {
+    return ((plugin_handle_t*)h)->get_metrics(metrics);
+}
+static const char* legacy_resize_queue(void* h, int capacity) {
+    return ((plugin_handle_t*)h)->resize_queue(capacity);
+}
+
+/*
+ * Resolve a stage's entry points. With the instance ABI a fresh instance
+ * is created, so the same .so can back any number of stages.
+ * Returns NULL on success, error message on failure.
+ */
+const char* bind_plugin(plugin_handle_t* p, int use_instances) {
+    if (!use_instances) {
+        p->instance = p;
+        p->ops.init = legacy_init;
+        p->ops.fini = legacy_fini;
+        p->ops.wait_finished = legacy_wait_finished;
+        p->ops.place_work = legacy_place_work;
+        p->ops.place_work_many = p->place_work_many ? legacy_place_work_many : NULL;
+        p->ops.place_work_move = p->place_work_move ? legacy_place_work_move : NULL;
+        p->ops.place_work_slices = NULL;
+        p->ops.set_option = p->set_option ? legacy_set_option : NULL;
+        p->ops.attach_output = p->attach_output ? legacy_attach_output : NULL;
+        p->ops.get_metrics = p->get_metrics ? legacy_get_metrics : NULL;
+        p->ops.resize_queue = p->resize_queue ? legacy_resize_queue : NULL;
+        return NULL;
+    }
+    
+    plugin_create_func_t create = (plugin_create_func_t)dlsym(p->handle, "plugin_create");
+    p->destroy = (plugin_destroy_func_t)dlsym(p->handle, "plugin_destroy");
+    p->ops.init = (plugin_instance_init_func_t)dlsym(p->handle, "plugin_instance_init");
+    p->ops.fini = (plugin_instance_call_func_t)dlsym(p->handle, "plugin_instance_fini");
+    p->ops.wait_finished = (plugin_instance_call_func_t)dlsym(p->handle, "plugin_instance_wait_finished");
+    p->ops.place_work = (plugin_instance_place_work_func_t)dlsym(p->handle, "plugin_instance_place_work");
+    p->instance_attach = (plugin_instance_attach_func_t)dlsym(p->handle, "plugin_instance_attach");
+    if (dlerror()) {
+        return "incomplete instance ABI";
+    }
+    
+    /* Optional entry points; clear the error left by missing ones */
+    p->ops.place_work_many = (plugin_instance_place_work_many_func_t)dlsym(p->handle, "plugin_instance_place_work_many");
+    p->ops.place_work_move = (plugin_instance_place_work_move_func_t)dlsym(p->handle, "plugin_instance_place_work_move");
+    p->ops.place_work_slices = (plugin_instance_place_work_slices_func_t)dlsym(p->handle, "plugin_instance_place_work_slices");
+    p->ops.set_option = (plugin_instance_set_option_func_t)dlsym(p->handle, "plugin_instance_set_option");
+    p->ops.attach_output = (plugin_instance_attach_output_func_t)dlsym(p->handle, "plugin_instance_attach_output");
+    p->ops.get_metrics = (plugin_instance_get_metrics_func_t)dlsym(p->handle, "plugin_instance_get_metrics");
+    p->ops.resize_queue = (plugin_instance_resize_queue_func_t)dlsym(p->handle, "plugin_instance_resize_queue");
+    p->attach_executor = (plugin_instance_attach_executor_func_t)dlsym(p->handle, "plugin_instance_attach_executor");
+    p->process_slice = (plugin_instance_process_slice_func_t)dlsym(p->handle, "plugin_instance_process_slice");
+    p->instance_fuse = (plugin_instance_fuse_func_t)dlsym(p->handle, "plugin_instance_fuse");
+    p->instance_transform = (plugin_instance_transform_func_t)dlsym(p->handle, "plugin_instance_transform");
+    p->instance_transform_inplace = p->transform_inplace
+        ? (plugin_instance_transform_inplace_func_t)dlsym(p->handle, "plugin_instance_transform_inplace")
+        : NULL;
+    
+    /* Slice transforms, only where the plugin itself provides them */
+    p->instance_fuse_slices = (plugin_instance_fuse_slices_func_t)dlsym(p->handle, "plugin_instance_fuse_slices");
+    p->instance_transform_slice = dlsym(p->handle, "plugin_transform_slice")
+        ? (plugin_instance_transform_slice_func_t)dlsym(p->handle, "plugin_instance_transform_slice")
+        : NULL;
+    p->instance_transform_inplace_slice = dlsym(p->handle, "plugin_transform_inplace_slice")
+        ? (plugin_instance_transform_inplace_slice_func_t)dlsym(p->handle, "plugin_instance_transform_inplace_slice")
+        : NULL;
+    dlerror();
+    
+    p->instance = create();
+    if (!p->instance) {
+        return "plugin_create failed";
+    }
+    p->instanced = 1;
+    return NULL;
+}
+
+/* Index of the next plugin that owns a thread and queue, or count if none */
+int next_stage(plugin_handle_t* plugins, int count, int i) {
+    for (i = i + 1; i < count; i++) {
+        if (!plugins[i].fused) {
+            return i;
+        }
+    }
+    return count;
+}
+
+/* A downstream stage's entry points as a link (instance ABI) */
+plugin_link_t stage_link(plugin_handle_t* down) {
+    plugin_link_t link = { down->instance, down->ops.place_work,
+                           down->ops.place_work_many, down->ops.place_work_move,
+                           down->ops.place_work_slices };
+    return link;
+}
+
+/* Point an upstream stage at a downstream stage's entry points */
+void connect_plugins(plugin_handle_t* up, plugin_handle_t* down) {
+    if (up->instanced) {
+        plugin_link_t link = stage_link(down);
+        up->instance_attach(up->instance, &link);
+        return;
+    }
+    
+    up->attach(down->place_work);
+    if (up->attach_many && down->place_work_many) {
+        up->attach_many(down->place_work_many);
+    }
+    /* Prefer handing buffers over when both sides support it */
+    if (up->attach_move && down->place_work_move) {
+        up->attach_move(down->place_work_move);
+    }
+}
+
+/*
+ * Group runs of consecutive stateless plugins into the first plugin of the
+ * run: the others are fused into its stage and never get a thread or queue.
+ * Plugins that are not stateless (e.g. typewriter) always keep their own
+ * stage, so their queue stays in front of them. Multi-worker stages are
+ * left alone as well.
+ */
+const char* fuse_plugins(plugin_handle_t* plugins, int count) {
+    for (int i = 0; i < count; ) {
+        int head = i++;
+        plugin_handle_t* h = &plugins[head];
+        if (!h->is_stateless || !(h->instanced ? h->instance_fuse != NULL : h->fuse != NULL) || h->workers > 1) {
+            continue;
+        }
+        while (i < count && plugins[i].chained && plugins[i].is_stateless && plugins[i].workers == 1 &&
+               !plugins[i].cpus && !plugins[i].queue_size &&
+               (plugins[i].instanced ? plugins[i].instance_transform != NULL
+                                    : plugins[i].transform != NULL)) {
+            const char* err;
+            if (h->instanced && h->instance_fuse_slices) {
+                err = h->instance_fuse_slices(h->instance, plugins[i].instance,
+                                              plugins[i].instance_transform,
+                                              plugins[i].instance_transform_inplace,
+                                              plugins[i].instance_transform_slice,
+                                              plugins[i].instance_transform_inplace_slice);
+            } else if (h->instanced) {
+                err = h->instance_fuse(h->instance, plugins[i].instance, plugins[i].instance_transform,
+                                       plugins[i].instance_transform_inplace);
+            } else {
+                err = h->fuse(plugins[i].transform, plugins[i].transform_inplace);
+            }
+            if (err) {
+                return err;
+            }
+            plugins[i].fused = 1;
+            i++;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Connect every stage to the stages its last plugin (the tail of a fused
+ * run) feeds. A single plain downstream stage is attached directly; several
+ * go through a fan-out, and a stage with several inputs is fed through a
+ * fan-in, one input per edge in topology order. Fan-outs are indexed by
+ * upstream stage and fan-ins by downstream stage. Stages that feed nothing
+ * are attached to terminal if given, and counted in ends.
+ * Returns NULL on success, error message on failure.
+ */
+const char* connect_graph(plugin_handle_t* plugins, const stage_graph_t* graph,
+                          buffer_pool_t* pool, stage_tee_t* tees, stage_merge_t* merges,
+                          const plugin_link_t* terminal, int* ends) {
+    int count = graph->count;
+    plugin_link_t* links = malloc(sizeof(plugin_link_t) * (graph->num_edges + 1));
+    if (!links) {
+        return "Failed to allocate memory for links";
+    }
+    const char* err = NULL;
+    for (int i = 0; i < count && !err; ) {
+        int next = next_stage(plugins, count, i);
+        int tail = next - 1;
+        int num_links = 0;
+        int last = -1;
+        for (int e = 0; e < graph->num_edges && !err; e++) {
+            if (graph->edge_from[e] != tail) {
+                continue;
+            }
+            int down = graph->edge_to[e];
+            last = down;
+            if (plugins[down].inputs < 2) {
+                links[num_links++] = stage_link(&plugins[down]);
+                continue;
+            }
+            
+            /* Inputs of a fan-in are numbered in edge order */
+            stage_merge_t* merge = &merges[down];
+            if (!merge->ports) {
+                plugin_link_t output = stage_link(&plugins[down]);
+                err = stage_merge_init(merge, &output, plugins[down].inputs,
+                                       !plugins[down].merge_any, pool);
+            }
+            int port = 0;
+            for (int f = 0; f < e; f++) {
+                port += graph->edge_to[f] == down;
+            }
+            if (!err) {
+                stage_merge_link(merge, port, &links[num_links++]);
+            }
+        }
+        
+        if (num_links == 0) {
+            (*ends)++;
+            if (terminal) {
+                plugins[i].instance_attach(plugins[i].instance, terminal);
+            }
+        } else if (!err && num_links == 1 && plugins[last].inputs < 2) {
+            connect_plugins(&plugins[i], &plugins[last]);
+        } else if (!err && num_links == 1) {
+            plugins[i].instance_attach(plugins[i].instance, &links[0]);
+        } else if (!err && num_links > 1) {
+            err = stage_tee_init(&tees[i], links, num_links, pool);
+            if (!err) {
+                plugin_link_t link;
+                stage_tee_link(&tees[i], &link);
+                plugins[i].instance_attach(plugins[i].instance, &link);
+            }
+        }
+        i = next;
+    }
+    free(links);
+    return err;
+}
+
+/*
+ * Parse a CPU list and check that the process may run on each CPU
+ * @return NULL on success, error message on failure
+ */
+const char* parse_cpus(const char* text, int* cpus, int max, int* count) {
+    const char* err = cpu_list_parse(text, cpus, max, count);
+    if (err) {
+        return err;
+    }
+    for (int i = 0; i < *count; i++) {
+        if (!cpu_allowed(cpus[i])) {
+            return "CPU not available to this process";
+        }
+    }
+    return NULL;
+}
+
+/* Allocate a line buffer the first stage can take ownership of */
+static char* line_alloc(buffer_pool_t* pool, size_t size) {
+    return pool ? buffer_pool_alloc(pool, size) : malloc(size);
+}
+
+/*
+ * With --inline there are no queues: each line goes through the stages'
+ * transforms in turn on the reading thread, and what comes out of the last
+ * stage is dropped, as a last stage does with its results
+ */
+static plugin_handle_t* inline_plugins;
+static int inline_count;
+
+static void feed_inline(buffer_pool_t* pool, char** lines, const size_t* lens, int count) {
+    for (int i = 0; i < count; i++) {
+        char* item = lines[i];
+        size_t len = lens[i];
+        for (int s = 0; item && s < inline_count; s = next_stage(inline_plugins, inline_count, s)) {
+            item = inline_plugins[s].process_slice(inline_plugins[s].instance, item, len, &len);
+        }
+        if (pool) {
+            buffer_pool_free(item);
+        } else {
+            free(item);
+        }
+    }
+}
+
+/*
+ * Send a control message to the first stage: typed if it takes slices,
+ * as its marker string otherwise (a barrier is then not sent at all)
+ */
+const char* feed_control(plugin_handle_t* first, plugin_item_kind_t kind) {
+    if (inline_plugins) {
+        return NULL;    /* Nothing is queued behind the last line */
+    }
+    if (first->ops.place_work_slices) {
+        char* item = NULL;
+        size_t len = PLUGIN_CONTROL_LEN(kind);
+        return first->ops.place_work_slices(first->instance, &item, &len, 1);
+    }
+    const char* marker = plugin_marker_string(kind);
+    return marker ? first->ops.place_work(first->instance, marker) : NULL;
+}
+
+/*
+ * With --metrics and a pipeline that passes typed messages all the way
+ * through, a barrier follows a batch of input whenever the previous one
+ * has come out of all barrier_branches branch ends; the tail times them
+ */
+static stage_tail_t* barrier_tail;
+static int barrier_branches;
+
+/*
+ * Hand lines from line_alloc (or getline without a pool) and their lengths
+ * to the first stage; ownership always passes
+ */
+const char* feed_owned(plugin_handle_t* first, buffer_pool_t* pool, char** lines,
+                       const size_t* lens, int count) {
+    const char* err = NULL;
+    if (inline_plugins) {
+        feed_inline(pool, lines, lens, count);
+    } else if (first->ops.place_work_slices) {
+        err = first->ops.place_work_slices(first->instance, lines, lens, count);
+    } else if (first->ops.place_work_move) {
+        err = first->ops.place_work_move(first->instance, lines, count);
+    } else {
+        for (int i = 0; i < count; i++) {
+            if (!err) {
+                err = first->ops.place_work(first->instance, lines[i]);
+            }
+            if (pool) {
+                buffer_pool_free(lines[i]);
+            } else {
+                free(lines[i]);
+            }
+        }
+    }
+    
+    if (!err && barrier_tail && stage_tail_begin_barrier(barrier_tail, barrier_branches)) {
+        err = feed_control(first, PLUGIN_ITEM_BARRIER);
+    }
+    return err;
+}
+
+/*
+ * Read a stream (STDIN or a client) line by line up to EOF or an <END>
+ * line, which is not sent on. getline grows its buffer as needed, so lines
+ * of any length arrive whole. Without a pool each buffer is handed to the
+ * first stage as-is and getline allocates a fresh one for the next line;
+ * with one the line is copied into a pool buffer and getline's is reused.
+ * Lines are sent one at a time so interactive input is not held back
+ * waiting for a batch.
+ */
+const char* feed_stream(plugin_handle_t* first, buffer_pool_t* pool, FILE* in) {
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    
+    while ((len = getline(&line, &cap, in)) != -1) {
+        size_t line_len = (size_t)len;
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--line_len] = '\0';
+        }
+        
+        if (line_len == 5 && memcmp(line, "<END>", 5) == 0) {
+            break;
+        }
+        
+        const char* err;
+        if (pool) {
+            char* copy = buffer_pool_alloc(pool, len + 1);
+            if (!copy) {
+                free(line);
+                return "Failed to allocate memory for input line";
+            }
+            memcpy(copy, line, len + 1);
+            err = feed_owned(first, pool, &copy, &line_len, 1);
+        } else {
+            err = feed_owned(first, pool, &line, &line_len, 1);
+            line = NULL;
+            cap = 0;
+        }
+        if (err) {
+            free(line);
+            return err;
+        }
+    }
+    
+    free(line);
+    return NULL;
+}
+
+/* Lines waiting to be handed to the first stage together */
+typedef struct {
+    plugin_handle_t* first;
+    buffer_pool_t* pool;
+    char* lines[INPUT_BATCH];
+    size_t lens[INPUT_BATCH];
+    int count;
+    int batch_size;
+} line_batch_t;
+
+static const char* batch_flush(line_batch_t* batch) {
+    const char* err = batch->count > 0
+        ? feed_owned(batch->first, batch->pool, batch->lines, batch->lens, batch->count) : NULL;
+    batch->count = 0;
+    return err;
+}
+
+/* Copy a line into a buffer of its own, sending the batch once it is full */
+static const char* batch_line(line_batch_t* batch, const char* text, size_t len) {
+    char* line = line_alloc(batch->pool, len + 1);
+    if (!line) {
+        return "Failed to allocate memory for input line";
+    }
+    memcpy(line, text, len);
+    line[len] = '\0';
+    batch->lens[batch->count] = len;
+    batch->lines[batch->count++] = line;
+    return batch->count == batch->batch_size ? batch_flush(batch) : NULL;
+}
+
+/* Append bytes to the carry buffer of a line that spans blocks */
+static const char* carry_append(char** carry, size_t* len, size_t* cap, const char* text,
+                                size_t n) {
+    if (n == 0) {
+        return NULL;    /* The carry buffer may not even exist yet */
+    }
+    if (*len + n > *cap) {
+        size_t new_cap = (*len + n) * 2;
+        char* grown = realloc(*carry, new_cap);
+        if (!grown) {
+            return "Failed to allocate memory for input line";
+        }
+        *carry = grown;
+        *cap = new_cap;
+    }
+    memcpy(*carry + *len, text, n);
+    *len += n;
+    return NULL;
+}
+
+/*
+ * Read a descriptor in large blocks on a reader thread (see input_reader.h)
+ * and split each block into lines with the vectorized newline scan while
+ * the next one is read. A line that spans blocks is put together in a carry
+ * buffer. Reading stops at EOF or an <END> line, which is not sent on. The
+ * lines of a block go out in batches, the last one as soon as the block is
+ * split, so interactive input is not held back.
+ */
+const char* feed_blocks(plugin_handle_t* first, buffer_pool_t* pool, int fd, int batch_size) {
+    input_reader_t reader;
+    const char* err = input_reader_start(&reader, fd, INPUT_READER_BLOCK_SIZE);
+    if (err) {
+        return err;
+    }
+    
+    const text_kernels_t* kernels = text_kernels();
+    line_batch_t batch = { first, pool, { NULL }, { 0 }, 0,
+                           batch_size < INPUT_BATCH ? batch_size : INPUT_BATCH };
+    unsigned offsets[INPUT_BATCH];
+    char* carry = NULL;
+    size_t carry_len = 0;
+    size_t carry_cap = 0;
+    int ended = 0;
+    const char* data;
+    size_t len;
+    
+    while (!err && !ended && !(err = input_reader_next(&reader, &data, &len)) && len > 0) {
+        size_t start = 0;   /* First byte of the current line */
+        size_t found;
+        do {
+            size_t from = start;
+            found = kernels->find_newlines(data + from, len - from, offsets, INPUT_BATCH);
+            for (size_t i = 0; i < found && !err; i++) {
+                const char* text = data + start;
+                size_t text_len = from + offsets[i] - start;
+                if (carry_len > 0) {
+                    err = carry_append(&carry, &carry_len, &carry_cap, text, text_len);
+                    text = carry;
+                    text_len = carry_len;
+                    carry_len = 0;
+                }
+                if (!err && text_len == 5 && memcmp(text, "<END>", 5) == 0) {
+                    ended = 1;
+                    break;
+                }
+                if (!err) {
+                    err = batch_line(&batch, text, text_len);
+                }
+                start = from + offsets[i] + 1;
+            }
+        } while (found == INPUT_BATCH && !err && !ended);
+        
+        if (!err && !ended) {
+            err = carry_append(&carry, &carry_len, &carry_cap, data + start, len - start);
+        }
+        if (!err) {
+            err = batch_flush(&batch);
+        }
+    }
+    
+    /* A last line without a newline */
+    if (!err && !ended && carry_len > 0 && !(carry_len == 5 && memcmp(carry, "<END>", 5) == 0)) {
+        err = batch_line(&batch, carry, carry_len);
+    }
+    if (!err) {
+        err = batch_flush(&batch);
+    }
+    
+    /* Lines not sent on are the reader's to free */
+    for (int i = 0; i < batch.count; i++) {
+        if (pool) {
+            buffer_pool_free(batch.lines[i]);
+        } else {
+            free(batch.lines[i]);
+        }
+    }
+    input_reader_stop(&reader);
+    free(carry);
+    return err;
+}
+
+/*
+ * Read a file through a private read-only mapping. Line boundaries are
+ * found with memchr directly in the mapping and each line is copied once,
+ * straight into the buffer the first stage takes ownership of. Reading
+ * stops at the end of the file or an <END> line, which is not sent on.
+ */
+const char* feed_mapped_file(plugin_handle_t* first, buffer_pool_t* pool, int fd, int batch_size) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return "Failed to stat input file";
+    }
+    if (st.st_size == 0) {
+        return NULL;
+    }
+    
+    char* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        return "Failed to map input file";
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    
+    char* batch[INPUT_BATCH];
+    size_t lens[INPUT_BATCH];
+    int pending = 0;
+    if (batch_size > INPUT_BATCH) {
+        batch_size = INPUT_BATCH;
+    }
+    
+    const char* err = NULL;
+    const char* pos = data;
+    const char* end = data + st.st_size;
+    while (pos < end && !err) {
+        const char* nl = memchr(pos, '\n', end - pos);
+        size_t len = (nl ? nl : end) - pos;
+        
+        if (len == 5 && memcmp(pos, "<END>", 5) == 0) {
+            break;
+        }
+        
+        char* line = line_alloc(pool, len + 1);
+        if (!line) {
+            err = "Failed to allocate memory for input line";
+            break;
+        }
+        memcpy(line, pos, len);
+        line[len] = '\0';
+        lens[pending] = len;
+        batch[pending++] = line;
+        
+        if (pending == batch_size) {
+            err = feed_owned(first, pool, batch, lens, pending);
+            pending = 0;
+        }
+        pos = nl ? nl + 1 : end;
+    }
+    
+    if (pending > 0) {
+        const char* flush_err = feed_owned(first, pool, batch, lens, pending);
+        err = err ? err : flush_err;
+    }
+    
+    munmap(data, st.st_size);
+    return err;
+}
+
+/* Set by SIGINT or SIGTERM: --serve takes no more clients */
+static volatile sig_atomic_t serve_stop;
+
+static void request_serve_stop(int sig) {
+    (void)sig;
+    serve_stop = 1;
+}
+
+/*
+ * Serve clients one after another until asked to stop. A client's lines
+ * are followed by a FLUSH message; once it has come out of every branch
+ * (ends of them), everything the client's lines printed is in the sink,
+ * which is then written out to the client before it is disconnected.
+ */
+const char* serve_clients(plugin_handle_t* first, buffer_pool_t* pool, output_sink_t* sink,
+                          stage_tail_t* tail, int ends, int listen_fd,
+                          const sigset_t* wait_mask) {
+    while (!serve_stop) {
+        int client = pipeline_server_accept(listen_fd, wait_mask);
+        if (client == -1) {
+            continue;
+        }
+        FILE* in = fdopen(client, "r");
+        if (!in) {
+            close(client);
+            continue;
+        }
+        
+        output_sink_set_fd(sink, client);
+        const char* err = feed_stream(first, pool, in);
+        if (!err) {
+            err = feed_control(first, PLUGIN_ITEM_FLUSH);
+        }
+        if (!err) {
+            stage_tail_wait_flush(tail, ends);
+        }
+        output_sink_set_fd(sink, STDOUT_FILENO);
+        fclose(in);
+        if (err) {
+            return err;
+        }
+    }
+    return NULL;
+}
+
 /* Clean up all plugins */
 void cleanup_plugins(plugin_handle_t* plugins, int count, char** names) {
     for (int i = 0; i < count; i++) {
@@ -111,17 +903,299 @@ void cleanup_plugins(plugin_handle_t* plugins, int count, char** names) {
     free(plugins);
 }
 
+/* Where --metrics reports go; shared with the SIGUSR1 thread */
+typedef struct {
+    plugin_handle_t* plugins;
+    int count;
+    FILE* out;
+    struct timespec start;  /* When input started flowing, for throughput */
+    stage_tail_t* tail;     /* Times barriers through the pipeline, NULL if none */
+    pthread_t thread;       /* Waits for SIGUSR1 */
+    atomic_int stop;        /* Tells thread to exit on its next wakeup */
+} metrics_report_t;
+
+/*
+ * Print every stage's counters as a table and as JSON. A stage is named
+ * after its plugin plus the plugins fused into it, e.g. "uppercaser+rotator".
+ */
+void dump_metrics(metrics_report_t* report) {
+    stage_metrics_t* stages = calloc(report->count, sizeof(stage_metrics_t));
+    char** names = calloc(report->count, sizeof(char*));
+    int count = 0;
+    if (!stages || !names) {
+        free(stages);
+        free(names);
+        return;
+    }
+    
+    for (int i = 0; i < report->count; i = next_stage(report->plugins, report->count, i)) {
+        plugin_handle_t* p = &report->plugins[i];
+        if (!p->ops.get_metrics || p->ops.get_metrics(p->instance, &stages[count]) != NULL) {
+            continue;
+        }
+        
+        size_t len = strlen(p->name) + 1;
+        int end = next_stage(report->plugins, report->count, i);
+        for (int j = i + 1; j < end; j++) {
+            len += strlen(report->plugins[j].name) + 1;
+        }
+        names[count] = malloc(len);
+        if (!names[count]) {
+            break;
+        }
+        strcpy(names[count], p->name);
+        for (int j = i + 1; j < end; j++) {
+            strcat(names[count], "+");
+            strcat(names[count], report->plugins[j].name);
+        }
+        count++;
+    }
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec - report->start.tv_sec) +
+                     (now.tv_nsec - report->start.tv_nsec) / 1e9;
+    stage_drain_t drain;
+    if (report->tail) {
+        stage_tail_get_drain(report->tail, &drain);
+    }
+    const stage_drain_t* drained = report->tail ? &drain : NULL;
+    stage_metrics_print_table(report->out, (const char* const*)names, stages, count, elapsed,
+                              drained);
+    stage_metrics_print_json(report->out, (const char* const*)names, stages, count, elapsed,
+                             drained);
+    fflush(report->out);
+    
+    for (int i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+    free(stages);
+}
+
+/* Dump metrics on every SIGUSR1 (blocked in all other threads) */
+void* metrics_signal_thread(void* arg) {
+    metrics_report_t* report = (metrics_report_t*)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    
+    for (;;) {
+        int sig;
+        if (sigwait(&set, &sig) != 0 || atomic_load(&report->stop)) {
+            break;
+        }
+        dump_metrics(report);
+    }
+    return NULL;
+}
+
+/* Queues resized by --queue-budget; shared with the tuning thread */
+typedef struct {
+    plugin_handle_t* plugins;
+    int* stages;            /* Indices of the tuned stages in plugins */
+    queue_tuner_t tuner;
+    pthread_t thread;
+    atomic_int stop;        /* Tells thread to exit after its current tick */
+} queue_tuning_t;
+
+/* Sample the tuned stages every QUEUE_TUNER_INTERVAL_MS and apply the tuner's capacities */
+void* queue_tuning_thread(void* arg) {
+    queue_tuning_t* tuning = (queue_tuning_t*)arg;
+    int count = tuning->tuner.count;
+    stage_metrics_t* samples = calloc(count, sizeof(stage_metrics_t));
+    int* capacities = calloc(count, sizeof(int));
+    if (!samples || !capacities) {
+        free(samples);
+        free(capacities);
+        return NULL;
+    }
+    
+    struct timespec interval = { 0, QUEUE_TUNER_INTERVAL_MS * 1000000L };
+    struct timespec last, now;
+    clock_gettime(CLOCK_MONOTONIC, &last);
+    while (!atomic_load(&tuning->stop)) {
+        for (int i = 0; i < count; i++) {
+            plugin_handle_t* p = &tuning->plugins[tuning->stages[i]];
+            p->ops.get_metrics(p->instance, &samples[i]);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        unsigned long long elapsed = (unsigned long long)(now.tv_sec - last.tv_sec) * 1000000000ull
+                                     + (unsigned long long)now.tv_nsec - (unsigned long long)last.tv_nsec;
+        last = now;
+        
+        if (queue_tuner_step(&tuning->tuner, samples, elapsed, capacities) > 0) {
+            for (int i = 0; i < count; i++) {
+                plugin_handle_t* p = &tuning->plugins[tuning->stages[i]];
+                if ((size_t)capacities[i] != (size_t)samples[i].queue_capacity) {
+                    p->ops.resize_queue(p->instance, capacities[i]);
+                }
+            }
+        }
+        nanosleep(&interval, NULL);
+    }
+    
+    free(samples);
+    free(capacities);
+    return NULL;
+}
+
 int main(int argc, char* argv[]) {
     
+    /* Parse leading options */
+    const char* batch_size = NULL;
+    int fuse = 0;
+    int input_fd = -1;
+    const char* flush_spec = NULL;
+    const char* type_rate = NULL;
+    FILE* metrics_out = NULL;
+    const char* pool_mode = "on";
+    const char* wait_spec = NULL;
+    int pin_order[CPU_LIST_MAX];
+    int pin_count = 0;      /* 0: threads are not pinned unless a stage asks */
+    int queue_budget = 0;   /* 0: queues keep their capacity */
+    const char* serve_path = NULL;
+    int executor_threads = 0;   /* 0: every stage runs on threads of its own */
+    int run_inline = 0;
+    int argi = 1;
+    while (argi < argc && strncmp(argv[argi], "--", 2) == 0) {
+        if (strcmp(argv[argi], "--connect") == 0 && argi + 1 < argc) {
+            /* Client mode: no pipeline of its own */
+            const char* err = pipeline_server_connect(argv[argi + 1], STDIN_FILENO, STDOUT_FILENO);
+            if (err) {
+                fprintf(stderr, "Error: --connect: %s.\n", err);
+                exit(1);
+            }
+            exit(0);
+        } else if (strcmp(argv[argi], "--serve") == 0 && argi + 1 < argc) {
+            serve_path = argv[argi + 1];
+            argi += 2;
+        } else if (strcmp(argv[argi], "--fuse") == 0) {
+            fuse = 1;
+            argi++;
+        } else if (strcmp(argv[argi], "--inline") == 0) {
+            run_inline = 1;
+            argi++;
+        } else if (strcmp(argv[argi], "--input") == 0 && argi + 1 < argc) {
+            input_fd = open(argv[argi + 1], O_RDONLY);
+            if (input_fd == -1) {
+                fprintf(stderr, "Error: Cannot open input file %s.\n", argv[argi + 1]);
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "--flush") == 0 && argi + 1 < argc) {
+            sink_policy_t policy;
+            const char* err = output_sink_parse_policy(argv[argi + 1], &policy);
+            if (err) {
+                fprintf(stderr, "Error: --flush: %s.\n", err);
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            flush_spec = argv[argi + 1];
+            argi += 2;
+        } else if (strcmp(argv[argi], "--type-rate") == 0 && argi + 1 < argc) {
+            type_rate = argv[argi + 1];
+            if (atoi(type_rate) < 0 || (atoi(type_rate) == 0 && strcmp(type_rate, "0") != 0)) {
+                fprintf(stderr, "Error: --type-rate must be a non-negative integer.\n");
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "--metrics") == 0 && argi + 1 < argc) {
+            metrics_out = strcmp(argv[argi + 1], "-") == 0 ? stderr : fopen(argv[argi + 1], "w");
+            if (!metrics_out) {
+                fprintf(stderr, "Error: Cannot open metrics file %s.\n", argv[argi + 1]);
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "--wait") == 0 && argi + 1 < argc) {
+            wait_spec = argv[argi + 1];
+            argi += 2;
+        } else if (strcmp(argv[argi], "--pin") == 0 && argi + 1 < argc) {
+            const char* err = NULL;
+            if (strcmp(argv[argi + 1], "auto") == 0) {
+                pin_count = cpu_topology_order(pin_order, CPU_LIST_MAX);
+                if (pin_count == 0) {
+                    err = "Cannot read the CPUs this process may run on";
+                }
+            } else {
+                err = parse_cpus(argv[argi + 1], pin_order, CPU_LIST_MAX, &pin_count);
+            }
+            if (err) {
+                fprintf(stderr, "Error: --pin: %s.\n", err);
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "--executor") == 0 && argi + 1 < argc) {
+            if (strcmp(argv[argi + 1], "auto") == 0) {
+                int cpus[CPU_LIST_MAX];
+                executor_threads = cpu_topology_order(cpus, CPU_LIST_MAX);
+                if (executor_threads == 0) {
+                    executor_threads = 1;
+                }
+            } else {
+                executor_threads = atoi(argv[argi + 1]);
+            }
+            if (executor_threads <= 0) {
+                fprintf(stderr, "Error: --executor must be auto or a positive integer.\n");
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "--queue-budget") == 0 && argi + 1 < argc) {
+            queue_budget = atoi(argv[argi + 1]);
+            if (queue_budget <= 0) {
+                fprintf(stderr, "Error: --queue-budget must be a positive integer.\n");
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "--pool") == 0 && argi + 1 < argc) {
+            pool_mode = argv[argi + 1];
+            if (strcmp(pool_mode, "on") != 0 && strcmp(pool_mode, "off") != 0 &&
+                strcmp(pool_mode, "huge") != 0) {
+                fprintf(stderr, "Error: --pool must be on, off or huge.\n");
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            argi += 2;
+        } else if (strcmp(argv[argi], "--batch") == 0 && argi + 1 < argc) {
+            batch_size = argv[argi + 1];
+            if (atoi(batch_size) <= 0) {
+                fprintf(stderr, "Error: --batch must be a positive integer.\n");
+                print_usage();
+                fflush(stdout);
+                exit(1);
+            }
+            argi += 2;
+        } else {
+            fprintf(stderr, "Error: Unknown option %s.\n", argv[argi]);
+            print_usage();
+            fflush(stdout);
+            exit(1);
+        }
+    }
+    
     /* Parse command-line arguments */
-    if (argc < 3) {
+    if (argc - argi < 2) {
         fprintf(stderr, "Error: Missing arguments.\n");
         print_usage();
         fflush(stdout);
         exit(1);
     }
     
-    int queue_size = atoi(argv[1]);
+    int queue_size = atoi(argv[argi]);
     if (queue_size <= 0) {
         fprintf(stderr, "Error: queue_size must be a positive integer.\n");
         print_usage();
@@ -129,8 +1203,41 @@ int main(int argc, char* argv[]) {
         exit(1);
     }
     
-    int num_plugins = argc - 2;
-    char** plugin_names = &argv[2];
+    /*
+     * Plugin arguments form a chain, or with "->" and braces any topology
+     * that starts with one stage; the shell may have split it into words
+     */
+    int topology = 0;
+    size_t topology_len = 1;
+    for (int i = argi + 1; i < argc; i++) {
+        topology |= stage_graph_is_topology(argv[i]);
+        topology_len += strlen(argv[i]) + 1;
+    }
+    stage_graph_t graph;
+    const char* graph_err;
+    if (topology) {
+        char* text = calloc(topology_len, 1);
+        if (!text) {
+            fprintf(stderr, "Error: Memory allocation failed.\n");
+            exit(1);
+        }
+        for (int i = argi + 1; i < argc; i++) {
+            strcat(strcat(text, argv[i]), " ");
+        }
+        graph_err = stage_graph_parse(&graph, text);
+        free(text);
+    } else {
+        graph_err = stage_graph_chain(&graph, &argv[argi + 1], argc - argi - 1);
+    }
+    if (graph_err) {
+        fprintf(stderr, "Error: topology: %s.\n", graph_err);
+        print_usage();
+        fflush(stdout);
+        exit(1);
+    }
+    
+    int num_plugins = graph.count;
+    char** plugin_names = graph.specs;
     
     plugin_handle_t* plugins = calloc(num_plugins, sizeof(plugin_handle_t));
     if (!plugins) {
@@ -138,6 +1245,133 @@ int main(int argc, char* argv[]) {
         exit(1);
     }
     
+    /* Where each plugin's input comes from */
+    for (int e = 0; e < graph.num_edges; e++) {
+        plugins[graph.edge_to[e]].inputs++;
+    }
+    for (int i = 1; i < num_plugins; i++) {
+        int outputs = 0;
+        int from_prev = 0;
+        for (int e = 0; e < graph.num_edges; e++) {
+            outputs += graph.edge_from[e] == i - 1;
+            from_prev |= graph.edge_from[e] == i - 1 && graph.edge_to[e] == i;
+        }
+        plugins[i].chained = plugins[i].inputs == 1 && outputs == 1 && from_prev;
+    }
+    
+    /* Split "name@N:key=value..." specs; the name is terminated in place */
+    for (int i = 0; i < num_plugins; i++) {
+        plugins[i].workers = 1;
+        char* options = strchr(plugin_names[i], ':');
+        if (options) {
+            *options++ = '\0';
+        }
+        while (options) {
+            char* option = options;
+            options = strchr(options, ':');
+            if (options) {
+                *options++ = '\0';
+            }
+            const char* err = NULL;
+            if (strncmp(option, "q=", 2) == 0) {
+                plugins[i].queue_size = atoi(option + 2);
+                if (plugins[i].queue_size <= 0) {
+                    err = "queue size must be a positive integer";
+                }
+            } else if (strncmp(option, "merge=", 6) == 0) {
+                plugins[i].merge_any = strcmp(option + 6, "any") == 0;
+                if (!plugins[i].merge_any && strcmp(option + 6, "ordered") != 0) {
+                    err = "merge must be ordered or any";
+                } else if (plugins[i].inputs < 2) {
+                    err = "only a stage with several inputs merges";
+                }
+            } else if (strncmp(option, "cpu=", 4) == 0) {
+                int cpus[CPU_LIST_MAX];
+                int count;
+                plugins[i].cpus = option + 4;
+                err = parse_cpus(plugins[i].cpus, cpus, CPU_LIST_MAX, &count);
+            } else {
+                err = "unknown stage option";
+            }
+            if (err) {
+                fprintf(stderr, "Error: %s: %s: %s.\n", plugin_names[i], option, err);
+                print_usage();
+                fflush(stdout);
+                free(plugins);
+                exit(1);
+            }
+        }
+        
+        char* at = strchr(plugin_names[i], '@');
+        if (at) {
+            *at = '\0';
+            plugins[i].workers = atoi(at + 1);
+            if (plugins[i].workers <= 0) {
+                fprintf(stderr, "Error: worker count for %s must be a positive integer.\n", plugin_names[i]);
+                print_usage();
+                fflush(stdout);
+                free(plugins);
+                exit(1);
+            }
+        }
+    }
+    
+    /*
+     * Use the instance ABI if every plugin has it: each .so is then loaded
+     * once however often it appears. A global-ABI stage can only attach to
+     * global entry points, so any such plugin puts the whole chain on the
+     * global ABI, where repeated plugins need their own copy of the .so.
+     */
+    int use_instances = 1;
+    for (int i = 0; i < num_plugins && use_instances; i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "output/%s.so", plugin_names[i]);
+        void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (handle) {
+            use_instances = dlsym(handle, "plugin_create") != NULL;
+            dlclose(handle);
+        }
+    }
+    dlerror();
+    
+    /* Fan-out and fan-in hand links to stages, which takes the instance ABI */
+    if (!use_instances && !stage_graph_is_chain(&graph)) {
+        fprintf(stderr, "Error: topology: branches need plugins with the instance ABI.\n");
+        print_usage();
+        fflush(stdout);
+        free(plugins);
+        exit(1);
+    }
+    
+    /* So does finding out when a client's lines have left the last stage */
+    if (!use_instances && serve_path) {
+        fprintf(stderr, "Error: --serve: needs plugins with the instance ABI.\n");
+        print_usage();
+        fflush(stdout);
+        free(plugins);
+        exit(1);
+    }
+    
+    /*
+     * Inline the reader calls the stages one after the other: there is no
+     * queue to resize or measure and nothing for the pool to run
+     */
+    if (run_inline && (!use_instances || !stage_graph_is_chain(&graph))) {
+        fprintf(stderr, "Error: --inline: needs a linear chain of plugins with the instance ABI.\n");
+        print_usage();
+        fflush(stdout);
+        free(plugins);
+        exit(1);
+    }
+    if (run_inline && (serve_path || executor_threads || queue_budget || metrics_out)) {
+        fprintf(stderr, "Error: --inline cannot be combined with --serve, --executor, "
+                        "--queue-budget or --metrics.\n");
+        print_usage();
+        fflush(stdout);
+        free(plugins);
+        exit(1);
+    }
+    
     /* Load all plugin shared objects */
     for (int i = 0; i < num_plugins; i++) {
         char src_path[256];
@@ -154,8 +1388,8 @@ int main(int argc, char* argv[]) {
             }
         }
 
-        /* If reused, make a copy with unique name */
-        if (is_reused) {
+        /* If reused by a global-ABI chain, make a copy with unique name */
+        if (is_reused && !use_instances) {
             snprintf(final_path, sizeof(final_path), "output/%s.%d.so", plugin_names[i], i);
             if (copy_file(src_path, final_path) != 0) {
                 fprintf(stderr, "Error: Failed to copy plugin %s\n", src_path);
@@ -201,64 +1435,447 @@ int main(int argc, char* argv[]) {
             exit(1);
         }
         
+        /* Optional entry points; clear the error left by missing ones */
+        plugins[i].place_work_many = (plugin_place_work_many_func_t)dlsym(plugins[i].handle, "plugin_place_work_many");
+        plugins[i].attach_many = (plugin_attach_many_func_t)dlsym(plugins[i].handle, "plugin_attach_many");
+        plugins[i].set_option = (plugin_set_option_func_t)dlsym(plugins[i].handle, "plugin_set_option");
+        plugins[i].place_work_move = (plugin_place_work_move_func_t)dlsym(plugins[i].handle, "plugin_place_work_move");
+        plugins[i].attach_move = (plugin_attach_move_func_t)dlsym(plugins[i].handle, "plugin_attach_move");
+        plugins[i].transform = (plugin_transform_func_t)dlsym(plugins[i].handle, "plugin_transform");
+        plugins[i].transform_inplace = (plugin_transform_inplace_func_t)dlsym(plugins[i].handle, "plugin_transform_inplace");
+        plugins[i].is_stateless = (plugin_is_stateless_func_t)dlsym(plugins[i].handle, "plugin_is_stateless");
+        plugins[i].fuse = (plugin_fuse_func_t)dlsym(plugins[i].handle, "plugin_fuse");
+        plugins[i].is_pure = (plugin_is_pure_func_t)dlsym(plugins[i].handle, "plugin_is_pure");
+        plugins[i].attach_output = (plugin_attach_output_func_t)dlsym(plugins[i].handle, "plugin_attach_output");
+        plugins[i].get_metrics = (plugin_get_metrics_func_t)dlsym(plugins[i].handle, "plugin_get_metrics");
+        plugins[i].attach_pool = (plugin_attach_pool_func_t)dlsym(plugins[i].handle, "plugin_attach_pool");
+        plugins[i].resize_queue = (plugin_resize_queue_func_t)dlsym(plugins[i].handle, "plugin_resize_queue");
+        dlerror();
+        
         plugins[i].name = strdup(plugin_names[i]);
+        
+        err = bind_plugin(&plugins[i], use_instances);
+        if (err) {
+            fprintf(stderr, "Error loading plugin %s: %s\n", final_path, err);
+            print_usage();
+            fflush(stdout);
+            cleanup_plugins(plugins, i + 1, plugin_names);
+            exit(1);
+        }
+        
+        /* Parallel workers would reorder a plugin's own side effects */
+        if (plugins[i].workers > 1 && (!plugins[i].is_pure || !plugins[i].ops.set_option)) {
+            fprintf(stderr, "Error: plugin %s cannot run with multiple workers.\n", plugin_names[i]);
+            print_usage();
+            fflush(stdout);
+            cleanup_plugins(plugins, i + 1, plugin_names);
+            exit(1);
+        }
+        
+        if (run_inline && (!plugins[i].process_slice || plugins[i].workers > 1 || plugins[i].cpus)) {
+            fprintf(stderr, plugins[i].process_slice
+                    ? "Error: --inline: plugin %s cannot have workers or CPUs of its own.\n"
+                    : "Error: --inline: plugin %s cannot be called directly.\n", plugin_names[i]);
+            print_usage();
+            fflush(stdout);
+            cleanup_plugins(plugins, i + 1, plugin_names);
+            exit(1);
+        }
     }
     
-    /* Initialize all plugins */
+    /* Fuse stateless runs before any stage is initialized */
+    if (fuse) {
+        const char* err = fuse_plugins(plugins, num_plugins);
+        if (err) {
+            fprintf(stderr, "Error fusing plugins: %s\n", err);
+            cleanup_plugins(plugins, num_plugins, plugin_names);
+            exit(2);
+        }
+    }
+    
+    /*
+     * SIGUSR1 is only taken by the metrics thread: block it before any
+     * thread exists so every plugin and sink thread inherits the mask
+     */
+    metrics_report_t report = { plugins, num_plugins, metrics_out };
+    atomic_init(&report.stop, 0);
+    if (metrics_out) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGUSR1);
+        pthread_sigmask(SIG_BLOCK, &set, NULL);
+    }
+    
+    /*
+     * Likewise a stop request of --serve only reaches the main thread, and
+     * only while it waits for the next client (see serve_clients). A
+     * client that goes away must not kill the server on the next write.
+     */
+    sigset_t serve_wait_mask;
+    if (serve_path) {
+        sigset_t set;
+        sigemptyset(&set);
+        sigaddset(&set, SIGINT);
+        sigaddset(&set, SIGTERM);
+        pthread_sigmask(SIG_BLOCK, &set, &serve_wait_mask);
+        sigdelset(&serve_wait_mask, SIGINT);
+        sigdelset(&serve_wait_mask, SIGTERM);
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = request_serve_stop;
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+        signal(SIGPIPE, SIG_IGN);
+    }
+    
+    /* Start the output sink; every plugin, fused or not, prints into its own buffer */
+    sink_policy_t policy;
+    output_sink_parse_policy(flush_spec ? flush_spec
+                             : isatty(STDOUT_FILENO) ? "line" : "size:65536", &policy);
+    output_sink_t sink;
+    fflush(stdout);
+    const char* sink_err = output_sink_init(&sink, STDOUT_FILENO, num_plugins, policy);
+    if (sink_err) {
+        fprintf(stderr, "Error: %s\n", sink_err);
+        cleanup_plugins(plugins, num_plugins, plugin_names);
+        exit(2);
+    }
     for (int i = 0; i < num_plugins; i++) {
-        const char* err = plugins[i].init(queue_size);
+        if (plugins[i].ops.attach_output) {
+            plugins[i].ops.attach_output(plugins[i].instance, &sink, i);
+        }
+    }
+    
+    /*
+     * Line buffers cross every stage, so the pool is all or nothing: it is
+     * used only if each plugin can take it. Each .so (loaded once in
+     * instance mode) gets it before its first instance is initialized.
+     */
+    int use_pool = strcmp(pool_mode, "off") != 0 && use_instances;
+    for (int i = 0; i < num_plugins && use_pool; i++) {
+        use_pool = plugins[i].attach_pool != NULL;
+    }
+    buffer_pool_t pool;
+    if (use_pool) {
+        const char* err = buffer_pool_init(&pool, strcmp(pool_mode, "huge") == 0);
         if (err) {
-            fprintf(stderr, "Error initializing plugin %s: %s\n", plugins[i].name, err);
+            fprintf(stderr, "Error: %s\n", err);
             cleanup_plugins(plugins, num_plugins, plugin_names);
             exit(2);
         }
+        for (int i = 0; i < num_plugins; i++) {
+            plugins[i].attach_pool(&pool);
+        }
     }
     
-    /* Connect plugins in chain */
-    for (int i = 0; i < num_plugins - 1; i++) {
-        plugins[i].attach(plugins[i + 1].place_work);
+    /*
+     * With --queue-budget every stage that can be resized is tuned; its
+     * queue is set up to grow up to the whole budget
+     */
+    queue_tuning_t tuning = { plugins, NULL };
+    atomic_init(&tuning.stop, 0);
+    if (queue_budget) {
+        int* capacities = calloc(num_plugins, sizeof(int));
+        tuning.stages = calloc(num_plugins, sizeof(int));
+        if (!capacities || !tuning.stages) {
+            fprintf(stderr, "Error: Memory allocation failed.\n");
+            exit(1);
+        }
+        int count = 0;
+        for (int i = 0; i < num_plugins; i = next_stage(plugins, num_plugins, i)) {
+            if (plugins[i].ops.resize_queue && plugins[i].ops.get_metrics && plugins[i].ops.set_option) {
+                capacities[count] = plugins[i].queue_size ? plugins[i].queue_size : queue_size;
+                tuning.stages[count++] = i;
+            }
+        }
+        const char* err = queue_tuner_init(&tuning.tuner, capacities, count, queue_budget);
+        free(capacities);
+        if (err) {
+            fprintf(stderr, "Error: --queue-budget: %s.\n", err);
+            print_usage();
+            fflush(stdout);
+            cleanup_plugins(plugins, num_plugins, plugin_names);
+            exit(1);
+        }
     }
     
-    /* Read from stdin and send to first plugin */
-    char line[1026];
-    int sent_end = 0;
-
-    while (fgets(line, sizeof(line), stdin)) {
-        line[strcspn(line, "\n")] = '\0';
-        const char* err = plugins[0].place_work(line);
+    /*
+     * With --executor the single-worker stages run as tasks of one pool
+     * instead of a thread each; the pool takes the --pin CPUs after the
+     * reader's
+     */
+    executor_t executor;
+    if (executor_threads > 0) {
+        int cpus[CPU_LIST_MAX];
+        int count = 0;
+        for (; pin_count > 0 && count < executor_threads && count < CPU_LIST_MAX; count++) {
+            cpus[count] = pin_order[(1 + count) % pin_count];
+        }
+        const char* err = executor_init(&executor, executor_threads, num_plugins, cpus, count);
         if (err) {
-            fprintf(stderr, "Error sending work to first plugin: %s\n", err);
+            fprintf(stderr, "Error starting executor: %s\n", err);
             cleanup_plugins(plugins, num_plugins, plugin_names);
             exit(1);
         }
+        for (int i = 0; i < num_plugins; i = next_stage(plugins, num_plugins, i)) {
+            if (plugins[i].attach_executor && plugins[i].workers == 1 && !plugins[i].cpus) {
+                plugins[i].attach_executor(plugins[i].instance, &executor);
+                plugins[i].scheduled = 1;
+            }
+        }
+    }
+    
+    /* Initialize all plugins */
+    int stage_cpu = 1;
+    for (int i = 0; i < num_plugins; i = next_stage(plugins, num_plugins, i)) {
+        if (batch_size && plugins[i].ops.set_option) {
+            const char* err = plugins[i].ops.set_option(plugins[i].instance, "batch", batch_size);
+            if (err) {
+                fprintf(stderr, "Error configuring plugin %s: %s\n", plugins[i].name, err);
+                cleanup_plugins(plugins, num_plugins, plugin_names);
+                exit(2);
+            }
+        }
         
-        if (strcmp(line, "<END>") == 0) {
-            sent_end = 1;
-            break;
+        if (type_rate && plugins[i].ops.set_option) {
+            const char* err = plugins[i].ops.set_option(plugins[i].instance, "type_rate", type_rate);
+            if (err) {
+                fprintf(stderr, "Error configuring plugin %s: %s\n", plugins[i].name, err);
+                cleanup_plugins(plugins, num_plugins, plugin_names);
+                exit(2);
+            }
+        }
+        
+        if (wait_spec && plugins[i].ops.set_option) {
+            const char* err = plugins[i].ops.set_option(plugins[i].instance, "wait", wait_spec);
+            if (err) {
+                fprintf(stderr, "Error configuring plugin %s: %s\n", plugins[i].name, err);
+                cleanup_plugins(plugins, num_plugins, plugin_names);
+                exit(2);
+            }
+        }
+        
+        /*
+         * A stage's own CPU list wins; otherwise with --pin its workers
+         * take the next CPUs of the order (the reader has the first)
+         */
+        char cpus[256];
+        const char* pin = plugins[i].cpus;
+        if (!pin && pin_count > 0 && !plugins[i].scheduled && !run_inline) {
+            int used = 0;
+            for (int w = 0; w < plugins[i].workers && used < (int)sizeof(cpus) - 16; w++) {
+                used += snprintf(cpus + used, sizeof(cpus) - used, "%s%d", w ? "," : "",
+                                 pin_order[stage_cpu++ % pin_count]);
+            }
+            pin = plugins[i].ops.set_option ? cpus : NULL;
+        }
+        if (pin) {
+            const char* err = plugins[i].ops.set_option
+                ? plugins[i].ops.set_option(plugins[i].instance, "cpus", pin)
+                : "Plugin does not support pinning";
+            if (err) {
+                fprintf(stderr, "Error configuring plugin %s: %s\n", plugins[i].name, err);
+                cleanup_plugins(plugins, num_plugins, plugin_names);
+                exit(2);
+            }
+        }
+        
+        if (queue_budget && plugins[i].ops.resize_queue && plugins[i].ops.set_option) {
+            char max[16];
+            snprintf(max, sizeof(max), "%d", queue_budget);
+            const char* err = plugins[i].ops.set_option(plugins[i].instance, "queue_max", max);
+            if (err) {
+                fprintf(stderr, "Error configuring plugin %s: %s\n", plugins[i].name, err);
+                cleanup_plugins(plugins, num_plugins, plugin_names);
+                exit(2);
+            }
+        }
+        
+        /* Set up without a queue or threads; feed_owned calls it instead */
+        if (run_inline) {
+            const char* err = plugins[i].ops.set_option(plugins[i].instance, "inline", "1");
+            if (err) {
+                fprintf(stderr, "Error configuring plugin %s: %s\n", plugins[i].name, err);
+                cleanup_plugins(plugins, num_plugins, plugin_names);
+                exit(2);
+            }
+        }
+        
+        /* Plugins that predate the option still report their counters */
+        if (metrics_out && plugins[i].ops.set_option) {
+            plugins[i].ops.set_option(plugins[i].instance, "metrics", "1");
+        }
+        
+        /* Behind an unordered fan-in every branch's thread puts into the queue */
+        if (plugins[i].inputs > 1) {
+            char producers[16];
+            snprintf(producers, sizeof(producers), "%d", plugins[i].inputs);
+            const char* err = plugins[i].ops.set_option
+                ? plugins[i].ops.set_option(plugins[i].instance, "producers", producers)
+                : "Plugin does not support several inputs";
+            if (err) {
+                fprintf(stderr, "Error configuring plugin %s: %s\n", plugins[i].name, err);
+                cleanup_plugins(plugins, num_plugins, plugin_names);
+                exit(2);
+            }
+        }
+        
+        if (plugins[i].workers > 1) {
+            char workers[16];
+            snprintf(workers, sizeof(workers), "%d", plugins[i].workers);
+            const char* err = plugins[i].ops.set_option(plugins[i].instance, "workers", workers);
+            if (err) {
+                fprintf(stderr, "Error configuring plugin %s: %s\n", plugins[i].name, err);
+                cleanup_plugins(plugins, num_plugins, plugin_names);
+                exit(2);
+            }
+        }
+        
+        const char* err = plugins[i].ops.init(plugins[i].instance,
+                                              plugins[i].queue_size ? plugins[i].queue_size : queue_size);
+        if (err) {
+            fprintf(stderr, "Error initializing plugin %s: %s\n", plugins[i].name, err);
+            cleanup_plugins(plugins, num_plugins, plugin_names);
+            exit(2);
         }
     }
-
-    /* If EOF reached before <END>, send it now */
-    if (!sent_end) {
-        const char* err = plugins[0].place_work("<END>");
+    
+    /* Connect plugins along the topology (fused plugins are skipped over) */
+    stage_tee_t* tees = calloc(num_plugins, sizeof(stage_tee_t));
+    stage_merge_t* merges = calloc(num_plugins, sizeof(stage_merge_t));
+    stage_tail_t tail;
+    plugin_link_t terminal;
+    int ends = 0;
+    const char* connect_err = tees && merges ? NULL : "Failed to allocate memory for links";
+    
+    /* Barriers are only timed if no stage would drop them on the way */
+    int use_barriers = metrics_out && use_instances;
+    for (int i = 0; use_barriers && i < num_plugins; i = next_stage(plugins, num_plugins, i)) {
+        use_barriers = plugins[i].ops.place_work_slices != NULL;
+    }
+    int use_tail = serve_path || use_barriers;
+    if (!connect_err && use_tail) {
+        connect_err = stage_tail_init(&tail, use_pool ? &pool : NULL);
+        stage_tail_link(&tail, &terminal);
+    }
+    if (!connect_err) {
+        connect_err = connect_graph(plugins, &graph, use_pool ? &pool : NULL, tees, merges,
+                                    use_tail ? &terminal : NULL, &ends);
+    }
+    if (!connect_err && use_barriers) {
+        barrier_tail = &tail;
+        barrier_branches = ends;
+        report.tail = &tail;
+    }
+    if (connect_err) {
+        fprintf(stderr, "Error connecting plugins: %s\n", connect_err);
+        cleanup_plugins(plugins, num_plugins, plugin_names);
+        exit(2);
+    }
+    
+    int listen_fd = -1;
+    if (serve_path) {
+        const char* err = pipeline_server_listen(serve_path, &listen_fd);
         if (err) {
-            fprintf(stderr, "Error sending <END> to first plugin: %s\n", err);
+            fprintf(stderr, "Error: --serve: %s.\n", err);
             cleanup_plugins(plugins, num_plugins, plugin_names);
-            exit(1);
+            exit(2);
         }
     }
     
+    clock_gettime(CLOCK_MONOTONIC, &report.start);
+    if (metrics_out && pthread_create(&report.thread, NULL, metrics_signal_thread, &report) != 0) {
+        fprintf(stderr, "Error: Failed to start metrics thread\n");
+        cleanup_plugins(plugins, num_plugins, plugin_names);
+        exit(2);
+    }
+    if (queue_budget && pthread_create(&tuning.thread, NULL, queue_tuning_thread, &tuning) != 0) {
+        fprintf(stderr, "Error: Failed to start queue tuning thread\n");
+        cleanup_plugins(plugins, num_plugins, plugin_names);
+        exit(2);
+    }
+    
+    /*
+     * Pin the reader last: the sink, metrics and tuning threads are already
+     * running, so they do not inherit its CPU
+     */
+    if (pin_count > 0) {
+        cpu_thread_pin(pthread_self(), pin_order[0]);
+    }
+    
+    /* Read input and send to first plugin (or, inline, through all of them) */
+    if (run_inline) {
+        inline_plugins = plugins;
+        inline_count = num_plugins;
+    }
+    const char* feed_err;
+    if (serve_path) {
+        feed_err = serve_clients(&plugins[0], use_pool ? &pool : NULL, &sink, &tail, ends,
+                                 listen_fd, &serve_wait_mask);
+        close(listen_fd);
+        unlink(serve_path);
+    } else if (input_fd != -1) {
+        feed_err = feed_mapped_file(&plugins[0], use_pool ? &pool : NULL, input_fd,
+                                    batch_size ? atoi(batch_size) : INPUT_BATCH);
+        close(input_fd);
+    } else {
+        feed_err = feed_blocks(&plugins[0], use_pool ? &pool : NULL, STDIN_FILENO,
+                               batch_size ? atoi(batch_size) : INPUT_BATCH);
+    }
+    if (feed_err) {
+        fprintf(stderr, "Error sending work to first plugin: %s\n", feed_err);
+        cleanup_plugins(plugins, num_plugins, plugin_names);
+        exit(1);
+    }
+
+    /* The input ended (at EOF or an <END> line): shut the pipeline down */
+    const char* end_err = feed_control(&plugins[0], PLUGIN_ITEM_END);
+    if (end_err) {
+        fprintf(stderr, "Error sending <END> to first plugin: %s\n", end_err);
+        cleanup_plugins(plugins, num_plugins, plugin_names);
+        exit(1);
+    }
+    
     /* Wait for all plugins to finish */
-    for (int i = 0; i < num_plugins; i++) {
-        const char* err = plugins[i].wait_finished();
+    for (int i = 0; i < num_plugins; i = next_stage(plugins, num_plugins, i)) {
+        const char* err = plugins[i].ops.wait_finished(plugins[i].instance);
         if (err) {
             fprintf(stderr, "Error waiting for plugin %s to finish: %s\n", plugins[i].name, err);
         }
     }
     
+    /* Every task has seen <END>; nothing notifies them any more */
+    if (executor_threads > 0) {
+        executor_destroy(&executor);
+    }
+    
+    /* Stop resizing before the stages (and their queues) go away */
+    if (queue_budget) {
+        atomic_store(&tuning.stop, 1);
+        pthread_join(tuning.thread, NULL);
+        queue_tuner_destroy(&tuning.tuner);
+        free(tuning.stages);
+    }
+    
+    /* Final report, while the stages (and their queues) still exist */
+    if (metrics_out) {
+        atomic_store(&report.stop, 1);
+        pthread_kill(report.thread, SIGUSR1);
+        pthread_join(report.thread, NULL);
+        dump_metrics(&report);
+        if (metrics_out != stderr) {
+            fclose(metrics_out);
+        }
+    }
+    
     /* Cleanup */
     for (int i = 0; i < num_plugins; i++) {
-        plugins[i].fini();
+        if (!plugins[i].fused) {
+            plugins[i].ops.fini(plugins[i].instance);
+        }
+        if (plugins[i].instanced) {
+            plugins[i].destroy(plugins[i].instance);
+        }
         dlclose(plugins[i].handle);
         free(plugins[i].name);
         
@@ -274,6 +1891,30 @@ int main(int argc, char* argv[]) {
     }
     free(plugins);
     
+    /* No stage thread is left to call into a fan-out or fan-in */
+    for (int i = 0; i < num_plugins; i++) {
+        if (tees[i].outputs) {
+            stage_tee_destroy(&tees[i]);
+        }
+        if (merges[i].ports) {
+            stage_merge_destroy(&merges[i]);
+        }
+    }
+    free(tees);
+    free(merges);
+    if (use_tail) {
+        stage_tail_destroy(&tail);
+    }
+    stage_graph_destroy(&graph);
+    
+    /* Every stage thread is gone and every buffer freed */
+    if (use_pool) {
+        buffer_pool_destroy(&pool);
+    }
+    
+    /* Write out the remaining printouts before the final message */
+    output_sink_destroy(&sink);
+    
     printf("Pipeline shutdown complete\n");
     exit(0);
 }
\ No newline at end of file
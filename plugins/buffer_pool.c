@@ -0,0 +1,405 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "buffer_pool.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* size_class of blocks that come from malloc */
+#define POOL_LARGE UINT32_MAX
+
+/* Blocks moved between a cache and the pool per refill, at most */
+#define POOL_BATCH 32
+
+/* Bytes of blocks carved per refill, at most (but at least one block) */
+#define POOL_BATCH_BYTES (64UL << 10)
+
+/* Bytes of free blocks a cache keeps per class before it spills half */
+#define POOL_CACHE_BYTES (256UL << 10)
+
+/* Placed in front of every block */
+typedef struct
+{
+    struct pool_cache* owner;   /* Cache the block goes back to; NULL if malloc'd */
+    uint32_t size_class;        /* POOL_LARGE for malloc'd blocks */
+    _Atomic uint32_t refs;      /* References to an allocated block */
+} pool_header_t;
+
+/* Free block; the link lives where the data goes */
+typedef struct pool_free
+{
+    struct pool_free* next;
+} pool_free_t;
+
+/* Start of every mapped chunk */
+struct pool_chunk
+{
+    struct pool_chunk* next;
+};
+
+/* Free blocks of one thread */
+struct pool_cache
+{
+    buffer_pool_t* pool;
+    struct pool_cache* next;                    /* In pool->caches */
+    int retired;                                /* Its thread exited (pool lock) */
+    pool_free_t* lists[POOL_CLASSES];           /* Owner thread only */
+    size_t counts[POOL_CLASSES];                /* */
+    _Alignas(64) _Atomic(pool_free_t*) remote;  /* Pushed by other threads */
+};
+
+static size_t class_size(int size_class) {
+    return (size_t)1 << (size_class + POOL_MIN_SHIFT);
+}
+
+/* Smallest class whose blocks hold `need` bytes */
+static int class_of(size_t need) {
+    int size_class = 0;
+    while (class_size(size_class) < need) {
+        size_class++;
+    }
+    return size_class;
+}
+
+static pool_header_t* header_of(void* data) {
+    return (pool_header_t*)data - 1;
+}
+
+/* Map one chunk; with huge pages, prefer hugetlb and fall back to an aligned THP region */
+static struct pool_chunk* map_chunk(buffer_pool_t* pool) {
+    void* mem = MAP_FAILED;
+
+    if (pool->huge_pages) {
+        mem = mmap(NULL, POOL_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem == MAP_FAILED) {
+            size_t span = 2 * POOL_CHUNK_SIZE;
+            char* raw = mmap(NULL, span, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (raw != MAP_FAILED) {
+                char* aligned = (char*)(((uintptr_t)raw + POOL_CHUNK_SIZE - 1) &
+                                        ~(uintptr_t)(POOL_CHUNK_SIZE - 1));
+                if (aligned > raw) {
+                    munmap(raw, aligned - raw);
+                }
+                munmap(aligned + POOL_CHUNK_SIZE, raw + span - (aligned + POOL_CHUNK_SIZE));
+                madvise(aligned, POOL_CHUNK_SIZE, MADV_HUGEPAGE);
+                mem = aligned;
+            }
+        }
+    } else {
+        mem = mmap(NULL, POOL_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+    struct pool_chunk* chunk = mem;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->mapped += POOL_CHUNK_SIZE;
+    return chunk;
+}
+
+/* Carve up to `want` fresh blocks onto *list (pool lock held) */
+static size_t carve(buffer_pool_t* pool, int size_class, pool_free_t** list, size_t want) {
+    size_t block = class_size(size_class);
+    size_t got = 0;
+
+    while (got < want) {
+        if (pool->bump_left < block) {
+            /* The rest of the chunk is too small for this class and is left unused */
+            if (got > 0) {
+                break;
+            }
+            struct pool_chunk* chunk = map_chunk(pool);
+            if (!chunk) {
+                break;
+            }
+            pool->bump = (char*)chunk + 16;
+            pool->bump_left = POOL_CHUNK_SIZE - 16;
+        }
+
+        pool_header_t* header = (pool_header_t*)pool->bump;
+        header->owner = NULL;
+        header->size_class = (uint32_t)size_class;
+        pool_free_t* node = (pool_free_t*)(header + 1);
+        node->next = *list;
+        *list = node;
+        pool->bump += block;
+        pool->bump_left -= block;
+        got++;
+    }
+    return got;
+}
+
+/* Move a whole list into the depot (pool lock held) */
+static void depot_put(buffer_pool_t* pool, int size_class, pool_free_t* list, size_t count) {
+    if (!list) {
+        return;
+    }
+    pool_free_t* tail = list;
+    while (tail->next) {
+        tail = tail->next;
+    }
+    tail->next = pool->depot[size_class];
+    pool->depot[size_class] = list;
+    pool->depot_count[size_class] += count;
+}
+
+/* Sort a remote list into the depot by class (pool lock held) */
+static void depot_put_remote(buffer_pool_t* pool, pool_free_t* node) {
+    while (node) {
+        pool_free_t* next = node->next;
+        uint32_t size_class = header_of(node)->size_class;
+        node->next = pool->depot[size_class];
+        pool->depot[size_class] = node;
+        pool->depot_count[size_class]++;
+        node = next;
+    }
+}
+
+/* Thread key destructor: the thread is gone, its blocks go back to the pool */
+static void retire_cache(void* arg) {
+    struct pool_cache* cache = (struct pool_cache*)arg;
+    buffer_pool_t* pool = cache->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        depot_put(pool, c, cache->lists[c], cache->counts[c]);
+        cache->lists[c] = NULL;
+        cache->counts[c] = 0;
+    }
+    depot_put_remote(pool, atomic_exchange_explicit(&cache->remote, NULL, memory_order_acquire));
+    cache->retired = 1;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* The calling thread's cache, created on first use */
+static struct pool_cache* get_cache(buffer_pool_t* pool) {
+    struct pool_cache* cache = pthread_getspecific(pool->key);
+    if (cache) {
+        return cache;
+    }
+
+    cache = aligned_alloc(64, sizeof(struct pool_cache));
+    if (!cache) {
+        return NULL;
+    }
+    memset(cache, 0, sizeof(*cache));
+    cache->pool = pool;
+    atomic_init(&cache->remote, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+    cache->next = pool->caches;
+    pool->caches = cache;
+    pthread_mutex_unlock(&pool->lock);
+
+    pthread_setspecific(pool->key, cache);
+    return cache;
+}
+
+/* Take back every block other threads freed to this cache */
+static void take_remote(struct pool_cache* cache) {
+    pool_free_t* node = atomic_exchange_explicit(&cache->remote, NULL, memory_order_acquire);
+    while (node) {
+        pool_free_t* next = node->next;
+        uint32_t size_class = header_of(node)->size_class;
+        node->next = cache->lists[size_class];
+        cache->lists[size_class] = node;
+        cache->counts[size_class]++;
+        node = next;
+    }
+}
+
+/* Give a cache a batch of blocks: from the depot, retired caches, or a chunk */
+static void refill(buffer_pool_t* pool, struct pool_cache* cache, int size_class) {
+    pthread_mutex_lock(&pool->lock);
+
+    if (!pool->depot[size_class]) {
+        /* Blocks freed to caches whose threads have exited */
+        for (struct pool_cache* other = pool->caches; other; other = other->next) {
+            if (other->retired) {
+                depot_put_remote(pool, atomic_exchange_explicit(&other->remote, NULL,
+                                                                memory_order_acquire));
+            }
+        }
+    }
+
+    size_t got = 0;
+    while (got < POOL_BATCH && pool->depot[size_class]) {
+        pool_free_t* node = pool->depot[size_class];
+        pool->depot[size_class] = node->next;
+        node->next = cache->lists[size_class];
+        cache->lists[size_class] = node;
+        got++;
+    }
+    pool->depot_count[size_class] -= got;
+
+    if (got == 0) {
+        size_t want = POOL_BATCH_BYTES / class_size(size_class);
+        want = want < 1 ? 1 : want > POOL_BATCH ? POOL_BATCH : want;
+        got = carve(pool, size_class, &cache->lists[size_class], want);
+    }
+    cache->counts[size_class] += got;
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Move half of an oversized class list back to the depot */
+static void spill(buffer_pool_t* pool, struct pool_cache* cache, int size_class) {
+    size_t count = cache->counts[size_class] / 2;
+    pool_free_t* list = cache->lists[size_class];
+    pool_free_t* tail = list;
+    for (size_t i = 1; i < count; i++) {
+        tail = tail->next;
+    }
+    cache->lists[size_class] = tail->next;
+    cache->counts[size_class] -= count;
+    tail->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    depot_put(pool, size_class, list, count);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+const char* buffer_pool_init(buffer_pool_t* pool, int huge_pages) {
+    memset(pool, 0, sizeof(*pool));
+    pool->huge_pages = huge_pages;
+    if (pthread_mutex_init(&pool->lock, NULL) != 0) {
+        return "Failed to initialize pool lock";
+    }
+    if (pthread_key_create(&pool->key, retire_cache) != 0) {
+        pthread_mutex_destroy(&pool->lock);
+        return "Failed to create pool thread key";
+    }
+    return NULL;
+}
+
+void buffer_pool_destroy(buffer_pool_t* pool) {
+    /* No destructor may run for a cache freed below */
+    pthread_key_delete(pool->key);
+
+    struct pool_cache* cache = pool->caches;
+    while (cache) {
+        struct pool_cache* next = cache->next;
+        free(cache);
+        cache = next;
+    }
+    struct pool_chunk* chunk = pool->chunks;
+    while (chunk) {
+        struct pool_chunk* next = chunk->next;
+        munmap(chunk, POOL_CHUNK_SIZE);
+        chunk = next;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    memset(pool, 0, sizeof(*pool));
+}
+
+void* buffer_pool_alloc(buffer_pool_t* pool, size_t size) {
+    size_t need = size + sizeof(pool_header_t);
+    struct pool_cache* cache = need <= class_size(POOL_CLASSES - 1) ? get_cache(pool) : NULL;
+
+    if (!cache) {
+        pool_header_t* header = malloc(need);
+        if (!header) {
+            return NULL;
+        }
+        header->owner = NULL;
+        header->size_class = POOL_LARGE;
+        atomic_init(&header->refs, 1);
+        return header + 1;
+    }
+
+    int size_class = class_of(need);
+    if (!cache->lists[size_class]) {
+        take_remote(cache);
+        if (!cache->lists[size_class]) {
+            refill(pool, cache, size_class);
+            if (!cache->lists[size_class]) {
+                return NULL;
+            }
+        }
+    }
+
+    pool_free_t* node = cache->lists[size_class];
+    cache->lists[size_class] = node->next;
+    cache->counts[size_class]--;
+    header_of(node)->owner = cache;
+    atomic_init(&header_of(node)->refs, 1);
+    return node;
+}
+
+char* buffer_pool_strdup(buffer_pool_t* pool, const char* str) {
+    return buffer_pool_memdup(pool, str, strlen(str));
+}
+
+char* buffer_pool_memdup(buffer_pool_t* pool, const char* data, size_t len) {
+    char* copy = buffer_pool_alloc(pool, len + 1);
+    if (copy) {
+        memcpy(copy, data, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void* buffer_pool_retain(void* ptr) {
+    atomic_fetch_add_explicit(&header_of(ptr)->refs, 1, memory_order_relaxed);
+    return ptr;
+}
+
+int buffer_pool_shared(const void* ptr) {
+    return atomic_load_explicit(&header_of((void*)ptr)->refs, memory_order_acquire) > 1;
+}
+
+void buffer_pool_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    pool_header_t* header = header_of(ptr);
+
+    /*
+     * A sole reference (the usual case) cannot gain another one meanwhile,
+     * so it is dropped without a read-modify-write
+     */
+    if (atomic_load_explicit(&header->refs, memory_order_acquire) != 1 &&
+        atomic_fetch_sub_explicit(&header->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    struct pool_cache* owner = header->owner;
+    if (!owner) {
+        free(header);
+        return;
+    }
+
+    pool_free_t* node = (pool_free_t*)ptr;
+    if (pthread_getspecific(owner->pool->key) == owner) {
+        uint32_t size_class = header->size_class;
+        node->next = owner->lists[size_class];
+        owner->lists[size_class] = node;
+        size_t limit = POOL_CACHE_BYTES / class_size(size_class);
+        if (++owner->counts[size_class] > (limit < 8 ? 8 : limit)) {
+            spill(owner->pool, owner, size_class);
+        }
+        return;
+    }
+
+    /* Another thread's block: push it onto the owner's remote list */
+    pool_free_t* head = atomic_load_explicit(&owner->remote, memory_order_relaxed);
+    do {
+        node->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote, &head, node,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+size_t buffer_pool_mapped(buffer_pool_t* pool) {
+    pthread_mutex_lock(&pool->lock);
+    size_t mapped = pool->mapped;
+    pthread_mutex_unlock(&pool->lock);
+    return mapped;
+}
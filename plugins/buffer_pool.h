@@ -0,0 +1,125 @@
+/* */
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/* Size classes are powers of two from 2^POOL_MIN_SHIFT to 2^POOL_MAX_SHIFT bytes */
+#define POOL_MIN_SHIFT 5
+#define POOL_MAX_SHIFT 16
+#define POOL_CLASSES (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+
+/* Blocks are carved from chunks of this size (one huge page) */
+#define POOL_CHUNK_SIZE (2UL << 20)
+
+/* Per-thread free blocks */
+struct pool_cache;
+
+/* Mapped memory blocks are carved from */
+struct pool_chunk;
+
+/**
+ * Pipeline-wide pool of line buffers
+ * Every thread allocates from its own cache, found through a thread key,
+ * without locking. A block remembers the cache that allocated it; freeing
+ * it on another thread pushes it onto that cache's lock-free remote list,
+ * which the owner takes back in one exchange when it runs out. Only cache
+ * refills and spills go through the pool's lock, in batches. Blocks larger
+ * than the biggest class come from malloc.
+ *
+ * Blocks are reference counted: buffer_pool_retain adds a reference and
+ * buffer_pool_free drops one, releasing the block with the last.
+ *
+ * Memory is never returned to the system before buffer_pool_destroy, so
+ * the pool's footprint is set by the peak number of buffers in flight.
+ */
+typedef struct buffer_pool
+{
+    pthread_key_t key;                  /* Calling thread's pool_cache */
+    int huge_pages;                     /* Back chunks with huge pages */
+
+    pthread_mutex_t lock;               /* Guards everything below */
+    void* depot[POOL_CLASSES];          /* Free blocks held by no cache, per class */
+    size_t depot_count[POOL_CLASSES];   /* */
+    char* bump;                         /* Uncarved part of the newest chunk */
+    size_t bump_left;                   /* */
+    struct pool_chunk* chunks;          /* Every chunk mapped so far */
+    struct pool_cache* caches;          /* Every cache, live or retired */
+    size_t mapped;                      /* Bytes of chunks mapped */
+} buffer_pool_t;
+
+/**
+ * Initialize a pool
+ * @param pool Pool to set up
+ * @param huge_pages Nonzero to back chunks with huge pages (explicit
+ * hugetlb pages if available, transparent huge pages otherwise)
+ * @return NULL on success, error message on failure
+ */
+const char* buffer_pool_init(buffer_pool_t* pool, int huge_pages); /* */
+
+/**
+ * Release all of the pool's memory. No other thread may use the pool any
+ * more, and no block from it may be used afterwards.
+ * @param pool Pool to destroy
+ */
+void buffer_pool_destroy(buffer_pool_t* pool); /* */
+
+/**
+ * Allocate a buffer
+ * @param pool Pool to allocate from
+ * @param size Bytes needed
+ * @return The buffer, or NULL on failure
+ */
+void* buffer_pool_alloc(buffer_pool_t* pool, size_t size); /* */
+
+/**
+ * Copy a string into a pool buffer
+ * @param pool Pool to allocate from
+ * @param str String to copy
+ * @return The copy, or NULL on failure
+ */
+char* buffer_pool_strdup(buffer_pool_t* pool, const char* str); /* */
+
+/**
+ * Copy len bytes, which may include NUL, into a pool buffer and terminate
+ * the copy
+ * @param pool Pool to allocate from
+ * @param data Bytes to copy
+ * @param len Number of bytes
+ * @return The copy, or NULL on failure
+ */
+char* buffer_pool_memdup(buffer_pool_t* pool, const char* data, size_t len); /* */
+
+/**
+ * Add a reference to a buffer, e.g. to pass on the buffer a stage received
+ * instead of a copy. Every reference is dropped with buffer_pool_free.
+ * @param ptr Buffer from buffer_pool_alloc or buffer_pool_strdup
+ * @return ptr
+ */
+void* buffer_pool_retain(void* ptr); /* */
+
+/**
+ * Check whether a buffer has more than one reference; a shared buffer must
+ * not be modified
+ * @param ptr Buffer from buffer_pool_alloc or buffer_pool_strdup
+ * @return Nonzero if another reference exists
+ */
+int buffer_pool_shared(const void* ptr); /* */
+
+/**
+ * Drop a reference to a buffer from buffer_pool_alloc, on any thread; the
+ * buffer is freed with its last reference
+ * @param ptr Buffer to release (NULL is ignored)
+ */
+void buffer_pool_free(void* ptr); /* */
+
+/**
+ * Bytes the pool has mapped for its chunks
+ * @param pool Pool to query
+ * @return Total chunk bytes
+ */
+size_t buffer_pool_mapped(buffer_pool_t* pool); /* */
+
+#endif // BUFFER_POOL_H
@@ -0,0 +1,232 @@
+/* * Unit test application for buffer_pool.c
+ */
+#include "buffer_pool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <assert.h>
+#include <string.h>
+
+#define ITEMS 5000
+#define ROUNDS 50
+
+buffer_pool_t test_pool;
+
+/* Blocks handed from the allocating thread to the freeing thread */
+char* handoff[ITEMS];
+pthread_barrier_t round_barrier;
+size_t mapped_after_first = 0;
+
+/* Size of the i-th block: spread over several classes */
+size_t item_size(int i) {
+    return 1 + (size_t)(i * 37) % 3000;
+}
+
+/* Owner: allocates every round, takes its blocks back from the other thread */
+void* owner_func(void* arg) {
+    (void)arg;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < ITEMS; i++) {
+            handoff[i] = buffer_pool_alloc(&test_pool, item_size(i));
+            assert(handoff[i] != NULL);
+            memset(handoff[i], 'a' + round % 26, item_size(i));
+        }
+        pthread_barrier_wait(&round_barrier);
+        pthread_barrier_wait(&round_barrier);
+        if (round == 0) {
+            mapped_after_first = buffer_pool_mapped(&test_pool);
+        }
+    }
+    return NULL;
+}
+
+/* Freer: checks the contents and frees on a thread that does not own them */
+void* freer_func(void* arg) {
+    (void)arg;
+    for (int round = 0; round < ROUNDS; round++) {
+        pthread_barrier_wait(&round_barrier);
+        for (int i = 0; i < ITEMS; i++) {
+            assert(handoff[i][0] == 'a' + round % 26);
+            assert(handoff[i][item_size(i) - 1] == 'a' + round % 26);
+            buffer_pool_free(handoff[i]);
+        }
+        pthread_barrier_wait(&round_barrier);
+    }
+    return NULL;
+}
+
+/* Short-lived thread: its cache is retired when it exits */
+void* short_lived_func(void* arg) {
+    char** blocks = (char**)arg;
+    for (int i = 0; i < ITEMS; i++) {
+        blocks[i] = buffer_pool_alloc(&test_pool, 100);
+        assert(blocks[i] != NULL);
+    }
+    /* Free half here; main frees the rest after the thread is gone */
+    for (int i = 0; i < ITEMS / 2; i++) {
+        buffer_pool_free(blocks[i]);
+    }
+    return NULL;
+}
+
+void test_reuse() {
+    printf("[TEST 1] Running: Same-Thread Reuse\n");
+    const char* err = buffer_pool_init(&test_pool, 0);
+    assert(err == NULL);
+
+    char* a = buffer_pool_alloc(&test_pool, 40);
+    assert(a != NULL && ((uintptr_t)a & 15) == 0);
+    buffer_pool_free(a);
+    /* Same class, so the block just freed comes straight back */
+    char* b = buffer_pool_alloc(&test_pool, 48);
+    assert(b == a);
+    buffer_pool_free(b);
+
+    char* s = buffer_pool_strdup(&test_pool, "hello");
+    assert(strcmp(s, "hello") == 0);
+    buffer_pool_free(s);
+    s = buffer_pool_memdup(&test_pool, "a\0b", 3);
+    assert(memcmp(s, "a\0b", 4) == 0);
+    buffer_pool_free(s);
+    buffer_pool_free(NULL);
+
+    assert(buffer_pool_mapped(&test_pool) == POOL_CHUNK_SIZE);
+    size_t mapped = 0;
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 10000; i++) {
+            buffer_pool_free(buffer_pool_alloc(&test_pool, 1 + (size_t)i * 7 % 60000));
+        }
+        if (round == 0) {
+            mapped = buffer_pool_mapped(&test_pool);
+        }
+    }
+    assert(buffer_pool_mapped(&test_pool) == mapped);
+
+    buffer_pool_destroy(&test_pool);
+    printf("[TEST 1] Passed.\n\n");
+}
+
+void test_cross_thread() {
+    printf("[TEST 2] Running: Cross-Thread Frees Return to the Owner\n");
+    const char* err = buffer_pool_init(&test_pool, 0);
+    assert(err == NULL);
+    pthread_barrier_init(&round_barrier, NULL, 2);
+
+    pthread_t owner, freer;
+    pthread_create(&owner, NULL, owner_func, NULL);
+    pthread_create(&freer, NULL, freer_func, NULL);
+    pthread_join(owner, NULL);
+    pthread_join(freer, NULL);
+
+    /* Every later round reuses the first round's blocks */
+    printf("  mapped after round 1: %zu, after round %d: %zu\n",
+           mapped_after_first, ROUNDS, buffer_pool_mapped(&test_pool));
+    assert(buffer_pool_mapped(&test_pool) == mapped_after_first);
+
+    pthread_barrier_destroy(&round_barrier);
+    buffer_pool_destroy(&test_pool);
+    printf("[TEST 2] Passed.\n\n");
+}
+
+void test_thread_exit() {
+    printf("[TEST 3] Running: Blocks of Exited Threads Are Reused\n");
+    const char* err = buffer_pool_init(&test_pool, 0);
+    assert(err == NULL);
+    char** blocks = malloc(sizeof(char*) * ITEMS);
+
+    size_t mapped = 0;
+    for (int round = 0; round < 20; round++) {
+        pthread_t thread;
+        pthread_create(&thread, NULL, short_lived_func, blocks);
+        pthread_join(thread, NULL);
+        for (int i = ITEMS / 2; i < ITEMS; i++) {
+            buffer_pool_free(blocks[i]);
+        }
+        if (round == 0) {
+            mapped = buffer_pool_mapped(&test_pool);
+        }
+    }
+    assert(buffer_pool_mapped(&test_pool) == mapped);
+
+    free(blocks);
+    buffer_pool_destroy(&test_pool);
+    printf("[TEST 3] Passed.\n\n");
+}
+
+void test_large_blocks() {
+    printf("[TEST 4] Running: Large Blocks and Huge Pages\n");
+    const char* err = buffer_pool_init(&test_pool, 1);
+    assert(err == NULL);
+
+    /* Above the largest class: malloc'd, not carved from a chunk */
+    char* big = buffer_pool_alloc(&test_pool, 1 << 20);
+    assert(big != NULL);
+    memset(big, 'x', 1 << 20);
+    assert(buffer_pool_mapped(&test_pool) == 0);
+    buffer_pool_free(big);
+
+    /* Huge-page chunks (or their fallback) behave like normal ones */
+    char* small = buffer_pool_alloc(&test_pool, 10);
+    assert(small != NULL);
+    memset(small, 'y', 10);
+    assert(buffer_pool_mapped(&test_pool) == POOL_CHUNK_SIZE);
+    buffer_pool_free(small);
+
+    buffer_pool_destroy(&test_pool);
+    printf("[TEST 4] Passed.\n\n");
+}
+
+/* Drops its reference to a shared buffer while main still holds one */
+void* release_func(void* arg) {
+    buffer_pool_free(arg);
+    return NULL;
+}
+
+void test_references() {
+    printf("[TEST 5] Running: Shared References\n");
+    const char* err = buffer_pool_init(&test_pool, 0);
+    assert(err == NULL);
+
+    char* line = buffer_pool_strdup(&test_pool, "shared line");
+    assert(!buffer_pool_shared(line));
+    char* same = buffer_pool_retain(line);
+    assert(same == line);
+    assert(buffer_pool_shared(line));
+
+    /* The first release, on another thread, keeps the buffer alive */
+    pthread_t thread;
+    pthread_create(&thread, NULL, release_func, line);
+    pthread_join(thread, NULL);
+    assert(!buffer_pool_shared(line));
+    assert(strcmp(line, "shared line") == 0);
+
+    /* The last one frees it, so it is handed out again */
+    buffer_pool_free(line);
+    char* again = buffer_pool_alloc(&test_pool, 12);
+    assert(again == line);
+    buffer_pool_free(again);
+
+    /* Large blocks are counted the same way */
+    char* big = buffer_pool_alloc(&test_pool, 1 << 17);
+    buffer_pool_retain(big);
+    buffer_pool_free(big);
+    memset(big, 'z', 1 << 17);
+    buffer_pool_free(big);
+
+    buffer_pool_destroy(&test_pool);
+    printf("[TEST 5] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running Buffer Pool Unit Tests ---\n\n");
+
+    test_reuse();
+    test_cross_thread();
+    test_thread_exit();
+    test_large_blocks();
+    test_references();
+
+    printf("--- All Buffer Pool Tests Passed ---\n");
+    return 0;
+}
@@ -0,0 +1,205 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "cpu_topology.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Where a CPU sits, as read from sysfs; sorted to get the placement order */
+typedef struct
+{
+    int cpu;
+    int package;    /* Socket */
+    int llc;        /* Lowest CPU sharing the last-level cache */
+    int sibling;    /* Position among the hardware threads of its core */
+    int core;
+} cpu_place_t;
+
+const char* cpu_list_parse(const char* text, int* cpus, int max, int* count) {
+    const char* pos = text;
+    *count = 0;
+
+    while (*pos) {
+        char* end;
+        if (*pos < '0' || *pos > '9') {
+            return "CPU lists look like 0,2,4-7";
+        }
+        long first = strtol(pos, &end, 10);
+        long last = first;
+        if (*end == '-') {
+            if (end[1] < '0' || end[1] > '9') {
+                return "CPU lists look like 0,2,4-7";
+            }
+            last = strtol(end + 1, &end, 10);
+        }
+        if (last < first || last >= CPU_SETSIZE) {
+            return "CPU numbers out of range";
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (*count == max) {
+                return "Too many CPUs in list";
+            }
+            cpus[(*count)++] = (int)cpu;
+        }
+
+        if (*end == ',') {
+            end++;
+            if (*end == '\0') {
+                return "CPU lists look like 0,2,4-7";
+            }
+        } else if (*end != '\0') {
+            return "CPU lists look like 0,2,4-7";
+        }
+        pos = end;
+    }
+    return *count > 0 ? NULL : "CPU list is empty";
+}
+
+int cpu_allowed(int cpu) {
+    cpu_set_t set;
+    if (cpu < 0 || cpu >= CPU_SETSIZE || sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return 0;
+    }
+    return CPU_ISSET(cpu, &set);
+}
+
+/* First integer in a sysfs file, or fallback if it cannot be read */
+static int read_sysfs_int(const char* path, int fallback) {
+    FILE* file = fopen(path, "r");
+    int value;
+    if (!file) {
+        return fallback;
+    }
+    if (fscanf(file, "%d", &value) != 1) {
+        value = fallback;
+    }
+    fclose(file);
+    return value;
+}
+
+/* Parse a sysfs CPU list file; returns the count, 0 if unreadable */
+static int read_sysfs_list(const char* path, int* cpus, int max) {
+    char text[4096];
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return 0;
+    }
+    char* line = fgets(text, sizeof(text), file);
+    fclose(file);
+    if (!line) {
+        return 0;
+    }
+    for (char* c = text; *c; c++) {
+        if (*c == '\n') {
+            *c = '\0';
+            break;
+        }
+    }
+    int count;
+    return cpu_list_parse(text, cpus, max, &count) ? 0 : count;
+}
+
+/* Read package, last-level cache, core and hyperthread position of a CPU */
+static void read_place(int cpu, cpu_place_t* place) {
+    char path[128];
+    int list[CPU_LIST_MAX];
+
+    place->cpu = cpu;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+    place->package = read_sysfs_int(path, 0);
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/core_id", cpu);
+    place->core = read_sysfs_int(path, cpu);
+
+    place->sibling = 0;
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+    int siblings = read_sysfs_list(path, list, CPU_LIST_MAX);
+    for (int i = 0; i < siblings; i++) {
+        if (list[i] == cpu) {
+            place->sibling = i;
+        }
+    }
+
+    /* The cache with the highest level is the last-level cache */
+    place->llc = -1;
+    int best_level = 0;
+    for (int index = 0; index < 16; index++) {
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/level", cpu, index);
+        int level = read_sysfs_int(path, -1);
+        if (level < 0) {
+            break;
+        }
+        if (level <= best_level) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list",
+                 cpu, index);
+        if (read_sysfs_list(path, list, CPU_LIST_MAX) > 0) {
+            best_level = level;
+            place->llc = list[0];
+        }
+    }
+    if (place->llc < 0) {
+        place->llc = place->package;
+    }
+}
+
+static int compare_places(const void* a, const void* b) {
+    const cpu_place_t* x = (const cpu_place_t*)a;
+    const cpu_place_t* y = (const cpu_place_t*)b;
+    if (x->package != y->package) {
+        return x->package < y->package ? -1 : 1;
+    }
+    if (x->llc != y->llc) {
+        return x->llc < y->llc ? -1 : 1;
+    }
+    if (x->sibling != y->sibling) {
+        return x->sibling < y->sibling ? -1 : 1;
+    }
+    if (x->core != y->core) {
+        return x->core < y->core ? -1 : 1;
+    }
+    return x->cpu < y->cpu ? -1 : x->cpu > y->cpu;
+}
+
+int cpu_topology_order(int* cpus, int max) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+        return 0;
+    }
+
+    cpu_place_t* places = malloc(sizeof(cpu_place_t) * CPU_SETSIZE);
+    if (!places) {
+        return 0;
+    }
+    int count = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            read_place(cpu, &places[count++]);
+        }
+    }
+    qsort(places, count, sizeof(cpu_place_t), compare_places);
+
+    if (count > max) {
+        count = max;
+    }
+    for (int i = 0; i < count; i++) {
+        cpus[i] = places[i].cpu;
+    }
+    free(places);
+    return count;
+}
+
+int cpu_attr_pin(pthread_attr_t* attr, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+}
+
+int cpu_thread_pin(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread, sizeof(set), &set);
+}
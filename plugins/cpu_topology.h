@@ -0,0 +1,56 @@
+/* */
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <pthread.h>
+
+/* Most CPUs a list or a placement order holds */
+#define CPU_LIST_MAX 1024
+
+/**
+ * Parse a CPU list in the kernel's format, e.g. "0,2,4-7"
+ * @param text List to parse
+ * @param cpus Receives the CPU numbers in list order
+ * @param max Capacity of cpus
+ * @param count Receives the number of CPUs
+ * @return NULL on success, error message on failure
+ */
+const char* cpu_list_parse(const char* text, int* cpus, int max, int* count); /* */
+
+/**
+ * Check whether the process may run on a CPU (see sched_getaffinity)
+ * @param cpu CPU number
+ * @return Nonzero if the CPU is online and allowed
+ */
+int cpu_allowed(int cpu); /* */
+
+/**
+ * Order the CPUs the process may run on for placing a chain of stages:
+ * CPUs that share a last-level cache are adjacent, and the first hardware
+ * thread of every core in a cache group comes before the second ones, so
+ * consecutive stages land on distinct cores that share a cache. Read from
+ * /sys/devices/system/cpu; without it, CPUs are in numeric order.
+ * @param cpus Receives the CPU numbers in placement order
+ * @param max Capacity of cpus
+ * @return Number of CPUs written
+ */
+int cpu_topology_order(int* cpus, int max); /* */
+
+/**
+ * Set a thread attribute's affinity to a single CPU, so the thread starts
+ * there
+ * @param attr Initialized thread attributes
+ * @param cpu CPU number
+ * @return 0 on success, an errno value on failure
+ */
+int cpu_attr_pin(pthread_attr_t* attr, int cpu); /* */
+
+/**
+ * Pin a running thread to a single CPU
+ * @param thread Thread to pin
+ * @param cpu CPU number
+ * @return 0 on success, an errno value on failure
+ */
+int cpu_thread_pin(pthread_t thread, int cpu); /* */
+
+#endif // CPU_TOPOLOGY_H
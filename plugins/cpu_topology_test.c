@@ -0,0 +1,100 @@
+/* * Unit test application for cpu_topology.c
+ */
+#define _GNU_SOURCE
+#include "cpu_topology.h"
+#include <sched.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+
+void test_list_parse() {
+    printf("[TEST 1] Running: CPU List Parsing\n");
+    int cpus[CPU_LIST_MAX];
+    int count;
+
+    const char* err = cpu_list_parse("3", cpus, CPU_LIST_MAX, &count);
+    assert(err == NULL);
+    assert(count == 1 && cpus[0] == 3);
+
+    /* Ranges expand in place and keep list order */
+    err = cpu_list_parse("6,0,2-4", cpus, CPU_LIST_MAX, &count);
+    assert(err == NULL);
+    int expected[] = { 6, 0, 2, 3, 4 };
+    assert(count == 5 && memcmp(cpus, expected, sizeof(expected)) == 0);
+
+    assert(cpu_list_parse("", cpus, CPU_LIST_MAX, &count) != NULL);
+    assert(cpu_list_parse("1,", cpus, CPU_LIST_MAX, &count) != NULL);
+    assert(cpu_list_parse("4-2", cpus, CPU_LIST_MAX, &count) != NULL);
+    assert(cpu_list_parse("2-", cpus, CPU_LIST_MAX, &count) != NULL);
+    assert(cpu_list_parse("-1", cpus, CPU_LIST_MAX, &count) != NULL);
+    assert(cpu_list_parse("a", cpus, CPU_LIST_MAX, &count) != NULL);
+    assert(cpu_list_parse("0-100000", cpus, CPU_LIST_MAX, &count) != NULL);
+    assert(cpu_list_parse("0-3", cpus, 2, &count) != NULL);
+    printf("[TEST 1] Passed.\n\n");
+}
+
+void test_topology_order() {
+    printf("[TEST 2] Running: Placement Order Covers the Allowed CPUs\n");
+    cpu_set_t set;
+    int rc = sched_getaffinity(0, sizeof(set), &set);
+    assert(rc == 0);
+
+    int cpus[CPU_LIST_MAX];
+    int count = cpu_topology_order(cpus, CPU_LIST_MAX);
+    printf("  order:");
+    for (int i = 0; i < count; i++) {
+        printf(" %d", cpus[i]);
+    }
+    printf("\n");
+
+    /* Every allowed CPU exactly once */
+    assert(count == CPU_COUNT(&set));
+    for (int i = 0; i < count; i++) {
+        assert(cpu_allowed(cpus[i]));
+        assert(CPU_ISSET(cpus[i], &set));
+        CPU_CLR(cpus[i], &set);
+    }
+    assert(CPU_COUNT(&set) == 0);
+    assert(!cpu_allowed(-1) && !cpu_allowed(CPU_SETSIZE));
+    printf("[TEST 2] Passed.\n\n");
+}
+
+void* report_cpu(void* arg) {
+    *(int*)arg = sched_getcpu();
+    return NULL;
+}
+
+void test_pinning() {
+    printf("[TEST 3] Running: Threads Start on Their CPU\n");
+    int cpus[CPU_LIST_MAX];
+    int count = cpu_topology_order(cpus, CPU_LIST_MAX);
+    int target = cpus[count - 1];
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    int rc = cpu_attr_pin(&attr, target);
+    assert(rc == 0);
+    int ran_on = -1;
+    pthread_t thread;
+    rc = pthread_create(&thread, &attr, report_cpu, &ran_on);
+    assert(rc == 0);
+    pthread_join(thread, NULL);
+    pthread_attr_destroy(&attr);
+    assert(ran_on == target);
+
+    rc = cpu_thread_pin(pthread_self(), cpus[0]);
+    assert(rc == 0);
+    assert(sched_getcpu() == cpus[0]);
+    printf("[TEST 3] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running CPU Topology Unit Tests ---\n\n");
+
+    test_list_parse();
+    test_topology_order();
+    test_pinning();
+
+    printf("--- All CPU Topology Tests Passed ---\n");
+    return 0;
+}
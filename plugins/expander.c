@@ -1,36 +1,44 @@
 /* */
 #include "plugin_common.h"
+#include "simd/text_kernels.h"
 #include <string.h>
 #include <stdlib.h>
 
 /**
- * Transformation function for the expander.
+ * Transformation function for the expander, on len bytes.
  * Inserts a single white space between each character.
  */
-const char* plugin_transform(const char* input) {
-    size_t len = strlen(input);
+const char* plugin_transform_slice(const char* input, size_t len, size_t* out_len) {
     if (len == 0) {
-        return strdup(input);
+        *out_len = 0;
+        return plugin_memdup(input, 0);
     }
     
     /* New length will be len + (len - 1) for spaces + 1 for null */
     size_t new_len = len * 2 - 1;
-    char* new_str = malloc(new_len + 1);
+    char* new_str = plugin_alloc(new_len + 1);
     if (!new_str) {
         return NULL;
     }
     
-    for (size_t i = 0, j = 0; i < len; i++) {
-        new_str[j++] = input[i];
-        if (i < len - 1) {
-            new_str[j++] = ' '; /* */
-        }
-    }
+    /* The kernel writes "c " pairs; the last space becomes the terminator */
+    text_kernels()->expand(new_str, input, len); /* */
     new_str[new_len] = '\0';
     
+    *out_len = new_len;
     return new_str;
 }
 
+const char* plugin_transform(const char* input) {
+    size_t len;
+    return plugin_transform_slice(input, strlen(input), &len);
+}
+
+PLUGIN_DECLARE_STATELESS()
+PLUGIN_DECLARE_PURE()
+
+PLUGIN_DECLARE_POOLED()
+
 /**
  * Initialization function for the expander plugin.
  */
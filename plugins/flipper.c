@@ -1,30 +1,52 @@
 /* */
 #include "plugin_common.h"
+#include "simd/text_kernels.h"
 #include <string.h>
 #include <stdlib.h>
 
 /**
- * Transformation function for the flipper.
+ * In-place transformation for the flipper, on len bytes.
+ * Reverses the order of characters by swapping from both ends.
+ */
+void plugin_transform_inplace_slice(char* str, size_t len) {
+    text_kernels()->reverse(str, len);
+}
+
+void plugin_transform_inplace(char* str) {
+    plugin_transform_inplace_slice(str, strlen(str));
+}
+
+/**
+ * Transformation function for the flipper, on len bytes.
  * Reverses the order of characters in the string.
  */
-const char* plugin_transform(const char* input) {
-    size_t len = strlen(input);
-    char* new_str = malloc(len + 1);
+const char* plugin_transform_slice(const char* input, size_t len, size_t* out_len) {
+    char* new_str = plugin_alloc(len + 1);
     if (!new_str) {
         return NULL;
     }
     
-    for (size_t i = 0; i < len; i++) {
-        new_str[i] = input[len - 1 - i]; /* */
-    }
+    text_kernels()->reverse_copy(new_str, input, len); /* */
     new_str[len] = '\0';
     
+    *out_len = len;
     return new_str;
 }
 
+const char* plugin_transform(const char* input) {
+    size_t len;
+    return plugin_transform_slice(input, strlen(input), &len);
+}
+
+PLUGIN_DECLARE_STATELESS()
+PLUGIN_DECLARE_PURE()
+
+PLUGIN_DECLARE_POOLED()
+
 /**
  * Initialization function for the flipper plugin.
  */
 const char* plugin_init(int queue_size) { /* */
-    return common_plugin_init(plugin_transform, "flipper", queue_size); /* */
-}
\ No newline at end of file
+    return common_plugin_init_inplace(plugin_transform, plugin_transform_inplace,
+                                      "flipper", queue_size); /* */
+}
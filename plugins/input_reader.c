@@ -0,0 +1,123 @@
+#include "input_reader.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Fill the blocks in turn. The thread can only be cancelled inside read(),
+ * where it holds no lock, so input_reader_stop does not have to wait for
+ * input that may never come.
+ */
+static void* reader_thread(void* arg) {
+    input_reader_t* reader = (input_reader_t*)arg;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    for (int b = 0; ; b ^= 1) {
+        pthread_mutex_lock(&reader->lock);
+        while ((reader->full[b] || reader->taken == b) && !reader->stopping) {
+            pthread_cond_wait(&reader->changed, &reader->lock);
+        }
+        int stopping = reader->stopping;
+        pthread_mutex_unlock(&reader->lock);
+        if (stopping) {
+            return NULL;
+        }
+
+        /* The caller does not touch a block that is neither full nor taken */
+        ssize_t n;
+        do {
+            pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+            n = read(reader->fd, reader->blocks[b], reader->size);
+            pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        } while (n < 0 && errno == EINTR);
+
+        pthread_mutex_lock(&reader->lock);
+        if (n > 0) {
+            reader->lengths[b] = (size_t)n;
+            reader->full[b] = 1;
+        } else {
+            reader->eof = 1;
+            reader->error = n < 0 ? "Failed to read input" : NULL;
+        }
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+        if (n <= 0) {
+            return NULL;
+        }
+    }
+}
+
+const char* input_reader_start(input_reader_t* reader, int fd, size_t size) {
+    reader->fd = fd;
+    reader->size = size;
+    reader->blocks[0] = malloc(size);
+    reader->blocks[1] = malloc(size);
+    if (!reader->blocks[0] || !reader->blocks[1]) {
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return "Failed to allocate memory for input blocks";
+    }
+    reader->lengths[0] = reader->lengths[1] = 0;
+    reader->full[0] = reader->full[1] = 0;
+    reader->next = 0;
+    reader->taken = -1;
+    reader->eof = 0;
+    reader->error = NULL;
+    reader->stopping = 0;
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+
+    if (pthread_create(&reader->thread, NULL, reader_thread, reader) != 0) {
+        pthread_cond_destroy(&reader->changed);
+        pthread_mutex_destroy(&reader->lock);
+        free(reader->blocks[0]);
+        free(reader->blocks[1]);
+        return "Failed to create input reader thread";
+    }
+    return NULL;
+}
+
+const char* input_reader_next(input_reader_t* reader, const char** data, size_t* len) {
+    pthread_mutex_lock(&reader->lock);
+    if (reader->taken >= 0) {
+        reader->full[reader->taken] = 0;
+        reader->taken = -1;
+        pthread_cond_broadcast(&reader->changed);
+    }
+    while (!reader->full[reader->next] && !reader->eof) {
+        pthread_cond_wait(&reader->changed, &reader->lock);
+    }
+
+    const char* err = NULL;
+    if (reader->full[reader->next]) {
+        *data = reader->blocks[reader->next];
+        *len = reader->lengths[reader->next];
+        reader->taken = reader->next;
+        reader->next ^= 1;
+    } else {
+        *data = NULL;
+        *len = 0;
+        err = reader->error;
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return err;
+}
+
+void input_reader_stop(input_reader_t* reader) {
+    pthread_mutex_lock(&reader->lock);
+    reader->stopping = 1;
+    int eof = reader->eof;
+    pthread_cond_broadcast(&reader->changed);
+    pthread_mutex_unlock(&reader->lock);
+
+    /* It may be blocked reading input nobody wants any more */
+    if (!eof) {
+        pthread_cancel(reader->thread);
+    }
+    pthread_join(reader->thread, NULL);
+
+    pthread_cond_destroy(&reader->changed);
+    pthread_mutex_destroy(&reader->lock);
+    free(reader->blocks[0]);
+    free(reader->blocks[1]);
+}
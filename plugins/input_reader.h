@@ -0,0 +1,61 @@
+/* */
+#ifndef INPUT_READER_H
+#define INPUT_READER_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* Most bytes read into one block */
+#define INPUT_READER_BLOCK_SIZE (1 << 20)
+
+/**
+ * Reads a file descriptor on a thread of its own into two blocks used in
+ * turn: while the caller splits one block into lines and hands them to the
+ * pipeline, the next read() fills the other. Each block holds what one
+ * read() returned, so on a pipe or terminal a line is passed on as soon as
+ * it arrives rather than when a block is full.
+ */
+typedef struct
+{
+    int fd;                 /* */
+    char* blocks[2];        /* */
+    size_t size;            /* Capacity of each block */
+    size_t lengths[2];      /* Bytes read into each block */
+    int full[2];            /* Block holds data the caller has not taken yet */
+    int next;               /* Block the caller takes next */
+    int taken;              /* Block the caller holds, -1 if none */
+    int eof;                /* No more blocks will be filled */
+    const char* error;      /* Read error, reported after the data before it */
+    int stopping;           /* The caller wants no more blocks */
+    pthread_mutex_t lock;   /* Guards the fields above */
+    pthread_cond_t changed; /* A block was filled or released, or the input ended */
+    pthread_t thread;       /* */
+} input_reader_t;
+
+/**
+ * Start reading
+ * @param reader Reader to initialize
+ * @param fd Descriptor to read until end of file
+ * @param size Capacity of each block (e.g. INPUT_READER_BLOCK_SIZE)
+ * @return NULL on success, error message on failure
+ */
+const char* input_reader_start(input_reader_t* reader, int fd, size_t size); /* */
+
+/**
+ * Take the next block, giving back the previous one for reading into.
+ * Blocks until data arrives.
+ * @param reader Reader
+ * @param data Receives the block; valid until the next call
+ * @param len Receives its length, 0 at the end of the input
+ * @return NULL on success, error message if reading failed
+ */
+const char* input_reader_next(input_reader_t* reader, const char** data, size_t* len); /* */
+
+/**
+ * Stop reading, also in the middle of the input (e.g. after <END>), and
+ * free the reader
+ * @param reader Reader
+ */
+void input_reader_stop(input_reader_t* reader); /* */
+
+#endif // INPUT_READER_H
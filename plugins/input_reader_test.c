@@ -0,0 +1,123 @@
+/* * Unit test application for input_reader.c
+ */
+#include "input_reader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TOTAL_BYTES 300000
+
+/* Write a known pattern to a pipe in uneven chunks and close it */
+void* write_pattern(void* arg) {
+    int fd = *(int*)arg;
+    char chunk[7001];
+    size_t sent = 0;
+    while (sent < TOTAL_BYTES) {
+        size_t n = TOTAL_BYTES - sent < sizeof(chunk) ? TOTAL_BYTES - sent : sizeof(chunk);
+        for (size_t i = 0; i < n; i++) {
+            chunk[i] = (char)('a' + (sent + i) % 26);
+        }
+        ssize_t written = write(fd, chunk, n);
+        assert(written == (ssize_t)n);
+        sent += n;
+    }
+    close(fd);
+    return NULL;
+}
+
+void test_blocks() {
+    printf("[TEST 1] Running: Blocks Add Up to the Input\n");
+    int fds[2];
+    int rc = pipe(fds);
+    assert(rc == 0);
+    pthread_t writer;
+    pthread_create(&writer, NULL, write_pattern, &fds[1]);
+
+    /* Blocks smaller than the input, so both are used many times over */
+    input_reader_t reader;
+    const char* err = input_reader_start(&reader, fds[0], 4096);
+    assert(err == NULL);
+    const char* data;
+    size_t len;
+    size_t total = 0;
+    int blocks = 0;
+    while (input_reader_next(&reader, &data, &len) == NULL && len > 0) {
+        assert(len <= 4096);
+        for (size_t i = 0; i < len; i++) {
+            assert(data[i] == (char)('a' + (total + i) % 26));
+        }
+        total += len;
+        blocks++;
+    }
+    assert(total == TOTAL_BYTES && len == 0);
+    assert(blocks >= TOTAL_BYTES / 4096);
+
+    /* The end stays the end */
+    err = input_reader_next(&reader, &data, &len);
+    assert(err == NULL && len == 0);
+    input_reader_stop(&reader);
+    pthread_join(writer, NULL);
+    close(fds[0]);
+    printf("[TEST 1] Passed.\n\n");
+}
+
+void test_stop_early() {
+    printf("[TEST 2] Running: Stop While the Writer Is Still Open\n");
+    int fds[2];
+    int rc = pipe(fds);
+    assert(rc == 0);
+    ssize_t written = write(fds[1], "line\n", 5);
+    assert(written == 5);
+
+    input_reader_t reader;
+    const char* err = input_reader_start(&reader, fds[0], INPUT_READER_BLOCK_SIZE);
+    assert(err == NULL);
+    const char* data;
+    size_t len;
+    err = input_reader_next(&reader, &data, &len);
+    assert(err == NULL);
+    assert(len == 5 && memcmp(data, "line\n", 5) == 0);
+
+    /* The reader thread is blocked in read() on a pipe that never ends */
+    input_reader_stop(&reader);
+    close(fds[1]);
+    close(fds[0]);
+
+    /* An empty input ends right away */
+    rc = pipe(fds);
+    assert(rc == 0);
+    close(fds[1]);
+    err = input_reader_start(&reader, fds[0], 64);
+    assert(err == NULL);
+    err = input_reader_next(&reader, &data, &len);
+    assert(err == NULL && len == 0);
+    input_reader_stop(&reader);
+    close(fds[0]);
+    printf("[TEST 2] Passed.\n\n");
+}
+
+void test_read_error() {
+    printf("[TEST 3] Running: Read Error Is Reported\n");
+    input_reader_t reader;
+    const char* data;
+    size_t len;
+    const char* err = input_reader_start(&reader, -1, 64);
+    assert(err == NULL);
+    err = input_reader_next(&reader, &data, &len);
+    assert(err != NULL && len == 0);
+    input_reader_stop(&reader);
+    printf("[TEST 3] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running Input Reader Unit Tests ---\n\n");
+
+    test_blocks();
+    test_stop_early();
+    test_read_error();
+
+    printf("--- All Input Reader Tests Passed ---\n");
+    return 0;
+}
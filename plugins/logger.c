@@ -5,17 +5,34 @@
 #include <stdlib.h>
 
 /**
- * Transformation function for the logger.
+ * Transformation function for the logger, on len bytes.
  * Logs all strings that pass through to standard output.
  */
-const char* plugin_transform(const char* input) {
+const char* plugin_transform_slice(const char* input, size_t len, size_t* out_len) {
     /* STDOUT must only contain pipeline printouts */
-    printf("[logger] %s\n", input); /* */
+    char* line = malloc(len + sizeof("[logger] \n"));
+    if (line) {
+        memcpy(line, "[logger] ", 9);
+        memcpy(line + 9, input, len);
+        line[9 + len] = '\n';
+        plugin_output(line, len + 10); /* */
+        free(line);
+    }
     
-    /* Must return a new, allocated string for the common infrastructure */
-    return strdup(input);
+    /* The line is unchanged: pass the same buffer on instead of a copy */
+    *out_len = len;
+    return plugin_retain_slice(input, len);
+}
+
+const char* plugin_transform(const char* input) {
+    size_t len;
+    return plugin_transform_slice(input, strlen(input), &len);
 }
 
+PLUGIN_DECLARE_STATELESS()
+
+PLUGIN_DECLARE_POOLED()
+
 /**
  * Initialization function for the logger plugin.
  * Calls the common init function.
@@ -0,0 +1,705 @@
+/* */
+#include "output_sink.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Default size trigger for "size" and "time" policies */
+#define SINK_DEFAULT_BYTES (64 * 1024)
+
+/* Appenders block once this much is buffered (never below 4 MB) */
+#define SINK_MIN_MAX_PENDING (4 * 1024 * 1024)
+
+/* First iovec capacity of the writer thread */
+#define SINK_INITIAL_IOV 64
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+const char* output_sink_parse_policy(const char* spec, sink_policy_t* policy) { /* */
+    policy->bytes = SINK_DEFAULT_BYTES;
+    policy->interval_ms = 0;
+
+    if (strcmp(spec, "line") == 0) {
+        policy->mode = SINK_FLUSH_LINE;
+        return NULL;
+    }
+    if (strncmp(spec, "size:", 5) == 0) {
+        long bytes = atol(spec + 5);
+        if (bytes <= 0) {
+            return "flush size must be a positive number of bytes";
+        }
+        policy->mode = SINK_FLUSH_SIZE;
+        policy->bytes = (size_t)bytes;
+        return NULL;
+    }
+    if (strncmp(spec, "time:", 5) == 0) {
+        int ms = atoi(spec + 5);
+        if (ms <= 0) {
+            return "flush interval must be a positive number of milliseconds";
+        }
+        policy->mode = SINK_FLUSH_TIME;
+        policy->interval_ms = ms;
+        return NULL;
+    }
+    return "flush policy must be line, size:<bytes> or time:<ms>";
+}
+
+/**
+ * Header of a typed record in a stage buffer, followed by its head, body
+ * and tail bytes. Once a stage is typed, plain writes to it are framed too
+ * (head only).
+ */
+typedef struct
+{
+    size_t head;            /* Written at once */
+    size_t body;            /* Written one byte per interval */
+    size_t tail;            /* Written one interval after the last body byte */
+    unsigned interval_us;   /* */
+} typed_header_t;
+
+/* End of the output collected from a stage in one writer pass */
+typedef struct
+{
+    unsigned long epoch;    /* Writer pass that collected it */
+    size_t end;             /* Offset in the track backlog */
+} sink_mark_t;
+
+struct sink_track
+{
+    int typed;              /* Holds framed records (the stage switched to typed) */
+    sink_buffer_t backlog;  /* Collected but not yet written */
+    size_t pos;             /* Next unwritten byte of backlog */
+    sink_mark_t* marks;     /* Pass boundaries in backlog, oldest first */
+    size_t first_mark;      /* */
+    size_t num_marks;       /* */
+    size_t cap_marks;       /* */
+
+    /* Typed stages: record being typed */
+    int in_record;          /* */
+    typed_header_t record;  /* */
+    size_t body_done;       /* Body bytes written so far */
+    uint64_t next_due;      /* When the next byte may be written (ns, monotonic) */
+};
+
+/* Growing list of iovecs written by one writev pass */
+typedef struct
+{
+    struct iovec* iov;      /* */
+    int count;              /* */
+    int cap;                /* */
+} iov_list_t;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static struct timespec to_timespec(uint64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = (time_t)(ns / 1000000000ull);
+    ts.tv_nsec = (long)(ns % 1000000000ull);
+    return ts;
+}
+
+/* Grow a buffer to hold at least `need` bytes */
+static int reserve(sink_buffer_t* buf, size_t need) {
+    if (need <= buf->cap) {
+        return 0;
+    }
+    size_t cap = buf->cap ? buf->cap : 4096;
+    while (cap < need) {
+        cap *= 2;
+    }
+    char* data = realloc(buf->data, cap);
+    if (!data) {
+        return -1;
+    }
+    buf->data = data;
+    buf->cap = cap;
+    return 0;
+}
+
+/* Queue bytes for the next writev, merging with the previous iovec if adjacent */
+static int add_iov(iov_list_t* list, const char* data, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+    if (list->count > 0) {
+        struct iovec* last = &list->iov[list->count - 1];
+        if ((const char*)last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return 0;
+        }
+    }
+    if (list->count == list->cap) {
+        int cap = list->cap ? list->cap * 2 : SINK_INITIAL_IOV;
+        struct iovec* iov = realloc(list->iov, sizeof(struct iovec) * cap);
+        if (!iov) {
+            return -1;
+        }
+        list->iov = iov;
+        list->cap = cap;
+    }
+    list->iov[list->count].iov_base = (void*)data;
+    list->iov[list->count].iov_len = len;
+    list->count++;
+    return 0;
+}
+
+/* Whether buffered output should be collected now. Caller holds sink->lock. */
+static int flush_due(output_sink_t* sink) {
+    if (atomic_load(&sink->typed_pending)) {
+        return 1;
+    }
+    size_t pending = atomic_load(&sink->pending);
+    if (sink->policy.mode == SINK_FLUSH_LINE) {
+        return pending > 0;
+    }
+    return pending >= sink->policy.bytes;
+}
+
+/* writev the whole iovec array, retrying on partial writes */
+static void write_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        int chunk = count < IOV_MAX ? count : IOV_MAX;
+        ssize_t n = writev(fd, iov, chunk);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return; /* Nowhere to report it; drop the output like stdio would */
+        }
+
+        /* Skip what was written, possibly in the middle of an entry */
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+}
+
+/* Move a collected buffer to the end of a track's backlog */
+static int hold(output_sink_t* sink, struct sink_track* track, sink_buffer_t* buf,
+                unsigned long epoch) {
+    if (reserve(&track->backlog, track->backlog.len + buf->len) != 0) {
+        return -1;
+    }
+    if (track->first_mark + track->num_marks == track->cap_marks) {
+        if (track->first_mark > 0) {
+            memmove(track->marks, track->marks + track->first_mark,
+                    sizeof(sink_mark_t) * track->num_marks);
+            track->first_mark = 0;
+        } else {
+            size_t cap = track->cap_marks ? track->cap_marks * 2 : 16;
+            sink_mark_t* marks = realloc(track->marks, sizeof(sink_mark_t) * cap);
+            if (!marks) {
+                return -1;
+            }
+            track->marks = marks;
+            track->cap_marks = cap;
+        }
+    }
+
+    memcpy(track->backlog.data + track->backlog.len, buf->data, buf->len);
+    track->backlog.len += buf->len;
+    sink_mark_t* mark = &track->marks[track->first_mark + track->num_marks++];
+    mark->epoch = epoch;
+    mark->end = track->backlog.len;
+    atomic_fetch_add(&sink->held, buf->len);
+    return 0;
+}
+
+/* Frame the plain output a track still holds when its stage becomes typed */
+static void frame_held(output_sink_t* sink, struct sink_track* track) {
+    size_t len = track->backlog.len - track->pos;
+    if (len == 0) {
+        return;
+    }
+    typed_header_t plain = { len, 0, 0, 0 };
+    if (reserve(&track->backlog, track->backlog.len + sizeof(plain)) != 0) {
+        /* Out of memory: write it out of order rather than lose it */
+        struct iovec iov = { track->backlog.data + track->pos, len };
+        write_all(atomic_load_explicit(&sink->fd, memory_order_relaxed), &iov, 1);
+        atomic_fetch_sub(&sink->held, len);
+        track->pos = track->backlog.len;
+        return;
+    }
+    char* at = track->backlog.data + track->pos;
+    memmove(at + sizeof(plain), at, len);
+    memcpy(at, &plain, sizeof(plain));
+    track->backlog.len += sizeof(plain);
+    for (size_t m = track->first_mark; m < track->first_mark + track->num_marks; m++) {
+        track->marks[m].end += sizeof(plain);
+    }
+    atomic_fetch_add(&sink->held, sizeof(plain));
+}
+
+/* Oldest pass with output still held in a track (ULONG_MAX if none) */
+static unsigned long oldest_held(struct sink_track* track) {
+    while (track->num_marks > 0 && track->marks[track->first_mark].end <= track->pos) {
+        track->first_mark++;
+        track->num_marks--;
+    }
+    return track->num_marks > 0 ? track->marks[track->first_mark].epoch : ULONG_MAX;
+}
+
+/* End of the held output collected before pass `barrier` */
+static size_t releasable_end(struct sink_track* track, unsigned long barrier) {
+    size_t end = track->pos;
+    for (size_t m = track->first_mark; m < track->first_mark + track->num_marks; m++) {
+        if (track->marks[m].epoch >= barrier) {
+            break;
+        }
+        end = track->marks[m].end;
+    }
+    return end;
+}
+
+/*
+ * Queue the typed records of a track up to `end`, as far as their pacing
+ * allows. With `single`, stop after the record in progress. Returns 1 if a
+ * record is left in progress (waiting for track->next_due), 0 otherwise.
+ */
+static int type_out(struct sink_track* track, size_t end, int single, uint64_t now,
+                    iov_list_t* list) {
+    char* data = track->backlog.data;
+    while (track->pos < end || track->in_record) {
+        if (!track->in_record) {
+            if (single) {
+                return 0;
+            }
+            memcpy(&track->record, data + track->pos, sizeof(typed_header_t));
+            track->pos += sizeof(typed_header_t);
+            add_iov(list, data + track->pos, track->record.head);
+            track->pos += track->record.head;
+            track->in_record = 1;
+            track->body_done = 0;
+            track->next_due = now;
+        }
+
+        typed_header_t* rec = &track->record;
+        uint64_t interval = (uint64_t)rec->interval_us * 1000ull;
+        while (track->body_done < rec->body && now >= track->next_due) {
+            /* Without an interval, or when behind schedule, catch up at once */
+            size_t n = rec->body - track->body_done;
+            if (interval > 0) {
+                uint64_t due = (now - track->next_due) / interval + 1;
+                if (due < n) {
+                    n = (size_t)due;
+                }
+            }
+            add_iov(list, data + track->pos, n);
+            track->pos += n;
+            track->body_done += n;
+            track->next_due += interval * n;
+        }
+        if (track->body_done < rec->body || now < track->next_due) {
+            return 1;
+        }
+
+        add_iov(list, data + track->pos, rec->tail);
+        track->pos += rec->tail;
+        track->in_record = 0;
+    }
+    return 0;
+}
+
+/*
+ * Take every stage buffer and write out what may be written. Stages are
+ * collected from the last to the first and written from the first to the
+ * last (see the ordering note in output_sink.h). Output of a stage collected
+ * in pass e is held back while an earlier stage still holds output from
+ * pass e or before; it is written straight from the collected buffer
+ * otherwise. A typed line that has started owns the output until its
+ * newline, so nothing is written into the middle of it; *owner is its stage
+ * (-1 if none). Returns whether output is still held back, and the time the
+ * next typed byte is due in *next_due.
+ */
+static int collect_and_write(output_sink_t* sink, iov_list_t* list, unsigned long epoch,
+                             int* owner, uint64_t* next_due) {
+    atomic_store(&sink->typed_pending, 0);
+    for (int s = sink->num_stages - 1; s >= 0; s--) {
+        sink_stage_t* stage = &sink->stages[s];
+        pthread_mutex_lock(&stage->lock);
+        sink_buffer_t taken = stage->buf;
+        stage->buf = sink->spare[s];
+        int typed = stage->typed;
+        pthread_mutex_unlock(&stage->lock);
+        sink->spare[s] = taken;
+
+        if (typed && !sink->tracks[s].typed) {
+            frame_held(sink, &sink->tracks[s]);
+        }
+        sink->tracks[s].typed = typed;
+    }
+
+    uint64_t now = now_ns();
+    unsigned long barrier = ULONG_MAX;
+    size_t collected = 0;
+    int held = 0;
+    list->count = 0;
+
+    /* Finish the line being typed before anything else */
+    if (*owner >= 0) {
+        struct sink_track* track = &sink->tracks[*owner];
+        sink_buffer_t* buf = &sink->spare[*owner];
+
+        /* Hold its new output first: growing the backlog may move it */
+        if (buf->len > 0 && hold(sink, track, buf, epoch) == 0) {
+            collected += buf->len;
+            buf->len = 0;
+        }
+        size_t before = track->pos;
+        if (!type_out(track, track->pos, 1, now, list)) {
+            *owner = -1;
+        }
+        atomic_fetch_sub(&sink->held, track->pos - before);
+    }
+
+    for (int s = 0; s < sink->num_stages; s++) {
+        struct sink_track* track = &sink->tracks[s];
+        sink_buffer_t* buf = &sink->spare[s];
+        collected += buf->len;
+
+        if (*owner < 0 && !track->typed && barrier == ULONG_MAX &&
+            track->pos == track->backlog.len) {
+            /* Nothing earlier is pending: write the collected buffer directly */
+            if (add_iov(list, buf->data, buf->len) == 0) {
+                continue;
+            }
+        }
+
+        if (buf->len > 0) {
+            if (hold(sink, track, buf, epoch) != 0) {
+                /* Out of memory: write it out of order rather than lose it */
+                add_iov(list, buf->data, buf->len);
+            }
+        }
+        if (*owner >= 0) {
+            continue;
+        }
+
+        size_t before = track->pos;
+        size_t end = releasable_end(track, barrier);
+        if (track->typed) {
+            if (type_out(track, end, 0, now, list)) {
+                *owner = s;
+            }
+        } else {
+            add_iov(list, track->backlog.data + track->pos, end - track->pos);
+            track->pos = end;
+        }
+        atomic_fetch_sub(&sink->held, track->pos - before);
+
+        unsigned long oldest = oldest_held(track);
+        if (oldest < barrier) {
+            barrier = oldest;
+        }
+    }
+
+    write_all(atomic_load_explicit(&sink->fd, memory_order_relaxed), list->iov, list->count);
+    for (int s = 0; s < sink->num_stages; s++) {
+        struct sink_track* track = &sink->tracks[s];
+        sink->spare[s].len = 0;
+        oldest_held(track);
+
+        /* Reclaim the written part of the backlog */
+        if (track->pos == track->backlog.len) {
+            track->pos = 0;
+            track->backlog.len = 0;
+            track->first_mark = 0;
+            track->num_marks = 0;
+        } else if (track->pos > track->backlog.len / 2) {
+            size_t shift = track->pos;
+            memmove(track->backlog.data, track->backlog.data + shift,
+                    track->backlog.len - shift);
+            track->backlog.len -= shift;
+            track->pos = 0;
+            for (size_t m = track->first_mark; m < track->first_mark + track->num_marks; m++) {
+                track->marks[m].end -= shift;
+            }
+        }
+        if (track->backlog.len > 0) {
+            held = 1;
+        }
+    }
+    atomic_fetch_sub(&sink->pending, collected);
+
+    /* Held output without a line being typed only follows a failed allocation */
+    *next_due = *owner >= 0 ? sink->tracks[*owner].next_due : now + 1000000ull;
+    return held || *owner >= 0;
+}
+
+/* Writer thread: waits for the flush policy or the typing timer, then writes */
+static void* writer_thread(void* arg) {
+    output_sink_t* sink = (output_sink_t*)arg;
+    iov_list_t list = { NULL, 0, 0 };
+    unsigned long epoch = 0;
+    int held = 0;
+    int owner = -1;
+    uint64_t next_due = UINT64_MAX;
+
+    pthread_mutex_lock(&sink->lock);
+    while (1) {
+        /* While output is held back, flush requests and stop wait for the timer */
+        while (!flush_due(sink) &&
+               (held || (!sink->stopping && sink->requested == sink->completed))) {
+            uint64_t deadline = held ? next_due : UINT64_MAX;
+            if (sink->policy.mode == SINK_FLUSH_TIME) {
+                uint64_t tick = now_ns() + (uint64_t)sink->policy.interval_ms * 1000000ull;
+                if (tick < deadline) {
+                    deadline = tick;
+                }
+            }
+            if (deadline == UINT64_MAX) {
+                pthread_cond_wait(&sink->wake, &sink->lock);
+                continue;
+            }
+            struct timespec ts = to_timespec(deadline);
+            if (pthread_cond_timedwait(&sink->wake, &sink->lock, &ts) == ETIMEDOUT) {
+                break;
+            }
+        }
+
+        /* Everything appended before these requests is collected below */
+        unsigned long target = sink->requested;
+        int stop = sink->stopping;
+        pthread_mutex_unlock(&sink->lock);
+
+        held = collect_and_write(sink, &list, ++epoch, &owner, &next_due);
+
+        pthread_mutex_lock(&sink->lock);
+        if (!held) {
+            sink->completed = target;
+            pthread_cond_broadcast(&sink->drained);
+            if (stop) {
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&sink->lock);
+
+    free(list.iov);
+    return NULL;
+}
+
+const char* output_sink_init(output_sink_t* sink, int fd, int num_stages,
+                             sink_policy_t policy) { /* */
+    if (num_stages <= 0) {
+        return "Output sink needs at least one stage.";
+    }
+    atomic_init(&sink->fd, fd);
+    sink->policy = policy;
+    sink->num_stages = num_stages;
+    sink->max_pending = policy.bytes * 4 > SINK_MIN_MAX_PENDING ? policy.bytes * 4
+                                                                : SINK_MIN_MAX_PENDING;
+    atomic_init(&sink->pending, 0);
+    atomic_init(&sink->held, 0);
+    atomic_init(&sink->typed_pending, 0);
+    sink->requested = 0;
+    sink->completed = 0;
+    sink->stopping = 0;
+
+    sink->stages = calloc(num_stages, sizeof(sink_stage_t));
+    sink->spare = calloc(num_stages, sizeof(sink_buffer_t));
+    sink->tracks = calloc(num_stages, sizeof(struct sink_track));
+    if (!sink->stages || !sink->spare || !sink->tracks) {
+        free(sink->stages);
+        free(sink->spare);
+        free(sink->tracks);
+        return "Failed to allocate memory for output sink.";
+    }
+    for (int s = 0; s < num_stages; s++) {
+        pthread_mutex_init(&sink->stages[s].lock, NULL);
+    }
+    pthread_mutex_init(&sink->lock, NULL);
+
+    /* Typing deadlines are on the monotonic clock */
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&sink->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&sink->drained, NULL);
+
+    if (pthread_create(&sink->writer, NULL, writer_thread, sink) != 0) {
+        for (int s = 0; s < num_stages; s++) {
+            pthread_mutex_destroy(&sink->stages[s].lock);
+        }
+        pthread_mutex_destroy(&sink->lock);
+        pthread_cond_destroy(&sink->wake);
+        pthread_cond_destroy(&sink->drained);
+        free(sink->stages);
+        free(sink->spare);
+        free(sink->tracks);
+        return "Failed to create output writer thread.";
+    }
+    return NULL;
+}
+
+/* Wake the writer and apply backpressure after `len` bytes were appended */
+static void appended(output_sink_t* sink, size_t len, int typed) {
+    size_t before = atomic_fetch_add(&sink->pending, len);
+    size_t after = before + len;
+    if (typed) {
+        atomic_store(&sink->typed_pending, 1);
+    }
+
+    /* Wake the writer only when this record makes a flush due */
+    if (typed || sink->policy.mode == SINK_FLUSH_LINE ||
+        (before < sink->policy.bytes && after >= sink->policy.bytes)) {
+        pthread_mutex_lock(&sink->lock);
+        pthread_cond_signal(&sink->wake);
+        pthread_mutex_unlock(&sink->lock);
+    }
+
+    /* Backpressure when output is produced faster than it can be written */
+    if (after + atomic_load(&sink->held) > sink->max_pending) {
+        output_sink_flush(sink);
+    }
+}
+
+/* Append one framed record to a typed stage buffer. Caller holds the stage lock. */
+static int append_typed(sink_stage_t* st, const typed_header_t* header, const char* head,
+                        const char* body, const char* tail) {
+    size_t len = sizeof(*header) + header->head + header->body + header->tail;
+    if (reserve(&st->buf, st->buf.len + len) != 0) {
+        return -1;
+    }
+    char* out = st->buf.data + st->buf.len;
+    memcpy(out, header, sizeof(*header));
+    out += sizeof(*header);
+    memcpy(out, head, header->head);
+    out += header->head;
+    memcpy(out, body, header->body);
+    out += header->body;
+    memcpy(out, tail, header->tail);
+    st->buf.len += len;
+    return 0;
+}
+
+void output_sink_write(output_sink_t* sink, int stage, const char* data, size_t len) { /* */
+    if (len == 0) {
+        return;
+    }
+
+    sink_stage_t* st = &sink->stages[stage];
+    size_t before = 0;
+    int failed;
+    pthread_mutex_lock(&st->lock);
+    before = st->buf.len;
+    if (st->typed) {
+        typed_header_t header = { len, 0, 0, 0 };
+        failed = append_typed(st, &header, data, NULL, NULL);
+    } else {
+        failed = reserve(&st->buf, st->buf.len + len);
+        if (!failed) {
+            memcpy(st->buf.data + st->buf.len, data, len);
+            st->buf.len += len;
+        }
+    }
+    size_t added = st->buf.len - before;
+    pthread_mutex_unlock(&st->lock);
+
+    if (failed) {
+        /* Out of memory: write what is buffered, then this record, directly */
+        output_sink_flush(sink);
+        struct iovec iov = { (void*)data, len };
+        write_all(atomic_load_explicit(&sink->fd, memory_order_relaxed), &iov, 1);
+        return;
+    }
+    appended(sink, added, 0);
+}
+
+void output_sink_write_typed(output_sink_t* sink, int stage, const char* prefix,
+                             const char* text, size_t len, unsigned interval_us) { /* */
+    sink_stage_t* st = &sink->stages[stage];
+    typed_header_t header = { strlen(prefix), len, 1, interval_us };
+    int failed = 0;
+
+    pthread_mutex_lock(&st->lock);
+    size_t before = st->buf.len;
+    if (!st->typed && st->buf.len > 0) {
+        /* Frame the plain output appended before the first typed line */
+        typed_header_t plain = { st->buf.len, 0, 0, 0 };
+        failed = reserve(&st->buf, st->buf.len + sizeof(plain));
+        if (!failed) {
+            memmove(st->buf.data + sizeof(plain), st->buf.data, st->buf.len);
+            memcpy(st->buf.data, &plain, sizeof(plain));
+            st->buf.len += sizeof(plain);
+        }
+    }
+    if (!failed) {
+        st->typed = 1;
+        failed = append_typed(st, &header, prefix, text, "\n");
+    }
+    size_t added = st->buf.len - before;
+    pthread_mutex_unlock(&st->lock);
+
+    if (failed) {
+        /* Out of memory: print the line without pacing */
+        output_sink_flush(sink);
+        struct iovec iov[3] = { { (void*)prefix, header.head }, { (void*)text, len },
+                                { "\n", 1 } };
+        write_all(atomic_load_explicit(&sink->fd, memory_order_relaxed), iov, 3);
+        return;
+    }
+    appended(sink, added, 1);
+}
+
+void output_sink_request_flush(output_sink_t* sink) { /* */
+    pthread_mutex_lock(&sink->lock);
+    sink->requested++;
+    pthread_cond_signal(&sink->wake);
+    pthread_mutex_unlock(&sink->lock);
+}
+
+void output_sink_flush(output_sink_t* sink) { /* */
+    pthread_mutex_lock(&sink->lock);
+    unsigned long ticket = ++sink->requested;
+    pthread_cond_signal(&sink->wake);
+    while (sink->completed < ticket) {
+        pthread_cond_wait(&sink->drained, &sink->lock);
+    }
+    pthread_mutex_unlock(&sink->lock);
+}
+
+void output_sink_set_fd(output_sink_t* sink, int fd) { /* */
+    output_sink_flush(sink);
+    atomic_store_explicit(&sink->fd, fd, memory_order_relaxed);
+}
+
+void output_sink_destroy(output_sink_t* sink) { /* */
+    pthread_mutex_lock(&sink->lock);
+    sink->stopping = 1;
+    pthread_cond_signal(&sink->wake);
+    pthread_mutex_unlock(&sink->lock);
+    pthread_join(sink->writer, NULL);
+
+    for (int s = 0; s < sink->num_stages; s++) {
+        pthread_mutex_destroy(&sink->stages[s].lock);
+        free(sink->stages[s].buf.data);
+        free(sink->spare[s].data);
+        free(sink->tracks[s].backlog.data);
+        free(sink->tracks[s].marks);
+    }
+    free(sink->stages);
+    free(sink->spare);
+    free(sink->tracks);
+    pthread_mutex_destroy(&sink->lock);
+    pthread_cond_destroy(&sink->wake);
+    pthread_cond_destroy(&sink->drained);
+}
@@ -0,0 +1,161 @@
+/* */
+#ifndef OUTPUT_SINK_H
+#define OUTPUT_SINK_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * When the writer thread flushes buffered output
+ */
+typedef enum
+{
+    SINK_FLUSH_LINE = 0,  /* After every record (interactive use) */
+    SINK_FLUSH_SIZE,      /* Once `bytes` are buffered, and on shutdown */
+    SINK_FLUSH_TIME       /* Every `interval_ms`, or earlier once `bytes` are buffered */
+} sink_flush_mode_t;
+
+/**
+ * Flush policy of an output sink
+ */
+typedef struct
+{
+    sink_flush_mode_t mode; /* */
+    size_t bytes;           /* Size trigger for SINK_FLUSH_SIZE / SINK_FLUSH_TIME */
+    int interval_ms;        /* Deadline for SINK_FLUSH_TIME */
+} sink_policy_t;
+
+/**
+ * Growable byte buffer
+ */
+typedef struct
+{
+    char* data;             /* */
+    size_t len;             /* */
+    size_t cap;             /* */
+} sink_buffer_t;
+
+/**
+ * Output buffer owned by one pipeline stage
+ */
+typedef struct
+{
+    pthread_mutex_t lock;   /* */
+    sink_buffer_t buf;      /* Records not yet taken by the writer */
+    int typed;              /* buf holds framed records (see output_sink_write_typed) */
+} sink_stage_t;
+
+/* Writer-private per-stage state for output that cannot be written yet */
+struct sink_track;
+
+/**
+ * Central output sink
+ * Every stage appends formatted records to its own buffer; one writer thread
+ * collects all buffers and writes them with a single writev. Buffers are
+ * collected last stage first and written first stage first: a record a stage
+ * emits for a line is always appended before the next stage can emit one for
+ * the same line, so per-line output order across stages is preserved.
+ *
+ * The writer thread is also the pipeline's typing timer: typed lines are
+ * written one character per interval, and output of later stages collected
+ * after a typed line is held back until that line is fully typed.
+ */
+typedef struct output_sink
+{
+    atomic_int fd;                  /* Written to by the writer thread */
+    sink_policy_t policy;           /* */
+    sink_stage_t* stages;           /* */
+    int num_stages;                 /* */
+
+    /* Writer-side buffers, swapped with the stage buffers on each flush */
+    sink_buffer_t* spare;
+    struct sink_track* tracks;      /* Held-back output, one per stage */
+
+    atomic_size_t pending;          /* Bytes buffered across all stages */
+    size_t max_pending;             /* Appenders wait above this */
+    atomic_size_t held;             /* Bytes collected but held back */
+    atomic_int typed_pending;       /* A typed line is waiting to be collected */
+
+    pthread_mutex_t lock;           /* Guards the fields below */
+    pthread_cond_t wake;            /* Writer has work */
+    pthread_cond_t drained;         /* Writer finished a flush */
+    unsigned long requested;        /* Flush requests made */
+    unsigned long completed;        /* Flush requests satisfied */
+    int stopping;                   /* */
+    pthread_t writer;               /* */
+} output_sink_t;
+
+/**
+ * Parse a flush policy: "line", "size:<bytes>" or "time:<ms>"
+ * @param spec Policy text
+ * @param policy Receives the parsed policy
+ * @return NULL on success, error message on failure
+ */
+const char* output_sink_parse_policy(const char* spec, sink_policy_t* policy); /* */
+
+/**
+ * Initialize a sink and start its writer thread
+ * @param sink Pointer to sink structure
+ * @param fd File descriptor to write to
+ * @param num_stages Number of stage buffers
+ * @param policy Flush policy
+ * @return NULL on success, error message on failure
+ */
+const char* output_sink_init(output_sink_t* sink, int fd, int num_stages,
+                             sink_policy_t policy); /* */
+
+/**
+ * Append a record to a stage's buffer
+ * Blocks only if the writer has fallen far behind.
+ * @param sink Pointer to sink structure
+ * @param stage Stage index (position in the chain)
+ * @param data Bytes to write
+ * @param len Number of bytes
+ */
+void output_sink_write(output_sink_t* sink, int stage, const char* data, size_t len); /* */
+
+/**
+ * Append a typed line to a stage's buffer: the prefix is written at once, the
+ * text one byte per interval, and a newline one interval after the last byte.
+ * Returns immediately; the writer thread does the pacing.
+ * @param sink Pointer to sink structure
+ * @param stage Stage index (position in the chain)
+ * @param prefix NUL-terminated text written without delay
+ * @param text Bytes to type
+ * @param len Number of bytes in text
+ * @param interval_us Delay between typed bytes, in microseconds
+ */
+void output_sink_write_typed(output_sink_t* sink, int stage, const char* prefix,
+                             const char* text, size_t len, unsigned interval_us); /* */
+
+/**
+ * Ask the writer thread to write out everything appended so far, whatever
+ * the flush policy, without waiting for it
+ * @param sink Sink
+ */
+void output_sink_request_flush(output_sink_t* sink); /* */
+
+/**
+ * Write out everything appended so far (including typing out typed lines)
+ * and wait until it is written
+ * @param sink Pointer to sink structure
+ */
+void output_sink_flush(output_sink_t* sink); /* */
+
+/**
+ * Write out everything appended so far to the current descriptor, then send
+ * later output to another one. Output appended while it runs may go to
+ * either descriptor.
+ * @param sink Pointer to sink structure
+ * @param fd File descriptor to write to from now on
+ */
+void output_sink_set_fd(output_sink_t* sink, int fd); /* */
+
+/**
+ * Flush, stop the writer thread and free the sink's resources
+ * @param sink Pointer to sink structure
+ */
+void output_sink_destroy(output_sink_t* sink); /* */
+
+#endif // OUTPUT_SINK_H
@@ -0,0 +1,202 @@
+/* * Unit test application for output_sink.c
+ */
+#include "output_sink.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TOTAL_LINES 5000
+
+output_sink_t test_sink;
+int test_pipe[2];
+char* captured = NULL;
+size_t captured_len = 0;
+
+/* Handoff between the two writer threads, like a queue between stages */
+pthread_mutex_t handoff_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t handoff_cond = PTHREAD_COND_INITIALIZER;
+int lines_ready = 0;
+
+/* Reader: collects everything written to the pipe */
+void* reader_func(void* arg) {
+    (void)arg;
+    size_t cap = 1 << 16;
+    captured = malloc(cap);
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(test_pipe[0], buf, sizeof(buf))) > 0) {
+        if (captured_len + n > cap) {
+            cap *= 2;
+            captured = realloc(captured, cap);
+        }
+        memcpy(captured + captured_len, buf, n);
+        captured_len += n;
+    }
+    return NULL;
+}
+
+/* Stage 0: prints each line, typed or plain, then hands it on */
+void* first_stage(void* arg) {
+    unsigned interval_us = *(unsigned*)arg;
+    for (int i = 0; i < TOTAL_LINES; i++) {
+        char text[32];
+        int len = snprintf(text, sizeof(text), "%d", i);
+        if (interval_us > 0) {
+            output_sink_write_typed(&test_sink, 0, "[t] ", text, len, interval_us);
+        } else {
+            char line[48];
+            int n = snprintf(line, sizeof(line), "[t] %s\n", text);
+            output_sink_write(&test_sink, 0, line, n);
+        }
+
+        pthread_mutex_lock(&handoff_mutex);
+        lines_ready++;
+        pthread_cond_signal(&handoff_cond);
+        pthread_mutex_unlock(&handoff_mutex);
+    }
+    return NULL;
+}
+
+/* Stage 1: prints each line after stage 0 has */
+void* second_stage(void* arg) {
+    (void)arg;
+    for (int i = 0; i < TOTAL_LINES; i++) {
+        pthread_mutex_lock(&handoff_mutex);
+        while (lines_ready <= i) {
+            pthread_cond_wait(&handoff_cond, &handoff_mutex);
+        }
+        pthread_mutex_unlock(&handoff_mutex);
+
+        char line[48];
+        int n = snprintf(line, sizeof(line), "[l] %d\n", i);
+        output_sink_write(&test_sink, 1, line, n);
+    }
+    return NULL;
+}
+
+/* Run two stages through a sink and check every line arrives whole, in order */
+void run_two_stages(const char* policy_spec, unsigned interval_us) {
+    sink_policy_t policy;
+    const char* err = output_sink_parse_policy(policy_spec, &policy);
+    assert(err == NULL);
+    int rc = pipe(test_pipe);
+    assert(rc == 0);
+    lines_ready = 0;
+    captured_len = 0;
+
+    pthread_t reader, first, second;
+    pthread_create(&reader, NULL, reader_func, NULL);
+    err = output_sink_init(&test_sink, test_pipe[1], 2, policy);
+    assert(err == NULL);
+    pthread_create(&first, NULL, first_stage, &interval_us);
+    pthread_create(&second, NULL, second_stage, NULL);
+    pthread_join(first, NULL);
+    pthread_join(second, NULL);
+    output_sink_destroy(&test_sink);
+    close(test_pipe[1]);
+    pthread_join(reader, NULL);
+    close(test_pipe[0]);
+
+    /* Each stage's lines in order, and [l] i never before [t] i */
+    int next_t = 0;
+    int next_l = 0;
+    char* line = captured;
+    char* end = captured + captured_len;
+    while (line < end) {
+        char* nl = memchr(line, '\n', end - line);
+        assert(nl != NULL);
+        *nl = '\0';
+        int value = -1;
+        if (sscanf(line, "[t] %d", &value) == 1) {
+            assert(value == next_t);
+            next_t++;
+        } else {
+            int matched = sscanf(line, "[l] %d", &value);
+            assert(matched == 1);
+            assert(value == next_l);
+            assert(next_l < next_t);
+            next_l++;
+        }
+        line = nl + 1;
+    }
+    assert(next_t == TOTAL_LINES);
+    assert(next_l == TOTAL_LINES);
+    free(captured);
+    captured = NULL;
+}
+
+/* Test 1: plain records under each flush policy */
+void test_policies() {
+    printf("[TEST 1] Running: Plain Records Under Each Flush Policy\n");
+    run_two_stages("line", 0);
+    run_two_stages("size:100", 0);
+    run_two_stages("time:1", 0);
+    printf("[TEST 1] Passed.\n\n");
+}
+
+/* Test 2: typed lines are never split and hold back later stages */
+void test_typed_lines() {
+    printf("[TEST 2] Running: Typed Lines Stay Whole And Ordered\n");
+    run_two_stages("line", 1);
+    run_two_stages("size:4096", 1);
+    printf("[TEST 2] Passed.\n\n");
+}
+
+/* Test 3: policy parsing */
+void test_parse_policy() {
+    printf("[TEST 3] Running: Flush Policy Parsing\n");
+    sink_policy_t policy;
+    const char* err = output_sink_parse_policy("line", &policy);
+    assert(err == NULL);
+    assert(policy.mode == SINK_FLUSH_LINE);
+    err = output_sink_parse_policy("size:4096", &policy);
+    assert(err == NULL);
+    assert(policy.mode == SINK_FLUSH_SIZE && policy.bytes == 4096);
+    err = output_sink_parse_policy("time:25", &policy);
+    assert(err == NULL);
+    assert(policy.mode == SINK_FLUSH_TIME && policy.interval_ms == 25);
+    assert(output_sink_parse_policy("size:0", &policy) != NULL);
+    assert(output_sink_parse_policy("time:", &policy) != NULL);
+    assert(output_sink_parse_policy("always", &policy) != NULL);
+    printf("[TEST 3] Passed.\n\n");
+}
+
+/* Test 4: a flush request writes out buffered output without waiting for it */
+void test_request_flush() {
+    printf("[TEST 4] Running: Flush Request Under a Size Policy\n");
+    int fds[2];
+    int rc = pipe(fds);
+    assert(rc == 0);
+    sink_policy_t policy;
+    const char* err = output_sink_parse_policy("size:1048576", &policy);
+    assert(err == NULL);
+    err = output_sink_init(&test_sink, fds[1], 1, policy);
+    assert(err == NULL);
+
+    /* Far below the size threshold: only the request gets it written */
+    output_sink_write(&test_sink, 0, "held\n", 5);
+    output_sink_request_flush(&test_sink);
+    char buf[8];
+    ssize_t got = read(fds[0], buf, sizeof(buf));
+    assert(got == 5 && memcmp(buf, "held\n", 5) == 0);
+
+    output_sink_destroy(&test_sink);
+    close(fds[0]);
+    close(fds[1]);
+    printf("[TEST 4] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running Output Sink Unit Tests ---\n\n");
+
+    test_policies();
+    test_typed_lines();
+    test_parse_policy();
+    test_request_flush();
+
+    printf("--- All Output Sink Tests Passed ---\n");
+    return 0;
+}
@@ -0,0 +1,190 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "pipeline_server.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/* Fill a socket address; fails if the path does not fit */
+static const char* socket_address(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return "Socket path is too long";
+    }
+    strcpy(addr->sun_path, path);
+    return NULL;
+}
+
+const char* pipeline_server_listen(const char* path, int* fd) {
+    struct sockaddr_un addr;
+    const char* err = socket_address(path, &addr);
+    if (err) {
+        return err;
+    }
+
+    /* Only a leftover socket is replaced, never another kind of file */
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            return "Socket path exists and is not a socket";
+        }
+        unlink(path);
+    }
+
+    *fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (*fd == -1) {
+        return "Failed to create socket";
+    }
+    if (bind(*fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+        close(*fd);
+        return "Failed to bind socket";
+    }
+    if (listen(*fd, SOMAXCONN) == -1) {
+        close(*fd);
+        unlink(path);
+        return "Failed to listen on socket";
+    }
+    return NULL;
+}
+
+int pipeline_server_accept(int fd, const sigset_t* wait_mask) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    if (ppoll(&pfd, 1, NULL, wait_mask) == -1) {
+        return -1;
+    }
+    return accept4(fd, NULL, NULL, SOCK_CLOEXEC);
+}
+
+/* Write a whole buffer to a blocking descriptor */
+static int write_full(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* Connect, retrying while the server is still starting up */
+static const char* connect_retry(const char* path, int* fd) {
+    struct sockaddr_un addr;
+    const char* err = socket_address(path, &addr);
+    if (err) {
+        return err;
+    }
+
+    for (int waited = 0; ; waited += 10) {
+        *fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (*fd == -1) {
+            return "Failed to create socket";
+        }
+        if (connect(*fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            return NULL;
+        }
+        int retry = errno == ENOENT || errno == ECONNREFUSED;
+        close(*fd);
+        if (!retry || waited >= PIPELINE_CONNECT_RETRY_MS) {
+            return "Failed to connect to socket";
+        }
+        struct timespec pause = { 0, 10 * 1000000L };
+        nanosleep(&pause, NULL);
+    }
+}
+
+/*
+ * Input and output move at the same time: the server only reads more of a
+ * client's lines while its output is being taken, so a client that sent
+ * everything before reading would deadlock once the buffers filled up
+ */
+const char* pipeline_server_connect(const char* path, int in_fd, int out_fd) {
+    int fd;
+    const char* err = connect_retry(path, &fd);
+    if (err) {
+        return err;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    char* in = malloc(65536);
+    char* out = malloc(65536);
+    if (!in || !out) {
+        free(in);
+        free(out);
+        close(fd);
+        return "Failed to allocate memory for client buffers";
+    }
+    size_t in_len = 0;
+    size_t in_pos = 0;
+    int in_open = 1;
+
+    for (;;) {
+        struct pollfd pfds[2] = {
+            { fd, POLLIN | (in_pos < in_len ? POLLOUT : 0), 0 },
+            { in_fd, POLLIN, 0 },
+        };
+        int watch_in = in_open && in_pos == in_len;
+        if (poll(pfds, watch_in ? 2 : 1, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err = "Failed to wait for the socket";
+            break;
+        }
+
+        if (pfds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t n = read(fd, out, 65536);
+            if (n == 0) {
+                break;  /* The server is done with this client */
+            }
+            if (n > 0 && write_full(out_fd, out, (size_t)n) == -1) {
+                err = "Failed to write output";
+                break;
+            }
+            if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                err = "Failed to read from socket";
+                break;
+            }
+        }
+
+        if (in_pos < in_len && (pfds[0].revents & POLLOUT)) {
+            ssize_t n = send(fd, in + in_pos, in_len - in_pos, MSG_NOSIGNAL);
+            if (n > 0) {
+                in_pos += (size_t)n;
+            } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                /* The server stopped reading (e.g. at <END>); still take its output */
+                in_pos = in_len;
+                in_open = 0;
+            }
+        }
+
+        if (watch_in && (pfds[1].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = read(in_fd, in, 65536);
+            if (n > 0) {
+                in_len = (size_t)n;
+                in_pos = 0;
+            } else if (n == 0 || errno != EINTR) {
+                in_open = 0;
+                shutdown(fd, SHUT_WR);
+            }
+        }
+    }
+
+    free(in);
+    free(out);
+    close(fd);
+    return err;
+}
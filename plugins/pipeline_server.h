@@ -0,0 +1,39 @@
+/* */
+#ifndef PIPELINE_SERVER_H
+#define PIPELINE_SERVER_H
+
+#include <signal.h>
+
+/* How long a client keeps retrying a socket that is not listening yet */
+#define PIPELINE_CONNECT_RETRY_MS 2000
+
+/**
+ * Listen on a Unix domain socket, replacing a stale socket file at path
+ * @param path Socket path
+ * @param fd Receives the listening socket
+ * @return NULL on success, error message on failure
+ */
+const char* pipeline_server_listen(const char* path, int* fd); /* */
+
+/**
+ * Wait for the next client. Signals blocked in the caller's mask but not in
+ * wait_mask are taken while waiting, so a stop request does not arrive in
+ * the middle of a client.
+ * @param fd Listening socket
+ * @param wait_mask Signal mask while waiting
+ * @return Connected socket, or -1 if a signal or an error came first
+ */
+int pipeline_server_accept(int fd, const sigset_t* wait_mask); /* */
+
+/**
+ * Run a client: send everything read from in_fd to the server at path and
+ * write what comes back to out_fd until the server closes the connection.
+ * The write side is shut down at the end of in_fd.
+ * @param path Socket path
+ * @param in_fd Input to send
+ * @param out_fd Where the server's output goes
+ * @return NULL on success, error message on failure
+ */
+const char* pipeline_server_connect(const char* path, int in_fd, int out_fd); /* */
+
+#endif // PIPELINE_SERVER_H
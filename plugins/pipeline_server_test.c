@@ -0,0 +1,101 @@
+/* * Unit test application for pipeline_server.c
+ */
+#include "pipeline_server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#define SOCKET_PATH "/tmp/pipeline_server_test.sock"
+
+/* Serve one client: uppercase everything it sends, then close */
+void* serve_upper(void* arg) {
+    int listen_fd = *(int*)arg;
+    sigset_t mask;
+    pthread_sigmask(SIG_SETMASK, NULL, &mask);
+    int client = pipeline_server_accept(listen_fd, &mask);
+    assert(client != -1);
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(client, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            buf[i] = (char)toupper((unsigned char)buf[i]);
+        }
+        ssize_t written = write(client, buf, n);
+        assert(written == n);
+    }
+    close(client);
+    return NULL;
+}
+
+/* Write a large input to the client and close the pipe */
+void* feed_input(void* arg) {
+    int fd = *(int*)arg;
+    char line[64];
+    for (int i = 0; i < 100000; i++) {
+        int len = snprintf(line, sizeof(line), "line %d\n", i);
+        ssize_t written = write(fd, line, len);
+        assert(written == len);
+    }
+    close(fd);
+    return NULL;
+}
+
+void test_round_trip() {
+    printf("[TEST 1] Running: Client Streams In and Out at Once\n");
+    int listen_fd;
+    const char* err = pipeline_server_listen(SOCKET_PATH, &listen_fd);
+    assert(err == NULL);
+
+    /* A stale socket file is replaced, other files are left alone */
+    close(listen_fd);
+    err = pipeline_server_listen(SOCKET_PATH, &listen_fd);
+    assert(err == NULL);
+    int other_fd;
+    assert(pipeline_server_listen("/dev/null", &other_fd) != NULL);
+
+    int in_pipe[2];
+    int rc = pipe(in_pipe);
+    assert(rc == 0);
+    FILE* out = tmpfile();
+    assert(out);
+    pthread_t server, feeder;
+    pthread_create(&server, NULL, serve_upper, &listen_fd);
+    pthread_create(&feeder, NULL, feed_input, &in_pipe[1]);
+
+    /* Far more than the socket buffers hold: only works if both directions move */
+    err = pipeline_server_connect(SOCKET_PATH, in_pipe[0], fileno(out));
+    assert(err == NULL);
+    pthread_join(feeder, NULL);
+    pthread_join(server, NULL);
+    close(in_pipe[0]);
+
+    rewind(out);
+    char line[64];
+    int count = 0;
+    while (fgets(line, sizeof(line), out)) {
+        char expected[64];
+        snprintf(expected, sizeof(expected), "LINE %d\n", count++);
+        assert(strcmp(line, expected) == 0);
+    }
+    assert(count == 100000);
+    fclose(out);
+    close(listen_fd);
+    unlink(SOCKET_PATH);
+
+    /* Nobody listening: retries, then gives up */
+    assert(pipeline_server_connect(SOCKET_PATH "-missing", in_pipe[0], 1) != NULL);
+    printf("[TEST 1] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running Pipeline Server Unit Tests ---\n\n");
+
+    test_round_trip();
+
+    printf("--- All Pipeline Server Tests Passed ---\n");
+    return 0;
+}
@@ -2,10 +2,40 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <time.h>
 
-/* Global context for this plugin (.so file) */
+/* Default instance of this plugin (.so file), used by the global entry points */
 static plugin_context_t g_context;
 
+/* Instance plugin_init's common_plugin_init call sets up (see plugin_instance_init) */
+static plugin_context_t* g_init_target = &g_context;
+
+/* Instance whose transform is running on this thread (NULL: the default one) */
+static __thread plugin_context_t* t_current;
+
+/* Pipeline-wide pool in-flight buffers come from (NULL: malloc) */
+static buffer_pool_t* g_pool;
+
+/* The plugin's transforms, for plugin_instance_transform (optional exports) */
+extern const char* plugin_transform(const char* input) __attribute__((weak));
+extern void plugin_transform_inplace(char* str) __attribute__((weak));
+extern int plugin_uses_pool(void) __attribute__((weak));
+extern const char* plugin_transform_slice(const char* input, size_t len, size_t* out_len)
+    __attribute__((weak));
+extern void plugin_transform_inplace_slice(char* str, size_t len) __attribute__((weak));
+
+/* The slice ABI's control messages are the queue's control items */
+_Static_assert(PLUGIN_ITEM_END == (int)CP_ITEM_END && PLUGIN_ITEM_FLUSH == (int)CP_ITEM_FLUSH &&
+               PLUGIN_ITEM_BARRIER == (int)CP_ITEM_BARRIER &&
+               PLUGIN_CONTROL_LEN(PLUGIN_ITEM_END) == CP_CONTROL_LEN(CP_ITEM_END),
+               "control message encodings differ");
+
+/* Instance the calling thread prints for */
+static plugin_context_t* current_context(void) {
+    return t_current ? t_current : &g_context;
+}
+
 /* Write error message to stderr */
 void log_error(plugin_context_t* context, const char* message) {
     fprintf(stderr, "[ERROR] [%s] %s\n", context->name, message);
@@ -18,110 +48,1116 @@ void log_info(plugin_context_t* context, const char* message) {
     /* Disabled per assignment requirements */
 }
 
-/* Worker thread: processes items from queue */
-void* plugin_consumer_thread(void* arg) {
-    plugin_context_t* context = (plugin_context_t*)arg;
+/* Print through the sink if one is attached, otherwise to stdout */
+void plugin_output(const char* data, size_t len) {
+    plugin_context_t* context = current_context();
+    if (context->sink) {
+        output_sink_write(context->sink, context->sink_stage, data, len);
+        return;
+    }
+    fwrite(data, 1, len, stdout);
+    fflush(stdout);
+}
+
+/* Type a printout at the configured rate, through the sink if one is attached */
+void plugin_output_typed(const char* prefix, const char* text, size_t len) {
+    plugin_context_t* context = current_context();
+    int rate = context->type_rate_set ? context->type_rate : PLUGIN_DEFAULT_TYPE_RATE;
+    size_t prefix_len = strlen(prefix);
+    
+    if (rate == 0) {
+        /* No pacing: one ordinary printout */
+        char* line = malloc(prefix_len + len + 1);
+        if (!line) {
+            return;
+        }
+        memcpy(line, prefix, prefix_len);
+        memcpy(line + prefix_len, text, len);
+        line[prefix_len + len] = '\n';
+        plugin_output(line, prefix_len + len + 1);
+        free(line);
+        return;
+    }
+    
+    unsigned interval_us = 1000000u / (unsigned)rate;
+    if (context->sink) {
+        output_sink_write_typed(context->sink, context->sink_stage, prefix, text, len,
+                                interval_us);
+        return;
+    }
+    
+    fwrite(prefix, 1, prefix_len, stdout);
+    fflush(stdout);
+    for (size_t i = 0; i < len; i++) {
+        putchar(text[i]);
+        fflush(stdout);
+        usleep(interval_us);
+    }
+    putchar('\n');
+    fflush(stdout);
+}
+
+/* Allocate from the pool if one is attached */
+char* plugin_alloc(size_t size) {
+    return g_pool ? buffer_pool_alloc(g_pool, size) : malloc(size);
+}
+
+char* plugin_strdup(const char* str) {
+    return g_pool ? buffer_pool_strdup(g_pool, str) : strdup(str);
+}
+
+char* plugin_memdup(const char* data, size_t len) {
+    if (g_pool) {
+        return buffer_pool_memdup(g_pool, data, len);
+    }
+    char* copy = malloc(len + 1);
+    if (copy) {
+        memcpy(copy, data, len);
+        copy[len] = '\0';
+    }
+    return copy;
+}
+
+void plugin_free(void* ptr) {
+    if (g_pool) {
+        buffer_pool_free(ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+/* Share the input with the next stage; with malloc it has to be copied */
+char* plugin_retain(const char* input) {
+    return g_pool ? buffer_pool_retain((char*)input) : strdup(input);
+}
+
+char* plugin_retain_slice(const char* input, size_t len) {
+    return g_pool ? buffer_pool_retain((char*)input) : plugin_memdup(input, len);
+}
+
+/* Copy on write of an item of len bytes */
+static char* make_writable_slice(char* str, size_t len) {
+    if (!g_pool || !buffer_pool_shared(str)) {
+        return str;
+    }
+    char* copy = buffer_pool_memdup(g_pool, str, len);
+    if (copy) {
+        buffer_pool_free(str);
+    }
+    return copy;
+}
+
+/* Copy on write: only a shared pool buffer needs a copy */
+char* plugin_make_writable(char* str) {
+    return make_writable_slice(str, strlen(str));
+}
+
+/* Queue allocator: the pool, without going through a function pointer to it */
+static char* pool_copy(const char* str) {
+    return buffer_pool_strdup(g_pool, str);
+}
+
+/* Move a malloc'd result (of len bytes) of a plugin that does not use the pool into it */
+static const char* adopt_result(const char* output, size_t len) {
+    if (!output || !g_pool || (plugin_uses_pool && plugin_uses_pool())) {
+        return output;
+    }
+    char* copy = buffer_pool_memdup(g_pool, output, len);
+    free((char*)output);
+    return copy;
+}
+
+/* Monotonic time in nanoseconds, for transform latency */
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+/* Add to a counter only the calling worker writes */
+static void count_size(atomic_size_t* counter, size_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+static void count_call(atomic_ullong* bucket) {
+    atomic_store_explicit(bucket, atomic_load_explicit(bucket, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+}
+
+/* Send a control message downstream; a string-ABI stage gets its marker string */
+static void forward_control(plugin_context_t* context, plugin_item_kind_t kind) {
+    plugin_link_t* next = &context->next;
+    if (next->place_work_slices) {
+        char* item = NULL;
+        size_t len = PLUGIN_CONTROL_LEN(kind);
+        next->place_work_slices(next->target, &item, &len, 1);
+        return;
+    }
+    
+    /* Barriers have no string form and stop here */
+    const char* marker = plugin_marker_string(kind);
+    if (!marker) {
+        return;
+    }
+    if (next->place_work) {
+        next->place_work(next->target, marker);
+    } else if (context->next_place_work) {
+        context->next_place_work(marker);
+    }
+}
+
+/* Send processed strings to a next stage without the slice ABI, then release them */
+static void forward_strings(plugin_context_t* context, char** outputs, int count) {
+    if (count == 0) {
+        return;
+    }
+    
+    plugin_link_t* next = &context->next;
+    if (next->place_work_move) {
+        /* Hand the buffers over; the next plugin now owns them */
+        next->place_work_move(next->target, outputs, count);
+        return;
+    }
+    if (context->next_place_work_move) {
+        context->next_place_work_move(outputs, count);
+        return;
+    }
+    
+    if (next->place_work_many) {
+        /* One synchronization on the next queue for the whole batch */
+        next->place_work_many(next->target, (const char* const*)outputs, count);
+    } else if (next->place_work) {
+        for (int i = 0; i < count; i++) {
+            next->place_work(next->target, outputs[i]);
+        }
+    } else if (context->next_place_work_many) {
+        /* One synchronization on the next queue for the whole batch */
+        context->next_place_work_many((const char* const*)outputs, count);
+    } else if (context->next_place_work) {
+        for (int i = 0; i < count; i++) {
+            context->next_place_work(outputs[i]);
+        }
+    }
+    
+    for (int i = 0; i < count; i++) {
+        plugin_free(outputs[i]);
+    }
+}
+
+/* Send a batch of processed items, control messages included, downstream */
+static void forward_batch(plugin_context_t* context, char** outputs, size_t* lens, int count) {
+    plugin_link_t* next = &context->next;
+    int last = !next->place_work && !next->place_work_slices && !context->next_place_work;
+    int controls = 0;
+    for (int i = 0; i < count; i++) {
+        plugin_item_kind_t kind = plugin_item_kind(lens[i]);
+        controls += kind != PLUGIN_ITEM_DATA;
+        
+        /*
+         * A flush that leaves the last stage follows everything printed
+         * before it into the sink: write it out. Branches that end in a
+         * pipeline tail leave that to whoever waits on the tail.
+         */
+        if (kind == PLUGIN_ITEM_FLUSH && last && context->sink) {
+            output_sink_request_flush(context->sink);
+        }
+    }
+    
+
+    if (next->place_work_slices) {
+        /* Hand the buffers over with their lengths */
+        if (count > 0) {
+            next->place_work_slices(next->target, outputs, lens, count);
+        }
+        return;
+    }
+    if (controls == 0) {
+        forward_strings(context, outputs, count);
+        return;
+    }
+    
+    /* Runs of data between the control messages */
+    int start = 0;
+    for (int i = 0; i <= count; i++) {
+        if (i < count && plugin_item_kind(lens[i]) == PLUGIN_ITEM_DATA) {
+            continue;
+        }
+        forward_strings(context, outputs + start, i - start);
+        if (i < count) {
+            forward_control(context, plugin_item_kind(lens[i]));
+        }
+        start = i + 1;
+    }
+}
+
+/* Writable version of an owned buffer for an in-place transform, or NULL */
+static char* writable_input(char* str, size_t len) {
+    char* writable = make_writable_slice(str, len);
+    if (!writable) {
+        plugin_free(str);
+    }
+    return writable;
+}
+
+/*
+ * Run one transform step on an owned buffer of *len bytes; returns the
+ * (owned) result and stores its length in *len. A string transform's
+ * result is measured with strlen.
+ */
+static char* apply_one(const plugin_step_t* step, char* str, size_t* len) {
+    /* Length-preserving plugins reuse the buffer they received */
+    if (step->inplace_slice || step->inplace || step->legacy_inplace) {
+        str = writable_input(str, *len);
+        if (!str) {
+            return NULL;
+        }
+        if (step->inplace_slice) {
+            step->inplace_slice(step->target, str, *len);
+        } else if (step->inplace) {
+            step->inplace(step->target, str);
+        } else {
+            step->legacy_inplace(str);
+        }
+        return str;
+    }
+    
+    const char* output_str;
+    if (step->process_slice) {
+        output_str = step->process_slice(step->target, str, *len, len);
+    } else {
+        output_str = step->process ? step->process(step->target, str) : step->legacy_process(str);
+        *len = output_str ? strlen(output_str) : 0;
+    }
+    plugin_free(str);
+    return (char*)output_str;
+}
+
+/* Apply this stage's transform and every fused transform after it */
+static char* apply_transforms(plugin_context_t* context, char* input, size_t* len) {
+    char* str;
+    if (context->inplace_slice || context->inplace_function) {
+        str = writable_input(input, *len);
+        if (str && context->inplace_slice) {
+            context->inplace_slice(str, *len);
+        } else if (str) {
+            context->inplace_function(str);
+        }
+    } else {
+        const char* output_str;
+        if (context->process_slice) {
+            output_str = context->process_slice(input, *len, len);
+        } else {
+            output_str = context->process_function(input);
+            *len = output_str ? strlen(output_str) : 0;
+        }
+        str = (char*)adopt_result(output_str, *len);
+        plugin_free(input);
+    }
+    
+    for (int i = 0; str && i < context->fused_count; i++) {
+        str = apply_one(&context->fused[i], str, len);
+    }
+    return str;
+}
+
+/* Reorder buffer callback: results released in input order go downstream */
+static void emit_in_order(void* ctx, char** items, size_t* lens, int count) {
+    forward_batch((plugin_context_t*)ctx, items, lens, count);
+}
+
+/* Shut the stage down once <END> (sequence number end_seq) is reached */
+static void handle_end(plugin_context_t* context, size_t end_seq) {
+    if (context->num_workers > 1) {
+        /* Siblings may be parked on the queue; pass <END> on to wake them */
+        int first = !atomic_exchange(&context->end_seen, 1);
+        consumer_producer_put_control(context->queue, CP_ITEM_END);
+        if (!first) {
+            return;
+        }
+        
+        /* Everything queued before <END> must be forwarded before it */
+        reorder_buffer_wait_released(&context->reorder, end_seq);
+    }
+    
+    /* Signal finished BEFORE forwarding <END> to avoid deadlock */
+    consumer_producer_signal_finished(context->queue);
+    
+    /* Forward <END> to next plugin if it exists */
+    forward_control(context, PLUGIN_ITEM_END);
+}
+
+/*
+ * Transform and forward count items the worker took from the queue, the
+ * first with sequence number first_seq; returns 0 once <END> was among them
+ */
+static int process_batch(plugin_worker_t* worker, int count, size_t first_seq) {
+    plugin_context_t* context = worker->context;
+    char** inputs = worker->inputs;
+    size_t* input_lens = worker->input_lens;
+    char** outputs = worker->outputs;
+    size_t* output_lens = worker->output_lens;
+    int parallel = context->num_workers > 1;
     
-    while (1) {
-        /* Get next item from queue (blocks if empty) */
-        char* input_str = consumer_producer_get(context->queue);
+    int produced = 0;
+    int forwarded = 0;
+    int end_at = -1;
+    size_t data_in = 0;
+    size_t bytes_in = 0;
+    size_t bytes_out = 0;
+    
+    for (int i = 0; i < count; i++) {
+        size_t len = input_lens[i];
+        plugin_item_kind_t kind = plugin_item_kind(len);
         
         /* Check if this is the shutdown signal */
-        if (strcmp(input_str, "<END>") == 0) {
-            /* Signal finished BEFORE forwarding <END> to avoid deadlock */
-            consumer_producer_signal_finished(context->queue);
-            
-            /* Forward <END> to next plugin if it exists */
-            if (context->next_place_work) {
-                context->next_place_work(input_str);
-            }
-            
-            free(input_str);
+        if (kind == PLUGIN_ITEM_END) {
+            end_at = i;
             break;
         }
         
-        /* Apply plugin-specific transformation */
-        const char* output_str = context->process_function(input_str);
-        free(input_str);
+        /* Flush and barrier messages go downstream untouched, in line with the data */
+        if (kind != PLUGIN_ITEM_DATA) {
+            output_lens[produced] = len;
+            outputs[produced++] = NULL;
+            continue;
+        }
+        data_in++;
         
-        if (context->next_place_work) {
-            /* Send to next plugin in chain */
-            context->next_place_work(output_str);
-            free((void*)output_str);
+        /* Apply plugin-specific (and fused) transformations */
+        char* output_str;
+        if (context->metrics) {
+            bytes_in += len;
+            unsigned long long start = now_ns();
+            output_str = apply_transforms(context, inputs[i], &len);
+            count_call(&worker->latency[stage_metrics_bucket(now_ns() - start)]);
+            bytes_out += output_str ? len : 0;
         } else {
-            /* Last plugin - free the output */
-            free((void*)output_str);
+            output_str = apply_transforms(context, inputs[i], &len);
+        }
+        if (!output_str) {
+            log_error(context, "Transformation failed, dropping item");
+            len = 0;
+        } else {
+            forwarded++;
+        }
+        
+        if (parallel || output_str) {
+            /* In parallel keep the slot (even if NULL) so sequence numbers line up */
+            output_lens[produced] = len;
+            outputs[produced++] = output_str;
+        }
+    }
+    
+    count_size(&worker->items_in, data_in);
+    count_size(&worker->items_out, (size_t)forwarded);
+    count_size(&worker->bytes_in, bytes_in);
+    count_size(&worker->bytes_out, bytes_out);
+    
+    /* Everything queued before <END> goes out first */
+    if (parallel) {
+        reorder_buffer_put(&context->reorder, first_seq, outputs, output_lens, produced,
+                           emit_in_order, context);
+    } else {
+        forward_batch(context, outputs, output_lens, produced);
+    }
+    
+    if (end_at >= 0) {
+        handle_end(context, first_seq + end_at);
+        
+        /* Nothing may follow <END>; drop any stray items */
+        for (int j = end_at; j < count; j++) {
+            plugin_free(inputs[j]);
         }
+        return 0;
+    }
+    return 1;
+}
+
+/* Worker thread: processes items from queue */
+void* plugin_consumer_thread(void* arg) {
+    plugin_worker_t* worker = (plugin_worker_t*)arg;
+    plugin_context_t* context = worker->context;
+    int running = 1;
+    
+    /* Printouts of this thread's transforms belong to this instance */
+    t_current = context;
+    
+    while (running) {
+        /* Drain everything available, up to batch_size (blocks if empty) */
+        size_t first_seq;
+        int count = consumer_producer_get_slices(context->queue, worker->inputs,
+                                                 worker->input_lens, context->batch_size,
+                                                 &first_seq);
+        running = process_batch(worker, count, first_seq);
     }
     
     return NULL;
 }
 
+/* Executor task: one batch per run, so the stages sharing a thread take turns */
+void plugin_stage_task(void* arg) {
+    plugin_context_t* context = (plugin_context_t*)arg;
+    plugin_worker_t* worker = &context->workers[0];
+    
+    /* The thread may be running another stage's task further up its stack */
+    plugin_context_t* saved = t_current;
+    t_current = context;
+    size_t first_seq;
+    int count = consumer_producer_try_get_slices(context->queue, worker->inputs,
+                                                 worker->input_lens, context->batch_size,
+                                                 &first_seq);
+    if (count > 0 && process_batch(worker, count, first_seq) && count == context->batch_size) {
+        /* More may be queued without a put left to announce it */
+        executor_notify(&context->task);
+    }
+    t_current = saved;
+}
+
+/*
+ * Queue full: run the stage on the producer's thread if it is waiting for
+ * one. The items put so far are announced first; the put that brings
+ * them only wakes the stage once it returns.
+ */
+static int help_stage(void* arg) {
+    plugin_context_t* context = (plugin_context_t*)arg;
+    executor_notify(&context->task);
+    return executor_help(&context->task);
+}
+
+/* Have a scheduled stage run after items were put into its queue */
+static void wake_stage(plugin_context_t* context) {
+    if (context->scheduled) {
+        executor_notify(&context->task);
+    }
+}
+
+/* Free everything common_plugin_init allocated */
+static void release_stage(plugin_context_t* context) {
+    if (context->queue) {
+        consumer_producer_destroy(context->queue);
+        free(context->queue);
+        context->queue = NULL;
+    }
+    if (context->num_workers > 1) {
+        reorder_buffer_destroy(&context->reorder);
+    }
+    if (context->workers) {
+        for (int i = 0; i < context->num_workers; i++) {
+            free(context->workers[i].inputs);
+            free(context->workers[i].input_lens);
+            free(context->workers[i].outputs);
+            free(context->workers[i].output_lens);
+        }
+        free(context->workers);
+        context->workers = NULL;
+    }
+}
+
 /* Initialize plugin with transformation function and queue size */
 const char* common_plugin_init(const char* (*process_function)(const char*),
                               const char* name, int queue_size) {
+    return common_plugin_init_inplace(process_function, NULL, name, queue_size);
+}
+
+/* Initialize plugin that can also transform buffers in place */
+const char* common_plugin_init_inplace(const char* (*process_function)(const char*),
+                                       void (*inplace_function)(char*),
+                                       const char* name, int queue_size) {
+    plugin_context_t* context = g_init_target;
     
     /* Set up context */
-    g_context.name = name;
-    g_context.process_function = process_function;
-    g_context.next_place_work = NULL;
-    g_context.initialized = 0;
-    g_context.finished = 0;
-    
-    /* Create queue */
-    g_context.queue = malloc(sizeof(consumer_producer_t));
-    if (!g_context.queue) {
+    context->name = name;
+    context->process_function = process_function;
+    context->inplace_function = inplace_function;
+    
+    /* The slice forms stand in for the plugin's own exported transforms only */
+    context->process_slice = process_function == plugin_transform ? plugin_transform_slice : NULL;
+    context->inplace_slice = inplace_function && inplace_function == plugin_transform_inplace
+        ? plugin_transform_inplace_slice : NULL;
+    memset(&context->next, 0, sizeof(context->next));
+    context->next_place_work = NULL;
+    context->next_place_work_many = NULL;
+    context->next_place_work_move = NULL;
+    context->initialized = 0;
+    context->finished = 0;
+    context->queue = NULL;
+    context->scheduled = 0;
+    atomic_init(&context->end_seen, 0);
+    if (context->batch_size <= 0) {
+        context->batch_size = PLUGIN_DEFAULT_BATCH;
+    }
+    if (context->num_workers <= 0) {
+        context->num_workers = 1;
+    }
+    
+    /* Inline the caller runs the transforms; nothing is drained or forwarded */
+    if (context->direct) {
+        context->num_workers = 1;
+        context->workers = NULL;
+        context->initialized = 1;
+        return NULL;
+    }
+    
+    /* Per-worker scratch arrays used to drain and forward batches */
+    /* Cache-line aligned so each worker's counters stay on its own lines */
+    context->workers = aligned_alloc(CP_CACHE_LINE,
+                                     sizeof(plugin_worker_t) * context->num_workers);
+    if (!context->workers) {
+        return "Failed to allocate memory for workers";
+    }
+    memset(context->workers, 0, sizeof(plugin_worker_t) * context->num_workers);
+    for (int i = 0; i < context->num_workers; i++) {
+        context->workers[i].context = context;
+        context->workers[i].inputs = malloc(sizeof(char*) * context->batch_size);
+        context->workers[i].input_lens = malloc(sizeof(size_t) * context->batch_size);
+        context->workers[i].outputs = malloc(sizeof(char*) * context->batch_size);
+        context->workers[i].output_lens = malloc(sizeof(size_t) * context->batch_size);
+        if (!context->workers[i].inputs || !context->workers[i].outputs ||
+            !context->workers[i].input_lens || !context->workers[i].output_lens) {
+            context->num_workers = i + 1;
+            release_stage(context);
+            return "Failed to allocate memory for batch buffers";
+        }
+    }
+    
+    /* Workers can finish out of order; results are put back in order here */
+    if (context->num_workers > 1) {
+        size_t window = (size_t)context->num_workers * context->batch_size * 2;
+        const char* err = reorder_buffer_init(&context->reorder, window);
+        if (err) {
+            int workers = context->num_workers;
+            context->num_workers = 1;
+            release_stage(context);
+            context->num_workers = workers;
+            return err;
+        }
+    }
+    
+    /* Create queue (cache-line aligned for the SPSC indices) */
+    context->queue = aligned_alloc(CP_CACHE_LINE, sizeof(consumer_producer_t));
+    if (!context->queue) {
+        release_stage(context);
         return "Failed to allocate memory for queue";
     }
     
-    const char* err = consumer_producer_init(g_context.queue, queue_size);
+    /*
+     * In a linear chain the queue has a single producer (the previous
+     * stage's thread, or main for the first stage). With a single worker
+     * it also has a single consumer, so the lock-free ring is safe there.
+     * A stage behind a fan-in is fed by several threads and needs the lock.
+     */
+    int producers = context->num_producers > 0 ? context->num_producers : 1;
+    const char* err = consumer_producer_init_mode(context->queue, queue_size,
+                                                  consumer_producer_mode_for(producers,
+                                                                             context->num_workers));
     if (err) {
-        free(g_context.queue);
+        free(context->queue);
+        context->queue = NULL;
+        release_stage(context);
         return err;
     }
+    if (g_pool) {
+        consumer_producer_set_allocator(context->queue, pool_copy, buffer_pool_free);
+    }
+    consumer_producer_set_wait(context->queue, &context->wait);
+    err = consumer_producer_reserve(context->queue, context->queue_max);
+    if (err) {
+        consumer_producer_destroy(context->queue);
+        free(context->queue);
+        context->queue = NULL;
+        release_stage(context);
+        return err;
+    }
+    
+    /*
+     * On a pool the stage runs whenever items arrive; a producer that
+     * finds its queue full runs it rather than wait for a pool thread
+     */
+    if (context->executor && context->num_workers == 1 && context->num_cpus == 0) {
+        err = executor_task_init(context->executor, &context->task, plugin_stage_task, context);
+        if (err) {
+            release_stage(context);
+            return err;
+        }
+        consumer_producer_set_help(context->queue, help_stage, context);
+        context->scheduled = 1;
+        context->initialized = 1;
+        return NULL;
+    }
     
-    /* Create worker thread */
-    if (pthread_create(&g_context.consumer_thread, NULL, 
-                      plugin_consumer_thread, &g_context) != 0) {
-        consumer_producer_destroy(g_context.queue);
-        free(g_context.queue);
-        return "Failed to create worker thread";
+    /* Create worker threads, each starting on its CPU if pinned */
+    for (int i = 0; i < context->num_workers; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (context->num_cpus > 0) {
+            cpu_attr_pin(&attr, context->cpus[i % context->num_cpus]);
+        }
+        int failed = pthread_create(&context->workers[i].thread, &attr,
+                                    plugin_consumer_thread, &context->workers[i]);
+        pthread_attr_destroy(&attr);
+        if (failed) {
+            /* Stop the workers already running; nothing is attached yet */
+            if (i > 0) {
+                consumer_producer_put_control(context->queue, CP_ITEM_END);
+                for (int j = 0; j < i; j++) {
+                    pthread_join(context->workers[j].thread, NULL);
+                }
+            }
+            release_stage(context);
+            return "Failed to create worker thread";
+        }
     }
     
-    g_context.initialized = 1;
+    context->initialized = 1;
     return NULL;
 }
 
-/* ===== Plugin Interface Functions ===== */
+/* ===== Instance Interface Functions ===== */
 
-/* Return plugin name */
+/* Allocate an instance; it is set up by plugin_instance_init */
 __attribute__((visibility("default")))
-const char* plugin_get_name(void) {
-    return g_context.name;
+void* plugin_create(void) {
+    return calloc(1, sizeof(plugin_context_t));
 }
 
-/* Cleanup: wait for thread and free resources */
+/* Finalize (if still running) and free an instance */
 __attribute__((visibility("default")))
-const char* plugin_fini(void) {
-    if (!g_context.initialized) {
+void plugin_destroy(void* instance) {
+    if (!instance || instance == &g_context) {
+        return;
+    }
+    plugin_instance_fini(instance);
+    free(instance);
+}
+
+/* Run the plugin's own plugin_init against an instance */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(void* instance, int queue_size) {
+    /* Called from main's thread only, one stage at a time */
+    g_init_target = (plugin_context_t*)instance;
+    const char* err = plugin_init(queue_size);
+    g_init_target = &g_context;
+    return err;
+}
+
+/* Return the instance's plugin name */
+__attribute__((visibility("default")))
+const char* plugin_instance_get_name(void* instance) {
+    return ((plugin_context_t*)instance)->name;
+}
+
+/* Cleanup: wait for threads and free resources */
+__attribute__((visibility("default")))
+const char* plugin_instance_fini(void* instance) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (!context->initialized) {
         return NULL;
     }
     
-    pthread_join(g_context.consumer_thread, NULL);
-    consumer_producer_destroy(g_context.queue);
-    free(g_context.queue);
+    int threads = context->scheduled || context->direct ? 0 : context->num_workers;
+    for (int i = 0; i < threads; i++) {
+        pthread_join(context->workers[i].thread, NULL);
+    }
+    release_stage(context);
     
-    g_context.initialized = 0;
+    context->initialized = 0;
     return NULL;
 }
 
-/* Add work to plugin's queue */
+/* Add work to the instance's queue */
 __attribute__((visibility("default")))
-const char* plugin_place_work(const char* str) {
-    if (!g_context.initialized) {
+const char* plugin_instance_place_work(void* instance, const char* str) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (!context->initialized) {
+        return "Plugin not initialized";
+    }
+    plugin_item_kind_t kind = plugin_marker_kind(str);
+    const char* err = NULL;
+    if (kind != PLUGIN_ITEM_DATA) {
+        consumer_producer_put_control(context->queue, (cp_item_kind_t)kind);
+    } else {
+        err = consumer_producer_put(context->queue, str);
+    }
+    wake_stage(context);
+    return err;
+}
+
+/* Add a batch of work to the instance's queue */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_many(void* instance, const char* const* items,
+                                            int count) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (!context->initialized) {
+        return "Plugin not initialized";
+    }
+    
+    /* Runs of data between marker strings */
+    int start = 0;
+    for (int i = 0; i <= count; i++) {
+        plugin_item_kind_t kind = i < count ? plugin_marker_kind(items[i]) : PLUGIN_ITEM_DATA;
+        if (i < count && kind == PLUGIN_ITEM_DATA) {
+            continue;
+        }
+        if (i > start) {
+            const char* err = consumer_producer_put_many(context->queue, items + start, i - start);
+            if (err) {
+                wake_stage(context);
+                return err;
+            }
+        }
+        if (i < count) {
+            consumer_producer_put_control(context->queue, (cp_item_kind_t)kind);
+        }
+        start = i + 1;
+    }
+    wake_stage(context);
+    return NULL;
+}
+
+/* Move already-allocated work into the instance's queue */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_move(void* instance, char* const* items, int count) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (!context->initialized) {
+        for (int i = 0; i < count; i++) {
+            plugin_free(items[i]);
+        }
+        return "Plugin not initialized";
+    }
+    
+    int start = 0;
+    for (int i = 0; i <= count; i++) {
+        plugin_item_kind_t kind = i < count ? plugin_marker_kind(items[i]) : PLUGIN_ITEM_DATA;
+        if (i < count && kind == PLUGIN_ITEM_DATA) {
+            continue;
+        }
+        consumer_producer_put_owned_many(context->queue, items + start, i - start);
+        if (i < count) {
+            plugin_free(items[i]);
+            consumer_producer_put_control(context->queue, (cp_item_kind_t)kind);
+        }
+        start = i + 1;
+    }
+    wake_stage(context);
+    return NULL;
+}
+
+/* Move already-allocated work into the instance's queue with its lengths */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_slices(void* instance, char* const* items,
+                                              const size_t* lens, int count) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (!context->initialized) {
+        for (int i = 0; i < count; i++) {
+            plugin_free(items[i]);
+        }
+        return "Plugin not initialized";
+    }
+    consumer_producer_put_slices(context->queue, items, lens, count);
+    wake_stage(context);
+    return NULL;
+}
+
+/* Connect the instance to the next stage */
+__attribute__((visibility("default")))
+void plugin_instance_attach(void* instance, const plugin_link_t* next) {
+    ((plugin_context_t*)instance)->next = *next;
+}
+
+/* Run the plugin's transform with printouts going to `instance` */
+__attribute__((visibility("default")))
+const char* plugin_instance_transform(void* instance, const char* input) {
+    plugin_context_t* saved = t_current;
+    t_current = (plugin_context_t*)instance;
+    const char* output = plugin_transform(input);
+    output = adopt_result(output, output ? strlen(output) : 0);
+    t_current = saved;
+    return output;
+}
+
+/* In-place counterpart of plugin_instance_transform */
+__attribute__((visibility("default")))
+void plugin_instance_transform_inplace(void* instance, char* str) {
+    plugin_context_t* saved = t_current;
+    t_current = (plugin_context_t*)instance;
+    plugin_transform_inplace(str);
+    t_current = saved;
+}
+
+/* Slice counterpart of plugin_instance_transform */
+__attribute__((visibility("default")))
+const char* plugin_instance_transform_slice(void* instance, const char* input, size_t len,
+                                            size_t* out_len) {
+    plugin_context_t* saved = t_current;
+    t_current = (plugin_context_t*)instance;
+    const char* output = plugin_transform_slice(input, len, out_len);
+    output = adopt_result(output, *out_len);
+    t_current = saved;
+    return output;
+}
+
+/* Slice counterpart of plugin_instance_transform_inplace */
+__attribute__((visibility("default")))
+void plugin_instance_transform_inplace_slice(void* instance, char* str, size_t len) {
+    plugin_context_t* saved = t_current;
+    t_current = (plugin_context_t*)instance;
+    plugin_transform_inplace_slice(str, len);
+    t_current = saved;
+}
+
+/* Run the stage's transforms on an owned item on the calling thread (inline) */
+__attribute__((visibility("default")))
+char* plugin_instance_process_slice(void* instance, char* item, size_t len, size_t* out_len) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    plugin_context_t* saved = t_current;
+    t_current = context;
+    char* output = apply_transforms(context, item, &len);
+    t_current = saved;
+    if (!output) {
+        log_error(context, "Transformation failed, dropping item");
+        len = 0;
+    }
+    *out_len = len;
+    return output;
+}
+
+/* Add a step to the instance's fused transforms (only before init) */
+static const char* add_fused(plugin_context_t* context, const plugin_step_t* step) {
+    if (context->initialized) {
+        return "Plugins must be fused before plugin_init";
+    }
+    if (!step->process && !step->legacy_process && !step->process_slice) {
+        return "Fused plugin has no transform";
+    }
+    if (context->fused_count == PLUGIN_MAX_FUSED) {
+        return "Too many fused plugins";
+    }
+    
+    context->fused[context->fused_count++] = *step;
+    return NULL;
+}
+
+/* Run another instance's transform inside this instance's stage */
+__attribute__((visibility("default")))
+const char* plugin_instance_fuse(void* instance, void* fused,
+                                 const char* (*process_function)(void*, const char*),
+                                 void (*inplace_function)(void*, char*)) {
+    plugin_step_t step = { fused, process_function, inplace_function, NULL, NULL, NULL, NULL };
+    return add_fused((plugin_context_t*)instance, &step);
+}
+
+/* Same, with the fused instance's length-carrying transforms */
+__attribute__((visibility("default")))
+const char* plugin_instance_fuse_slices(void* instance, void* fused,
+                                        const char* (*process_function)(void*, const char*),
+                                        void (*inplace_function)(void*, char*),
+                                        const char* (*process_slice)(void*, const char*, size_t,
+                                                                     size_t*),
+                                        void (*inplace_slice)(void*, char*, size_t)) {
+    plugin_step_t step = { fused, process_function, inplace_function, process_slice,
+                           inplace_slice, NULL, NULL };
+    return add_fused((plugin_context_t*)instance, &step);
+}
+
+/* Route the instance's printouts through the output sink (only before init) */
+__attribute__((visibility("default")))
+void plugin_instance_attach_output(void* instance, output_sink_t* sink, int stage) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (context->initialized) {
+        return;
+    }
+    context->sink = sink;
+    context->sink_stage = stage;
+}
+
+/* Run the instance's stage on a shared pool (only before init) */
+__attribute__((visibility("default")))
+void plugin_instance_attach_executor(void* instance, executor_t* executor) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (context->initialized) {
+        return;
+    }
+    context->executor = executor;
+}
+
+/* Set a tuning option (only before init) */
+__attribute__((visibility("default")))
+const char* plugin_instance_set_option(void* instance, const char* key, const char* value) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (context->initialized) {
+        return "Options must be set before plugin_init";
+    }
+    
+    if (strcmp(key, "batch") == 0) {
+        int batch = atoi(value);
+        if (batch <= 0) {
+            return "batch must be a positive integer";
+        }
+        context->batch_size = batch;
+        return NULL;
+    }
+    
+    if (strcmp(key, "workers") == 0) {
+        int workers = atoi(value);
+        if (workers <= 0) {
+            return "workers must be a positive integer";
+        }
+        context->num_workers = workers;
+        return NULL;
+    }
+    
+    if (strcmp(key, "wait") == 0) {
+        return consumer_producer_parse_wait(value, &context->wait);
+    }
+    
+    if (strcmp(key, "queue_max") == 0) {
+        int max = atoi(value);
+        if (max <= 0) {
+            return "queue_max must be a positive integer";
+        }
+        context->queue_max = max;
+        return NULL;
+    }
+    
+    if (strcmp(key, "producers") == 0) {
+        int producers = atoi(value);
+        if (producers <= 0) {
+            return "producers must be a positive integer";
+        }
+        context->num_producers = producers;
+        return NULL;
+    }
+    
+    if (strcmp(key, "cpus") == 0) {
+        int count;
+        const char* err = cpu_list_parse(value, context->cpus, PLUGIN_MAX_CPUS, &count);
+        if (err) {
+            return err;
+        }
+        context->num_cpus = count;
+        return NULL;
+    }
+    
+    if (strcmp(key, "metrics") == 0) {
+        context->metrics = strcmp(value, "0") != 0;
+        return NULL;
+    }
+    
+    if (strcmp(key, "inline") == 0) {
+        context->direct = strcmp(value, "0") != 0;
+        return NULL;
+    }
+    
+    if (strcmp(key, "type_rate") == 0) {
+        int rate = atoi(value);
+        if (rate < 0 || (rate == 0 && strcmp(value, "0") != 0)) {
+            return "type_rate must be a non-negative integer";
+        }
+        context->type_rate = rate;
+        context->type_rate_set = 1;
+        return NULL;
+    }
+    
+    return "Unknown option";
+}
+
+/* Wait for the instance to finish processing */
+__attribute__((visibility("default")))
+const char* plugin_instance_wait_finished(void* instance) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (!context->initialized) {
+        return "Plugin not initialized";
+    }
+    
+    if (!context->direct) {
+        consumer_producer_wait_finished(context->queue);
+    }
+    context->finished = 1;
+    return NULL;
+}
+
+/* Sum the workers' counters and add the queue's */
+__attribute__((visibility("default")))
+const char* plugin_instance_get_metrics(void* instance, stage_metrics_t* metrics) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (!context->initialized) {
+        return "Plugin not initialized";
+    }
+    
+    memset(metrics, 0, sizeof(*metrics));
+    /* Inline there are no workers or queue to count: report zeros */
+    if (!context->workers) {
+        return NULL;
+    }
+    for (int i = 0; i < context->num_workers; i++) {
+        plugin_worker_t* worker = &context->workers[i];
+        metrics->items_in += atomic_load_explicit(&worker->items_in, memory_order_relaxed);
+        metrics->items_out += atomic_load_explicit(&worker->items_out, memory_order_relaxed);
+        metrics->bytes_in += atomic_load_explicit(&worker->bytes_in, memory_order_relaxed);
+        metrics->bytes_out += atomic_load_explicit(&worker->bytes_out, memory_order_relaxed);
+        for (int b = 0; b < STAGE_LATENCY_BUCKETS; b++) {
+            metrics->latency[b] += atomic_load_explicit(&worker->latency[b], memory_order_relaxed);
+        }
+    }
+    
+    queue_stats_t stats;
+    consumer_producer_get_stats(context->queue, &stats);
+    metrics->queue_capacity = stats.capacity;
+    metrics->queue_depth = stats.depth;
+    metrics->queue_high_water = stats.high_water;
+    metrics->put_blocked_ns = stats.put_blocked_ns;
+    metrics->get_blocked_ns = stats.get_blocked_ns;
+    for (int i = 0; i < STAGE_WAIT_PHASES; i++) {
+        metrics->put_waits[i] = stats.put_waits[i];
+        metrics->get_waits[i] = stats.get_waits[i];
+    }
+    return NULL;
+}
+
+/* Change the queue's capacity while the stage runs */
+__attribute__((visibility("default")))
+const char* plugin_instance_resize_queue(void* instance, int capacity) {
+    plugin_context_t* context = (plugin_context_t*)instance;
+    if (!context->initialized) {
         return "Plugin not initialized";
     }
-    return consumer_producer_put(g_context.queue, str);
+    if (!context->queue) {
+        return "Plugin has no queue";
+    }
+    return consumer_producer_resize(context->queue, capacity);
+}
+
+/* ===== Plugin Interface Functions (default instance) ===== */
+
+/* Return plugin name */
+__attribute__((visibility("default")))
+const char* plugin_get_name(void) {
+    return g_context.name;
+}
+
+/* Cleanup: wait for thread and free resources */
+__attribute__((visibility("default")))
+const char* plugin_fini(void) {
+    return plugin_instance_fini(&g_context);
+}
+
+/* Add work to plugin's queue */
+__attribute__((visibility("default")))
+const char* plugin_place_work(const char* str) {
+    return plugin_instance_place_work(&g_context, str);
+}
+
+/* Add a batch of work to plugin's queue */
+__attribute__((visibility("default")))
+const char* plugin_place_work_many(const char* const* items, int count) {
+    return plugin_instance_place_work_many(&g_context, items, count);
+}
+
+/* Move already-allocated work into plugin's queue */
+__attribute__((visibility("default")))
+const char* plugin_place_work_move(char* const* items, int count) {
+    return plugin_instance_place_work_move(&g_context, items, count);
 }
 
 /* Connect to next plugin in chain */
@@ -130,14 +1166,58 @@ void plugin_attach(const char* (*next_place_work)(const char*)) {
     g_context.next_place_work = next_place_work;
 }
 
+/* Connect to next plugin's batched entry point */
+__attribute__((visibility("default")))
+void plugin_attach_many(const char* (*next_place_work_many)(const char* const*, int)) {
+    g_context.next_place_work_many = next_place_work_many;
+}
+
+/* Connect to next plugin's ownership-taking entry point */
+__attribute__((visibility("default")))
+void plugin_attach_move(const char* (*next_place_work_move)(char* const*, int)) {
+    g_context.next_place_work_move = next_place_work_move;
+}
+
+/* Run a downstream plugin's transform inside this stage (only before plugin_init) */
+__attribute__((visibility("default")))
+const char* plugin_fuse(const char* (*process_function)(const char*),
+                        void (*inplace_function)(char*)) {
+    plugin_step_t step = { NULL, NULL, NULL, NULL, NULL, process_function, inplace_function };
+    return add_fused(&g_context, &step);
+}
+
+/* Route printouts through the pipeline's output sink (only before plugin_init) */
+__attribute__((visibility("default")))
+void plugin_attach_output(output_sink_t* sink, int stage) {
+    plugin_instance_attach_output(&g_context, sink, stage);
+}
+
+/* Take in-flight buffers from the pipeline's pool (only before the first init) */
+__attribute__((visibility("default")))
+void plugin_attach_pool(buffer_pool_t* pool) {
+    g_pool = pool;
+}
+
+/* Set a tuning option (only before plugin_init) */
+__attribute__((visibility("default")))
+const char* plugin_set_option(const char* key, const char* value) {
+    return plugin_instance_set_option(&g_context, key, value);
+}
+
+/* Read the plugin's runtime counters */
+__attribute__((visibility("default")))
+const char* plugin_get_metrics(stage_metrics_t* metrics) {
+    return plugin_instance_get_metrics(&g_context, metrics);
+}
+
+/* Change the queue's capacity while the plugin runs */
+__attribute__((visibility("default")))
+const char* plugin_resize_queue(int capacity) {
+    return plugin_instance_resize_queue(&g_context, capacity);
+}
+
 /* Wait for plugin to finish processing */
 __attribute__((visibility("default")))
 const char* plugin_wait_finished(void) {
-    if (!g_context.initialized) {
-        return "Plugin not initialized";
-    }
-    
-    consumer_producer_wait_finished(g_context.queue);
-    g_context.finished = 1;
-    return NULL;
-}
\ No newline at end of file
+    return plugin_instance_wait_finished(&g_context);
+}
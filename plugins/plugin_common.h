@@ -3,8 +3,15 @@
 #define PLUGIN_COMMON_H
 
 #include "plugin_sdk.h"
+#include "buffer_pool.h"
+#include "cpu_topology.h"
+#include "output_sink.h"
+#include "stage_metrics.h"
 #include "sync/consumer_producer.h"
+#include "sync/executor.h"
+#include "sync/reorder_buffer.h"
 #include <pthread.h>
+#include <stdatomic.h>
 
 /* For strdup */
 #ifndef _GNU_SOURCE
@@ -15,21 +22,167 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/* Default maximum number of items a worker drains and forwards at once */
+#define PLUGIN_DEFAULT_BATCH 64
+
+/* Characters per second of typed printouts (see plugin_output_typed) */
+#define PLUGIN_DEFAULT_TYPE_RATE 10
+
+/* Maximum number of other plugins' transforms one stage can run (fusion) */
+#define PLUGIN_MAX_FUSED 64
+
+/* Maximum number of CPUs a stage's workers can be pinned to */
+#define PLUGIN_MAX_CPUS 64
+
 /**
- * Plugin context structure
+ * Mark a plugin whose plugin_transform keeps no state between calls and is
+ * cheap enough to run inside another stage's thread, so --fuse may run it
+ * in a neighbouring stage (see plugin_fuse)
+ */
+#define PLUGIN_DECLARE_STATELESS() \
+    __attribute__((visibility("default"))) int plugin_is_stateless(void) { return 1; }
+
+/**
+ * Mark a plugin whose transform has no side effects besides its result, so
+ * several worker threads may run it at once and results may finish out of
+ * order (see the "workers" option, name@N)
+ */
+#define PLUGIN_DECLARE_PURE() \
+    __attribute__((visibility("default"))) int plugin_is_pure(void) { return 1; }
+
+/**
+ * Mark a plugin whose plugin_transform allocates its results with
+ * plugin_alloc/plugin_strdup, so a pipeline buffer pool takes them as they
+ * are. Results of other plugins are copied into the pool when one is attached.
+ */
+#define PLUGIN_DECLARE_POOLED() \
+    __attribute__((visibility("default"))) int plugin_uses_pool(void) { return 1; }
+
+struct plugin_context;
+
+/**
+ * One transform run by a stage: its own, or one fused into it. Instance
+ * steps are called with their target; global-ABI steps directly. The slice
+ * forms are preferred when present.
+ */
+typedef struct /* */
+{
+    void* target;                                   /* Fused instance, or NULL */
+    const char* (*process) (void*, const char*);    /* Instance transform */
+    void (*inplace) (void*, char*);                 /* Instance in-place transform (optional) */
+    const char* (*process_slice) (void*, const char*, size_t, size_t*); /* (optional) */
+    void (*inplace_slice) (void*, char*, size_t);   /* (optional) */
+    const char* (*legacy_process) (const char*);    /* Global-ABI transform */
+    void (*legacy_inplace) (char*);                 /* Global-ABI in-place transform (optional) */
+} plugin_step_t; /* */
+
+/**
+ * Per-thread state of one stage worker
  */
 typedef struct /* */
+{
+    struct plugin_context* context; /* Stage this worker belongs to */
+    pthread_t thread;               /* */
+    char** inputs;                  /* Items taken from the queue */
+    size_t* input_lens;             /* Their lengths */
+    char** outputs;                 /* Transformed items awaiting forwarding */
+    size_t* output_lens;            /* Their lengths */
+    
+    /*
+     * Counters written only by this worker, with relaxed stores, and summed
+     * by plugin_instance_get_metrics. Each worker's start on its own line.
+     */
+    _Alignas(CP_CACHE_LINE) atomic_size_t items_in;
+    atomic_size_t items_out;
+    atomic_size_t bytes_in;
+    atomic_size_t bytes_out;
+    atomic_ullong latency[STAGE_LATENCY_BUCKETS];
+} plugin_worker_t; /* */
+
+/**
+ * Plugin context structure
+ */
+typedef struct plugin_context /* */
 {
     const char* name;          /* */
     consumer_producer_t* queue; /* */
-    pthread_t consumer_thread; /* */
     
-    /* Next plugin's place_work function */
+    /* Consumer threads draining the queue (more than one with "workers") */
+    plugin_worker_t* workers;
+    int num_workers;
+    
+    /*
+     * Pool the stage runs on instead (plugin_instance_attach_executor):
+     * with scheduled set, workers[0] holds the scratch arrays and counters
+     * and task drains the queue whenever items arrive
+     */
+    executor_t* executor;
+    executor_task_t task;
+    int scheduled;
+    
+    /*
+     * Called directly on the caller's thread ("inline" option, see
+     * plugin_instance_process_slice): no queue, workers or threads
+     */
+    int direct;
+    
+    /* Restores input order when num_workers > 1 */
+    reorder_buffer_t reorder;
+    atomic_int end_seen;       /* A worker has taken the END message */
+    
+    /* Next stage through the instance ABI (plugin_instance_attach) */
+    plugin_link_t next;
+    
+    /* Next plugin's place_work function (global ABI) */
     const char* (*next_place_work) (const char*); 
     
+    /* Next plugin's batched place_work function (global ABI, optional) */
+    const char* (*next_place_work_many) (const char* const*, int);
+    
+    /* Next plugin's ownership-taking place_work function (global ABI, optional) */
+    const char* (*next_place_work_move) (char* const*, int);
+    
+    /* Maximum number of items drained from the queue at once */
+    int batch_size;
+    
     /* Plugin-specific processing function */
     const char* (*process_function) (const char*); 
     
+    /* Length-preserving variant that edits the buffer in place (optional) */
+    void (*inplace_function) (char*);
+    
+    /* Length-carrying forms of the two above (optional, preferred when set) */
+    const char* (*process_slice) (const char*, size_t, size_t*);
+    void (*inplace_slice) (char*, size_t);
+    
+    /* Transforms of downstream plugins fused into this stage, in chain order */
+    plugin_step_t fused[PLUGIN_MAX_FUSED];
+    int fused_count;
+    
+    /* Where printouts go; NULL means straight to stdout */
+    output_sink_t* sink;
+    int sink_stage;
+    
+    /* How the stage's queue waits ("wait" option) */
+    queue_wait_t wait;
+    
+    /* Largest capacity the queue may be resized to ("queue_max" option) */
+    int queue_max;
+    
+    /* Threads putting into the queue ("producers" option; fan-in has several) */
+    int num_producers;
+    
+    /* CPUs worker i is pinned to: cpus[i % num_cpus] ("cpus" option) */
+    int cpus[PLUGIN_MAX_CPUS];
+    int num_cpus;
+    
+    /* Record bytes and transform latency ("metrics" option) */
+    int metrics;
+    
+    /* Characters per second of typed printouts, 0 for no pacing */
+    int type_rate;
+    int type_rate_set;         /* type_rate came from the "type_rate" option */
+    
     int initialized; /* */
     int finished;    /* */
 } plugin_context_t; /* */
@@ -37,11 +190,18 @@ typedef struct /* */
 /**
  * Generic consumer thread function
  * This function runs in a separate thread and processes items from the queue
- * @param arg Pointer to plugin_context_t
+ * @param arg Pointer to the plugin_worker_t of this thread
  * @return NULL
  */
 void* plugin_consumer_thread(void* arg); /* */
 
+/**
+ * Executor task of a scheduled stage: processes one batch from the queue,
+ * if there is one, without blocking
+ * @param arg Plugin context
+ */
+void plugin_stage_task(void* arg); /* */
+
 /**
  * Print error message in the format [ERROR] [Plugin Name] message
  * @param context Plugin context
@@ -56,6 +216,84 @@ void log_error(plugin_context_t* context, const char* message); /* */
  */
 void log_info(plugin_context_t* context, const char* message); /* */
 
+/**
+ * Emit a printout (e.g. "[logger] ...\n") through the attached output sink,
+ * or directly to stdout if none is attached
+ * @param data Bytes to print
+ * @param len Number of bytes
+ */
+void plugin_output(const char* data, size_t len); /* */
+
+/**
+ * Emit a printout as typed text: the prefix at once, then the text one
+ * character at a time at the "type_rate" option's pace, then a newline.
+ * With a sink attached this returns immediately and the sink's writer thread
+ * does the pacing; without one it sleeps between characters.
+ * @param prefix NUL-terminated text printed without delay
+ * @param text Text to type
+ * @param len Number of bytes in text
+ */
+void plugin_output_typed(const char* prefix, const char* text, size_t len); /* */
+
+/**
+ * Allocate a buffer for a transform result: from the pipeline's buffer pool
+ * if one is attached, with malloc otherwise
+ * @param size Bytes needed
+ * @return The buffer, or NULL on failure
+ */
+char* plugin_alloc(size_t size); /* */
+
+/**
+ * Copy a string into a buffer from plugin_alloc
+ * @param str String to copy
+ * @return The copy, or NULL on failure
+ */
+char* plugin_strdup(const char* str); /* */
+
+/**
+ * Copy bytes, which may include NUL, into a buffer from plugin_alloc and
+ * terminate the copy
+ * @param data Bytes to copy
+ * @param len Number of bytes
+ * @return The copy, or NULL on failure
+ */
+char* plugin_memdup(const char* data, size_t len); /* */
+
+/**
+ * Free a buffer from plugin_alloc, plugin_strdup or plugin_retain, on any
+ * thread. With a buffer pool this drops one reference.
+ * @param ptr Buffer to free (NULL is ignored)
+ */
+void plugin_free(void* ptr); /* */
+
+/**
+ * Return the transform's input as its result without copying it: adds a
+ * reference to the buffer, so the stage can release its own as usual and
+ * the same bytes go downstream. Without a buffer pool this is a copy.
+ * Only valid for the buffer a transform was given.
+ * @param input The transform's input
+ * @return The input with an extra reference (or a copy), NULL on failure
+ */
+char* plugin_retain(const char* input); /* */
+
+/**
+ * plugin_retain for a slice transform: without a buffer pool the copy
+ * takes len bytes, NUL bytes included
+ * @param input The transform's input
+ * @param len Number of input bytes
+ * @return The input with an extra reference (or a copy), NULL on failure
+ */
+char* plugin_retain_slice(const char* input, size_t len); /* */
+
+/**
+ * Get a buffer that may be modified (copy on write): the buffer itself if
+ * this is its only reference, otherwise a private copy, and the reference
+ * passed in is dropped
+ * @param str Buffer owned by the caller
+ * @return Writable buffer, or NULL on failure (str is then still owned)
+ */
+char* plugin_make_writable(char* str); /* */
+
 /**
  * Get the plugin's name
  * @return The plugin's name
@@ -74,6 +312,23 @@ const char* plugin_get_name(void); /* */
 const char* common_plugin_init(const char* (*process_function) (const char*), /* */
                              const char* name, int queue_size); /* */
 
+/**
+ * Initialize the common plugin infrastructure for a length-preserving plugin
+ * The worker edits each received buffer with inplace_function and hands the
+ * same buffer downstream instead of allocating a new one.
+ * With either init function, a plugin that also exports
+ * plugin_transform_slice or plugin_transform_inplace_slice gets item lengths
+ * from the queue and is run through those instead.
+ * @param process_function Copying processing function (used when a copy is needed)
+ * @param inplace_function Function that transforms a buffer in place
+ * @param name Plugin name
+ * @param queue_size Maximum number of items that can be queued
+ * @return NULL on success, error message on failure
+ */
+const char* common_plugin_init_inplace(const char* (*process_function) (const char*),
+                                       void (*inplace_function) (char*),
+                                       const char* name, int queue_size); /* */
+
 /**
  * Initialize the plugin (to be implemented by each plugin)
  * @param queue_size Maximum number of items
@@ -104,6 +359,113 @@ const char* plugin_place_work(const char* str); /* */
 __attribute__((visibility("default"))) /* */
 void plugin_attach(const char* (*next_place_work) (const char*)); /* */
 
+/**
+ * Place several strings into the plugin's queue under one synchronization
+ * @param items The strings to process, in order
+ * @param count Number of strings
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default"))) /* */
+const char* plugin_place_work_many(const char* const* items, int count); /* */
+
+/**
+ * Attach this plugin to the next plugin's batched place_work
+ * The consumer thread forwards each drained batch with a single call.
+ * @param next_place_work_many Function pointer to the next plugin's place_work_many
+ */
+__attribute__((visibility("default"))) /* */
+void plugin_attach_many(const char* (*next_place_work_many) (const char* const*, int)); /* */
+
+/**
+ * Move heap-allocated strings into the plugin's queue without copying
+ * @param items Strings allocated with malloc; the plugin takes ownership
+ * @param count Number of strings
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default"))) /* */
+const char* plugin_place_work_move(char* const* items, int count); /* */
+
+/**
+ * Attach this plugin to the next plugin's ownership-taking place_work
+ * Output buffers are then handed downstream instead of copied and freed.
+ * @param next_place_work_move Function pointer to the next plugin's place_work_move
+ */
+__attribute__((visibility("default"))) /* */
+void plugin_attach_move(const char* (*next_place_work_move) (char* const*, int)); /* */
+
+/**
+ * Fuse a downstream plugin's transform into this stage; must be called
+ * before plugin_init. Fused transforms run on this stage's thread right
+ * after its own transform, in the order they were added, with no queue in
+ * between.
+ * @param process_function The downstream plugin's plugin_transform
+ * @param inplace_function Its plugin_transform_inplace, or NULL
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default"))) /* */
+const char* plugin_fuse(const char* (*process_function) (const char*),
+                        void (*inplace_function) (char*)); /* */
+
+/**
+ * Send printouts to a central output sink; must be called before plugin_init
+ * @param sink Sink shared by the whole pipeline
+ * @param stage This plugin's position in the chain (its sink buffer)
+ */
+__attribute__((visibility("default"))) /* */
+void plugin_attach_output(output_sink_t* sink, int stage); /* */
+
+/**
+ * Allocate in-flight buffers from a pool shared by the whole pipeline; must
+ * be called before the first plugin_init of this .so, and applies to all
+ * of its instances
+ * @param pool Pool that outlives every instance of the plugin
+ */
+__attribute__((visibility("default"))) /* */
+void plugin_attach_pool(buffer_pool_t* pool); /* */
+
+/**
+ * Set a tuning option; must be called before plugin_init
+ * Supported keys:
+ *   "batch"    maximum number of items drained and forwarded at once
+ *   "workers"  number of consumer threads on the queue; output order is
+ *              kept with a reorder buffer (only for pure plugins)
+ *   "type_rate" characters per second of typed printouts (0 = no pacing)
+ *   "wait"     how the stage's queue waits: park, spin, spin:<spins> or
+ *              spin:<spins>:<yields> (see consumer_producer_parse_wait)
+ *   "queue_max" largest capacity plugin_resize_queue may later set; the
+ *              queue's ring is sized for it up front
+ *   "producers" number of threads that put into the queue at once (more
+ *              than one when several branches feed the stage)
+ *   "cpus"     CPU list (e.g. "2" or "2,4-5") to pin the consumer threads
+ *              to, one CPU per worker, round robin
+ *   "metrics"  1 to also record bytes and per-item transform latency
+ *              (item and queue counters are always kept)
+ *   "inline"   1 to start neither queue nor threads: the caller runs each
+ *              item through plugin_instance_process_slice instead
+ * @param key Option name
+ * @param value Option value
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default"))) /* */
+const char* plugin_set_option(const char* key, const char* value); /* */
+
+/**
+ * Read the stage's runtime counters; valid between plugin_init and plugin_fini
+ * @param metrics Receives the counters
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default"))) /* */
+const char* plugin_get_metrics(stage_metrics_t* metrics); /* */
+
+/**
+ * Change the capacity of the stage's queue while it runs; valid between
+ * plugin_init and plugin_fini
+ * @param capacity New maximum number of queued items (see "queue_max")
+ * @return NULL on success, error message on failure
+ */
+__attribute__((visibility("default"))) /* */
+const char* plugin_resize_queue(int capacity); /* */
+
 /**
  * Wait until the plugin has finished processing
  * This is a blocking function
@@ -112,5 +474,62 @@ void plugin_attach(const char* (*next_place_work) (const char*)); /* */
 __attribute__((visibility("default"))) /* */
 const char* plugin_wait_finished(void); /* */
 
+/*
+ * Instance ABI (see plugin_sdk.h). Every global entry point above is the
+ * instance entry point applied to this .so's default instance.
+ */
+__attribute__((visibility("default"))) void* plugin_create(void); /* */
+__attribute__((visibility("default"))) void plugin_destroy(void* instance); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_init(void* instance, int queue_size); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_fini(void* instance); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_get_name(void* instance); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work(void* instance, const char* str); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_many(void* instance, const char* const* items,
+                                            int count); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_move(void* instance, char* const* items,
+                                            int count); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_place_work_slices(void* instance, char* const* items,
+                                              const size_t* lens, int count); /* */
+__attribute__((visibility("default")))
+void plugin_instance_attach(void* instance, const plugin_link_t* next); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_set_option(void* instance, const char* key,
+                                       const char* value); /* */
+__attribute__((visibility("default")))
+void plugin_instance_attach_output(void* instance, output_sink_t* sink, int stage); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_wait_finished(void* instance); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_get_metrics(void* instance, stage_metrics_t* metrics); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_resize_queue(void* instance, int capacity); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_transform(void* instance, const char* input); /* */
+__attribute__((visibility("default")))
+void plugin_instance_transform_inplace(void* instance, char* str); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_transform_slice(void* instance, const char* input, size_t len,
+                                            size_t* out_len); /* */
+__attribute__((visibility("default")))
+void plugin_instance_transform_inplace_slice(void* instance, char* str, size_t len); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_fuse(void* instance, void* fused,
+                                 const char* (*process_function) (void*, const char*),
+                                 void (*inplace_function) (void*, char*)); /* */
+__attribute__((visibility("default")))
+const char* plugin_instance_fuse_slices(void* instance, void* fused,
+                                        const char* (*process_function) (void*, const char*),
+                                        void (*inplace_function) (void*, char*),
+                                        const char* (*process_slice) (void*, const char*, size_t,
+                                                                      size_t*),
+                                        void (*inplace_slice) (void*, char*, size_t)); /* */
+
 
 #endif // PLUGIN_COMMON_H
\ No newline at end of file
@@ -2,6 +2,10 @@
 #ifndef PLUGIN_SDK_H
 #define PLUGIN_SDK_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
 /**
  * Get the plugin's name
  * @return The plugin's name (should not be modified or freed)
@@ -36,6 +40,110 @@ const char* plugin_place_work(const char* str); /* */
  */
 void plugin_attach(const char* (*next_place_work) (const char*)); /* */
 
+/**
+ * Place several strings into the plugin's queue at once (optional entry point)
+ * @param items The strings to process, in order
+ * @param count Number of strings
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_place_work_many(const char* const* items, int count); /* */
+
+/**
+ * Attach this plugin to the next plugin's batched place_work (optional
+ * entry point). Plugins without it receive items through plugin_attach only.
+ * @param next_place_work_many Function pointer to the next plugin's
+ place_work_many function
+ */
+void plugin_attach_many(const char* (*next_place_work_many) (const char* const*, int)); /* */
+
+/**
+ * Move heap-allocated strings into the plugin's queue without copying
+ * (optional entry point)
+ * @param items Strings allocated with malloc; the plugin takes ownership of
+ * all of them and the caller must not use them afterwards
+ * @param count Number of strings
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_place_work_move(char* const* items, int count); /* */
+
+/**
+ * Attach this plugin to the next plugin's place_work_move (optional entry
+ * point). When attached, output buffers are handed over instead of copied.
+ * @param next_place_work_move Function pointer to the next plugin's
+ place_work_move function
+ */
+void plugin_attach_move(const char* (*next_place_work_move) (char* const*, int)); /* */
+
+/**
+ * Run another plugin's transform on this plugin's thread, right after its
+ * own transform (optional entry point, used for stage fusion)
+ * @param process_function The other plugin's plugin_transform
+ * @param inplace_function Its plugin_transform_inplace, or NULL
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_fuse(const char* (*process_function) (const char*),
+                        void (*inplace_function) (char*)); /* */
+
+/**
+ * Optional exports a plugin can provide for stage fusion:
+ *   const char* plugin_transform(const char* input);  copying transform
+ *   void plugin_transform_inplace(char* str);         length-preserving
+ *   int plugin_is_stateless(void);                    safe to fuse
+ *   int plugin_uses_pool(void);                       results come from plugin_alloc
+ *
+ * and their length-carrying forms (see the slice ABI below), used instead
+ * of the ones above when present:
+ *   const char* plugin_transform_slice(const char* input, size_t len, size_t* out_len);
+ *   void plugin_transform_inplace_slice(char* str, size_t len);
+ */
+
+/**
+ * Send the plugin's printouts to a central output sink instead of stdout
+ * (optional entry point). Must be called before plugin_init.
+ * @param sink Sink shared by the whole pipeline (see output_sink.h)
+ * @param stage This plugin's position in the chain
+ */
+struct output_sink;
+void plugin_attach_output(struct output_sink* sink, int stage); /* */
+
+/**
+ * Allocate the plugin's in-flight buffers from a pool shared by the whole
+ * pipeline (optional entry point). Must be called before the plugin's
+ * first init; every buffer the plugin then hands downstream or receives
+ * comes from the pool and is freed with buffer_pool_free.
+ * @param pool Pool that outlives the plugin (see buffer_pool.h)
+ */
+struct buffer_pool;
+void plugin_attach_pool(struct buffer_pool* pool); /* */
+
+/**
+ * Set a tuning option before plugin_init (optional entry point)
+ * @param key Option name, e.g. "batch"
+ * @param value Option value
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_set_option(const char* key, const char* value); /* */
+
+/**
+ * Read the plugin's runtime counters (optional entry point): items and
+ * bytes through the stage, its queue's depth and blocked time, and a
+ * latency histogram of its transform. Valid between plugin_init and
+ * plugin_fini, and safe to call while the plugin is running.
+ * @param metrics Receives the counters (see stage_metrics.h)
+ * @return NULL on success, error message on failure
+ */
+struct stage_metrics;
+const char* plugin_get_metrics(struct stage_metrics* metrics); /* */
+
+/**
+ * Change the capacity of the plugin's input queue while it runs (optional
+ * entry point); valid between plugin_init and plugin_fini. Items already
+ * queued are kept when it shrinks.
+ * @param capacity New maximum number of queued items
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_resize_queue(int capacity); /* */
+
 /**
  * Wait until the plugin has finished processing all work and is ready to
  shutdown
@@ -44,4 +152,211 @@ void plugin_attach(const char* (*next_place_work) (const char*)); /* */
  */
 const char* plugin_wait_finished(void); /* */
 
+/*
+ * Slice ABI (optional). Items travel as a buffer and the number of bytes in
+ * it, so no stage scans for the terminator and records may contain NUL
+ * bytes. A NUL still follows every item's bytes, so a plugin without the
+ * slice ABI reads an item as a string (up to its first NUL).
+ *
+ * Control messages travel in line with the data as typed items: a NULL
+ * item whose length is PLUGIN_CONTROL_LEN(kind). Through the slice entry
+ * points every other item is data, whatever its bytes. Through the string
+ * entry points the strings "<END>" and "<FLUSH>" stand for the END and
+ * FLUSH messages, as they always have; barriers are not passed to them.
+ */
+
+/**
+ * Kinds of items in the slice ABI
+ */
+typedef enum
+{
+    PLUGIN_ITEM_DATA = 0,       /* A line */
+    PLUGIN_ITEM_END = 1,        /* End of the stream: forward it, then shut down */
+    PLUGIN_ITEM_FLUSH = 2,      /* Write out the printouts of the items before it */
+    PLUGIN_ITEM_BARRIER = 3     /* Forwarded once everything before it has been */
+} plugin_item_kind_t;
+
+/* Length of a control message of the given kind; no line is that long */
+#define PLUGIN_CONTROL_LEN(kind) (SIZE_MAX - (size_t)(kind))
+
+/**
+ * Kind of a slice ABI item, from its length
+ * @param len Length passed with the item
+ * @return PLUGIN_ITEM_DATA, or the control message's kind
+ */
+static inline plugin_item_kind_t plugin_item_kind(size_t len) {
+    return len >= PLUGIN_CONTROL_LEN(PLUGIN_ITEM_BARRIER)
+        ? (plugin_item_kind_t)(SIZE_MAX - len) : PLUGIN_ITEM_DATA;
+}
+
+/**
+ * Control message a string of the string ABI stands for
+ * @param str String passed to a place_work entry point
+ * @return PLUGIN_ITEM_END for "<END>", PLUGIN_ITEM_FLUSH for "<FLUSH>",
+ * PLUGIN_ITEM_DATA otherwise
+ */
+static inline plugin_item_kind_t plugin_marker_kind(const char* str) {
+    if (str[0] != '<') {
+        return PLUGIN_ITEM_DATA;
+    }
+    if (strcmp(str, "<END>") == 0) {
+        return PLUGIN_ITEM_END;
+    }
+    return strcmp(str, "<FLUSH>") == 0 ? PLUGIN_ITEM_FLUSH : PLUGIN_ITEM_DATA;
+}
+
+/**
+ * String a control message is passed as through the string entry points
+ * @param kind Control message kind
+ * @return "<END>" or "<FLUSH>", NULL for a barrier
+ */
+static inline const char* plugin_marker_string(plugin_item_kind_t kind) {
+    return kind == PLUGIN_ITEM_END ? "<END>" : kind == PLUGIN_ITEM_FLUSH ? "<FLUSH>" : NULL;
+}
+
+/*
+ * Instance ABI (optional). A plugin that exports plugin_create can appear
+ * any number of times in one chain from a single dlopen: each appearance is
+ * an opaque instance handle passed to the plugin_instance_* entry points,
+ * which behave like the global entry points above. The global entry points
+ * keep working on a default instance of their own.
+ */
+
+/**
+ * Next stage as seen by an instance: its entry points and the handle they
+ * are called with
+ */
+typedef struct plugin_link
+{
+    void* target;   /* Passed as the first argument of every entry point */
+    const char* (*place_work) (void* target, const char* str);
+    const char* (*place_work_many) (void* target, const char* const* items, int count); /* optional */
+    const char* (*place_work_move) (void* target, char* const* items, int count); /* optional */
+    const char* (*place_work_slices) (void* target, char* const* items, const size_t* lens,
+                                      int count); /* optional, takes ownership like place_work_move */
+} plugin_link_t;
+
+/**
+ * Create an uninitialized plugin instance
+ * @return Instance handle, or NULL on allocation failure
+ */
+void* plugin_create(void); /* */
+
+/**
+ * Finalize an instance if needed and free it
+ * @param instance Instance handle
+ */
+void plugin_destroy(void* instance); /* */
+
+/* Instance counterparts of the global entry points */
+const char* plugin_instance_init(void* instance, int queue_size); /* */
+const char* plugin_instance_fini(void* instance); /* */
+const char* plugin_instance_get_name(void* instance); /* */
+const char* plugin_instance_place_work(void* instance, const char* str); /* */
+const char* plugin_instance_place_work_many(void* instance, const char* const* items,
+                                            int count); /* */
+const char* plugin_instance_place_work_move(void* instance, char* const* items,
+                                            int count); /* */
+const char* plugin_instance_place_work_slices(void* instance, char* const* items,
+                                              const size_t* lens, int count); /* optional */
+const char* plugin_instance_set_option(void* instance, const char* key,
+                                       const char* value); /* */
+void plugin_instance_attach_output(void* instance, struct output_sink* sink, int stage); /* */
+const char* plugin_instance_wait_finished(void* instance); /* */
+const char* plugin_instance_get_metrics(void* instance, struct stage_metrics* metrics); /* */
+const char* plugin_instance_resize_queue(void* instance, int capacity); /* */
+
+/**
+ * Run the instance's stage as a task of a shared thread pool instead of
+ * on threads of its own (optional entry point). Must be called before
+ * plugin_instance_init; a stage with several workers or its own CPUs
+ * keeps its threads.
+ * @param instance Instance handle
+ * @param executor Pool that outlives the instance (see sync/executor.h)
+ */
+struct executor;
+void plugin_instance_attach_executor(void* instance, struct executor* executor); /* optional */
+
+/**
+ * Attach an instance to the next stage; replaces plugin_attach,
+ * plugin_attach_many and plugin_attach_move
+ * @param instance Instance handle
+ * @param next Next stage (copied)
+ */
+void plugin_instance_attach(void* instance, const plugin_link_t* next); /* */
+
+/**
+ * Run the plugin's transform on behalf of an instance, so its printouts go
+ * where that instance's go (used when the instance is fused)
+ * @param instance Instance handle
+ * @param input Input string
+ * @return Result as plugin_transform returns it
+ */
+const char* plugin_instance_transform(void* instance, const char* input); /* */
+
+/**
+ * In-place counterpart of plugin_instance_transform; only valid if the
+ * plugin exports plugin_transform_inplace
+ * @param instance Instance handle
+ * @param str Buffer to transform
+ */
+void plugin_instance_transform_inplace(void* instance, char* str); /* */
+
+/**
+ * Length-carrying counterparts of the two functions above; only valid if
+ * the plugin exports plugin_transform_slice (plugin_transform_inplace_slice)
+ * @param instance Instance handle
+ * @param input Input bytes, followed by a NUL
+ * @param len Number of input bytes
+ * @param out_len Receives the number of bytes in the result
+ * @return Result as plugin_transform_slice returns it
+ */
+const char* plugin_instance_transform_slice(void* instance, const char* input, size_t len,
+                                            size_t* out_len); /* optional */
+void plugin_instance_transform_inplace_slice(void* instance, char* str, size_t len); /* optional */
+
+/**
+ * Run an item through the instance's transform, and those fused into it,
+ * on the calling thread (optional entry point). For an instance set up
+ * with the "inline" option, which has no queue or threads of its own.
+ * @param instance Instance handle
+ * @param item Owned buffer of len bytes followed by a NUL; always consumed
+ * @param len Number of bytes in item
+ * @param out_len Receives the number of bytes in the result
+ * @return The owned result, or NULL if the transform failed
+ */
+char* plugin_instance_process_slice(void* instance, char* item, size_t len,
+                                    size_t* out_len); /* optional */
+
+/**
+ * Fuse another instance's transform into this instance's stage (see
+ * plugin_fuse)
+ * @param instance Instance handle
+ * @param fused Instance whose transform is fused in, passed to the functions below
+ * @param process_function Its plugin_instance_transform
+ * @param inplace_function Its plugin_instance_transform_inplace, or NULL
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_fuse(void* instance, void* fused,
+                                 const char* (*process_function) (void*, const char*),
+                                 void (*inplace_function) (void*, char*)); /* */
+
+/**
+ * Same as plugin_instance_fuse, also giving the fused instance's
+ * length-carrying transforms, which the stage then uses instead (optional)
+ * @param instance Instance handle
+ * @param fused Instance whose transform is fused in
+ * @param process_function Its plugin_instance_transform
+ * @param inplace_function Its plugin_instance_transform_inplace, or NULL
+ * @param process_slice Its plugin_instance_transform_slice, or NULL
+ * @param inplace_slice Its plugin_instance_transform_inplace_slice, or NULL
+ * @return NULL on success, error message on failure
+ */
+const char* plugin_instance_fuse_slices(void* instance, void* fused,
+                                        const char* (*process_function) (void*, const char*),
+                                        void (*inplace_function) (void*, char*),
+                                        const char* (*process_slice) (void*, const char*, size_t,
+                                                                      size_t*),
+                                        void (*inplace_slice) (void*, char*, size_t)); /* */
+
 #endif // PLUGIN_SDK_H
\ No newline at end of file
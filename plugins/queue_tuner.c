@@ -0,0 +1,157 @@
+#include "queue_tuner.h"
+#include <stdlib.h>
+#include <string.h>
+
+const char* queue_tuner_init(queue_tuner_t* tuner, const int* capacities, int count,
+                             int budget) {
+    int total = 0;
+    for (int i = 0; i < count; i++) {
+        total += capacities[i];
+    }
+    if (total > budget) {
+        return "budget is smaller than the queues' starting capacities";
+    }
+
+    tuner->stages = calloc(count > 0 ? count : 1, sizeof(queue_tuner_stage_t));
+    if (!tuner->stages) {
+        return "Failed to allocate memory for queue tuner";
+    }
+    for (int i = 0; i < count; i++) {
+        tuner->stages[i].capacity = capacities[i];
+        tuner->stages[i].floor = capacities[i] < QUEUE_TUNER_MIN_CAPACITY
+                                 ? capacities[i] : QUEUE_TUNER_MIN_CAPACITY;
+    }
+    tuner->count = count;
+    tuner->budget = budget;
+    tuner->primed = 0;
+    return NULL;
+}
+
+/* Sum of the producers' waits over every phase */
+static size_t total_put_waits(const stage_metrics_t* sample) {
+    size_t waits = 0;
+    for (int i = 0; i < STAGE_WAIT_PHASES; i++) {
+        waits += sample->put_waits[i];
+    }
+    return waits;
+}
+
+/* Blocked time as a share of elapsed time, in 1/1000 */
+static int blocked_permille(unsigned long long blocked_ns, unsigned long long elapsed_ns) {
+    if (elapsed_ns == 0) {
+        return 0;
+    }
+    unsigned long long permille = blocked_ns * 1000 / elapsed_ns;
+    return permille > 1000 ? 1000 : (int)permille;
+}
+
+/*
+ * Shrink or judge one queue and report whether it asks to grow; its
+ * counters move to the current sample
+ */
+static int update_stage(queue_tuner_stage_t* stage, const stage_metrics_t* sample,
+                        unsigned long long elapsed_ns, int* permille) {
+    unsigned long long blocked = sample->put_blocked_ns - stage->put_blocked_ns;
+    size_t waits = total_put_waits(sample) - stage->put_waits;
+    size_t items = sample->items_in - stage->items_in;
+    stage->put_blocked_ns = sample->put_blocked_ns;
+    stage->put_waits = total_put_waits(sample);
+    stage->items_in = sample->items_in;
+    *permille = blocked_permille(blocked, elapsed_ns);
+    if (stage->cooldown_ticks > 0) {
+        stage->cooldown_ticks--;
+    }
+
+    /* A grow that did not speed the stage up is undone */
+    if (stage->judge_ticks > 0) {
+        stage->judge_items += items;
+        stage->judge_elapsed_ns += elapsed_ns;
+        if (--stage->judge_ticks == 0) {
+            double rate = stage->judge_elapsed_ns
+                ? (double)stage->judge_items * 1e9 / (double)stage->judge_elapsed_ns : 0;
+            if (rate * 100 < stage->grown_rate * (100 + QUEUE_TUNER_GAIN_PERCENT)) {
+                stage->capacity = stage->grown_from;
+                stage->cooldown_ticks = QUEUE_TUNER_COOLDOWN_TICKS;
+            }
+        }
+        return 0;
+    }
+    stage->grown_rate = elapsed_ns ? (double)items * 1e9 / (double)elapsed_ns : 0;
+
+    stage->idle_ticks = waits == 0 ? stage->idle_ticks + 1 : 0;
+    if (stage->idle_ticks >= QUEUE_TUNER_IDLE_TICKS && stage->capacity > stage->floor &&
+        sample->queue_depth * 4 <= (size_t)stage->capacity) {
+        stage->capacity = stage->capacity / 2 > stage->floor ? stage->capacity / 2 : stage->floor;
+        stage->idle_ticks = 0;
+        return 0;
+    }
+    return *permille >= QUEUE_TUNER_GROW_PERMILLE && stage->cooldown_ticks == 0;
+}
+
+int queue_tuner_step(queue_tuner_t* tuner, const stage_metrics_t* samples,
+                     unsigned long long elapsed_ns, int* capacities) {
+    if (!tuner->primed) {
+        for (int i = 0; i < tuner->count; i++) {
+            tuner->stages[i].put_blocked_ns = samples[i].put_blocked_ns;
+            tuner->stages[i].put_waits = total_put_waits(&samples[i]);
+            tuner->stages[i].items_in = samples[i].items_in;
+            capacities[i] = tuner->stages[i].capacity;
+        }
+        tuner->primed = 1;
+        return 0;
+    }
+
+    /* Shrinks and undone grows first, so their room can go to others */
+    int* before = malloc(sizeof(int) * tuner->count * 3);
+    if (!before) {
+        return 0;
+    }
+    int* wanting = before + tuner->count;
+    int* permille = wanting + tuner->count;
+    int num_wanting = 0;
+    int total = 0;
+    for (int i = 0; i < tuner->count; i++) {
+        before[i] = tuner->stages[i].capacity;
+        if (update_stage(&tuner->stages[i], &samples[i], elapsed_ns, &permille[i])) {
+            wanting[num_wanting++] = i;
+        }
+        total += tuner->stages[i].capacity;
+    }
+
+    /* Most blocked first (insertion sort; chains are short) */
+    for (int i = 1; i < num_wanting; i++) {
+        int stage = wanting[i];
+        int j = i;
+        while (j > 0 && permille[wanting[j - 1]] < permille[stage]) {
+            wanting[j] = wanting[j - 1];
+            j--;
+        }
+        wanting[j] = stage;
+    }
+
+    for (int i = 0; i < num_wanting && total < tuner->budget; i++) {
+        queue_tuner_stage_t* stage = &tuner->stages[wanting[i]];
+        int grow = stage->capacity < tuner->budget - total ? stage->capacity
+                                                           : tuner->budget - total;
+        stage->grown_from = stage->capacity;
+        stage->capacity += grow;
+        stage->judge_ticks = QUEUE_TUNER_JUDGE_TICKS;
+        stage->judge_items = 0;
+        stage->judge_elapsed_ns = 0;
+        total += grow;
+    }
+
+    int changed = 0;
+    for (int i = 0; i < tuner->count; i++) {
+        capacities[i] = tuner->stages[i].capacity;
+        changed += capacities[i] != before[i];
+    }
+    free(before);
+    return changed;
+}
+
+void queue_tuner_destroy(queue_tuner_t* tuner) {
+    free(tuner->stages);
+    tuner->stages = NULL;
+    tuner->count = 0;
+}
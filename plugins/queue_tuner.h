@@ -0,0 +1,94 @@
+/* */
+#ifndef QUEUE_TUNER_H
+#define QUEUE_TUNER_H
+
+#include "stage_metrics.h"
+
+/* How often the tuner samples the stages, in milliseconds */
+#define QUEUE_TUNER_INTERVAL_MS 20
+
+/* A queue grows when its producers were blocked this long per 1000 ns */
+#define QUEUE_TUNER_GROW_PERMILLE 50
+
+/* Ticks without a blocked producer before a queue may shrink */
+#define QUEUE_TUNER_IDLE_TICKS 10
+
+/* Ticks after a grow before checking that it raised throughput */
+#define QUEUE_TUNER_JUDGE_TICKS 2
+
+/* Ticks a queue whose grow did not help is left alone */
+#define QUEUE_TUNER_COOLDOWN_TICKS 100
+
+/* A grow is kept if the stage's throughput rose by this many percent */
+#define QUEUE_TUNER_GAIN_PERCENT 10
+
+/* Queues never shrink below this, or their starting capacity if smaller */
+#define QUEUE_TUNER_MIN_CAPACITY 16
+
+/**
+ * Tuning state of one queue
+ */
+typedef struct
+{
+    int capacity;                       /* Current capacity */
+    int floor;                          /* Smallest capacity it may shrink to */
+    unsigned long long put_blocked_ns;  /* Counters at the previous tick */
+    size_t put_waits;
+    size_t items_in;
+    int idle_ticks;                     /* Ticks in a row without a blocked producer */
+    int judge_ticks;                    /* Ticks left before judging the last grow, 0 if none */
+    size_t judge_items;                 /* Items through the stage since the last grow */
+    unsigned long long judge_elapsed_ns;
+    double grown_rate;                  /* Items per second in the tick that triggered it */
+    int grown_from;                     /* Capacity before the last grow */
+    int cooldown_ticks;                 /* Ticks left before it may grow again */
+} queue_tuner_stage_t;
+
+/**
+ * Grows queues whose producers block and shrinks idle ones, keeping the sum
+ * of all capacities within a budget. A queue is doubled when its producers
+ * spent more than QUEUE_TUNER_GROW_PERMILLE of a tick blocked; the most
+ * blocked queues get the budget first. A grow that does not raise the
+ * stage's throughput by QUEUE_TUNER_GAIN_PERCENT means the consumer is
+ * simply slower than its producer, where any queue fills up, so it is
+ * undone and the queue is left alone for a while. A queue is halved after QUEUE_TUNER_IDLE_TICKS
+ * ticks without a blocked producer while at most a quarter full.
+ */
+typedef struct
+{
+    queue_tuner_stage_t* stages;
+    int count;
+    int budget;     /* Most items all queues may hold together */
+    int primed;     /* The counters of a first tick were recorded */
+} queue_tuner_t;
+
+/**
+ * Start tuning queues at their current capacities
+ * @param tuner Tuner to initialize
+ * @param capacities Starting capacity of each queue
+ * @param count Number of queues
+ * @param budget Most items all queues may hold together
+ * @return NULL on success, error message on failure
+ */
+const char* queue_tuner_init(queue_tuner_t* tuner, const int* capacities, int count,
+                             int budget); /* */
+
+/**
+ * Take one sample of every queue and decide new capacities. The first call
+ * only records the counters.
+ * @param tuner Tuner state
+ * @param samples Current counters of each queue's stage, in init order
+ * @param elapsed_ns Time since the previous call
+ * @param capacities Receives the capacity each queue should have now
+ * @return Number of queues whose capacity changed
+ */
+int queue_tuner_step(queue_tuner_t* tuner, const stage_metrics_t* samples,
+                     unsigned long long elapsed_ns, int* capacities); /* */
+
+/**
+ * Free the tuner's state
+ * @param tuner Tuner state
+ */
+void queue_tuner_destroy(queue_tuner_t* tuner); /* */
+
+#endif // QUEUE_TUNER_H
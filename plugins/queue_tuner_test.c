@@ -0,0 +1,145 @@
+/* * Unit test application for queue_tuner.c
+ */
+#include "queue_tuner.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#define TICK_NS (QUEUE_TUNER_INTERVAL_MS * 1000000ull)
+
+queue_tuner_t tuner;
+stage_metrics_t samples[3];
+int capacities[3];
+
+/* Advance a stage's producers by one tick, blocked for the given share */
+void block(int stage, int permille) {
+    samples[stage].put_blocked_ns += TICK_NS * permille / 1000;
+    if (permille > 0) {
+        samples[stage].put_waits[2] += 1;
+    }
+}
+
+/* Advance blocked producers by one tick while the stage takes some items */
+void block_flow(int stage, size_t items) {
+    block(stage, 1000);
+    samples[stage].items_in += items;
+}
+
+int step() {
+    return queue_tuner_step(&tuner, samples, TICK_NS, capacities);
+}
+
+int sum() {
+    return capacities[0] + capacities[1] + capacities[2];
+}
+
+void reset(int budget, int c0, int c1, int c2) {
+    int start[3] = { c0, c1, c2 };
+    queue_tuner_destroy(&tuner);
+    memset(samples, 0, sizeof(samples));
+    const char* err = queue_tuner_init(&tuner, start, 3, budget);
+    assert(err == NULL);
+    int changed = step();
+    assert(changed == 0);
+}
+
+void test_grow_within_budget() {
+    printf("[TEST 1] Running: Blocked Queues Grow Within the Budget\n");
+    int start[3] = { 64, 64, 64 };
+    assert(queue_tuner_init(&tuner, start, 3, 100) != NULL);
+
+    reset(300, 64, 64, 64);
+    /* Stage 1 blocked most: it is served first, stage 2 gets what is left */
+    block(1, 500);
+    block(2, 100);
+    int changed = step();
+    assert(changed == 2);
+    assert(capacities[0] == 64 && capacities[1] == 128 && capacities[2] == 108);
+    assert(sum() == 300);
+
+    /* The budget is used up: nothing more grows */
+    block(0, 1000);
+    changed = step();
+    assert(changed == 0);
+
+    /* A few blocked nanoseconds are not enough */
+    reset(300, 64, 64, 64);
+    block(0, QUEUE_TUNER_GROW_PERMILLE / 2);
+    changed = step();
+    assert(changed == 0);
+    queue_tuner_destroy(&tuner);
+    printf("[TEST 1] Passed.\n\n");
+}
+
+void test_judge_grow() {
+    printf("[TEST 2] Running: A Grow That Does Not Help Is Undone\n");
+    /* Same throughput after the grow: the consumer is the bottleneck */
+    reset(1000, 32, 32, 32);
+    block_flow(0, 1000);
+    int changed = step();
+    assert(changed == 1 && capacities[0] == 64);
+    for (int i = 0; i < QUEUE_TUNER_JUDGE_TICKS; i++) {
+        block_flow(0, 1050);
+        step();
+    }
+    assert(capacities[0] == 32);
+    /* And it is not tried again right away */
+    block_flow(0, 1000);
+    changed = step();
+    assert(changed == 0);
+
+    /* More items per tick after the grow: it is kept, and the next one tried */
+    reset(1000, 32, 32, 32);
+    block_flow(0, 1000);
+    changed = step();
+    assert(changed == 1 && capacities[0] == 64);
+    for (int i = 0; i < QUEUE_TUNER_JUDGE_TICKS; i++) {
+        block_flow(0, 2000);
+        step();
+    }
+    assert(capacities[0] == 64);
+    block_flow(0, 2000);
+    changed = step();
+    assert(changed == 1 && capacities[0] == 128);
+    queue_tuner_destroy(&tuner);
+    printf("[TEST 2] Passed.\n\n");
+}
+
+void test_shrink_idle() {
+    printf("[TEST 3] Running: Idle Queues Shrink to Their Floor\n");
+    reset(1000, 256, 8, 256);
+    samples[2].queue_depth = 200;
+    for (int i = 0; i < QUEUE_TUNER_IDLE_TICKS; i++) {
+        step();
+    }
+    /* Stage 1 starts below the floor; stage 2 is busy */
+    assert(capacities[0] == 128 && capacities[1] == 8 && capacities[2] == 256);
+    for (int i = 0; i < 10 * QUEUE_TUNER_IDLE_TICKS; i++) {
+        step();
+    }
+    assert(capacities[0] == QUEUE_TUNER_MIN_CAPACITY);
+
+    /* A blocked producer resets the idle count */
+    reset(1000, 256, 8, 8);
+    for (int i = 0; i < 3 * QUEUE_TUNER_IDLE_TICKS; i++) {
+        if (i % (QUEUE_TUNER_IDLE_TICKS - 1) == 0) {
+            samples[0].put_waits[0]++;
+        }
+        step();
+    }
+    assert(capacities[0] == 256);
+    queue_tuner_destroy(&tuner);
+    printf("[TEST 3] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running Queue Tuner Unit Tests ---\n\n");
+
+    test_grow_within_budget();
+    test_judge_grow();
+    test_shrink_idle();
+
+    printf("--- All Queue Tuner Tests Passed ---\n");
+    return 0;
+}
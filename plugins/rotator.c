@@ -4,16 +4,35 @@
 #include <stdlib.h>
 
 /**
- * Transformation function for the rotator.
+ * In-place transformation for the rotator, on len bytes.
  * Moves every character one position to the right. Last char wraps to front.
  */
-const char* plugin_transform(const char* input) {
-    size_t len = strlen(input);
+void plugin_transform_inplace_slice(char* str, size_t len) {
+    if (len == 0) {
+        return;
+    }
+    
+    /* Shift str[0..len-2] right by one, then place the last char at the front */
+    char last = str[len - 1];
+    memmove(str + 1, str, len - 1);
+    str[0] = last;
+}
+
+void plugin_transform_inplace(char* str) {
+    plugin_transform_inplace_slice(str, strlen(str));
+}
+
+/**
+ * Transformation function for the rotator, on len bytes.
+ * Moves every character one position to the right. Last char wraps to front.
+ */
+const char* plugin_transform_slice(const char* input, size_t len, size_t* out_len) {
+    *out_len = len;
     if (len == 0) {
-        return strdup(input);
+        return plugin_memdup(input, 0);
     }
     
-    char* new_str = malloc(len + 1);
+    char* new_str = plugin_alloc(len + 1);
     if (!new_str) {
         return NULL;
     }
@@ -33,10 +52,21 @@ const char* plugin_transform(const char* input) {
     return new_str;
 }
 
+const char* plugin_transform(const char* input) {
+    size_t len;
+    return plugin_transform_slice(input, strlen(input), &len);
+}
+
+PLUGIN_DECLARE_STATELESS()
+PLUGIN_DECLARE_PURE()
+
+PLUGIN_DECLARE_POOLED()
+
 /**
  * Initialization function for the rotator plugin.
  */
 const char* plugin_init(int queue_size) {
-    return common_plugin_init(plugin_transform, "rotator", queue_size);
+    return common_plugin_init_inplace(plugin_transform, plugin_transform_inplace,
+                                      "rotator", queue_size);
 }
 
@@ -0,0 +1,386 @@
+/* */
+#include "text_kernels.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TEXT_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+/* ===== Scalar kernels (reference and tail handling) ===== */
+
+static void upper_scalar(char* str, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (str[i] >= 'a' && str[i] <= 'z') {
+            str[i] -= 'a' - 'A';
+        }
+    }
+}
+
+static void reverse_scalar(char* str, size_t len) {
+    for (size_t i = 0, j = len; i + 1 < j; i++, j--) {
+        char tmp = str[i];
+        str[i] = str[j - 1];
+        str[j - 1] = tmp;
+    }
+}
+
+static void reverse_copy_scalar(char* dst, const char* src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[i] = src[len - 1 - i];
+    }
+}
+
+static void expand_scalar(char* dst, const char* src, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        dst[2 * i] = src[i];
+        dst[2 * i + 1] = ' ';
+    }
+}
+
+/* Scan str[i..len) byte by byte, adding to the count offsets already hold */
+static size_t newlines_from(const char* str, size_t i, size_t len, unsigned* offsets,
+                            size_t count, size_t max) {
+    for (; i < len && count < max; i++) {
+        if (str[i] == '\n') {
+            offsets[count++] = (unsigned)i;
+        }
+    }
+    return count;
+}
+
+static size_t find_newlines_scalar(const char* str, size_t len, unsigned* offsets, size_t max) {
+    return newlines_from(str, 0, len, offsets, 0, max);
+}
+
+/* Store the positions of the set bits of a compare mask, lowest first */
+static inline size_t newlines_in_mask(unsigned long long mask, size_t base, unsigned* offsets,
+                                      size_t count, size_t max) {
+    while (mask && count < max) {
+        offsets[count++] = (unsigned)(base + (size_t)__builtin_ctzll(mask));
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+#ifdef TEXT_KERNELS_X86
+
+/* ===== SSE2 kernels: 16 bytes per step ===== */
+
+/*
+ * a-z test without unsigned compares: adding 0x80 - 'a' maps a-z onto the
+ * 26 smallest signed bytes, so one signed compare selects them.
+ */
+__attribute__((target("sse2")))
+static void upper_sse2(char* str, size_t len) {
+    const __m128i shift = _mm_set1_epi8((char)(0x80 - 'a'));
+    const __m128i limit = _mm_set1_epi8((char)(0x80 + 26));
+    const __m128i flip = _mm_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i lower = _mm_cmplt_epi8(_mm_add_epi8(v, shift), limit);
+        _mm_storeu_si128((__m128i*)(str + i), _mm_sub_epi8(v, _mm_and_si128(lower, flip)));
+    }
+    upper_scalar(str + i, len - i);
+}
+
+/* SSE2 has no byte shuffle: swap bytes in words, then reverse the words */
+__attribute__((target("sse2")))
+static inline __m128i reverse16_sse2(__m128i x) {
+    x = _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0, 1, 2, 3));
+    return _mm_shuffle_epi32(x, _MM_SHUFFLE(1, 0, 3, 2));
+}
+
+__attribute__((target("sse2")))
+static void reverse_sse2(char* str, size_t len) {
+    size_t i = 0, j = len;
+
+    /* Swap reversed blocks from both ends until they would overlap */
+    while (j - i >= 32) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(str + j - 16));
+        _mm_storeu_si128((__m128i*)(str + i), reverse16_sse2(b));
+        _mm_storeu_si128((__m128i*)(str + j - 16), reverse16_sse2(a));
+        i += 16;
+        j -= 16;
+    }
+    reverse_scalar(str + i, j - i);
+}
+
+__attribute__((target("sse2")))
+static void reverse_copy_sse2(char* dst, const char* src, size_t len) {
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + len - i - 16));
+        _mm_storeu_si128((__m128i*)(dst + i), reverse16_sse2(v));
+    }
+    reverse_copy_scalar(dst + i, src, len - i);
+}
+
+__attribute__((target("sse2")))
+static void expand_sse2(char* dst, const char* src, size_t len) {
+    const __m128i spaces = _mm_set1_epi8(' ');
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_unpacklo_epi8(v, spaces));
+        _mm_storeu_si128((__m128i*)(dst + 2 * i + 16), _mm_unpackhi_epi8(v, spaces));
+    }
+    expand_scalar(dst + 2 * i, src + i, len - i);
+}
+
+__attribute__((target("sse2")))
+static size_t find_newlines_sse2(const char* str, size_t len, unsigned* offsets, size_t max) {
+    const __m128i nl = _mm_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= len && count < max; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+        count = newlines_in_mask(mask, i, offsets, count, max);
+    }
+    return newlines_from(str, i, len, offsets, count, max);
+}
+
+/* ===== AVX2 kernels: 32 bytes per step ===== */
+
+__attribute__((target("avx2")))
+static void upper_avx2(char* str, size_t len) {
+    const __m256i a = _mm256_set1_epi8('a');
+    const __m256i span = _mm256_set1_epi8(25);
+    const __m256i flip = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i t = _mm256_sub_epi8(v, a);
+        /* Unsigned t <= 25 exactly when the byte is a-z */
+        __m256i lower = _mm256_cmpeq_epi8(_mm256_min_epu8(t, span), t);
+        _mm256_storeu_si256((__m256i*)(str + i), _mm256_sub_epi8(v, _mm256_and_si256(lower, flip)));
+    }
+    upper_sse2(str + i, len - i);
+}
+
+/* Reverse within each 128-bit lane, then swap the lanes */
+__attribute__((target("avx2")))
+static inline __m256i reverse32_avx2(__m256i x) {
+    const __m256i mask = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                          15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    x = _mm256_shuffle_epi8(x, mask);
+    return _mm256_permute2x128_si256(x, x, 0x01);
+}
+
+__attribute__((target("avx2")))
+static void reverse_avx2(char* str, size_t len) {
+    size_t i = 0, j = len;
+
+    while (j - i >= 64) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(str + j - 32));
+        _mm256_storeu_si256((__m256i*)(str + i), reverse32_avx2(b));
+        _mm256_storeu_si256((__m256i*)(str + j - 32), reverse32_avx2(a));
+        i += 32;
+        j -= 32;
+    }
+    reverse_sse2(str + i, j - i);
+}
+
+__attribute__((target("avx2")))
+static void reverse_copy_avx2(char* dst, const char* src, size_t len) {
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + len - i - 32));
+        _mm256_storeu_si256((__m256i*)(dst + i), reverse32_avx2(v));
+    }
+    reverse_copy_sse2(dst + i, src, len - i);
+}
+
+/* Zero-extend each byte to 16 bits and put a space in the high byte */
+__attribute__((target("avx2")))
+static void expand_avx2(char* dst, const char* src, size_t len) {
+    const __m256i spaces = _mm256_set1_epi16(' ' << 8);
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m256i w = _mm256_or_si256(_mm256_cvtepu8_epi16(v), spaces);
+        _mm256_storeu_si256((__m256i*)(dst + 2 * i), w);
+    }
+    expand_scalar(dst + 2 * i, src + i, len - i);
+}
+
+__attribute__((target("avx2")))
+static size_t find_newlines_avx2(const char* str, size_t len, unsigned* offsets, size_t max) {
+    const __m256i nl = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= len && count < max; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl));
+        count = newlines_in_mask(mask, i, offsets, count, max);
+    }
+    return newlines_from(str, i, len, offsets, count, max);
+}
+
+/* ===== AVX-512BW kernels: 64 bytes per step ===== */
+
+__attribute__((target("avx512f,avx512bw")))
+static void upper_avx512(char* str, size_t len) {
+    const __m512i a = _mm512_set1_epi8('a');
+    const __m512i span = _mm512_set1_epi8(26);
+    const __m512i flip = _mm512_set1_epi8(0x20);
+    size_t i = 0;
+
+    for (; i < len; i += 64) {
+        /* The last partial block is handled with a masked load/store */
+        __mmask64 active = (len - i >= 64) ? ~(__mmask64)0 : (((__mmask64)1 << (len - i)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi8(active, str + i);
+        __mmask64 lower = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(v, a), span);
+        _mm512_mask_storeu_epi8(str + i, active, _mm512_mask_sub_epi8(v, lower, v, flip));
+    }
+}
+
+/* Reverse within each 128-bit lane, then reverse the order of the lanes */
+__attribute__((target("avx512f,avx512bw")))
+static inline __m512i reverse64_avx512(__m512i x) {
+    const __m512i mask = _mm512_set_epi64(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL,
+                                          0x0001020304050607LL, 0x08090a0b0c0d0e0fLL,
+                                          0x0001020304050607LL, 0x08090a0b0c0d0e0fLL,
+                                          0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+    x = _mm512_shuffle_epi8(x, mask);
+    return _mm512_shuffle_i64x2(x, x, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void reverse_avx512(char* str, size_t len) {
+    size_t i = 0, j = len;
+
+    while (j - i >= 128) {
+        __m512i a = _mm512_loadu_si512((const void*)(str + i));
+        __m512i b = _mm512_loadu_si512((const void*)(str + j - 64));
+        _mm512_storeu_si512((void*)(str + i), reverse64_avx512(b));
+        _mm512_storeu_si512((void*)(str + j - 64), reverse64_avx512(a));
+        i += 64;
+        j -= 64;
+    }
+    reverse_avx2(str + i, j - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void reverse_copy_avx512(char* dst, const char* src, size_t len) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void*)(src + len - i - 64));
+        _mm512_storeu_si512((void*)(dst + i), reverse64_avx512(v));
+    }
+    reverse_copy_avx2(dst + i, src, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void expand_avx512(char* dst, const char* src, size_t len) {
+    const __m512i spaces = _mm512_set1_epi16(' ' << 8);
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        __m512i w = _mm512_or_si512(_mm512_cvtepu8_epi16(v), spaces);
+        _mm512_storeu_si512((void*)(dst + 2 * i), w);
+    }
+    expand_avx2(dst + 2 * i, src + i, len - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static size_t find_newlines_avx512(const char* str, size_t len, unsigned* offsets, size_t max) {
+    const __m512i nl = _mm512_set1_epi8('\n');
+    size_t count = 0;
+
+    for (size_t i = 0; i < len && count < max; i += 64) {
+        __mmask64 active = (len - i >= 64) ? ~(__mmask64)0 : (((__mmask64)1 << (len - i)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi8(active, str + i);
+        __mmask64 mask = _mm512_mask_cmpeq_epi8_mask(active, v, nl);
+        count = newlines_in_mask(mask, i, offsets, count, max);
+    }
+    return count;
+}
+
+#endif /* TEXT_KERNELS_X86 */
+
+/* ===== Dispatch ===== */
+
+static const text_kernels_t kernel_tables[TEXT_ISA_COUNT] = {
+    [TEXT_ISA_SCALAR] = { "scalar", upper_scalar, reverse_scalar, reverse_copy_scalar, expand_scalar,
+                          find_newlines_scalar },
+#ifdef TEXT_KERNELS_X86
+    [TEXT_ISA_SSE2]   = { "sse2", upper_sse2, reverse_sse2, reverse_copy_sse2, expand_sse2,
+                          find_newlines_sse2 },
+    [TEXT_ISA_AVX2]   = { "avx2", upper_avx2, reverse_avx2, reverse_copy_avx2, expand_avx2,
+                          find_newlines_avx2 },
+    [TEXT_ISA_AVX512] = { "avx512", upper_avx512, reverse_avx512, reverse_copy_avx512, expand_avx512,
+                          find_newlines_avx512 },
+#endif
+};
+
+static const text_kernels_t* g_selected;
+
+static int isa_supported(text_isa_t isa) {
+    switch (isa) {
+    case TEXT_ISA_SCALAR:
+        return 1;
+#ifdef TEXT_KERNELS_X86
+    case TEXT_ISA_SSE2:
+        return __builtin_cpu_supports("sse2");
+    case TEXT_ISA_AVX2:
+        return __builtin_cpu_supports("avx2");
+    case TEXT_ISA_AVX512:
+        return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw");
+#endif
+    default:
+        return 0;
+    }
+}
+
+const text_kernels_t* text_kernels_for(text_isa_t isa) { /* */
+    if (isa < 0 || isa >= TEXT_ISA_COUNT || !kernel_tables[isa].name) {
+        return NULL;
+    }
+#ifdef TEXT_KERNELS_X86
+    __builtin_cpu_init();
+#endif
+    return isa_supported(isa) ? &kernel_tables[isa] : NULL;
+}
+
+/*
+ * Pick the widest supported kernels when the plugin is loaded.
+ * TEXT_KERNELS=<name> in the environment caps the choice (e.g. "scalar"
+ * to compare against the reference implementation).
+ */
+__attribute__((constructor))
+static void select_kernels(void) {
+    const char* cap = getenv("TEXT_KERNELS");
+    int best = TEXT_ISA_SCALAR;
+
+    for (int isa = TEXT_ISA_SCALAR; isa < TEXT_ISA_COUNT; isa++) {
+        if (text_kernels_for((text_isa_t)isa)) {
+            best = isa;
+        }
+        if (cap && kernel_tables[isa].name && strcmp(cap, kernel_tables[isa].name) == 0) {
+            break;
+        }
+    }
+    g_selected = &kernel_tables[best];
+}
+
+const text_kernels_t* text_kernels(void) { /* */
+    if (!g_selected) {
+        select_kernels();
+    }
+    return g_selected;
+}
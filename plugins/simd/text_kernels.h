@@ -0,0 +1,60 @@
+/* */
+#ifndef TEXT_KERNELS_H
+#define TEXT_KERNELS_H
+
+#include <stddef.h>
+
+/**
+ * Instruction set a kernel table is built for
+ */
+typedef enum
+{
+    TEXT_ISA_SCALAR = 0,
+    TEXT_ISA_SSE2,
+    TEXT_ISA_AVX2,
+    TEXT_ISA_AVX512,
+    TEXT_ISA_COUNT
+} text_isa_t;
+
+/**
+ * Byte-oriented string kernels used by the built-in transforms.
+ * All lengths are in bytes and exclude the NUL terminator; the kernels
+ * never read or write past the lengths they are given.
+ */
+typedef struct
+{
+    const char* name; /* */
+
+    /* ASCII a-z to A-Z in place (same result as toupper in the C locale) */
+    void (*upper)(char* str, size_t len);
+
+    /* Reverse len bytes in place */
+    void (*reverse)(char* str, size_t len);
+
+    /* dst[i] = src[len - 1 - i]; buffers must not overlap */
+    void (*reverse_copy)(char* dst, const char* src, size_t len);
+
+    /* Write src[0] ' ' src[1] ' ' ... src[len-1] ' ' (2 * len bytes) to dst */
+    void (*expand)(char* dst, const char* src, size_t len);
+
+    /*
+     * Store the offsets of the first newlines in str, at most max of them;
+     * returns how many were stored. len must be below 4 GB.
+     */
+    size_t (*find_newlines)(const char* str, size_t len, unsigned* offsets, size_t max);
+} text_kernels_t;
+
+/**
+ * Get the kernels chosen for this CPU when the plugin was loaded
+ * @return The widest supported kernel table (never NULL)
+ */
+const text_kernels_t* text_kernels(void); /* */
+
+/**
+ * Get the kernel table for a specific instruction set
+ * @param isa Instruction set
+ * @return The table, or NULL if this CPU or build does not support it
+ */
+const text_kernels_t* text_kernels_for(text_isa_t isa); /* */
+
+#endif // TEXT_KERNELS_H
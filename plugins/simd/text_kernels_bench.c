@@ -0,0 +1,93 @@
+/* * Benchmark for text_kernels.c
+ * Reports throughput of every supported kernel table for line lengths
+ * from 16 B to 1 MB.
+ */
+#include "text_kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TARGET_BYTES (256UL << 20) /* Bytes processed per measurement */
+
+static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536, 1 << 20 };
+
+double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Run one kernel over a buffer of `len` bytes until TARGET_BYTES are done */
+double measure(const text_kernels_t* k, const char* op, char* buf, char* out, unsigned* offsets,
+               size_t len) {
+    size_t reps = TARGET_BYTES / len;
+    double start = now_sec();
+
+    for (size_t r = 0; r < reps; r++) {
+        if (strcmp(op, "upper") == 0) {
+            k->upper(buf, len);
+            buf[r % len] = 'a'; /* Keep work for the next round */
+        } else if (strcmp(op, "reverse") == 0) {
+            k->reverse(buf, len);
+        } else if (strcmp(op, "reverse_copy") == 0) {
+            k->reverse_copy(out, buf, len);
+        } else if (strcmp(op, "newlines") == 0) {
+            k->find_newlines(buf, len, offsets, len);
+        } else {
+            k->expand(out, buf, len);
+        }
+        __asm__ volatile("" : : "r"(buf), "r"(out) : "memory");
+    }
+
+    double elapsed = now_sec() - start;
+    return (double)(reps * len) / elapsed / 1e9;
+}
+
+
+int main() {
+    static const char* ops[] = { "upper", "reverse", "reverse_copy", "expand", "newlines" };
+    size_t max_len = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    char* buf = malloc(max_len);
+    char* out = malloc(2 * max_len);
+    unsigned* offsets = malloc(sizeof(unsigned) * max_len);
+    if (!buf || !out || !offsets) {
+        fprintf(stderr, "Error: Memory allocation failed.\n");
+        return 1;
+    }
+    for (size_t i = 0; i < max_len; i++) {
+        buf[i] = 'a' + (char)(i % 26);
+    }
+
+    printf("%-13s %-8s", "kernel", "isa");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        printf(" %9zu", sizes[s]);
+    }
+    printf("   (GB/s by line length in bytes)\n");
+
+    for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]); o++) {
+        if (strcmp(ops[o], "newlines") == 0) {
+            /* 64-byte lines */
+            for (size_t i = 63; i < max_len; i += 64) {
+                buf[i] = '\n';
+            }
+        }
+        for (int isa = TEXT_ISA_SCALAR; isa < TEXT_ISA_COUNT; isa++) {
+            const text_kernels_t* k = text_kernels_for((text_isa_t)isa);
+            if (!k) {
+                continue;
+            }
+            printf("%-13s %-8s", ops[o], k->name);
+            for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                printf(" %9.2f", measure(k, ops[o], buf, out, offsets, sizes[s]));
+                fflush(stdout);
+            }
+            printf("\n");
+        }
+    }
+
+    free(buf);
+    free(out);
+    free(offsets);
+    return 0;
+}
@@ -0,0 +1,135 @@
+/* * Unit test application for text_kernels.c
+ * Every vector kernel must produce byte-for-byte the same output as the
+ * scalar reference, for all lengths around the vector widths and for
+ * unaligned buffers.
+ */
+#include "text_kernels.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#define MAX_LEN 600
+#define GUARD 64
+
+/* Fill with every byte value except NUL, including bytes >= 0x80 */
+void fill_random(char* buf, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (char)(1 + rand() % 255);
+    }
+}
+
+/* Test 1: upper matches the scalar kernel and toupper in the C locale */
+void test_upper(const text_kernels_t* scalar, const text_kernels_t* k) {
+    char src[MAX_LEN + GUARD], want[MAX_LEN + GUARD], got[MAX_LEN + GUARD];
+
+    for (size_t len = 0; len < MAX_LEN; len++) {
+        for (size_t off = 0; off < 3; off++) {
+            fill_random(src, sizeof(src));
+            memcpy(want, src, sizeof(src));
+            memcpy(got, src, sizeof(src));
+
+            scalar->upper(want + off, len);
+            k->upper(got + off, len);
+            assert(memcmp(want, got, sizeof(src)) == 0);
+
+            for (size_t i = 0; i < len; i++) {
+                assert(want[off + i] == (char)toupper((unsigned char)src[off + i]));
+            }
+        }
+    }
+}
+
+/* Test 2: in-place and copying reverse match the scalar kernels */
+void test_reverse(const text_kernels_t* scalar, const text_kernels_t* k) {
+    char src[MAX_LEN + GUARD], want[MAX_LEN + GUARD], got[MAX_LEN + GUARD];
+
+    for (size_t len = 0; len < MAX_LEN; len++) {
+        size_t off = len % 5;
+        fill_random(src, sizeof(src));
+
+        memcpy(want, src, sizeof(src));
+        memcpy(got, src, sizeof(src));
+        scalar->reverse(want + off, len);
+        k->reverse(got + off, len);
+        assert(memcmp(want, got, sizeof(src)) == 0);
+
+        memset(want, 'x', sizeof(want));
+        memset(got, 'x', sizeof(got));
+        scalar->reverse_copy(want + off, src + 1, len);
+        k->reverse_copy(got + off, src + 1, len);
+        assert(memcmp(want, got, sizeof(src)) == 0);
+    }
+}
+
+/* Test 3: expand matches the scalar kernel and writes exactly 2 * len bytes */
+void test_expand(const text_kernels_t* scalar, const text_kernels_t* k) {
+    char src[MAX_LEN + GUARD], want[2 * MAX_LEN + GUARD], got[2 * MAX_LEN + GUARD];
+
+    for (size_t len = 0; len < MAX_LEN; len++) {
+        size_t off = len % 3;
+        fill_random(src, sizeof(src));
+        memset(want, 'x', sizeof(want));
+        memset(got, 'x', sizeof(got));
+
+        scalar->expand(want + off, src + off, len);
+        k->expand(got + off, src + off, len);
+        assert(memcmp(want, got, sizeof(want)) == 0);
+        assert(got[off + 2 * len] == 'x');
+    }
+}
+
+/* Test 4: find_newlines matches the scalar kernel, also when max cuts it short */
+void test_newlines(const text_kernels_t* scalar, const text_kernels_t* k) {
+    char src[MAX_LEN + GUARD];
+    unsigned want[MAX_LEN], got[MAX_LEN];
+
+    for (size_t len = 0; len < MAX_LEN; len++) {
+        size_t off = len % 7;
+        fill_random(src, sizeof(src));
+        /* From no newlines at all to one in every other byte */
+        for (size_t i = 0; i < sizeof(src); i++) {
+            if (rand() % (1 + len % 40) == 0) {
+                src[i] = '\n';
+            }
+        }
+
+        size_t max = len % 3 == 0 ? MAX_LEN : len % 11;
+        size_t n = scalar->find_newlines(src + off, len, want, max);
+        size_t found = k->find_newlines(src + off, len, got, max);
+        assert(found == n);
+        assert(memcmp(want, got, n * sizeof(unsigned)) == 0);
+        for (size_t i = 0; i < n; i++) {
+            assert(want[i] < len && src[off + want[i]] == '\n');
+        }
+    }
+}
+
+
+int main() {
+    printf("--- Running Text Kernel Unit Tests ---\n\n");
+    srand(1234);
+
+    const text_kernels_t* scalar = text_kernels_for(TEXT_ISA_SCALAR);
+    assert(scalar != NULL);
+    assert(text_kernels() != NULL);
+    printf("  [INFO] Selected kernels: %s\n\n", text_kernels()->name);
+
+    for (int isa = TEXT_ISA_SCALAR; isa < TEXT_ISA_COUNT; isa++) {
+        const text_kernels_t* k = text_kernels_for((text_isa_t)isa);
+        if (!k) {
+            printf("[TEST] Skipping ISA %d (not supported here)\n\n", isa);
+            continue;
+        }
+        printf("[TEST] Running: %s kernels match scalar\n", k->name);
+        test_upper(scalar, k);
+        test_reverse(scalar, k);
+        test_expand(scalar, k);
+        test_newlines(scalar, k);
+        printf("[TEST] PASS\n\n");
+    }
+
+    printf("--- All Text Kernel Tests Passed ---\n");
+    return 0;
+}
@@ -0,0 +1,891 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "stage_graph.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* ===== Topology parsing ===== */
+
+typedef enum
+{
+    TOKEN_STAGE = 0,
+    TOKEN_ARROW,    /* -> */
+    TOKEN_OPEN,     /* { */
+    TOKEN_CLOSE,    /* } */
+    TOKEN_COMMA,    /* , */
+    TOKEN_END
+} token_type_t;
+
+typedef struct
+{
+    token_type_t type;
+    const char* text;   /* Start of a stage spec */
+    size_t len;         /* */
+} token_t;
+
+typedef struct
+{
+    token_t* tokens;
+    int num_tokens;
+    int pos;
+    stage_graph_t* graph;
+    int specs_cap;
+    int edges_cap;
+} parser_t;
+
+/* Split text into tokens; the last one is TOKEN_END */
+static const char* tokenize(parser_t* p, const char* text) {
+    p->tokens = malloc(sizeof(token_t) * (strlen(text) + 1));
+    if (!p->tokens) {
+        return "Failed to allocate memory for topology";
+    }
+    p->num_tokens = 0;
+
+    const char* pos = text;
+    for (;;) {
+        while (*pos == ' ' || *pos == '\t' || *pos == '\n') {
+            pos++;
+        }
+        token_t* token = &p->tokens[p->num_tokens++];
+        token->text = pos;
+        token->len = 1;
+        if (*pos == '\0') {
+            token->type = TOKEN_END;
+            return NULL;
+        }
+        if (pos[0] == '-' && pos[1] == '>') {
+            token->type = TOKEN_ARROW;
+            token->len = 2;
+        } else if (*pos == '{') {
+            token->type = TOKEN_OPEN;
+        } else if (*pos == '}') {
+            token->type = TOKEN_CLOSE;
+        } else if (*pos == ',') {
+            token->type = TOKEN_COMMA;
+        } else {
+            /* A stage spec runs up to a delimiter; ",<digit>" continues a CPU list */
+            const char* end = pos;
+            while (*end && *end != ' ' && *end != '\t' && *end != '\n' && *end != '{' &&
+                   *end != '}' && !(end[0] == '-' && end[1] == '>') &&
+                   !(*end == ',' && (end[1] < '0' || end[1] > '9'))) {
+                end++;
+            }
+            token->type = TOKEN_STAGE;
+            token->len = (size_t)(end - pos);
+        }
+        pos += token->len;
+    }
+}
+
+static int accept(parser_t* p, token_type_t type) {
+    if (p->tokens[p->pos].type == type) {
+        p->pos++;
+        return 1;
+    }
+    return 0;
+}
+
+static const char* add_stage(parser_t* p, const token_t* token, int* index) {
+    stage_graph_t* graph = p->graph;
+    if (graph->count == p->specs_cap) {
+        int cap = p->specs_cap ? p->specs_cap * 2 : 8;
+        char** specs = realloc(graph->specs, sizeof(char*) * cap);
+        if (!specs) {
+            return "Failed to allocate memory for topology";
+        }
+        graph->specs = specs;
+        p->specs_cap = cap;
+    }
+    graph->specs[graph->count] = strndup(token->text, token->len);
+    if (!graph->specs[graph->count]) {
+        return "Failed to allocate memory for topology";
+    }
+    *index = graph->count++;
+    return NULL;
+}
+
+static const char* add_edge(parser_t* p, int from, int to) {
+    stage_graph_t* graph = p->graph;
+    if (graph->num_edges == p->edges_cap) {
+        int cap = p->edges_cap ? p->edges_cap * 2 : 8;
+        int* edge_from = realloc(graph->edge_from, sizeof(int) * cap);
+        if (edge_from) {
+            graph->edge_from = edge_from;
+        }
+        int* edge_to = realloc(graph->edge_to, sizeof(int) * cap);
+        if (edge_to) {
+            graph->edge_to = edge_to;
+        }
+        if (!edge_from || !edge_to) {
+            return "Failed to allocate memory for topology";
+        }
+        p->edges_cap = cap;
+    }
+    graph->edge_from[graph->num_edges] = from;
+    graph->edge_to[graph->num_edges] = to;
+    graph->num_edges++;
+    return NULL;
+}
+
+static const char* parse_chain(parser_t* p, const int* heads, int num_heads,
+                               int* tails, int* num_tails);
+
+/*
+ * A stage or a group of branches, fed by every stage in heads; tails
+ * receives the stages whose output leaves the element
+ */
+static const char* parse_element(parser_t* p, const int* heads, int num_heads,
+                                 int* tails, int* num_tails) {
+    token_t* token = &p->tokens[p->pos];
+    if (accept(p, TOKEN_STAGE)) {
+        int index = 0;
+        const char* err = add_stage(p, token, &index);
+        for (int i = 0; !err && i < num_heads; i++) {
+            err = add_edge(p, heads[i], index);
+        }
+        tails[0] = index;
+        *num_tails = 1;
+        return err;
+    }
+
+    if (!accept(p, TOKEN_OPEN)) {
+        return "expected a plugin name or {";
+    }
+    if (num_heads == 0) {
+        return "a topology starts with a single plugin";
+    }
+    *num_tails = 0;
+    do {
+        int num_branch;
+        const char* err = parse_chain(p, heads, num_heads, tails + *num_tails, &num_branch);
+        if (err) {
+            return err;
+        }
+        *num_tails += num_branch;
+    } while (accept(p, TOKEN_COMMA));
+    return accept(p, TOKEN_CLOSE) ? NULL : "expected , or }";
+}
+
+/* Elements joined by "->" */
+static const char* parse_chain(parser_t* p, const int* heads, int num_heads,
+                               int* tails, int* num_tails) {
+    /* Every stage token is at most one tail */
+    int* feed = malloc(sizeof(int) * p->num_tokens);
+    if (!feed) {
+        return "Failed to allocate memory for topology";
+    }
+    const char* err = parse_element(p, heads, num_heads, tails, num_tails);
+    while (!err && accept(p, TOKEN_ARROW)) {
+        memcpy(feed, tails, sizeof(int) * *num_tails);
+        err = parse_element(p, feed, *num_tails, tails, num_tails);
+    }
+    free(feed);
+    return err;
+}
+
+const char* stage_graph_parse(stage_graph_t* graph, const char* text) {
+    memset(graph, 0, sizeof(*graph));
+    parser_t p = { NULL, 0, 0, graph, 0, 0 };
+    const char* err = tokenize(&p, text);
+    int* tails = err ? NULL : malloc(sizeof(int) * p.num_tokens);
+    if (!err && !tails) {
+        err = "Failed to allocate memory for topology";
+    }
+    if (!err) {
+        int num_tails;
+        err = parse_chain(&p, NULL, 0, tails, &num_tails);
+    }
+    if (!err && !accept(&p, TOKEN_END)) {
+        err = p.tokens[p.pos].type == TOKEN_STAGE ? "expected -> between plugins"
+                                                  : "unexpected text after topology";
+    }
+    free(tails);
+    free(p.tokens);
+    if (err) {
+        stage_graph_destroy(graph);
+    }
+    return err;
+}
+
+const char* stage_graph_chain(stage_graph_t* graph, char* const* specs, int count) {
+    memset(graph, 0, sizeof(*graph));
+    graph->specs = calloc(count, sizeof(char*));
+    graph->edge_from = malloc(sizeof(int) * (count > 1 ? count - 1 : 1));
+    graph->edge_to = malloc(sizeof(int) * (count > 1 ? count - 1 : 1));
+    if (!graph->specs || !graph->edge_from || !graph->edge_to) {
+        stage_graph_destroy(graph);
+        return "Failed to allocate memory for topology";
+    }
+    for (int i = 0; i < count; i++) {
+        graph->specs[i] = strdup(specs[i]);
+        graph->count++;
+        if (!graph->specs[i]) {
+            stage_graph_destroy(graph);
+            return "Failed to allocate memory for topology";
+        }
+        if (i > 0) {
+            graph->edge_from[graph->num_edges] = i - 1;
+            graph->edge_to[graph->num_edges] = i;
+            graph->num_edges++;
+        }
+    }
+    return NULL;
+}
+
+int stage_graph_is_topology(const char* text) {
+    return strstr(text, "->") || strchr(text, '{') || strchr(text, '}');
+}
+
+int stage_graph_is_chain(const stage_graph_t* graph) {
+    if (graph->num_edges != (graph->count > 0 ? graph->count - 1 : 0)) {
+        return 0;
+    }
+    for (int i = 0; i < graph->num_edges; i++) {
+        if (graph->edge_from[i] != i || graph->edge_to[i] != i + 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void stage_graph_destroy(stage_graph_t* graph) {
+    for (int i = 0; i < graph->count; i++) {
+        free(graph->specs[i]);
+    }
+    free(graph->specs);
+    free(graph->edge_from);
+    free(graph->edge_to);
+    memset(graph, 0, sizeof(*graph));
+}
+
+/* ===== Fan-out and fan-in ===== */
+
+/* Release one reference to a moved buffer */
+static void release(buffer_pool_t* pool, char* item) {
+    if (pool) {
+        buffer_pool_free(item);
+    } else {
+        free(item);
+    }
+}
+
+/* Copy strings to a link; the link makes its own copies */
+static const char* send_copies(const plugin_link_t* link, const char* const* items, int count) {
+    if (link->place_work_many) {
+        return link->place_work_many(link->target, items, count);
+    }
+    const char* err = NULL;
+    for (int i = 0; i < count && !err; i++) {
+        err = link->place_work(link->target, items[i]);
+    }
+    return err;
+}
+
+/* Move buffers to a link, or copy them there and free them if it cannot take them */
+static const char* send_moved(const plugin_link_t* link, buffer_pool_t* pool,
+                              char* const* items, int count) {
+    if (link->place_work_move) {
+        return link->place_work_move(link->target, items, count);
+    }
+    const char* err = send_copies(link, (const char* const*)items, count);
+    for (int i = 0; i < count; i++) {
+        release(pool, items[i]);
+    }
+    return err;
+}
+
+/* Send a control message to a link; a string-ABI link gets its marker string */
+static const char* send_control(const plugin_link_t* link, plugin_item_kind_t kind) {
+    if (link->place_work_slices) {
+        char* item = NULL;
+        size_t len = PLUGIN_CONTROL_LEN(kind);
+        return link->place_work_slices(link->target, &item, &len, 1);
+    }
+    const char* marker = plugin_marker_string(kind);
+    return marker ? link->place_work(link->target, marker) : NULL;
+}
+
+/*
+ * Move buffers with their lengths to a link. Without the slice ABI the
+ * runs of data go through send_moved and control messages as strings.
+ */
+static const char* send_slices(const plugin_link_t* link, buffer_pool_t* pool,
+                               char* const* items, const size_t* lens, int count) {
+    if (link->place_work_slices) {
+        return link->place_work_slices(link->target, items, lens, count);
+    }
+    const char* err = NULL;
+    int start = 0;
+    for (int i = 0; i <= count; i++) {
+        if (i < count && plugin_item_kind(lens[i]) == PLUGIN_ITEM_DATA) {
+            continue;
+        }
+        const char* out_err = i > start ? send_moved(link, pool, items + start, i - start) : NULL;
+        const char* control_err = i < count ? send_control(link, plugin_item_kind(lens[i])) : NULL;
+        err = err ? err : out_err ? out_err : control_err;
+        start = i + 1;
+    }
+    return err;
+}
+
+/* Give a link copies of buffers that may contain NUL bytes */
+static const char* send_slice_copies(const plugin_link_t* link, char* const* items,
+                                     const size_t* lens, int count) {
+    const char* err = NULL;
+    for (int start = 0; start < count && !err; start += 64) {
+        char* copies[64];
+        int n = count - start < 64 ? count - start : 64;
+        for (int i = 0; i < n; i++) {
+            if (plugin_item_kind(lens[start + i]) != PLUGIN_ITEM_DATA) {
+                copies[i] = NULL;
+                continue;
+            }
+            copies[i] = malloc(lens[start + i] + 1);
+            if (!copies[i]) {
+                while (i-- > 0) {
+                    free(copies[i]);
+                }
+                return "Failed to allocate memory for fan-out";
+            }
+            memcpy(copies[i], items[start + i], lens[start + i] + 1);
+        }
+        err = send_slices(link, NULL, copies, lens + start, n);
+    }
+    return err;
+}
+
+static const char* tee_place_work(void* target, const char* str) {
+    stage_tee_t* tee = (stage_tee_t*)target;
+    const char* err = NULL;
+    for (int i = 0; i < tee->count; i++) {
+        const char* out_err = tee->outputs[i].place_work(tee->outputs[i].target, str);
+        err = err ? err : out_err;
+    }
+    return err;
+}
+
+static const char* tee_place_work_many(void* target, const char* const* items, int count) {
+    stage_tee_t* tee = (stage_tee_t*)target;
+    const char* err = NULL;
+    for (int i = 0; i < tee->count; i++) {
+        const char* out_err = send_copies(&tee->outputs[i], items, count);
+        err = err ? err : out_err;
+    }
+    return err;
+}
+
+static const char* tee_place_work_move(void* target, char* const* items, int count) {
+    stage_tee_t* tee = (stage_tee_t*)target;
+    const char* err = NULL;
+    for (int i = 0; i < tee->count - 1; i++) {
+        const char* out_err;
+        if (tee->pool) {
+            /* Every output but the last gets a reference of its own */
+            for (int j = 0; j < count; j++) {
+                buffer_pool_retain(items[j]);
+            }
+            out_err = send_moved(&tee->outputs[i], tee->pool, items, count);
+        } else {
+            out_err = send_copies(&tee->outputs[i], (const char* const*)items, count);
+        }
+        err = err ? err : out_err;
+    }
+    const char* out_err = send_moved(&tee->outputs[tee->count - 1], tee->pool, items, count);
+    return err ? err : out_err;
+}
+
+/* Same as tee_place_work_move, keeping the lengths */
+static const char* tee_place_work_slices(void* target, char* const* items, const size_t* lens,
+                                         int count) {
+    stage_tee_t* tee = (stage_tee_t*)target;
+    const char* err = NULL;
+    for (int i = 0; i < tee->count - 1; i++) {
+        const char* out_err;
+        if (tee->pool) {
+            for (int j = 0; j < count; j++) {
+                if (items[j]) {
+                    buffer_pool_retain(items[j]);
+                }
+            }
+            out_err = send_slices(&tee->outputs[i], tee->pool, items, lens, count);
+        } else {
+            out_err = send_slice_copies(&tee->outputs[i], items, lens, count);
+        }
+        err = err ? err : out_err;
+    }
+    const char* out_err = send_slices(&tee->outputs[tee->count - 1], tee->pool, items, lens,
+                                      count);
+    return err ? err : out_err;
+}
+
+const char* stage_tee_init(stage_tee_t* tee, const plugin_link_t* outputs, int count,
+                           buffer_pool_t* pool) {
+    if (count <= 0) {
+        return "Fan-out needs at least one output";
+    }
+    tee->outputs = malloc(sizeof(plugin_link_t) * count);
+    if (!tee->outputs) {
+        return "Failed to allocate memory for fan-out";
+    }
+    memcpy(tee->outputs, outputs, sizeof(plugin_link_t) * count);
+    tee->count = count;
+    tee->pool = pool;
+    return NULL;
+}
+
+void stage_tee_link(stage_tee_t* tee, plugin_link_t* link) {
+    link->target = tee;
+    link->place_work = tee_place_work;
+    link->place_work_many = tee_place_work_many;
+    link->place_work_move = tee_place_work_move;
+    link->place_work_slices = tee_place_work_slices;
+}
+
+void stage_tee_destroy(stage_tee_t* tee) {
+    free(tee->outputs);
+    tee->outputs = NULL;
+    tee->count = 0;
+}
+
+/* Append an owned buffer to a port's ring, growing it as needed */
+static const char* port_push(stage_merge_port_t* port, char* item, size_t len) {
+    if (port->count == port->cap) {
+        size_t cap = port->cap ? port->cap * 2 : 64;
+        char** items = malloc(sizeof(char*) * cap);
+        size_t* lens = malloc(sizeof(size_t) * cap);
+        if (!items || !lens) {
+            free(items);
+            free(lens);
+            return "Failed to allocate memory for fan-in";
+        }
+        for (size_t i = 0; i < port->count; i++) {
+            items[i] = port->items[(port->head + i) % port->cap];
+            lens[i] = port->lens[(port->head + i) % port->cap];
+        }
+        free(port->items);
+        free(port->lens);
+        port->items = items;
+        port->lens = lens;
+        port->cap = cap;
+        port->head = 0;
+    }
+    port->items[(port->head + port->count) % port->cap] = item;
+    port->lens[(port->head + port->count) % port->cap] = len;
+    port->count++;
+    return NULL;
+}
+
+static char* port_pop(stage_merge_port_t* port, size_t* len) {
+    char* item = port->items[port->head];
+    *len = port->lens[port->head];
+    port->head = (port->head + 1) % port->cap;
+    port->count--;
+    return item;
+}
+
+/*
+ * Ordered merge: send every complete round (one item from each input, in
+ * input order); once all inputs have ended, send what is left. Called
+ * with the lock held.
+ */
+static const char* merge_drain(stage_merge_t* merge) {
+    char* batch[64];
+    size_t lens[64];
+    int n = 0;
+    const char* err = NULL;
+    int all_ended = merge->ended + merge->flushed >= merge->count;
+
+    for (;;) {
+        int full = 1;
+        int any = 0;
+        for (int i = 0; i < merge->count; i++) {
+            full = full && merge->ports[i].count > 0;
+            any = any || merge->ports[i].count > 0;
+        }
+        if (!(full || (all_ended && any))) {
+            break;
+        }
+        for (int i = 0; i < merge->count; i++) {
+            if (merge->ports[i].count == 0) {
+                continue;
+            }
+            batch[n] = port_pop(&merge->ports[i], &lens[n]);
+            if (++n == (int)(sizeof(batch) / sizeof(batch[0]))) {
+                const char* out_err = send_slices(&merge->output, merge->pool, batch, lens, n);
+                err = err ? err : out_err;
+                n = 0;
+            }
+        }
+    }
+    if (n > 0) {
+        const char* out_err = send_slices(&merge->output, merge->pool, batch, lens, n);
+        err = err ? err : out_err;
+    }
+    return err;
+}
+
+/* Whether every input that has not ended has sent a barrier not yet passed on */
+static int barrier_complete(const stage_merge_t* merge) {
+    int any = 0;
+    for (int i = 0; i < merge->count; i++) {
+        if (merge->ports[i].barriers == 0 && !merge->ports[i].ended) {
+            return 0;
+        }
+        any = any || merge->ports[i].barriers > 0;
+    }
+    return any;
+}
+
+/* Pass on every barrier all live inputs have sent (lock held) */
+static const char* release_barriers(stage_merge_t* merge) {
+    const char* err = NULL;
+    while (barrier_complete(merge)) {
+        for (int i = 0; i < merge->count; i++) {
+            if (merge->ports[i].barriers > 0) {
+                merge->ports[i].barriers--;
+            }
+        }
+        const char* out_err = send_control(&merge->output, PLUGIN_ITEM_BARRIER);
+        err = err ? err : out_err;
+    }
+    return err;
+}
+
+/* Count an input's barrier; it goes out after what came before it everywhere (lock held) */
+static const char* merge_barrier(stage_merge_port_t* port) {
+    stage_merge_t* merge = port->merge;
+    port->barriers++;
+    const char* err = merge->ordered ? merge_drain(merge) : NULL;
+    const char* barrier_err = release_barriers(merge);
+    return err ? err : barrier_err;
+}
+
+/* Count an input's <END>; the last one is passed on (lock held) */
+static const char* merge_end(stage_merge_port_t* port) {
+    stage_merge_t* merge = port->merge;
+    if (port->ended) {
+        return NULL;
+    }
+    port->ended = 1;
+    if (++merge->ended + merge->flushed < merge->count) {
+        const char* err = merge->ordered ? merge_drain(merge) : NULL;
+        const char* barrier_err = release_barriers(merge);
+        return err ? err : barrier_err;
+    }
+    const char* err = merge->ordered ? merge_drain(merge) : NULL;
+    const char* barrier_err = release_barriers(merge);
+    const char* end_err = send_control(&merge->output, PLUGIN_ITEM_END);
+    return err ? err : barrier_err ? barrier_err : end_err;
+}
+
+/*
+ * Count an input's <FLUSH>; once every input has sent one, everything
+ * before them goes out followed by a single <FLUSH> (lock held)
+ */
+static const char* merge_flush(stage_merge_port_t* port) {
+    stage_merge_t* merge = port->merge;
+    if (port->flushed) {
+        return NULL;
+    }
+    port->flushed = 1;
+    if (merge->ended + ++merge->flushed < merge->count) {
+        return merge->ordered ? merge_drain(merge) : NULL;
+    }
+    const char* err = merge->ordered ? merge_drain(merge) : NULL;
+    for (int i = 0; i < merge->count; i++) {
+        merge->ports[i].flushed = 0;
+    }
+    merge->flushed = 0;
+    const char* flush_err = send_control(&merge->output, PLUGIN_ITEM_FLUSH);
+    return err ? err : flush_err;
+}
+
+/* Handle a control message arriving at a port (lock held) */
+static const char* merge_control(stage_merge_port_t* port, plugin_item_kind_t kind) {
+    if (kind == PLUGIN_ITEM_END) {
+        return merge_end(port);
+    }
+    return kind == PLUGIN_ITEM_FLUSH ? merge_flush(port) : merge_barrier(port);
+}
+
+static const char* locked_control(stage_merge_port_t* port, plugin_item_kind_t kind) {
+    pthread_mutex_lock(&port->merge->lock);
+    const char* err = merge_control(port, kind);
+    pthread_mutex_unlock(&port->merge->lock);
+    return err;
+}
+
+/* Kind of an item moved into a port; without lens only marker strings are control */
+static plugin_item_kind_t item_kind(char* const* items, const size_t* lens, int i) {
+    return lens ? plugin_item_kind(lens[i]) : plugin_marker_kind(items[i]);
+}
+
+/*
+ * Take ownership of items arriving at a port and send what can go out;
+ * without lens the items are measured
+ */
+static const char* merge_take(stage_merge_port_t* port, char* const* items, const size_t* lens,
+                              int count) {
+    stage_merge_t* merge = port->merge;
+    const char* err = NULL;
+    for (int i = 0; i < count; i++) {
+        plugin_item_kind_t kind = item_kind(items, lens, i);
+        if (kind != PLUGIN_ITEM_DATA) {
+            release(merge->pool, items[i]);
+            const char* control_err = merge_control(port, kind);
+            err = err ? err : control_err;
+            continue;
+        }
+        if (!err) {
+            err = port_push(port, items[i], lens ? lens[i] : strlen(items[i]));
+        }
+        if (err) {
+            release(merge->pool, items[i]);
+        }
+    }
+    const char* drain_err = merge_drain(merge);
+    return err ? err : drain_err;
+}
+
+static const char* merge_place_work(void* target, const char* str) {
+    stage_merge_port_t* port = (stage_merge_port_t*)target;
+    stage_merge_t* merge = port->merge;
+    const char* err;
+
+    pthread_mutex_lock(&merge->lock);
+    plugin_item_kind_t kind = plugin_marker_kind(str);
+    if (kind != PLUGIN_ITEM_DATA) {
+        err = merge_control(port, kind);
+    } else if (!merge->ordered) {
+        err = merge->output.place_work(merge->output.target, str);
+    } else {
+        char* copy = merge->pool ? buffer_pool_strdup(merge->pool, str) : strdup(str);
+        err = copy ? merge_take(port, &copy, NULL, 1) : "Failed to duplicate string for fan-in";
+    }
+    pthread_mutex_unlock(&merge->lock);
+    return err;
+}
+
+static const char* merge_place_work_many(void* target, const char* const* items, int count) {
+    stage_merge_port_t* port = (stage_merge_port_t*)target;
+    stage_merge_t* merge = port->merge;
+    if (!merge->ordered) {
+        /* The downstream queue takes several producers; no need to serialize */
+        const char* err = NULL;
+        int start = 0;
+        for (int i = 0; i <= count; i++) {
+            plugin_item_kind_t kind = i < count ? plugin_marker_kind(items[i]) : PLUGIN_ITEM_DATA;
+            if (i < count && kind == PLUGIN_ITEM_DATA) {
+                continue;
+            }
+            const char* out_err = i > start ? send_copies(&merge->output, items + start, i - start)
+                                            : NULL;
+            const char* flush_err = i < count ? locked_control(port, kind) : NULL;
+            err = err ? err : out_err ? out_err : flush_err;
+            start = i + 1;
+        }
+        return err;
+    }
+
+    const char* err = NULL;
+    for (int i = 0; i < count && !err; i++) {
+        err = merge_place_work(target, items[i]);
+    }
+    return err;
+}
+
+/* Move items into a port, with their lengths if lens is not NULL */
+static const char* merge_place_work_slices(void* target, char* const* items, const size_t* lens,
+                                           int count) {
+    stage_merge_port_t* port = (stage_merge_port_t*)target;
+    stage_merge_t* merge = port->merge;
+    if (!merge->ordered) {
+        const char* err = NULL;
+        int start = 0;
+        for (int i = 0; i <= count; i++) {
+            plugin_item_kind_t kind = i < count ? item_kind(items, lens, i) : PLUGIN_ITEM_DATA;
+            if (i < count && kind == PLUGIN_ITEM_DATA) {
+                continue;
+            }
+            const char* out_err = NULL;
+            if (i > start && lens) {
+                out_err = send_slices(&merge->output, merge->pool, items + start, lens + start,
+                                      i - start);
+            } else if (i > start) {
+                out_err = send_moved(&merge->output, merge->pool, items + start, i - start);
+            }
+            const char* flush_err = NULL;
+            if (i < count) {
+                release(merge->pool, items[i]);
+                flush_err = locked_control(port, kind);
+            }
+            err = err ? err : out_err ? out_err : flush_err;
+            start = i + 1;
+        }
+        return err;
+    }
+
+    pthread_mutex_lock(&merge->lock);
+    const char* err = merge_take(port, items, lens, count);
+    pthread_mutex_unlock(&merge->lock);
+    return err;
+}
+
+static const char* merge_place_work_move(void* target, char* const* items, int count) {
+    return merge_place_work_slices(target, items, NULL, count);
+}
+
+const char* stage_merge_init(stage_merge_t* merge, const plugin_link_t* output, int inputs,
+                             int ordered, buffer_pool_t* pool) {
+    if (inputs <= 0) {
+        return "Fan-in needs at least one input";
+    }
+    merge->ports = calloc(inputs, sizeof(stage_merge_port_t));
+    if (!merge->ports) {
+        return "Failed to allocate memory for fan-in";
+    }
+    if (pthread_mutex_init(&merge->lock, NULL) != 0) {
+        free(merge->ports);
+        return "Failed to initialize fan-in lock";
+    }
+    for (int i = 0; i < inputs; i++) {
+        merge->ports[i].merge = merge;
+        merge->ports[i].index = i;
+    }
+    merge->output = *output;
+    merge->count = inputs;
+    merge->ordered = ordered;
+    merge->ended = 0;
+    merge->flushed = 0;
+    merge->pool = pool;
+    return NULL;
+}
+
+void stage_merge_link(stage_merge_t* merge, int index, plugin_link_t* link) {
+    link->target = &merge->ports[index];
+    link->place_work = merge_place_work;
+    link->place_work_many = merge_place_work_many;
+    link->place_work_move = merge_place_work_move;
+    link->place_work_slices = merge_place_work_slices;
+}
+
+void stage_merge_destroy(stage_merge_t* merge) {
+    for (int i = 0; i < merge->count; i++) {
+        stage_merge_port_t* port = &merge->ports[i];
+        size_t len;
+        while (port->count > 0) {
+            release(merge->pool, port_pop(port, &len));
+        }
+        free(port->items);
+        free(port->lens);
+    }
+    free(merge->ports);
+    merge->ports = NULL;
+    merge->count = 0;
+    pthread_mutex_destroy(&merge->lock);
+}
+
+/* ===== Pipeline tail ===== */
+
+/* Monotonic time in nanoseconds */
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+/* Handle a control message that reached the end of a branch */
+static void tail_control(stage_tail_t* tail, plugin_item_kind_t kind) {
+    pthread_mutex_lock(&tail->lock);
+    if (kind == PLUGIN_ITEM_FLUSH) {
+        tail->flushes++;
+        pthread_cond_broadcast(&tail->arrived);
+    } else if (kind == PLUGIN_ITEM_BARRIER && tail->barrier_branches > 0 &&
+               ++tail->barrier_arrivals == tail->barrier_branches) {
+        unsigned long long elapsed = now_ns() - tail->barrier_sent_ns;
+        tail->drain.latency[stage_metrics_bucket(elapsed)]++;
+        tail->drain.count++;
+        tail->barrier_branches = 0;
+    }
+    pthread_mutex_unlock(&tail->lock);
+}
+
+static const char* tail_place_work(void* target, const char* str) {
+    plugin_item_kind_t kind = plugin_marker_kind(str);
+    if (kind != PLUGIN_ITEM_DATA) {
+        tail_control((stage_tail_t*)target, kind);
+    }
+    return NULL;
+}
+
+static const char* tail_place_work_slices(void* target, char* const* items, const size_t* lens,
+                                          int count) {
+    stage_tail_t* tail = (stage_tail_t*)target;
+    for (int i = 0; i < count; i++) {
+        plugin_item_kind_t kind = lens ? plugin_item_kind(lens[i]) : plugin_marker_kind(items[i]);
+        if (kind != PLUGIN_ITEM_DATA) {
+            tail_control(tail, kind);
+        }
+        release(tail->pool, items[i]);
+    }
+    return NULL;
+}
+
+static const char* tail_place_work_move(void* target, char* const* items, int count) {
+    return tail_place_work_slices(target, items, NULL, count);
+}
+
+const char* stage_tail_init(stage_tail_t* tail, buffer_pool_t* pool) {
+    memset(tail, 0, sizeof(*tail));
+    if (pthread_mutex_init(&tail->lock, NULL) != 0) {
+        return "Failed to initialize pipeline tail lock";
+    }
+    if (pthread_cond_init(&tail->arrived, NULL) != 0) {
+        pthread_mutex_destroy(&tail->lock);
+        return "Failed to initialize pipeline tail condition";
+    }
+    tail->pool = pool;
+    return NULL;
+}
+
+void stage_tail_link(stage_tail_t* tail, plugin_link_t* link) {
+    link->target = tail;
+    link->place_work = tail_place_work;
+    link->place_work_many = NULL;
+    link->place_work_move = tail_place_work_move;
+    link->place_work_slices = tail_place_work_slices;
+}
+
+void stage_tail_wait_flush(stage_tail_t* tail, int count) {
+    pthread_mutex_lock(&tail->lock);
+    while (tail->flushes < count) {
+        pthread_cond_wait(&tail->arrived, &tail->lock);
+    }
+    tail->flushes -= count;
+    pthread_mutex_unlock(&tail->lock);
+}
+
+int stage_tail_begin_barrier(stage_tail_t* tail, int branches) {
+    pthread_mutex_lock(&tail->lock);
+    int begin = tail->barrier_branches == 0 && branches > 0;
+    if (begin) {
+        tail->barrier_branches = branches;
+        tail->barrier_arrivals = 0;
+        tail->barrier_sent_ns = now_ns();
+    }
+    pthread_mutex_unlock(&tail->lock);
+    return begin;
+}
+
+void stage_tail_get_drain(stage_tail_t* tail, stage_drain_t* drain) {
+    pthread_mutex_lock(&tail->lock);
+    *drain = tail->drain;
+    pthread_mutex_unlock(&tail->lock);
+}
+
+void stage_tail_destroy(stage_tail_t* tail) {
+    pthread_cond_destroy(&tail->arrived);
+    pthread_mutex_destroy(&tail->lock);
+}
@@ -0,0 +1,233 @@
+/* */
+#ifndef STAGE_GRAPH_H
+#define STAGE_GRAPH_H
+
+#include "plugin_sdk.h"
+#include "buffer_pool.h"
+#include "stage_metrics.h"
+#include <pthread.h>
+
+/**
+ * Stages of a pipeline and the edges between them. Stages are numbered in
+ * the order they appear, which is also a topological order: every edge
+ * goes from a lower to a higher number, and stage 0 takes the input.
+ */
+typedef struct
+{
+    char** specs;       /* Stage specs ("name@N:key=value..."), owned */
+    int count;          /* */
+    int* edge_from;     /* Edge i goes from stage edge_from[i] to edge_to[i] */
+    int* edge_to;       /* */
+    int num_edges;      /* */
+} stage_graph_t;
+
+/**
+ * Build the graph of a straight chain: each stage feeds the next one
+ * @param graph Graph to initialize
+ * @param specs Stage specs in chain order (copied)
+ * @param count Number of stages
+ * @return NULL on success, error message on failure
+ */
+const char* stage_graph_chain(stage_graph_t* graph, char* const* specs, int count); /* */
+
+/**
+ * Parse a topology such as "uppercaser -> {logger, flipper -> expander}".
+ * "a -> b" feeds a's output to b; "{x, y}" runs branches x and y side by
+ * side on the same input (fan-out); a stage after a group takes the output
+ * of every branch (fan-in). Groups nest. Inside a stage spec a comma
+ * followed by a digit belongs to a CPU list, e.g. "rotator:cpu=0,2".
+ * @param graph Graph to initialize
+ * @param text Topology to parse
+ * @return NULL on success, error message on failure
+ */
+const char* stage_graph_parse(stage_graph_t* graph, const char* text); /* */
+
+/**
+ * Check whether text uses topology syntax ("->", "{" or "}")
+ * @param text Command-line argument
+ * @return Nonzero if it does
+ */
+int stage_graph_is_topology(const char* text); /* */
+
+/**
+ * Check whether every stage feeds only the next one, as on a plain command line
+ * @param graph Graph to check
+ * @return Nonzero for a straight chain
+ */
+int stage_graph_is_chain(const stage_graph_t* graph); /* */
+
+/**
+ * Free the graph's specs and edges
+ * @param graph Graph to free
+ */
+void stage_graph_destroy(stage_graph_t* graph); /* */
+
+/**
+ * Fan-out: a link target that hands everything it receives to several
+ * downstream links. With a pool, moved buffers are shared (one reference
+ * per output, see buffer_pool_retain) instead of copied; without one,
+ * every output but the last gets a copy.
+ */
+typedef struct
+{
+    plugin_link_t* outputs; /* */
+    int count;              /* */
+    buffer_pool_t* pool;    /* Pool the moved buffers come from, NULL for malloc */
+} stage_tee_t;
+
+/**
+ * Set up a fan-out
+ * @param tee Fan-out to initialize
+ * @param outputs Downstream links (copied)
+ * @param count Number of outputs
+ * @param pool Pool the pipeline's buffers come from, or NULL
+ * @return NULL on success, error message on failure
+ */
+const char* stage_tee_init(stage_tee_t* tee, const plugin_link_t* outputs, int count,
+                           buffer_pool_t* pool); /* */
+
+/**
+ * Link an upstream stage attaches to in order to feed the fan-out
+ * @param tee Fan-out
+ * @param link Receives the entry points
+ */
+void stage_tee_link(stage_tee_t* tee, plugin_link_t* link); /* */
+
+/**
+ * Free a fan-out
+ * @param tee Fan-out to free
+ */
+void stage_tee_destroy(stage_tee_t* tee); /* */
+
+struct stage_merge;
+
+/**
+ * One input of a fan-in, the target of one upstream branch's link
+ */
+typedef struct
+{
+    struct stage_merge* merge;  /* */
+    int index;                  /* Position among the merge's inputs */
+    char** items;               /* Ordered merge: items waiting for the other inputs */
+    size_t* lens;               /* Their lengths */
+    size_t head;                /* Ring position of the oldest waiting item */
+    size_t count;               /* */
+    size_t cap;                 /* */
+    int ended;                  /* <END> received */
+    int flushed;                /* <FLUSH> received since the last one went out */
+    int barriers;               /* Barriers received and not yet passed on */
+} stage_merge_port_t;
+
+/**
+ * Fan-in: several upstream branches feed one downstream link, which gets a
+ * single <END> (or <FLUSH>, or barrier) once every branch has sent one. Unordered,
+ * items are passed on as they arrive (the downstream queue must accept
+ * several producers).
+ * Ordered, the n-th items of all inputs go out together, in input order:
+ * with branches that each emit one line per input line, every input line's
+ * results stay adjacent and in branch order. A branch that runs ahead is
+ * buffered without bound until the others catch up.
+ */
+typedef struct stage_merge
+{
+    plugin_link_t output;       /* */
+    stage_merge_port_t* ports;  /* */
+    int count;                  /* */
+    int ordered;                /* */
+    int ended;                  /* Inputs that have sent <END> */
+    int flushed;                /* Inputs that have sent <FLUSH> since the last one went out */
+    buffer_pool_t* pool;        /* Pool the moved buffers come from, NULL for malloc */
+    pthread_mutex_t lock;       /* Guards ports, ended and flushed */
+} stage_merge_t;
+
+/**
+ * Set up a fan-in
+ * @param merge Fan-in to initialize
+ * @param output Downstream link (copied)
+ * @param inputs Number of upstream branches
+ * @param ordered Nonzero to interleave inputs in order, zero to pass items on as they come
+ * @param pool Pool the pipeline's buffers come from, or NULL
+ * @return NULL on success, error message on failure
+ */
+const char* stage_merge_init(stage_merge_t* merge, const plugin_link_t* output, int inputs,
+                             int ordered, buffer_pool_t* pool); /* */
+
+/**
+ * Link the upstream branch feeding input `index` attaches to
+ * @param merge Fan-in
+ * @param index Input number, 0 to inputs-1
+ * @param link Receives the entry points
+ */
+void stage_merge_link(stage_merge_t* merge, int index, plugin_link_t* link); /* */
+
+/**
+ * Free a fan-in and any items still buffered
+ * @param merge Fan-in to free
+ */
+void stage_merge_destroy(stage_merge_t* merge); /* */
+
+/**
+ * End of the pipeline: the link target of the last stage of every branch.
+ * Lines are dropped. FLUSH messages are counted, so the server knows when
+ * all of a client's lines have been through every branch. A barrier is
+ * timed from being sent into the first stage until the last branch has
+ * delivered it; only one is in flight at a time, so counting its arrivals
+ * is enough.
+ */
+typedef struct
+{
+    pthread_mutex_t lock;       /* */
+    pthread_cond_t arrived;     /* A FLUSH arrived */
+    int flushes;                /* FLUSH messages that arrived and were not waited for yet */
+    int barrier_branches;       /* Branches the barrier in flight must leave, 0 if none */
+    int barrier_arrivals;       /* Branches it has left */
+    unsigned long long barrier_sent_ns; /* When it was sent */
+    stage_drain_t drain;        /* Drain times of the barriers that left every branch */
+    buffer_pool_t* pool;        /* Pool the moved buffers come from, NULL for malloc */
+} stage_tail_t;
+
+/**
+ * Set up a pipeline tail
+ * @param tail Tail to initialize
+ * @param pool Pool the pipeline's buffers come from, or NULL
+ * @return NULL on success, error message on failure
+ */
+const char* stage_tail_init(stage_tail_t* tail, buffer_pool_t* pool); /* */
+
+/**
+ * Link the last stage of a branch attaches to
+ * @param tail Pipeline tail
+ * @param link Receives the entry points
+ */
+void stage_tail_link(stage_tail_t* tail, plugin_link_t* link); /* */
+
+/**
+ * Wait until count FLUSH messages have arrived, and consume them
+ * @param tail Pipeline tail
+ * @param count Number of messages (one per branch end)
+ */
+void stage_tail_wait_flush(stage_tail_t* tail, int count); /* */
+
+/**
+ * Start timing a barrier, unless one is still in flight. On success the
+ * caller sends the barrier into the first stage right away.
+ * @param tail Pipeline tail
+ * @param branches Number of branch ends the barrier arrives from
+ * @return Nonzero if a barrier should be sent now
+ */
+int stage_tail_begin_barrier(stage_tail_t* tail, int branches); /* */
+
+/**
+ * Read the drain times recorded so far; safe while the pipeline runs
+ * @param tail Pipeline tail
+ * @param drain Receives the histogram
+ */
+void stage_tail_get_drain(stage_tail_t* tail, stage_drain_t* drain); /* */
+
+/**
+ * Free a pipeline tail
+ * @param tail Tail to free
+ */
+void stage_tail_destroy(stage_tail_t* tail); /* */
+
+#endif // STAGE_GRAPH_H
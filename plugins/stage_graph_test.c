@@ -0,0 +1,438 @@
+/* * Unit test application for stage_graph.c
+ */
+#include "stage_graph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* A link target that records what reaches it */
+typedef struct
+{
+    char* items[64];
+    size_t lens[64];
+    int count;
+    int ends;
+    int barriers;
+} sink_t;
+
+const char* sink_place_work(void* target, const char* str) {
+    sink_t* sink = (sink_t*)target;
+    if (strcmp(str, "<END>") == 0) {
+        sink->ends++;
+    } else {
+        sink->items[sink->count++] = strdup(str);
+    }
+    return NULL;
+}
+
+const char* sink_place_work_move(void* target, char* const* items, int count) {
+    sink_t* sink = (sink_t*)target;
+    for (int i = 0; i < count; i++) {
+        sink->items[sink->count++] = items[i];
+    }
+    return NULL;
+}
+
+const char* sink_place_work_slices(void* target, char* const* items, const size_t* lens, int count) {
+    sink_t* sink = (sink_t*)target;
+    for (int i = 0; i < count; i++) {
+        if (plugin_item_kind(lens[i]) == PLUGIN_ITEM_END) {
+            sink->ends++;
+            continue;
+        }
+        if (plugin_item_kind(lens[i]) == PLUGIN_ITEM_BARRIER) {
+            sink->barriers++;
+            continue;
+        }
+        sink->lens[sink->count] = lens[i];
+        sink->items[sink->count++] = items[i];
+    }
+    return NULL;
+}
+
+plugin_link_t sink_slice_link(sink_t* sink) {
+    plugin_link_t link = { sink, sink_place_work, NULL, sink_place_work_move, sink_place_work_slices };
+    return link;
+}
+
+plugin_link_t sink_link(sink_t* sink, int move) {
+    plugin_link_t link = { sink, sink_place_work, NULL, move ? sink_place_work_move : NULL, NULL };
+    return link;
+}
+
+void sink_clear(sink_t* sink, buffer_pool_t* pool) {
+    for (int i = 0; i < sink->count; i++) {
+        if (pool) {
+            buffer_pool_free(sink->items[i]);
+        } else {
+            free(sink->items[i]);
+        }
+    }
+    memset(sink, 0, sizeof(*sink));
+}
+
+int has_edge(stage_graph_t* graph, int from, int to) {
+    for (int i = 0; i < graph->num_edges; i++) {
+        if (graph->edge_from[i] == from && graph->edge_to[i] == to) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void test_parse() {
+    printf("[TEST 1] Running: Topology Parsing\n");
+    stage_graph_t graph;
+
+    const char* err = stage_graph_parse(&graph, "uppercaser -> {logger, flipper -> expander}");
+    assert(err == NULL);
+    assert(graph.count == 4 && graph.num_edges == 3);
+    assert(strcmp(graph.specs[0], "uppercaser") == 0 && strcmp(graph.specs[3], "expander") == 0);
+    assert(has_edge(&graph, 0, 1) && has_edge(&graph, 0, 2) && has_edge(&graph, 2, 3));
+    assert(!stage_graph_is_chain(&graph));
+    stage_graph_destroy(&graph);
+
+    /* Fan-in after a group; options and CPU lists stay in the spec */
+    err = stage_graph_parse(&graph, "a->{b@2:cpu=0,2, c}->d:merge=any");
+    assert(err == NULL);
+    assert(graph.count == 4 && graph.num_edges == 4);
+    assert(strcmp(graph.specs[1], "b@2:cpu=0,2") == 0);
+    assert(strcmp(graph.specs[3], "d:merge=any") == 0);
+    assert(has_edge(&graph, 1, 3) && has_edge(&graph, 2, 3));
+    stage_graph_destroy(&graph);
+
+    err = stage_graph_parse(&graph, "a -> b -> c");
+    assert(err == NULL);
+    assert(stage_graph_is_chain(&graph));
+    stage_graph_destroy(&graph);
+
+    assert(stage_graph_parse(&graph, "{a, b} -> c") != NULL);
+    assert(stage_graph_parse(&graph, "a -> {b, c") != NULL);
+    assert(stage_graph_parse(&graph, "a -> ") != NULL);
+    assert(stage_graph_parse(&graph, "a b") != NULL);
+    assert(stage_graph_parse(&graph, "a -> {}") != NULL);
+    assert(stage_graph_parse(&graph, "a } b") != NULL);
+
+    assert(stage_graph_is_topology("a->b") && stage_graph_is_topology("{a"));
+    assert(!stage_graph_is_topology("rotator:cpu=0,2"));
+    printf("[TEST 1] Passed.\n\n");
+}
+
+void test_tee() {
+    printf("[TEST 2] Running: Fan-out Shares Pool Buffers\n");
+    buffer_pool_t pool;
+    const char* err = buffer_pool_init(&pool, 0);
+    assert(err == NULL);
+    sink_t a = { 0 }, b = { 0 }, c = { 0 };
+    plugin_link_t outputs[3] = { sink_link(&a, 1), sink_link(&b, 1), sink_link(&c, 0) };
+    stage_tee_t tee;
+    plugin_link_t link;
+    err = stage_tee_init(&tee, outputs, 3, &pool);
+    assert(err == NULL);
+    stage_tee_link(&tee, &link);
+
+    char* items[2] = { buffer_pool_strdup(&pool, "one"), buffer_pool_strdup(&pool, "two") };
+    err = link.place_work_move(link.target, items, 2);
+    assert(err == NULL);
+    err = link.place_work(link.target, "<END>");
+    assert(err == NULL);
+
+    /* Moving outputs hold the same buffer; the copying one its own */
+    assert(a.count == 2 && b.count == 2 && c.count == 2);
+    assert(a.items[0] == items[0] && b.items[1] == items[1]);
+    assert(buffer_pool_shared(items[0]));
+    assert(strcmp(c.items[1], "two") == 0 && c.items[1] != items[1]);
+    assert(a.ends == 1 && b.ends == 1 && c.ends == 1);
+    sink_clear(&a, &pool);
+    assert(!buffer_pool_shared(items[0]));
+    sink_clear(&b, &pool);
+    sink_clear(&c, NULL);
+    stage_tee_destroy(&tee);
+
+    /* Without a pool every output but the last gets a copy */
+    plugin_link_t plain[2] = { sink_link(&a, 1), sink_link(&b, 1) };
+    err = stage_tee_init(&tee, plain, 2, NULL);
+    assert(err == NULL);
+    stage_tee_link(&tee, &link);
+    char* item = strdup("three");
+    err = link.place_work_move(link.target, &item, 1);
+    assert(err == NULL);
+    assert(a.items[0] != item && b.items[0] == item && strcmp(a.items[0], "three") == 0);
+    sink_clear(&a, NULL);
+    sink_clear(&b, NULL);
+    stage_tee_destroy(&tee);
+    buffer_pool_destroy(&pool);
+    printf("[TEST 2] Passed.\n\n");
+}
+
+void test_merge() {
+    printf("[TEST 3] Running: Ordered and Unordered Fan-in\n");
+    sink_t out = { 0 };
+    plugin_link_t output = sink_link(&out, 1);
+    stage_merge_t merge;
+    plugin_link_t in0, in1;
+
+    /* Ordered: rounds of one item per input, in input order */
+    const char* err = stage_merge_init(&merge, &output, 2, 1, NULL);
+    assert(err == NULL);
+    stage_merge_link(&merge, 0, &in0);
+    stage_merge_link(&merge, 1, &in1);
+    const char* first[3] = { "a1", "a2", "a3" };
+    err = in0.place_work_many(in0.target, first, 3);
+    assert(err == NULL);
+    assert(out.count == 0);
+    char* second = strdup("b1");
+    err = in1.place_work_move(in1.target, &second, 1);
+    assert(err == NULL);
+    assert(out.count == 2);
+    err = in0.place_work(in0.target, "<END>");
+    assert(err == NULL);
+    assert(out.ends == 0);
+    err = in1.place_work(in1.target, "b2");
+    assert(err == NULL);
+    err = in1.place_work(in1.target, "<END>");
+    assert(err == NULL);
+    const char* expected[] = { "a1", "b1", "a2", "b2", "a3" };
+    assert(out.count == 5 && out.ends == 1);
+    for (int i = 0; i < 5; i++) {
+        assert(strcmp(out.items[i], expected[i]) == 0);
+    }
+    sink_clear(&out, NULL);
+    stage_merge_destroy(&merge);
+
+    /* Unordered: items pass straight through, <END> once all inputs end */
+    err = stage_merge_init(&merge, &output, 2, 0, NULL);
+    assert(err == NULL);
+    stage_merge_link(&merge, 0, &in0);
+    stage_merge_link(&merge, 1, &in1);
+    err = in1.place_work(in1.target, "b1");
+    assert(err == NULL);
+    assert(out.count == 1);
+    err = in1.place_work(in1.target, "<END>");
+    assert(err == NULL);
+    err = in0.place_work(in0.target, "a1");
+    assert(err == NULL);
+    assert(out.count == 2 && out.ends == 0);
+    err = in0.place_work(in0.target, "<END>");
+    assert(err == NULL);
+    assert(out.ends == 1);
+    sink_clear(&out, NULL);
+    stage_merge_destroy(&merge);
+
+    /* <FLUSH> goes out once, after every input's earlier items */
+    err = stage_merge_init(&merge, &output, 2, 1, NULL);
+    assert(err == NULL);
+    stage_merge_link(&merge, 0, &in0);
+    stage_merge_link(&merge, 1, &in1);
+    char* batch[3] = { strdup("a1"), strdup("a2"), strdup("<FLUSH>") };
+    err = in0.place_work_move(in0.target, batch, 3);
+    assert(err == NULL);
+    err = in1.place_work(in1.target, "b1");
+    assert(err == NULL);
+    assert(out.count == 2);
+    err = in1.place_work(in1.target, "<FLUSH>");
+    assert(err == NULL);
+    assert(out.count == 4 && strcmp(out.items[2], "a2") == 0);
+    assert(strcmp(out.items[3], "<FLUSH>") == 0);
+    /* And the next flush needs every input again */
+    err = in1.place_work(in1.target, "<FLUSH>");
+    assert(err == NULL);
+    assert(out.count == 4);
+    sink_clear(&out, NULL);
+    stage_merge_destroy(&merge);
+
+    /* Items still waiting at shutdown are freed */
+    err = stage_merge_init(&merge, &output, 2, 1, NULL);
+    assert(err == NULL);
+    stage_merge_link(&merge, 0, &in0);
+    err = in0.place_work(in0.target, "left");
+    assert(err == NULL);
+    stage_merge_destroy(&merge);
+    assert(out.count == 0);
+    printf("[TEST 3] Passed.\n\n");
+}
+
+void test_slices() {
+    printf("[TEST 4] Running: Lengths Pass Through Fan-out and Fan-in\n");
+    sink_t a = { 0 }, b = { 0 };
+    plugin_link_t outputs[2] = { sink_slice_link(&a), sink_link(&b, 0) };
+    stage_tee_t tee;
+    plugin_link_t link;
+    const char* err = stage_tee_init(&tee, outputs, 2, NULL);
+    assert(err == NULL);
+    stage_tee_link(&tee, &link);
+
+    /* The slice output gets the NUL byte; the string-only one a string copy */
+    char* item = malloc(4);
+    memcpy(item, "a\0b", 4);
+    size_t len = 3;
+    err = link.place_work_slices(link.target, &item, &len, 1);
+    assert(err == NULL);
+    assert(a.count == 1 && a.lens[0] == 3 && memcmp(a.items[0], "a\0b", 4) == 0);
+    assert(b.count == 1 && strcmp(b.items[0], "a") == 0);
+    sink_clear(&a, NULL);
+    sink_clear(&b, NULL);
+    stage_tee_destroy(&tee);
+
+    /* Ordered fan-in keeps each item's length while it waits */
+    plugin_link_t output = sink_slice_link(&a);
+    stage_merge_t merge;
+    plugin_link_t in0, in1;
+    err = stage_merge_init(&merge, &output, 2, 1, NULL);
+    assert(err == NULL);
+    stage_merge_link(&merge, 0, &in0);
+    stage_merge_link(&merge, 1, &in1);
+    char* first[2] = { malloc(3), malloc(3) };
+    memcpy(first[0], "x\0", 3);
+    memcpy(first[1], "yz", 3);
+    size_t first_lens[2] = { 2, 2 };
+    err = in0.place_work_slices(in0.target, first, first_lens, 2);
+    assert(err == NULL);
+    err = in1.place_work(in1.target, "b");
+    assert(err == NULL);
+    assert(a.count == 2 && a.lens[0] == 2 && a.lens[1] == 1);
+    assert(memcmp(a.items[0], "x\0", 3) == 0 && strcmp(a.items[1], "b") == 0);
+    err = in1.place_work(in1.target, "<END>");
+    assert(err == NULL);
+    err = in0.place_work(in0.target, "<END>");
+    assert(err == NULL);
+    assert(a.count == 3 && a.lens[2] == 2 && a.ends == 1);
+    sink_clear(&a, NULL);
+    stage_merge_destroy(&merge);
+    printf("[TEST 4] Passed.\n\n");
+}
+
+void test_control() {
+    printf("[TEST 5] Running: Typed Control Messages Through Fan-out and Fan-in\n");
+    sink_t a = { 0 }, b = { 0 };
+    plugin_link_t outputs[2] = { sink_slice_link(&a), sink_link(&b, 1) };
+    stage_tee_t tee;
+    plugin_link_t link;
+    buffer_pool_t pool;
+    const char* err = buffer_pool_init(&pool, 0);
+    assert(err == NULL);
+    err = stage_tee_init(&tee, outputs, 2, &pool);
+    assert(err == NULL);
+    stage_tee_link(&tee, &link);
+
+    /* A line "<END>" is data; the typed END reaches the string output as "<END>" */
+    char* items[3] = { buffer_pool_strdup(&pool, "<END>"), NULL, NULL };
+    size_t lens[3] = { 5, PLUGIN_CONTROL_LEN(PLUGIN_ITEM_BARRIER), PLUGIN_CONTROL_LEN(PLUGIN_ITEM_END) };
+    err = link.place_work_slices(link.target, items, lens, 3);
+    assert(err == NULL);
+    assert(a.count == 1 && a.barriers == 1 && a.ends == 1);
+    assert(b.count == 1 && strcmp(b.items[0], "<END>") == 0 && b.ends == 1);
+    sink_clear(&a, &pool);
+    sink_clear(&b, &pool);
+    stage_tee_destroy(&tee);
+    buffer_pool_destroy(&pool);
+
+    /* A barrier leaves the fan-in once every input has sent it, or ended */
+    plugin_link_t output = sink_slice_link(&a);
+    stage_merge_t merge;
+    plugin_link_t in0, in1;
+    for (int ordered = 0; ordered <= 1; ordered++) {
+        err = stage_merge_init(&merge, &output, 2, ordered, NULL);
+        assert(err == NULL);
+        stage_merge_link(&merge, 0, &in0);
+        stage_merge_link(&merge, 1, &in1);
+        char* barrier = NULL;
+        size_t len = PLUGIN_CONTROL_LEN(PLUGIN_ITEM_BARRIER);
+        err = in0.place_work_slices(in0.target, &barrier, &len, 1);
+        assert(err == NULL);
+        err = in0.place_work_slices(in0.target, &barrier, &len, 1);
+        assert(err == NULL);
+        assert(a.barriers == 0);
+        err = in1.place_work_slices(in1.target, &barrier, &len, 1);
+        assert(err == NULL);
+        assert(a.barriers == 1);
+        len = PLUGIN_CONTROL_LEN(PLUGIN_ITEM_END);
+        err = in1.place_work_slices(in1.target, &barrier, &len, 1);
+        assert(err == NULL);
+        assert(a.barriers == 2 && a.ends == 0);
+        err = in0.place_work(in0.target, "<END>");
+        assert(err == NULL);
+        assert(a.barriers == 2 && a.ends == 1);
+        sink_clear(&a, NULL);
+        stage_merge_destroy(&merge);
+    }
+    printf("[TEST 5] Passed.\n\n");
+}
+
+stage_tail_t tail;
+plugin_link_t link_to_tail;
+
+/* Send one FLUSH from another thread */
+void* send_flush(void* arg) {
+    (void)arg;
+    usleep(20000);
+    char* item = NULL;
+    size_t len = PLUGIN_CONTROL_LEN(PLUGIN_ITEM_FLUSH);
+    link_to_tail.place_work_slices(link_to_tail.target, &item, &len, 1);
+    return NULL;
+}
+
+void test_tail() {
+    printf("[TEST 6] Running: Pipeline Tail Counts Flushes and Times Barriers\n");
+    const char* err = stage_tail_init(&tail, NULL);
+    assert(err == NULL);
+    stage_tail_link(&tail, &link_to_tail);
+
+    /* Data and <END> are dropped; flushes are counted whichever way they come */
+    char* items[3] = { strdup("line"), strdup("<FLUSH>"), strdup("other") };
+    err = link_to_tail.place_work_move(link_to_tail.target, items, 3);
+    assert(err == NULL);
+    err = link_to_tail.place_work(link_to_tail.target, "<END>");
+    assert(err == NULL);
+    err = link_to_tail.place_work(link_to_tail.target, "<FLUSH>");
+    assert(err == NULL);
+    stage_tail_wait_flush(&tail, 2);
+    assert(tail.flushes == 0);
+
+    /* Waiting blocks until the last branch's flush arrives */
+    pthread_t thread;
+    err = link_to_tail.place_work(link_to_tail.target, "<FLUSH>");
+    assert(err == NULL);
+    pthread_create(&thread, NULL, send_flush, NULL);
+    stage_tail_wait_flush(&tail, 2);
+    pthread_join(thread, NULL);
+
+    /* One barrier at a time, timed once both branches delivered it */
+    int began = stage_tail_begin_barrier(&tail, 2);
+    assert(began);
+    began = stage_tail_begin_barrier(&tail, 2);
+    assert(!began);
+    char* barrier = NULL;
+    size_t len = PLUGIN_CONTROL_LEN(PLUGIN_ITEM_BARRIER);
+    usleep(1000);
+    err = link_to_tail.place_work_slices(link_to_tail.target, &barrier, &len, 1);
+    assert(err == NULL);
+    stage_drain_t drain;
+    stage_tail_get_drain(&tail, &drain);
+    assert(drain.count == 0);
+    err = link_to_tail.place_work_slices(link_to_tail.target, &barrier, &len, 1);
+    assert(err == NULL);
+    stage_tail_get_drain(&tail, &drain);
+    assert(drain.count == 1 && stage_metrics_histogram_percentile(drain.latency, 0.5) >= 1000000);
+    began = stage_tail_begin_barrier(&tail, 2);
+    assert(began);
+    stage_tail_destroy(&tail);
+    printf("[TEST 6] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running Stage Graph Unit Tests ---\n\n");
+
+    test_parse();
+    test_tee();
+    test_merge();
+    test_slices();
+    test_control();
+    test_tail();
+
+    printf("--- All Stage Graph Tests Passed ---\n");
+    return 0;
+}
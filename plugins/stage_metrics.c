@@ -0,0 +1,153 @@
+#include "stage_metrics.h"
+
+/* Total number of calls recorded in a histogram */
+static unsigned long long latency_count(const unsigned long long* latency) {
+    unsigned long long total = 0;
+    for (int i = 0; i < STAGE_LATENCY_BUCKETS; i++) {
+        total += latency[i];
+    }
+    return total;
+}
+
+/* Upper bound of the bucket holding the given fraction of calls */
+unsigned long long stage_metrics_histogram_percentile(const unsigned long long* latency,
+                                                      double fraction) {
+    unsigned long long total = latency_count(latency);
+    if (total == 0) {
+        return 0;
+    }
+
+    /* Rank of the call the percentile falls on, 1-based */
+    unsigned long long rank = (unsigned long long)(fraction * (double)total);
+    if ((double)rank < fraction * (double)total) {
+        rank++;
+    }
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    unsigned long long seen = 0;
+    for (int i = 0; i < STAGE_LATENCY_BUCKETS; i++) {
+        seen += latency[i];
+        if (seen >= rank) {
+            return 2ull << i;
+        }
+    }
+    return 2ull << (STAGE_LATENCY_BUCKETS - 1);
+}
+
+unsigned long long stage_metrics_percentile(const stage_metrics_t* metrics, double fraction) {
+    return stage_metrics_histogram_percentile(metrics->latency, fraction);
+}
+
+/* Format a duration in the most readable unit */
+static void format_ns(char* buf, size_t size, unsigned long long ns) {
+    if (ns < 10000ull) {
+        snprintf(buf, size, "%lluns", ns);
+    } else if (ns < 10000000ull) {
+        snprintf(buf, size, "%.1fus", ns / 1e3);
+    } else if (ns < 10000000000ull) {
+        snprintf(buf, size, "%.1fms", ns / 1e6);
+    } else {
+        snprintf(buf, size, "%.1fs", ns / 1e9);
+    }
+}
+
+/* Print one row per stage with the columns most useful for tuning */
+void stage_metrics_print_table(FILE* out, const char* const* names,
+                               const stage_metrics_t* stages, int count, double elapsed_s,
+                               const stage_drain_t* drain) {
+    fprintf(out, "--- Stage metrics (%.3fs) ---\n", elapsed_s);
+    fprintf(out, "%-24s %10s %10s %10s %10s %10s %11s %10s %10s %14s %14s %9s %9s %9s\n",
+            "stage", "items_in", "items_out", "bytes_in", "bytes_out", "items/s",
+            "queue", "put_wait", "get_wait", "put_phases", "get_phases", "p50", "p99", "p999");
+
+    for (int i = 0; i < count; i++) {
+        const stage_metrics_t* m = &stages[i];
+        char queue[32], put_wait[16], get_wait[16], p50[16], p99[16], p999[16];
+        char put_phases[48], get_phases[48];
+        snprintf(queue, sizeof(queue), "%zu/%zu/%d", m->queue_depth, m->queue_high_water,
+                 m->queue_capacity);
+        snprintf(put_phases, sizeof(put_phases), "%zu/%zu/%zu",
+                 m->put_waits[0], m->put_waits[1], m->put_waits[2]);
+        snprintf(get_phases, sizeof(get_phases), "%zu/%zu/%zu",
+                 m->get_waits[0], m->get_waits[1], m->get_waits[2]);
+        format_ns(put_wait, sizeof(put_wait), m->put_blocked_ns);
+        format_ns(get_wait, sizeof(get_wait), m->get_blocked_ns);
+        format_ns(p50, sizeof(p50), stage_metrics_percentile(m, 0.50));
+        format_ns(p99, sizeof(p99), stage_metrics_percentile(m, 0.99));
+        format_ns(p999, sizeof(p999), stage_metrics_percentile(m, 0.999));
+
+        fprintf(out, "%-24s %10zu %10zu %10zu %10zu %10.0f %11s %10s %10s %14s %14s %9s %9s %9s\n",
+                names[i], m->items_in, m->items_out, m->bytes_in, m->bytes_out,
+                elapsed_s > 0 ? m->items_out / elapsed_s : 0.0,
+                queue, put_wait, get_wait, put_phases, get_phases, p50, p99, p999);
+    }
+    if (drain) {
+        char p50[16], p99[16], p999[16];
+        format_ns(p50, sizeof(p50), stage_metrics_histogram_percentile(drain->latency, 0.50));
+        format_ns(p99, sizeof(p99), stage_metrics_histogram_percentile(drain->latency, 0.99));
+        format_ns(p999, sizeof(p999), stage_metrics_histogram_percentile(drain->latency, 0.999));
+        fprintf(out, "drain: %zu barriers, p50 %s, p99 %s, p999 %s\n", drain->count, p50, p99, p999);
+    }
+    fprintf(out, "(queue = depth/high-water/capacity; phases = waits that ended spinning/"
+            "yielding/parked; latency percentiles are bucket upper bounds)\n");
+}
+
+/* Print a JSON string, escaping quotes, backslashes and control characters */
+static void print_json_string(FILE* out, const char* str) {
+    fputc('"', out);
+    for (const char* c = str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if ((unsigned char)*c < 0x20) {
+            fprintf(out, "\\u%04x", (unsigned char)*c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/* Print every counter, including the raw histogram, as one JSON line */
+void stage_metrics_print_json(FILE* out, const char* const* names,
+                              const stage_metrics_t* stages, int count, double elapsed_s,
+                              const stage_drain_t* drain) {
+    fprintf(out, "{\"elapsed_s\":%.6f,\"stages\":[", elapsed_s);
+    for (int i = 0; i < count; i++) {
+        const stage_metrics_t* m = &stages[i];
+        fprintf(out, "%s{\"name\":", i > 0 ? "," : "");
+        print_json_string(out, names[i]);
+        fprintf(out, ",\"items_in\":%zu,\"items_out\":%zu,\"bytes_in\":%zu,\"bytes_out\":%zu"
+                ",\"queue_capacity\":%d,\"queue_depth\":%zu,\"queue_high_water\":%zu"
+                ",\"put_blocked_ns\":%llu,\"get_blocked_ns\":%llu"
+                ",\"put_waits\":{\"spin\":%zu,\"yield\":%zu,\"park\":%zu}"
+                ",\"get_waits\":{\"spin\":%zu,\"yield\":%zu,\"park\":%zu}"
+                ",\"latency_p50_ns\":%llu,\"latency_p99_ns\":%llu,\"latency_p999_ns\":%llu"
+                ",\"latency_log2_ns\":[",
+                m->items_in, m->items_out, m->bytes_in, m->bytes_out,
+                m->queue_capacity, m->queue_depth, m->queue_high_water,
+                m->put_blocked_ns, m->get_blocked_ns,
+                m->put_waits[0], m->put_waits[1], m->put_waits[2],
+                m->get_waits[0], m->get_waits[1], m->get_waits[2],
+                stage_metrics_percentile(m, 0.50), stage_metrics_percentile(m, 0.99),
+                stage_metrics_percentile(m, 0.999));
+        for (int b = 0; b < STAGE_LATENCY_BUCKETS; b++) {
+            fprintf(out, "%s%llu", b > 0 ? "," : "", m->latency[b]);
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "]");
+    if (drain) {
+        fprintf(out, ",\"drain\":{\"barriers\":%zu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu"
+                ",\"latency_log2_ns\":[",
+                drain->count, stage_metrics_histogram_percentile(drain->latency, 0.50),
+                stage_metrics_histogram_percentile(drain->latency, 0.99),
+                stage_metrics_histogram_percentile(drain->latency, 0.999));
+        for (int b = 0; b < STAGE_LATENCY_BUCKETS; b++) {
+            fprintf(out, "%s%llu", b > 0 ? "," : "", drain->latency[b]);
+        }
+        fprintf(out, "]}");
+    }
+    fprintf(out, "}\n");
+}
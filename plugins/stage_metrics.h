@@ -0,0 +1,99 @@
+/* */
+#ifndef STAGE_METRICS_H
+#define STAGE_METRICS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* Latency histogram buckets: bucket i counts calls of [2^i, 2^(i+1)) ns */
+#define STAGE_LATENCY_BUCKETS 40
+
+/* Queue wait phases: spin, yield, park (see queue_phase_t) */
+#define STAGE_WAIT_PHASES 3
+
+/**
+ * Runtime counters of one pipeline stage, as returned by
+ * plugin_instance_get_metrics. Queue fields describe the stage's input queue.
+ */
+typedef struct stage_metrics
+{
+    size_t items_in;                    /* Lines taken from the queue (control messages not counted) */
+    size_t items_out;                   /* Items forwarded downstream */
+    size_t bytes_in;                    /* Bytes of the items taken (only with "metrics") */
+    size_t bytes_out;                   /* Bytes of the items forwarded (only with "metrics") */
+    int queue_capacity;                 /* */
+    size_t queue_depth;                 /* Items queued when the snapshot was taken */
+    size_t queue_high_water;            /* Most items ever queued at once */
+    unsigned long long put_blocked_ns;  /* Upstream time spent waiting for a free slot */
+    unsigned long long get_blocked_ns;  /* Worker time spent waiting for an item */
+    size_t put_waits[STAGE_WAIT_PHASES]; /* Upstream waits by the phase they ended in */
+    size_t get_waits[STAGE_WAIT_PHASES]; /* Worker waits by the phase they ended in */
+    unsigned long long latency[STAGE_LATENCY_BUCKETS]; /* Transform calls by duration */
+} stage_metrics_t;
+
+/**
+ * How long barriers took to drain through the whole pipeline: from being
+ * sent into the first stage until every branch had delivered them
+ */
+typedef struct
+{
+    size_t count;                                       /* Barriers timed */
+    unsigned long long latency[STAGE_LATENCY_BUCKETS];  /* Barriers by drain time */
+} stage_drain_t;
+
+/**
+ * Histogram bucket of a duration
+ * @param ns Duration in nanoseconds
+ * @return Index into stage_metrics_t.latency
+ */
+static inline int stage_metrics_bucket(unsigned long long ns) {
+    int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+    return bucket < STAGE_LATENCY_BUCKETS ? bucket : STAGE_LATENCY_BUCKETS - 1;
+}
+
+/**
+ * Approximate a percentile from a latency histogram
+ * @param latency STAGE_LATENCY_BUCKETS counts, bucket i for [2^i, 2^(i+1)) ns
+ * @param fraction Percentile as a fraction, e.g. 0.99
+ * @return Upper bound in nanoseconds of the bucket holding that percentile,
+ * or 0 if the histogram is empty
+ */
+unsigned long long stage_metrics_histogram_percentile(const unsigned long long* latency,
+                                                      double fraction); /* */
+
+/**
+ * Approximate a latency percentile from the histogram
+ * @param metrics Stage counters
+ * @param fraction Percentile as a fraction, e.g. 0.99
+ * @return Upper bound in nanoseconds of the bucket holding that percentile,
+ * or 0 if no calls were recorded
+ */
+unsigned long long stage_metrics_percentile(const stage_metrics_t* metrics, double fraction); /* */
+
+/**
+ * Print stages as an aligned, human-readable table
+ * @param out Destination stream
+ * @param names Stage names
+ * @param stages Counters of each stage
+ * @param count Number of stages
+ * @param elapsed_s Seconds since the pipeline started, for throughput
+ * @param drain Barrier drain times, or NULL if none were measured
+ */
+void stage_metrics_print_table(FILE* out, const char* const* names,
+                               const stage_metrics_t* stages, int count, double elapsed_s,
+                               const stage_drain_t* drain); /* */
+
+/**
+ * Print stages as one JSON object on a single line
+ * @param out Destination stream
+ * @param names Stage names
+ * @param stages Counters of each stage
+ * @param count Number of stages
+ * @param elapsed_s Seconds since the pipeline started
+ * @param drain Barrier drain times, or NULL if none were measured
+ */
+void stage_metrics_print_json(FILE* out, const char* const* names,
+                              const stage_metrics_t* stages, int count, double elapsed_s,
+                              const stage_drain_t* drain); /* */
+
+#endif // STAGE_METRICS_H
@@ -0,0 +1,90 @@
+/* * Unit test application for stage_metrics.c
+ */
+#include "stage_metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+/* Test 1: durations land in power-of-two buckets */
+void test_buckets() {
+    printf("[TEST 1] Running: Latency Buckets\n");
+    assert(stage_metrics_bucket(0) == 0);
+    assert(stage_metrics_bucket(1) == 0);
+    assert(stage_metrics_bucket(2) == 1);
+    assert(stage_metrics_bucket(3) == 1);
+    assert(stage_metrics_bucket(1000) == 9);
+    assert(stage_metrics_bucket(~0ull) == STAGE_LATENCY_BUCKETS - 1);
+    printf("[TEST 1] Passed.\n\n");
+}
+
+/* Test 2: percentiles report the upper bound of the right bucket */
+void test_percentiles() {
+    printf("[TEST 2] Running: Percentiles\n");
+    stage_metrics_t m;
+    memset(&m, 0, sizeof(m));
+    assert(stage_metrics_percentile(&m, 0.5) == 0);
+
+    /* 990 calls of ~100ns, 9 of ~10us, 1 of ~1ms */
+    m.latency[stage_metrics_bucket(100)] = 990;
+    m.latency[stage_metrics_bucket(10000)] = 9;
+    m.latency[stage_metrics_bucket(1000000)] = 1;
+    assert(stage_metrics_percentile(&m, 0.50) == 128);
+    assert(stage_metrics_percentile(&m, 0.99) == 128);
+    assert(stage_metrics_percentile(&m, 0.995) == 16384);
+    assert(stage_metrics_percentile(&m, 0.999) == 16384);
+    assert(stage_metrics_percentile(&m, 1.0) == 1048576);
+    printf("[TEST 2] Passed.\n\n");
+}
+
+/* Test 3: table and JSON carry every stage */
+void test_printing() {
+    printf("[TEST 3] Running: Table And JSON Output\n");
+    stage_metrics_t stages[2];
+    memset(stages, 0, sizeof(stages));
+    stages[0].items_in = 7;
+    stages[0].queue_capacity = 16;
+    stages[1].items_out = 5;
+    const char* names[] = { "upper\"caser", "logger" };
+
+    char* text = NULL;
+    size_t size = 0;
+    FILE* out = open_memstream(&text, &size);
+    stage_metrics_print_table(out, names, stages, 2, 1.0, NULL);
+    stage_metrics_print_json(out, names, stages, 2, 1.0, NULL);
+    fclose(out);
+    assert(strstr(text, "drain") == NULL);
+
+    assert(strstr(text, "logger") != NULL);
+    assert(strstr(text, "0/0/16") != NULL);
+    assert(strstr(text, "{\"name\":\"upper\\\"caser\",\"items_in\":7,") != NULL);
+    assert(strstr(text, "{\"name\":\"logger\",\"items_in\":0,\"items_out\":5,") != NULL);
+    assert(text[size - 1] == '\n' && text[size - 2] == '}');
+    free(text);
+
+    /* Barrier drain times follow the stages */
+    stage_drain_t drain;
+    memset(&drain, 0, sizeof(drain));
+    drain.count = 2;
+    drain.latency[stage_metrics_bucket(3000)] = 2;
+    out = open_memstream(&text, &size);
+    stage_metrics_print_table(out, names, stages, 2, 1.0, &drain);
+    stage_metrics_print_json(out, names, stages, 2, 1.0, &drain);
+    fclose(out);
+    assert(strstr(text, "drain: 2 barriers, p50 4096ns") != NULL);
+    assert(strstr(text, "],\"drain\":{\"barriers\":2,\"p50_ns\":4096,") != NULL);
+    assert(text[size - 1] == '\n' && text[size - 2] == '}' && text[size - 3] == '}');
+    free(text);
+    printf("[TEST 3] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running Stage Metrics Unit Tests ---\n\n");
+
+    test_buckets();
+    test_percentiles();
+    test_printing();
+
+    printf("--- All Stage Metrics Tests Passed ---\n");
+    return 0;
+}
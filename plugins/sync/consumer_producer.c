@@ -9,100 +9,679 @@
 #define _GNU_SOURCE
 #endif
 #include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <errno.h>
 
 
+/* Smallest power of two that is >= n */
+static size_t round_up_pow2(size_t n) {
+	size_t p = 1;
+	while (p < n) {
+		p <<= 1;
+	}
+	return p;
+}
+
+/* Monotonic time in nanoseconds, for the blocked-time counters */
+static unsigned long long now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+/* Counter updates; the caller is the field's only writer at this point */
+static void count_items(atomic_size_t* counter, size_t n) {
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+						  memory_order_relaxed);
+}
+
+static void count_blocked(atomic_ullong* counter, unsigned long long since) {
+	unsigned long long ns = now_ns() - since;
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + ns,
+						  memory_order_relaxed);
+}
+
+/* Current capacity; may change at any time (see consumer_producer_resize) */
+static size_t capacity_of(consumer_producer_t* queue) {
+	return (size_t)atomic_load_explicit(&queue->capacity, memory_order_relaxed);
+}
+
+static void raise_high_water(consumer_producer_t* queue, size_t depth) {
+	if (depth > atomic_load_explicit(&queue->high_water, memory_order_relaxed)) {
+		atomic_store_explicit(&queue->high_water, depth, memory_order_relaxed);
+	}
+}
+
+/* Tell the CPU this is a busy-wait loop */
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+/*
+ * Spin, then yield, until *word no longer holds seen. Returns the phase
+ * the wait ended in, or QUEUE_PHASE_PARK if the caller has to sleep.
+ */
+static queue_phase_t poll_until_changed(const consumer_producer_t* queue,
+										atomic_size_t* word, size_t seen) {
+	for (unsigned i = 0; i < queue->wait.spins; i++) {
+		if (atomic_load_explicit(word, memory_order_acquire) != seen) {
+			return QUEUE_PHASE_SPIN;
+		}
+		cpu_relax();
+	}
+	for (unsigned i = 0; i < queue->wait.yields; i++) {
+		sched_yield();
+		if (atomic_load_explicit(word, memory_order_acquire) != seen) {
+			return QUEUE_PHASE_YIELD;
+		}
+	}
+	return QUEUE_PHASE_PARK;
+}
+
+/*
+ * Sleep on a condition with the queue lock held. With a help function the
+ * sleep is cut short after a millisecond and 1 returned, so the producer
+ * calls it again.
+ */
+static int park(consumer_producer_t* queue, pthread_cond_t* condition) {
+	if (!queue->help) {
+		pthread_cond_wait(condition, &queue->lock);
+		return 0;
+	}
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_nsec += 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	return pthread_cond_timedwait(condition, &queue->lock, &ts) == ETIMEDOUT;
+}
+
+/* Wake parked threads on a condition, only if some are registered */
+static void wake_waiters(pthread_cond_t* condition, int waiters) {
+	if (waiters == 1) {
+		pthread_cond_signal(condition);
+	} else if (waiters > 1) {
+		pthread_cond_broadcast(condition);
+	}
+}
+
 const char* consumer_producer_init(consumer_producer_t* queue, int capacity) { /* */
+	return consumer_producer_init_mode(queue, capacity, QUEUE_MODE_LOCKED);
+}
+
+const char* consumer_producer_init_mode(consumer_producer_t* queue, int capacity,
+										queue_mode_t mode) { /* */
 	if (capacity <= 0) {
 		return "Queue capacity must be positive.";
 	}
-	queue->items = malloc(sizeof(char*) * capacity); /* */
-	if (!queue->items) {
+
+	/* The SPSC ring is sized to a power of two so a slot is index & mask */
+	size_t slots = (mode == QUEUE_MODE_SPSC) ? round_up_pow2((size_t)capacity)
+	                                         : (size_t)capacity;
+	queue->items = malloc(sizeof(char*) * slots); /* */
+	queue->lens = malloc(sizeof(size_t) * slots);
+	if (!queue->items || !queue->lens) {
+		free(queue->items);
+		free(queue->lens);
 		return "Failed to allocate memory for queue items.";
 	}
-	queue->capacity = capacity; /* */
+	atomic_init(&queue->capacity, capacity); /* */
+	queue->slots = (int)slots;
 	queue->count = 0; /* */
 	queue->head = 0; /* */
 	queue->tail = 0; /* */
-	
+	queue->taken = 0; /* */
+	queue->mode = mode; /* */
+	queue->wait.spins = 0;
+	queue->wait.yields = 0;
+	queue->put_waiters = 0;
+	queue->get_waiters = 0;
+	queue->copy_item = strdup;
+	queue->free_item = free;
+	queue->help = NULL;
+	queue->help_arg = NULL;
+	queue->mask = slots - 1;
+	atomic_init(&queue->spsc_head, 0);
+	atomic_init(&queue->spsc_tail, 0);
+	atomic_init(&queue->producer_waiting, 0);
+	atomic_init(&queue->consumer_waiting, 0);
+	atomic_init(&queue->items_in, 0);
+	atomic_init(&queue->high_water, 0);
+	atomic_init(&queue->put_blocked_ns, 0);
+	atomic_init(&queue->items_out, 0);
+	atomic_init(&queue->get_blocked_ns, 0);
+	for (int i = 0; i < QUEUE_WAIT_PHASES; i++) {
+		atomic_init(&queue->put_waits[i], 0);
+		atomic_init(&queue->get_waits[i], 0);
+	}
+
+	if (pthread_mutex_init(&queue->lock, NULL) != 0) {
+		free(queue->items);
+		free(queue->lens);
+		return "Failed to initialize queue lock.";
+	}
 	if (monitor_init(&queue->not_full_monitor) != 0) {
+		pthread_mutex_destroy(&queue->lock);
 		free(queue->items);
+		free(queue->lens);
 		return "Failed to initialize not_full monitor.";
 	}
 	if (monitor_init(&queue->not_empty_monitor) != 0) {
 		monitor_destroy(&queue->not_full_monitor);
+		pthread_mutex_destroy(&queue->lock);
 		free(queue->items);
+		free(queue->lens);
 		return "Failed to initialize not_empty monitor.";
 	}
 	if (monitor_init(&queue->finished_monitor) != 0) { /* */
 		monitor_destroy(&queue->not_full_monitor);
 		monitor_destroy(&queue->not_empty_monitor);
+		pthread_mutex_destroy(&queue->lock);
 		free(queue->items);
+		free(queue->lens);
 		return "Failed to initialize finished monitor.";
 	}
-	
+
 	return NULL; /* */
 }
 
+queue_mode_t consumer_producer_mode_for(int producers, int consumers) { /* */
+	return (producers == 1 && consumers == 1) ? QUEUE_MODE_SPSC : QUEUE_MODE_LOCKED;
+}
+
+void consumer_producer_set_allocator(consumer_producer_t* queue,
+									 char* (*copy_item) (const char*),
+									 void (*free_item) (void*)) { /* */
+	queue->copy_item = copy_item;
+	queue->free_item = free_item;
+}
+
+void consumer_producer_set_wait(consumer_producer_t* queue, const queue_wait_t* wait) { /* */
+	queue->wait = *wait;
+}
+
+void consumer_producer_set_help(consumer_producer_t* queue, int (*help) (void*), void* arg) { /* */
+	queue->help = help;
+	queue->help_arg = arg;
+}
+
+const char* consumer_producer_reserve(consumer_producer_t* queue, int max_capacity) { /* */
+	if (queue->mode != QUEUE_MODE_SPSC || max_capacity <= queue->slots) {
+		return NULL;
+	}
+	size_t slots = round_up_pow2((size_t)max_capacity);
+	char** items = malloc(sizeof(char*) * slots);
+	size_t* lens = malloc(sizeof(size_t) * slots);
+	if (!items || !lens) {
+		free(items);
+		free(lens);
+		return "Failed to allocate memory for queue items.";
+	}
+	free(queue->items);
+	free(queue->lens);
+	queue->items = items;
+	queue->lens = lens;
+	queue->slots = (int)slots;
+	queue->mask = slots - 1;
+	return NULL;
+}
+
+/*
+ * Locked resize: copy the queued items, oldest first, into a ring of
+ * max(capacity, count) slots
+ */
+static const char* locked_resize(consumer_producer_t* queue, int capacity) {
+	pthread_mutex_lock(&queue->lock);
+	int slots = capacity > queue->count ? capacity : queue->count;
+	if (slots != queue->slots) {
+		char** items = malloc(sizeof(char*) * slots);
+		size_t* lens = malloc(sizeof(size_t) * slots);
+		if (!items || !lens) {
+			pthread_mutex_unlock(&queue->lock);
+			free(items);
+			free(lens);
+			return "Failed to allocate memory for queue items.";
+		}
+		for (int i = 0; i < queue->count; i++) {
+			items[i] = queue->items[(queue->tail + i) % queue->slots];
+			lens[i] = queue->lens[(queue->tail + i) % queue->slots];
+		}
+		free(queue->items);
+		free(queue->lens);
+		queue->items = items;
+		queue->lens = lens;
+		queue->slots = slots;
+		queue->tail = 0;
+		queue->head = queue->count % slots;
+	}
+	atomic_store_explicit(&queue->capacity, capacity, memory_order_relaxed);
+	pthread_cond_broadcast(&queue->not_full_monitor.condition);
+	pthread_mutex_unlock(&queue->lock);
+	return NULL;
+}
+
+const char* consumer_producer_resize(consumer_producer_t* queue, int capacity) { /* */
+	if (capacity <= 0) {
+		return "Queue capacity must be positive.";
+	}
+	if (queue->mode != QUEUE_MODE_SPSC) {
+		return locked_resize(queue, capacity);
+	}
+	if (capacity > queue->slots) {
+		return "Queue capacity exceeds the reserved ring.";
+	}
+
+	/*
+	 * The producer re-reads the capacity on every check, including under
+	 * the lock before it parks, so a signal sent after the store and under
+	 * the lock cannot be missed
+	 */
+	atomic_store_explicit(&queue->capacity, capacity, memory_order_relaxed);
+	pthread_mutex_lock(&queue->lock);
+	pthread_cond_signal(&queue->not_full_monitor.condition);
+	pthread_mutex_unlock(&queue->lock);
+	return NULL;
+}
+
+const char* consumer_producer_parse_wait(const char* spec, queue_wait_t* wait) { /* */
+	if (strcmp(spec, "park") == 0) {
+		wait->spins = 0;
+		wait->yields = 0;
+		return NULL;
+	}
+	if (strncmp(spec, "spin", 4) != 0 || (spec[4] != '\0' && spec[4] != ':')) {
+		return "wait strategy must be park, spin, spin:<spins> or spin:<spins>:<yields>";
+	}
+
+	wait->spins = QUEUE_DEFAULT_SPINS;
+	wait->yields = QUEUE_DEFAULT_YIELDS;
+	const char* pos = spec + 4;
+	for (int field = 0; *pos == ':' && field < 2; field++) {
+		char* end;
+		if (pos[1] < '0' || pos[1] > '9') {
+			return "wait strategy counts must be non-negative integers";
+		}
+		unsigned long value = strtoul(pos + 1, &end, 10);
+		if (field == 0) {
+			wait->spins = (unsigned)value;
+		} else {
+			wait->yields = (unsigned)value;
+		}
+		pos = end;
+	}
+	if (*pos != '\0') {
+		return "wait strategy must be park, spin, spin:<spins> or spin:<spins>:<yields>";
+	}
+	return NULL;
+}
+
 void consumer_producer_destroy(consumer_producer_t* queue) { /* */
 	/* Free any remaining items in the queue */
-	for (int i = 0; i < queue->count; i++) {
-		free(queue->items[(queue->tail + i) % queue->capacity]);
+	if (queue->mode == QUEUE_MODE_SPSC) {
+		size_t head = atomic_load(&queue->spsc_head);
+		for (size_t i = atomic_load(&queue->spsc_tail); i != head; i++) {
+			queue->free_item(queue->items[i & queue->mask]);
+		}
+	} else {
+		for (int i = 0; i < queue->count; i++) {
+			queue->free_item(queue->items[(queue->tail + i) % queue->slots]);
+		}
 	}
-	
+
 	free(queue->items); /* */
+	free(queue->lens);
+	pthread_mutex_destroy(&queue->lock);
 	monitor_destroy(&queue->not_full_monitor);
 	monitor_destroy(&queue->not_empty_monitor);
 	monitor_destroy(&queue->finished_monitor); /* */
 }
 
-const char* consumer_producer_put(consumer_producer_t* queue, const char* item) { /* */
+/*
+ * SPSC put. The producer owns spsc_head and only reads spsc_tail.
+ * It takes the lock only to sleep when the ring is full, and the consumer
+ * only takes it to wake a producer that announced itself in producer_waiting.
+ * The seq_cst store/load pairs on the index and the waiting flag ensure that
+ * at least one side sees the other, so a wakeup cannot be lost.
+ * Items are published in runs: one index store per run of free slots.
+ */
+static void spsc_put_items(consumer_producer_t* queue, char* const* items, const size_t* lens,
+						   int count) {
+	size_t head = atomic_load_explicit(&queue->spsc_head, memory_order_relaxed);
+	int done = 0;
+
+	while (done < count) {
+		size_t cap = capacity_of(queue);
+		size_t tail = atomic_load_explicit(&queue->spsc_tail, memory_order_acquire);
+		if (head - tail >= cap) {
+			if (queue->help && queue->help(queue->help_arg)) {
+				continue;
+			}
+			unsigned long long since = now_ns();
+			queue_phase_t phase = poll_until_changed(queue, &queue->spsc_tail, tail);
+			if (phase == QUEUE_PHASE_PARK) {
+				pthread_mutex_lock(&queue->lock);
+				atomic_store(&queue->producer_waiting, 1);
+				while (head - atomic_load(&queue->spsc_tail) >= capacity_of(queue)) {
+					if (park(queue, &queue->not_full_monitor.condition)) {
+						break;
+					}
+				}
+				atomic_store_explicit(&queue->producer_waiting, 0, memory_order_relaxed);
+				pthread_mutex_unlock(&queue->lock);
+			}
+			count_blocked(&queue->put_blocked_ns, since);
+			count_items(&queue->put_waits[phase], 1);
+			continue;
+		}
+
+		size_t space = cap - (head - tail);
+		size_t n = (size_t)(count - done) < space ? (size_t)(count - done) : space;
+		for (size_t i = 0; i < n; i++) {
+			queue->items[(head + i) & queue->mask] = items[done + i];
+			queue->lens[(head + i) & queue->mask] = lens ? lens[done + i] : strlen(items[done + i]);
+		}
+		head += n;
+		done += (int)n;
+		atomic_store(&queue->spsc_head, head);
+		count_items(&queue->items_in, n);
+		raise_high_water(queue, head - tail);
+
+		/* Wake the consumer only if it is actually parked */
+		if (atomic_load(&queue->consumer_waiting)) {
+			pthread_mutex_lock(&queue->lock);
+			pthread_cond_signal(&queue->not_empty_monitor.condition);
+			pthread_mutex_unlock(&queue->lock);
+		}
+	}
+}
+
+/*
+ * SPSC get: mirror image of spsc_put_items, the consumer owns spsc_tail.
+ * Without block an empty queue returns 0 at once.
+ */
+static int spsc_get_items(consumer_producer_t* queue, char** out, size_t* lens, int max,
+						  size_t* first_seq, int block) {
+	size_t tail = atomic_load_explicit(&queue->spsc_tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&queue->spsc_head, memory_order_acquire);
+
+	if (head == tail && !block) {
+		return 0;
+	}
+	if (head == tail) {
+		unsigned long long since = now_ns();
+		queue_phase_t phase = poll_until_changed(queue, &queue->spsc_head, tail);
+		if (phase == QUEUE_PHASE_PARK) {
+			pthread_mutex_lock(&queue->lock);
+			atomic_store(&queue->consumer_waiting, 1);
+			while (atomic_load(&queue->spsc_head) == tail) {
+				pthread_cond_wait(&queue->not_empty_monitor.condition, &queue->lock);
+			}
+			atomic_store_explicit(&queue->consumer_waiting, 0, memory_order_relaxed);
+			pthread_mutex_unlock(&queue->lock);
+		}
+		head = atomic_load_explicit(&queue->spsc_head, memory_order_acquire);
+		count_blocked(&queue->get_blocked_ns, since);
+		count_items(&queue->get_waits[phase], 1);
+	}
+
+	size_t n = head - tail < (size_t)max ? head - tail : (size_t)max;
+	*first_seq = tail;
+	for (size_t i = 0; i < n; i++) {
+		out[i] = queue->items[(tail + i) & queue->mask];
+		queue->items[(tail + i) & queue->mask] = NULL; /* Avoid dangling pointer */
+		if (lens) {
+			lens[i] = queue->lens[(tail + i) & queue->mask];
+		}
+	}
+	atomic_store(&queue->spsc_tail, tail + n);
+	count_items(&queue->items_out, n);
+
+	if (atomic_load(&queue->producer_waiting)) {
+		pthread_mutex_lock(&queue->lock);
+		pthread_cond_signal(&queue->not_full_monitor.condition);
+		pthread_mutex_unlock(&queue->lock);
+	}
+	return (int)n;
+}
+
+/* Locked put: fill every free slot per wakeup, broadcast once per run */
+static void locked_put_items(consumer_producer_t* queue, char* const* items, const size_t* lens,
+							 int count) {
+	int done = 0;
+
 	/* Lock for accessing the queue */
-	pthread_mutex_lock(&queue->not_full_monitor.mutex);
-	
-	/* Wait until there is space in the queue */
-	while (queue->count == queue->capacity) { /* */
-		pthread_cond_wait(&queue->not_full_monitor.condition, &queue->not_full_monitor.mutex); /* */
-	}
-	
-	/* We must copy the string, as the queue takes ownership */
-	char* new_item = strdup(item);
-	if (!new_item) {
-		pthread_mutex_unlock(&queue->not_full_monitor.mutex);
-		return "Failed to duplicate string for queue.";
-	}
-	
-	queue->items[queue->head] = new_item; /* */
-	queue->head = (queue->head + 1) % queue->capacity; /* */
-	queue->count++; /* */
-	
-	/* Signal that the queue is no longer empty */
-	pthread_cond_broadcast(&queue->not_empty_monitor.condition);
-	
-	pthread_mutex_unlock(&queue->not_full_monitor.mutex); /* */
-	return NULL; /* */
+	pthread_mutex_lock(&queue->lock);
+	while (done < count) {
+		/* Wait until there is space in the queue */
+		if ((size_t)queue->count >= capacity_of(queue)) {
+			if (queue->help) {
+				pthread_mutex_unlock(&queue->lock);
+				int helped = queue->help(queue->help_arg);
+				pthread_mutex_lock(&queue->lock);
+				if (helped) {
+					continue;
+				}
+			}
+			unsigned long long since = now_ns();
+			queue_phase_t phase = QUEUE_PHASE_PARK;
+			if (queue->wait.spins || queue->wait.yields) {
+				/* Poll the consumers' counter without holding the lock */
+				size_t seen = atomic_load_explicit(&queue->items_out, memory_order_relaxed);
+				pthread_mutex_unlock(&queue->lock);
+				phase = poll_until_changed(queue, &queue->items_out, seen);
+				pthread_mutex_lock(&queue->lock);
+			}
+			if ((size_t)queue->count >= capacity_of(queue)) {
+				/* Another producer may have taken the slots meanwhile */
+				phase = QUEUE_PHASE_PARK;
+				queue->put_waiters++;
+				while ((size_t)queue->count >= capacity_of(queue)) { /* */
+					if (park(queue, &queue->not_full_monitor.condition)) { /* */
+						break;
+					}
+				}
+				queue->put_waiters--;
+			}
+			count_blocked(&queue->put_blocked_ns, since);
+			count_items(&queue->put_waits[phase], 1);
+		}
+
+		int start = done;
+		while (done < count && (size_t)queue->count < capacity_of(queue)) {
+			queue->lens[queue->head] = lens ? lens[done] : strlen(items[done]);
+			queue->items[queue->head] = items[done++]; /* */
+			queue->head = (queue->head + 1) % queue->slots; /* */
+			queue->count++; /* */
+		}
+		count_items(&queue->items_in, (size_t)(done - start));
+		raise_high_water(queue, (size_t)queue->count);
+
+		/* Signal that the queue is no longer empty, if anyone sleeps on it */
+		wake_waiters(&queue->not_empty_monitor.condition, queue->get_waiters);
+	}
+	pthread_mutex_unlock(&queue->lock); /* */
 }
 
-char* consumer_producer_get(consumer_producer_t* queue) { /* */
+/* Locked get: take everything queued, up to max (0 at once if empty and not block) */
+static int locked_get_items(consumer_producer_t* queue, char** out, size_t* lens, int max,
+							size_t* first_seq, int block) {
+	int n = 0;
+
 	/* Lock for accessing the queue */
-	pthread_mutex_lock(&queue->not_empty_monitor.mutex);
-	
+	pthread_mutex_lock(&queue->lock);
+	if (queue->count == 0 && !block) {
+		pthread_mutex_unlock(&queue->lock);
+		return 0;
+	}
+
 	/* Wait until there is an item in the queue */
-	while (queue->count == 0) { /* */
-		pthread_cond_wait(&queue->not_empty_monitor.condition, &queue->not_empty_monitor.mutex); /* */
-	}
-	
-	char* item = queue->items[queue->tail]; /* */
-	queue->items[queue->tail] = NULL; /* Avoid dangling pointer */
-	queue->tail = (queue->tail + 1) % queue->capacity; /* */
-	queue->count--; /* */
-	
-	/* Signal that the queue is no longer full */
-	pthread_cond_broadcast(&queue->not_full_monitor.condition);
-	
-	pthread_mutex_unlock(&queue->not_empty_monitor.mutex); /* */
+	if (queue->count == 0) {
+		unsigned long long since = now_ns();
+		queue_phase_t phase = QUEUE_PHASE_PARK;
+		if (queue->wait.spins || queue->wait.yields) {
+			/* Poll the producers' counter without holding the lock */
+			size_t seen = atomic_load_explicit(&queue->items_in, memory_order_relaxed);
+			pthread_mutex_unlock(&queue->lock);
+			phase = poll_until_changed(queue, &queue->items_in, seen);
+			pthread_mutex_lock(&queue->lock);
+		}
+		if (queue->count == 0) {
+			/* Another consumer may have taken the items meanwhile */
+			phase = QUEUE_PHASE_PARK;
+			queue->get_waiters++;
+			while (queue->count == 0) { /* */
+				pthread_cond_wait(&queue->not_empty_monitor.condition, &queue->lock); /* */
+			}
+			queue->get_waiters--;
+		}
+		count_blocked(&queue->get_blocked_ns, since);
+		count_items(&queue->get_waits[phase], 1);
+	}
+
+	*first_seq = queue->taken;
+	while (n < max && queue->count > 0) {
+		if (lens) {
+			lens[n] = queue->lens[queue->tail];
+		}
+		out[n++] = queue->items[queue->tail]; /* */
+		queue->items[queue->tail] = NULL; /* Avoid dangling pointer */
+		queue->tail = (queue->tail + 1) % queue->slots; /* */
+		queue->count--; /* */
+	}
+	queue->taken += n;
+	count_items(&queue->items_out, (size_t)n);
+
+	/* Signal that the queue is no longer full, if anyone sleeps on it */
+	wake_waiters(&queue->not_full_monitor.condition, queue->put_waiters);
+
+	pthread_mutex_unlock(&queue->lock); /* */
+	return n; /* */
+}
+
+const char* consumer_producer_put(consumer_producer_t* queue, const char* item) { /* */
+	return consumer_producer_put_many(queue, &item, 1);
+}
+
+char* consumer_producer_get(consumer_producer_t* queue) { /* */
+	char* item = NULL;
+	consumer_producer_get_many(queue, &item, 1);
 	return item; /* */
 }
 
+const char* consumer_producer_put_many(consumer_producer_t* queue,
+									   const char* const* items, int count) { /* */
+	char* stack_copies[64];
+	char** copies = stack_copies;
+
+	if (count <= 0) {
+		return NULL;
+	}
+	if (count > (int)(sizeof(stack_copies) / sizeof(stack_copies[0]))) {
+		copies = malloc(sizeof(char*) * count);
+		if (!copies) {
+			return "Failed to allocate memory for batch.";
+		}
+	}
+
+	/* We must copy the strings, as the queue takes ownership */
+	for (int i = 0; i < count; i++) {
+		copies[i] = queue->copy_item(items[i]);
+		if (!copies[i]) {
+			while (i-- > 0) {
+				queue->free_item(copies[i]);
+			}
+			if (copies != stack_copies) {
+				free(copies);
+			}
+			return "Failed to duplicate string for queue.";
+		}
+	}
+
+	consumer_producer_put_owned_many(queue, copies, count);
+
+	if (copies != stack_copies) {
+		free(copies);
+	}
+	return NULL; /* */
+}
+
+void consumer_producer_put_owned_many(consumer_producer_t* queue,
+									  char* const* items, int count) { /* */
+	consumer_producer_put_slices(queue, items, NULL, count);
+}
+
+/* Without lens, each item's length is measured as it goes into its slot */
+void consumer_producer_put_slices(consumer_producer_t* queue, char* const* items,
+								  const size_t* lens, int count) { /* */
+	if (count <= 0) {
+		return;
+	}
+	if (queue->mode == QUEUE_MODE_SPSC) {
+		spsc_put_items(queue, items, lens, count);
+	} else {
+		locked_put_items(queue, items, lens, count);
+	}
+}
+
+void consumer_producer_put_control(consumer_producer_t* queue, cp_item_kind_t kind) { /* */
+	char* item = NULL;
+	size_t len = CP_CONTROL_LEN(kind);
+	consumer_producer_put_slices(queue, &item, &len, 1);
+}
+
+int consumer_producer_get_many(consumer_producer_t* queue, char** out, int max) { /* */
+	size_t first_seq;
+	return consumer_producer_get_many_seq(queue, out, max, &first_seq);
+}
+
+int consumer_producer_get_many_seq(consumer_producer_t* queue, char** out, int max,
+								   size_t* first_seq) { /* */
+	return consumer_producer_get_slices(queue, out, NULL, max, first_seq);
+}
+
+int consumer_producer_get_slices(consumer_producer_t* queue, char** out, size_t* lens,
+								 int max, size_t* first_seq) { /* */
+	if (max <= 0) {
+		return 0;
+	}
+	if (queue->mode == QUEUE_MODE_SPSC) {
+		return spsc_get_items(queue, out, lens, max, first_seq, 1);
+	}
+	return locked_get_items(queue, out, lens, max, first_seq, 1);
+}
+
+int consumer_producer_try_get_slices(consumer_producer_t* queue, char** out, size_t* lens,
+									 int max, size_t* first_seq) { /* */
+	if (max <= 0) {
+		return 0;
+	}
+	if (queue->mode == QUEUE_MODE_SPSC) {
+		return spsc_get_items(queue, out, lens, max, first_seq, 0);
+	}
+	return locked_get_items(queue, out, lens, max, first_seq, 0);
+}
+
+void consumer_producer_get_stats(consumer_producer_t* queue, queue_stats_t* stats) { /* */
+	stats->capacity = (int)capacity_of(queue);
+	stats->items_out = atomic_load_explicit(&queue->items_out, memory_order_relaxed);
+	stats->items_in = atomic_load_explicit(&queue->items_in, memory_order_relaxed);
+	stats->depth = stats->items_in > stats->items_out ? stats->items_in - stats->items_out : 0;
+	stats->high_water = atomic_load_explicit(&queue->high_water, memory_order_relaxed);
+	stats->put_blocked_ns = atomic_load_explicit(&queue->put_blocked_ns, memory_order_relaxed);
+	stats->get_blocked_ns = atomic_load_explicit(&queue->get_blocked_ns, memory_order_relaxed);
+	for (int i = 0; i < QUEUE_WAIT_PHASES; i++) {
+		stats->put_waits[i] = atomic_load_explicit(&queue->put_waits[i], memory_order_relaxed);
+		stats->get_waits[i] = atomic_load_explicit(&queue->get_waits[i], memory_order_relaxed);
+	}
+}
+
 void consumer_producer_signal_finished(consumer_producer_t* queue) { /* */
 	monitor_signal(&queue->finished_monitor); /* */
 }
@@ -110,4 +689,4 @@ void consumer_producer_signal_finished(consumer_producer_t* queue) { /* */
 int consumer_producer_wait_finished(consumer_producer_t* queue) { /* */
 	monitor_wait(&queue->finished_monitor); /* */
 	return 0; /* */
-}
\ No newline at end of file
+}
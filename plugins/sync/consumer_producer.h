@@ -4,6 +4,90 @@
 
 #include "monitor.h"
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Size used to keep the SPSC producer and consumer indices on separate lines */
+#define CP_CACHE_LINE 64
+
+/**
+* Synchronization mode of a queue
+*/
+typedef enum
+{
+	QUEUE_MODE_LOCKED = 0,	/* Any number of producers/consumers, one mutex */
+	QUEUE_MODE_SPSC = 1		/* Exactly one producer and one consumer, lock-free */
+} queue_mode_t;
+
+/**
+* Kinds of queue items. A control item carries no data: it is a NULL item
+* whose length is CP_CONTROL_LEN(kind), so it moves through the queue like
+* any other item and is told apart by its length alone.
+*/
+typedef enum
+{
+	CP_ITEM_DATA = 0,		/* A line */
+	CP_ITEM_END = 1,		/* End of the stream; nothing follows */
+	CP_ITEM_FLUSH = 2,		/* Write out what the items before it produced */
+	CP_ITEM_BARRIER = 3		/* Marks a point in the stream, e.g. to time how long it takes to drain */
+} cp_item_kind_t;
+
+/* Length slot of a control item; no data item is that long */
+#define CP_CONTROL_LEN(kind) (SIZE_MAX - (size_t)(kind))
+
+/**
+* Kind of an item, from its length
+* @param len Length stored with the item
+* @return CP_ITEM_DATA, or the control kind
+*/
+static inline cp_item_kind_t cp_item_kind(size_t len) {
+	return len >= CP_CONTROL_LEN(CP_ITEM_BARRIER) ? (cp_item_kind_t)(SIZE_MAX - len) : CP_ITEM_DATA;
+}
+
+/**
+* Phases of a wait for a slot or an item, tried in this order
+*/
+typedef enum
+{
+	QUEUE_PHASE_SPIN = 0,	/* Polled with a CPU pause between checks */
+	QUEUE_PHASE_YIELD = 1,	/* Polled with sched_yield between checks */
+	QUEUE_PHASE_PARK = 2,	/* Slept on a condition variable (futex) until woken */
+	QUEUE_WAIT_PHASES = 3
+} queue_phase_t;
+
+/* Polls of the "spin" wait strategy before yielding, and yields before parking */
+#define QUEUE_DEFAULT_SPINS 2000
+#define QUEUE_DEFAULT_YIELDS 16
+
+/**
+* How a queue waits: spins polls, then yields sched_yield calls, then park.
+* { 0, 0 } parks right away, which costs no CPU while a stage is idle; a
+* bounded spin saves the futex sleep and wakeup when the other side is
+* only a few microseconds behind, if it runs on another CPU.
+*/
+typedef struct
+{
+	unsigned spins;
+	unsigned yields;
+} queue_wait_t;
+
+/**
+* Snapshot of a queue's traffic counters (see consumer_producer_get_stats).
+* A wait still in progress is added to the blocked times when it ends.
+*/
+typedef struct
+{
+	int capacity;						/* Maximum number of items */
+	size_t depth;						/* Items queued when the snapshot was taken */
+	size_t items_in;					/* Items put so far */
+	size_t items_out;					/* Items taken so far */
+	size_t high_water;					/* Most items ever queued at once */
+	unsigned long long put_blocked_ns;	/* Time producers waited for a free slot */
+	unsigned long long get_blocked_ns;	/* Time consumers waited for an item */
+	size_t put_waits[QUEUE_WAIT_PHASES];	/* Producer waits, by the phase they ended in */
+	size_t get_waits[QUEUE_WAIT_PHASES];	/* Consumer waits, by the phase they ended in */
+} queue_stats_t;
 
 /**
 * Consumer-Producer queue structure
@@ -11,25 +95,149 @@
 typedef struct
 {
  	char** items; 			/* */
- 	int capacity; 			/* */
+ 	size_t* lens;			/* Byte length of the item in the same slot */
+ 	atomic_int capacity; 	/* Most items queued at once (see consumer_producer_resize) */
+ 	int slots;				/* Length of items; at least capacity, or count after a shrink */
  	int count; 				/* */
  	int head; 				/* */
  	int tail; 				/* */
+ 	size_t taken;			/* Items removed so far (locked mode sequence numbers) */
+ 	queue_mode_t mode;		/* */
+
+ 	/* Wait strategy (park right away unless set) */
+ 	queue_wait_t wait;
+ 	int put_waiters;		/* Producers parked on not_full (locked mode) */
+ 	int get_waiters;		/* Consumers parked on not_empty (locked mode) */
+
+ 	/* How the queue copies and frees items (strdup/free unless set) */
+ 	char* (*copy_item) (const char*);
+ 	void (*free_item) (void*);
+
+ 	/* Run by a producer that finds the queue full (see consumer_producer_set_help) */
+ 	int (*help) (void*);
+ 	void* help_arg;
 
+ 	/* Locked mode: guards count/head/tail and both conditions below */
+ 	pthread_mutex_t lock;
  	monitor_t not_full_monitor;
     monitor_t not_empty_monitor;
  	monitor_t finished_monitor; /* */
- 	
+
+ 	/* SPSC mode: free-running indices, slot = index & mask */
+ 	size_t mask;
+ 	_Alignas(CP_CACHE_LINE) atomic_size_t spsc_head;	/* Written by the producer only */
+ 	_Alignas(CP_CACHE_LINE) atomic_size_t spsc_tail;	/* Written by the consumer only */
+ 	_Alignas(CP_CACHE_LINE) atomic_int producer_waiting;
+ 	atomic_int consumer_waiting;
+
+ 	/*
+ 	 * Traffic counters, updated once per batch with relaxed loads and
+ 	 * stores: each field has a single writer at a time (the SPSC side that
+ 	 * owns it, or whoever holds the lock in locked mode). Producer and
+ 	 * consumer fields sit on separate lines.
+ 	 */
+ 	_Alignas(CP_CACHE_LINE) atomic_size_t items_in;
+ 	atomic_size_t high_water;
+ 	atomic_ullong put_blocked_ns;
+ 	atomic_size_t put_waits[QUEUE_WAIT_PHASES];
+ 	_Alignas(CP_CACHE_LINE) atomic_size_t items_out;
+ 	atomic_ullong get_blocked_ns;
+ 	atomic_size_t get_waits[QUEUE_WAIT_PHASES];
+
 } consumer_producer_t; /* */
 
 /**
-* Initialize a consumer-producer queue
+* Initialize a consumer-producer queue in locked (multi-producer,
+* multi-consumer) mode
 * @param queue Pointer to queue structure
 * @param capacity Maximum number of items
 * @return NULL on success, error message on failure
 */
 const char* consumer_producer_init(consumer_producer_t* queue, int capacity); /* */
 
+/**
+* Initialize a consumer-producer queue with an explicit synchronization mode
+* @param queue Pointer to queue structure
+* @param capacity Maximum number of items
+* @param mode QUEUE_MODE_LOCKED or QUEUE_MODE_SPSC
+* @return NULL on success, error message on failure
+*/
+const char* consumer_producer_init_mode(consumer_producer_t* queue, int capacity,
+										queue_mode_t mode); /* */
+
+/**
+* Pick the cheapest mode that is safe for the given number of threads
+* @param producers Number of threads that will call put
+* @param consumers Number of threads that will call get
+* @return QUEUE_MODE_SPSC for a 1:1 queue, QUEUE_MODE_LOCKED otherwise
+*/
+queue_mode_t consumer_producer_mode_for(int producers, int consumers); /* */
+
+/**
+* Replace the functions the queue copies items with (put, put_many) and
+* frees leftover items with (destroy). Items moved in with put_owned_many
+* must come from the same allocator. Call before the queue is used.
+* @param queue Pointer to queue structure
+* @param copy_item Returns a copy of a string, or NULL on failure
+* @param free_item Frees a string returned by copy_item
+*/
+void consumer_producer_set_allocator(consumer_producer_t* queue,
+									 char* (*copy_item) (const char*),
+									 void (*free_item) (void*)); /* */
+
+/**
+* Set how producers and consumers of the queue wait. Call before the queue
+* is used.
+* @param queue Pointer to queue structure
+* @param wait Wait strategy (copied)
+*/
+void consumer_producer_set_wait(consumer_producer_t* queue, const queue_wait_t* wait); /* */
+
+/**
+* Have producers that find the queue full call help(arg) before they wait,
+* e.g. to run a consumer that is not scheduled on a thread of its own.
+* help returns nonzero if it ran, and the producer then checks for room
+* again. While a help function is set a parked producer wakes every
+* millisecond to call it again. Call before the queue is used.
+* @param queue Pointer to queue structure
+* @param help Called with arg; NULL for none
+* @param arg Passed to help
+*/
+void consumer_producer_set_help(consumer_producer_t* queue, int (*help) (void*), void* arg); /* */
+
+/**
+* Size the SPSC ring for up to max_capacity items, so that
+* consumer_producer_resize can later grow the queue that far while it is
+* running. Locked queues reallocate on resize and need no reserve. Call
+* before the queue is used.
+* @param queue Pointer to queue structure
+* @param max_capacity Largest capacity the queue will be resized to
+* @return NULL on success, error message on failure
+*/
+const char* consumer_producer_reserve(consumer_producer_t* queue, int max_capacity); /* */
+
+/**
+* Change how many items the queue holds, while producers and consumers use
+* it. Growing wakes blocked producers. Shrinking below the current depth
+* keeps the queued items; producers then block until it drains below the
+* new capacity. A locked queue reallocates its ring; an SPSC queue only
+* grows within its ring (see consumer_producer_reserve). Call from one
+* thread at a time.
+* @param queue Pointer to queue structure
+* @param capacity New maximum number of items
+* @return NULL on success, error message on failure
+*/
+const char* consumer_producer_resize(consumer_producer_t* queue, int capacity); /* */
+
+/**
+* Parse a wait strategy: "park" (no spinning), "spin" (default counts),
+* "spin:<spins>" or "spin:<spins>:<yields>"
+* @param spec Text to parse
+* @param wait Receives the strategy
+* @return NULL on success, error message on failure
+*/
+const char* consumer_producer_parse_wait(const char* spec, queue_wait_t* wait); /* */
+
 /**
 * Destroy a consumer-producer queue and free its resources
 * @param queue Pointer to queue structure
@@ -38,7 +246,7 @@ void consumer_producer_destroy(consumer_producer_t* queue); /* */
 
 /**
 * Add an item to the queue (producer).
-* Blocks if queue is full. 
+* Blocks if queue is full.
 * @param queue Pointer to queue structure
 * @param item String to add (queue takes ownership)
 * @return NULL on success, error message on failure
@@ -47,12 +255,115 @@ const char* consumer_producer_put(consumer_producer_t* queue, const char* item);
 
 /**
 * Remove an item from the queue (consumer) and returns it.
-* Blocks if queue is empty. 
+* Blocks if queue is empty.
 * @param queue Pointer to queue structure
-* @return String item or NULL if queue is empty
+* @return String item, or NULL for a control item (see consumer_producer_get_slices)
 */
 char* consumer_producer_get(consumer_producer_t* queue); /* */
 
+/**
+* Add several items to the queue (producer) with one synchronization per
+* run of free slots rather than one per item.
+* Blocks while the queue is full. Items are enqueued in array order.
+* @param queue Pointer to queue structure
+* @param items Strings to add (queue stores copies)
+* @param count Number of items
+* @return NULL on success, error message on failure
+*/
+const char* consumer_producer_put_many(consumer_producer_t* queue,
+									   const char* const* items, int count); /* */
+
+/**
+* Move already-allocated items into the queue without copying them.
+* Blocks while the queue is full. Items are enqueued in array order.
+* @param queue Pointer to queue structure
+* @param items Heap strings; ownership passes to the queue (and later to
+* whoever gets them), the caller must not touch them afterwards
+* @param count Number of items
+*/
+void consumer_producer_put_owned_many(consumer_producer_t* queue,
+									  char* const* items, int count); /* */
+
+/**
+* Move already-allocated items into the queue together with their lengths,
+* so neither side has to scan for the terminator and items may contain NUL
+* bytes. Otherwise the same as consumer_producer_put_owned_many, which
+* measures each item with strlen.
+* @param queue Pointer to queue structure
+* @param items Heap buffers; ownership passes to the queue
+* @param lens Number of bytes in each item
+* @param count Number of items
+*/
+void consumer_producer_put_slices(consumer_producer_t* queue, char* const* items,
+								  const size_t* lens, int count); /* */
+
+/**
+* Add a control item (see cp_item_kind_t) behind the items already queued.
+* Blocks while the queue is full.
+* @param queue Pointer to queue structure
+* @param kind CP_ITEM_END, CP_ITEM_FLUSH or CP_ITEM_BARRIER
+*/
+void consumer_producer_put_control(consumer_producer_t* queue, cp_item_kind_t kind); /* */
+
+/**
+* Remove up to max items from the queue (consumer) in FIFO order.
+* Blocks until at least one item is available, then takes everything that
+* is queued, up to max, under a single synchronization.
+* @param queue Pointer to queue structure
+* @param out Array receiving the items (caller frees each one)
+* @param max Capacity of out
+* @return Number of items stored in out (at least 1)
+*/
+int consumer_producer_get_many(consumer_producer_t* queue, char** out, int max); /* */
+
+/**
+* Same as consumer_producer_get_many, and also report the sequence number
+* of the first item taken. Items are numbered 0, 1, 2... in the order they
+* were put, so out[i] has sequence number *first_seq + i.
+* @param queue Pointer to queue structure
+* @param out Array receiving the items (caller frees each one)
+* @param max Capacity of out
+* @param first_seq Receives the sequence number of out[0]
+* @return Number of items stored in out (at least 1)
+*/
+int consumer_producer_get_many_seq(consumer_producer_t* queue, char** out, int max,
+								   size_t* first_seq); /* */
+
+/**
+* Same as consumer_producer_get_many_seq, and also report each item's length.
+* Control items come out as NULL with their CP_CONTROL_LEN length; the
+* functions without lengths return them as NULL alone.
+* @param queue Pointer to queue structure
+* @param out Array receiving the items (caller frees each one)
+* @param lens Array receiving their lengths, or NULL
+* @param max Capacity of out and lens
+* @param first_seq Receives the sequence number of out[0]
+* @return Number of items stored in out (at least 1)
+*/
+int consumer_producer_get_slices(consumer_producer_t* queue, char** out, size_t* lens,
+								 int max, size_t* first_seq); /* */
+
+/**
+* Same as consumer_producer_get_slices, but returns 0 right away instead
+* of blocking when the queue is empty
+* @param queue Pointer to queue structure
+* @param out Array receiving the items (caller frees each one)
+* @param lens Array receiving their lengths, or NULL
+* @param max Capacity of out and lens
+* @param first_seq Receives the sequence number of out[0]
+* @return Number of items stored in out, 0 if none was queued
+*/
+int consumer_producer_try_get_slices(consumer_producer_t* queue, char** out, size_t* lens,
+									 int max, size_t* first_seq); /* */
+
+/**
+* Read the queue's traffic counters. Safe to call while other threads use
+* the queue; the fields are read one by one, so they may be a few items apart.
+* @param queue Pointer to queue structure
+* @param stats Receives the counters
+*/
+void consumer_producer_get_stats(consumer_producer_t* queue, queue_stats_t* stats); /* */
+
 /**
 * Signal that processing is finished
 * @param queue Pointer to queue structure
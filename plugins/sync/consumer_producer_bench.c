@@ -0,0 +1,429 @@
+/* * Microbenchmark for consumer_producer.c
+ * Measures throughput and handoff latency of the queue for 1:1, N:1, 1:N
+ * and N:M producer/consumer layouts, over a range of capacities and item
+ * sizes, with threads pinned to CPUs or left to the scheduler.
+ * Queue implementations are listed in `queues` below; another
+ * implementation is benchmarked by adding an entry there.
+ */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "consumer_producer.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LIST 16
+#define MAX_THREADS 64
+#define SAMPLE_EVERY 8                  /* One item in SAMPLE_EVERY carries a timestamp */
+#define ID_DIGITS 7                     /* Base-62 item id at the start of every item */
+#define BYTES_PER_RUN (64UL << 20)      /* Caps items per run for large item sizes */
+
+/**
+ * A queue implementation under test. Items are NUL-terminated strings; put
+ * copies them, get returns a heap string the caller frees.
+ */
+typedef struct {
+    const char* name;
+    /* Largest layout supported, 0 for any */
+    int max_producers;
+    int max_consumers;
+    void* (*create)(int capacity, int producers, int consumers);
+    void (*put)(void* queue, const char* item);
+    char* (*get)(void* queue);
+    void (*destroy)(void* queue);
+} queue_impl_t;
+
+/* consumer_producer_t in a given mode, parking or spinning before it parks */
+static void* cp_create(int capacity, queue_mode_t mode, int spin) {
+    consumer_producer_t* queue = aligned_alloc(CP_CACHE_LINE, sizeof(consumer_producer_t));
+    if (queue && consumer_producer_init_mode(queue, capacity, mode) != NULL) {
+        free(queue);
+        return NULL;
+    }
+    if (queue && spin) {
+        queue_wait_t wait = { QUEUE_DEFAULT_SPINS, QUEUE_DEFAULT_YIELDS };
+        consumer_producer_set_wait(queue, &wait);
+    }
+    return queue;
+}
+
+static void* cp_create_locked(int capacity, int producers, int consumers) {
+    (void)producers;
+    (void)consumers;
+    return cp_create(capacity, QUEUE_MODE_LOCKED, 0);
+}
+
+static void* cp_create_spsc(int capacity, int producers, int consumers) {
+    (void)producers;
+    (void)consumers;
+    return cp_create(capacity, QUEUE_MODE_SPSC, 0);
+}
+
+static void* cp_create_locked_spin(int capacity, int producers, int consumers) {
+    (void)producers;
+    (void)consumers;
+    return cp_create(capacity, QUEUE_MODE_LOCKED, 1);
+}
+
+static void* cp_create_spsc_spin(int capacity, int producers, int consumers) {
+    (void)producers;
+    (void)consumers;
+    return cp_create(capacity, QUEUE_MODE_SPSC, 1);
+}
+
+static void cp_put(void* queue, const char* item) {
+    consumer_producer_put((consumer_producer_t*)queue, item);
+}
+
+static char* cp_get(void* queue) {
+    return consumer_producer_get((consumer_producer_t*)queue);
+}
+
+static void cp_destroy(void* queue) {
+    consumer_producer_destroy((consumer_producer_t*)queue);
+    free(queue);
+}
+
+/* Implementations under test */
+static const queue_impl_t queues[] = {
+    { "locked", 0, 0, cp_create_locked, cp_put, cp_get, cp_destroy },
+    { "spsc", 1, 1, cp_create_spsc, cp_put, cp_get, cp_destroy },
+    { "locked-spin", 0, 0, cp_create_locked_spin, cp_put, cp_get, cp_destroy },
+    { "spsc-spin", 1, 1, cp_create_spsc_spin, cp_put, cp_get, cp_destroy },
+};
+
+/**
+ * One benchmark configuration
+ */
+typedef struct {
+    const queue_impl_t* impl;
+    int producers;
+    int consumers;
+    int capacity;
+    size_t item_size;           /* Bytes per item including the NUL */
+    int pinned;
+    size_t items;               /* Items per producer */
+} bench_config_t;
+
+/**
+ * Per-thread state
+ */
+typedef struct {
+    const bench_config_t* config;
+    void* queue;
+    int index;                  /* Thread number, also picks the CPU when pinned */
+    int producer_id;
+    double* stamps;             /* Send time of sampled items, by item id */
+    double* latencies;          /* Consumer: handoff latencies of sampled items */
+    size_t num_latencies;
+    size_t capacity_latencies;
+} thread_state_t;
+
+static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Pin the calling thread to one CPU */
+void pin_thread(int index) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(index % (cpus > 0 ? cpus : 1), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/* Producer: item ids are encoded at the start of each item */
+void* producer_func(void* arg) {
+    thread_state_t* state = (thread_state_t*)arg;
+    const bench_config_t* config = state->config;
+    if (config->pinned) {
+        pin_thread(state->index);
+    }
+
+    char* item = malloc(config->item_size);
+    memset(item, 'x', config->item_size - 1);
+    item[config->item_size - 1] = '\0';
+
+    size_t base = (size_t)state->producer_id * config->items;
+    for (size_t i = 0; i < config->items; i++) {
+        size_t id = base + i;
+        for (int d = ID_DIGITS - 1; d >= 0; d--) {
+            item[d] = digits[id % 62];
+            id /= 62;
+        }
+        if (i % SAMPLE_EVERY == 0) {
+            state->stamps[base + i] = now_sec();
+        }
+        config->impl->put(state->queue, item);
+    }
+    free(item);
+    return NULL;
+}
+
+/* Consumer: runs until it takes an "<END>" */
+void* consumer_func(void* arg) {
+    thread_state_t* state = (thread_state_t*)arg;
+    const bench_config_t* config = state->config;
+    if (config->pinned) {
+        pin_thread(state->index);
+    }
+
+    for (;;) {
+        char* item = config->impl->get(state->queue);
+        double now = now_sec();
+        if (item[0] == '<') {
+            free(item);
+            break;
+        }
+
+        size_t id = 0;
+        for (int d = 0; d < ID_DIGITS; d++) {
+            id = id * 62 + (size_t)(strchr(digits, item[d]) - digits);
+        }
+        if ((id % config->items) % SAMPLE_EVERY == 0 &&
+            state->num_latencies < state->capacity_latencies) {
+            state->latencies[state->num_latencies++] = now - state->stamps[id];
+        }
+        free(item);
+    }
+    return NULL;
+}
+
+int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* Value at a fraction of a sorted array (nearest rank) */
+double percentile(const double* sorted, size_t count, double fraction) {
+    if (count == 0) {
+        return 0;
+    }
+    size_t rank = (size_t)(fraction * (double)count + 0.999999);
+    rank = rank == 0 ? 1 : rank > count ? count : rank;
+    return sorted[rank - 1];
+}
+
+/* Run one configuration and print its row */
+int run_config(const bench_config_t* config) {
+    int threads = config->producers + config->consumers;
+    size_t total = config->items * config->producers;
+    void* queue = config->impl->create(config->capacity, config->producers, config->consumers);
+    double* stamps = malloc(sizeof(double) * total);
+    size_t max_samples = total / SAMPLE_EVERY + config->producers;
+    double* latencies = malloc(sizeof(double) * max_samples * config->consumers);
+    thread_state_t* states = calloc(threads, sizeof(thread_state_t));
+    pthread_t* ids = calloc(threads, sizeof(pthread_t));
+    if (!queue || !stamps || !latencies || !states || !ids) {
+        fprintf(stderr, "Error: Failed to set up %s queue.\n", config->impl->name);
+        if (queue) {
+            config->impl->destroy(queue);
+        }
+        free(stamps);
+        free(latencies);
+        free(states);
+        free(ids);
+        return -1;
+    }
+
+    /* Consumers share one latency array; any of them may take every sample */
+    for (int t = 0; t < threads; t++) {
+        states[t].config = config;
+        states[t].queue = queue;
+        states[t].index = t;
+        states[t].stamps = stamps;
+        if (t < config->consumers) {
+            states[t].latencies = latencies + max_samples * t;
+            states[t].capacity_latencies = max_samples;
+        } else {
+            states[t].producer_id = t - config->consumers;
+        }
+    }
+
+    double start = now_sec();
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&ids[t], NULL, t < config->consumers ? consumer_func : producer_func,
+                       &states[t]);
+    }
+    for (int t = config->consumers; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    for (int c = 0; c < config->consumers; c++) {
+        config->impl->put(queue, "<END>");
+    }
+    for (int t = 0; t < config->consumers; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    double elapsed = now_sec() - start;
+
+    /* Gather every consumer's samples at the front and sort them */
+    size_t samples = 0;
+    for (int t = 0; t < config->consumers; t++) {
+        memmove(latencies + samples, states[t].latencies, sizeof(double) * states[t].num_latencies);
+        samples += states[t].num_latencies;
+    }
+    qsort(latencies, samples, sizeof(double), compare_double);
+
+    char layout[16];
+    snprintf(layout, sizeof(layout), "%d:%d", config->producers, config->consumers);
+    printf("%-11s %6s %6d %7zu %4s %12.0f %9.2f %9.1f %9.1f %9.1f\n", config->impl->name, layout,
+           config->capacity, config->item_size, config->pinned ? "yes" : "no",
+           total / elapsed, total * config->item_size / elapsed / 1e6,
+           percentile(latencies, samples, 0.50) * 1e6, percentile(latencies, samples, 0.99) * 1e6,
+           percentile(latencies, samples, 0.999) * 1e6);
+    fflush(stdout);
+
+    config->impl->destroy(queue);
+    free(stamps);
+    free(latencies);
+    free(states);
+    free(ids);
+    return 0;
+}
+
+void print_usage(void) {
+    printf("Usage: consumer_producer_bench [options]\n"
+           "Options:\n"
+           "  --queues <list>      Implementations to run (default all:");
+    for (size_t q = 0; q < sizeof(queues) / sizeof(queues[0]); q++) {
+        printf(" %s", queues[q].name);
+    }
+    printf(")\n"
+           "  --layouts <list>     producers:consumers pairs (default 1:1,4:1,1:4,4:4)\n"
+           "  --capacities <list>  Queue capacities (default 1,16,256,4096)\n"
+           "  --sizes <list>       Item sizes in bytes, at least 8 (default 8,64,1024,65536)\n"
+           "  --pin <mode>         off, on or both (default both)\n"
+           "  --items <n>          Items per producer (default 100000, fewer for large items)\n");
+}
+
+/* Parse "a,b,c" into positive integers; returns the count, 0 on error */
+int parse_list(const char* text, long* out) {
+    int count = 0;
+    const char* pos = text;
+    while (*pos && count < MAX_LIST) {
+        char* end;
+        long value = strtol(pos, &end, 10);
+        if (end == pos || value <= 0 || (*end != ',' && *end != '\0')) {
+            return 0;
+        }
+        out[count++] = value;
+        pos = *end == ',' ? end + 1 : end;
+    }
+    return *pos ? 0 : count;
+}
+
+int main(int argc, char* argv[]) {
+    const char* queue_names = NULL;
+    long producers[MAX_LIST] = { 1, 4, 1, 4 };
+    long consumers[MAX_LIST] = { 1, 1, 4, 4 };
+    int num_layouts = 4;
+    long capacities[MAX_LIST] = { 1, 16, 256, 4096 };
+    int num_capacities = 4;
+    long sizes[MAX_LIST] = { 8, 64, 1024, 65536 };
+    int num_sizes = 4;
+    int pin_from = 0, pin_to = 1;
+    size_t items = 100000;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        int ok = value != NULL;
+        if (!ok) {
+            /* Fall through to the error below */
+        } else if (strcmp(argv[i], "--queues") == 0) {
+            queue_names = value;
+        } else if (strcmp(argv[i], "--layouts") == 0) {
+            num_layouts = 0;
+            const char* pos = value;
+            while (ok && *pos && num_layouts < MAX_LIST) {
+                char* end;
+                producers[num_layouts] = strtol(pos, &end, 10);
+                ok = *end == ':' && producers[num_layouts] > 0;
+                if (ok) {
+                    consumers[num_layouts] = strtol(end + 1, &end, 10);
+                    ok = consumers[num_layouts] > 0 && (*end == ',' || *end == '\0') &&
+                         producers[num_layouts] + consumers[num_layouts] <= MAX_THREADS;
+                    num_layouts++;
+                    pos = *end == ',' ? end + 1 : end;
+                }
+            }
+            ok = ok && num_layouts > 0 && *pos == '\0';
+        } else if (strcmp(argv[i], "--capacities") == 0) {
+            num_capacities = parse_list(value, capacities);
+            ok = num_capacities > 0;
+        } else if (strcmp(argv[i], "--sizes") == 0) {
+            num_sizes = parse_list(value, sizes);
+            ok = num_sizes > 0;
+            for (int s = 0; s < num_sizes; s++) {
+                ok = ok && sizes[s] >= ID_DIGITS + 1;
+            }
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            pin_from = strcmp(value, "on") == 0;
+            pin_to = strcmp(value, "off") != 0;
+            ok = strcmp(value, "on") == 0 || strcmp(value, "off") == 0 || strcmp(value, "both") == 0;
+        } else if (strcmp(argv[i], "--items") == 0) {
+            items = strtoul(value, NULL, 10);
+            ok = items > 0;
+        } else {
+            ok = 0;
+        }
+        if (!ok) {
+            fprintf(stderr, "Error: Invalid option %s.\n", argv[i]);
+            print_usage();
+            return 1;
+        }
+        i++;
+    }
+
+    printf("%-11s %6s %6s %7s %4s %12s %9s %9s %9s %9s\n", "queue", "layout", "cap", "size",
+           "pin", "ops/s", "MB/s", "p50_us", "p99_us", "p999_us");
+
+    for (size_t q = 0; q < sizeof(queues) / sizeof(queues[0]); q++) {
+        const queue_impl_t* impl = &queues[q];
+        if (queue_names) {
+            /* Match whole names in the comma-separated list */
+            size_t len = strlen(impl->name);
+            const char* hit = strstr(queue_names, impl->name);
+            while (hit && ((hit != queue_names && hit[-1] != ',') ||
+                           (hit[len] != ',' && hit[len] != '\0'))) {
+                hit = strstr(hit + 1, impl->name);
+            }
+            if (!hit) {
+                continue;
+            }
+        }
+
+        for (int l = 0; l < num_layouts; l++) {
+            if ((impl->max_producers && producers[l] > impl->max_producers) ||
+                (impl->max_consumers && consumers[l] > impl->max_consumers)) {
+                continue;
+            }
+            for (int c = 0; c < num_capacities; c++) {
+                for (int s = 0; s < num_sizes; s++) {
+                    for (int pin = pin_from; pin <= pin_to; pin++) {
+                        /* Keep large-item runs to a bounded number of bytes */
+                        size_t budget = BYTES_PER_RUN / ((size_t)sizes[s] * producers[l]);
+                        bench_config_t config = {
+                            impl, (int)producers[l], (int)consumers[l], (int)capacities[c],
+                            (size_t)sizes[s], pin,
+                            items < budget ? items : (budget > 0 ? budget : 1)
+                        };
+                        if (run_config(&config) != 0) {
+                            return 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
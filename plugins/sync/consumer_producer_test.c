@@ -108,11 +108,355 @@ void test_multi_producer_consumer() {
     printf("[TEST] PASS\n\n");
 }
 
+#define SPSC_ITEMS 100000
+
+/* Producer for the SPSC test: numbered items followed by <END> */
+void* spsc_producer_func(void* arg) {
+    (void)arg;
+    for (int i = 0; i < SPSC_ITEMS; i++) {
+        char item_str[32];
+        snprintf(item_str, sizeof(item_str), "%d", i);
+        const char* err = consumer_producer_put(&test_queue, item_str);
+        assert(err == NULL);
+    }
+    const char* err = consumer_producer_put(&test_queue, "<END>");
+    assert(err == NULL);
+    return NULL;
+}
+
+/* Test: lock-free SPSC ring keeps strict FIFO order, including capacity 1 */
+void test_spsc_ordering(int capacity) {
+    printf("[TEST] Running: SPSC Ordering (capacity %d)\n", capacity);
+
+    const char* err = consumer_producer_init_mode(&test_queue, capacity, QUEUE_MODE_SPSC);
+    assert(err == NULL);
+    assert(consumer_producer_mode_for(1, 1) == QUEUE_MODE_SPSC);
+    assert(consumer_producer_mode_for(2, 1) == QUEUE_MODE_LOCKED);
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, spsc_producer_func, NULL);
+
+    int expected = 0;
+    while (1) {
+        char* item = consumer_producer_get(&test_queue);
+        if (strcmp(item, "<END>") == 0) {
+            free(item);
+            break;
+        }
+        assert(atoi(item) == expected);
+        expected++;
+        free(item);
+    }
+    pthread_join(producer, NULL);
+    consumer_producer_destroy(&test_queue);
+
+    printf("  [TEST] Received %d items in order\n", expected);
+    assert(expected == SPSC_ITEMS);
+    printf("[TEST] PASS\n\n");
+}
+
+/* Test: put_many/get_many keep FIFO order and respect max */
+void test_batch_api(queue_mode_t mode) {
+    printf("[TEST] Running: Batch Put/Get (%s)\n", mode == QUEUE_MODE_SPSC ? "spsc" : "locked");
+
+    const char* err = consumer_producer_init_mode(&test_queue, 8, mode);
+    assert(err == NULL);
+
+    const char* batch[] = { "a", "b", "c", "d", "e" };
+    err = consumer_producer_put_many(&test_queue, batch, 5);
+    assert(err == NULL);
+
+    char* out[8];
+    int n = consumer_producer_get_many(&test_queue, out, 3);
+    assert(n == 3);
+    assert(strcmp(out[0], "a") == 0 && strcmp(out[2], "c") == 0);
+    for (int i = 0; i < n; i++) {
+        free(out[i]);
+    }
+
+    n = consumer_producer_get_many(&test_queue, out, 8);
+    assert(n == 2);
+    assert(strcmp(out[0], "d") == 0 && strcmp(out[1], "e") == 0);
+    for (int i = 0; i < n; i++) {
+        free(out[i]);
+    }
+
+    consumer_producer_destroy(&test_queue);
+    printf("[TEST] PASS\n\n");
+}
+
+/* Consumer for the stats test: starts late so the producer has to wait */
+void* slow_consumer_func(void* arg) {
+    (void)arg;
+    usleep(20000);
+    for (int i = 0; i < 10; i++) {
+        free(consumer_producer_get(&test_queue));
+    }
+    return NULL;
+}
+
+/* Test: traffic counters see every item, the high-water mark and blocking */
+void test_stats(queue_mode_t mode) {
+    printf("[TEST] Running: Queue Stats (%s)\n", mode == QUEUE_MODE_SPSC ? "spsc" : "locked");
+
+    const char* err = consumer_producer_init_mode(&test_queue, 4, mode);
+    assert(err == NULL);
+    queue_stats_t stats;
+    consumer_producer_get_stats(&test_queue, &stats);
+    assert(stats.capacity == 4 && stats.items_in == 0 && stats.high_water == 0);
+
+    pthread_t consumer;
+    pthread_create(&consumer, NULL, slow_consumer_func, NULL);
+    for (int i = 0; i < 10; i++) {
+        err = consumer_producer_put(&test_queue, "x");
+        assert(err == NULL);
+    }
+    pthread_join(consumer, NULL);
+
+    consumer_producer_get_stats(&test_queue, &stats);
+    assert(stats.items_in == 10 && stats.items_out == 10 && stats.depth == 0);
+    assert(stats.high_water == 4);
+    /* The producer filled the queue long before the consumer started */
+    assert(stats.put_blocked_ns >= 10000000ull);
+    /* Without a wait strategy every wait parks */
+    assert(stats.put_waits[QUEUE_PHASE_PARK] >= 1);
+    assert(stats.put_waits[QUEUE_PHASE_SPIN] == 0 && stats.put_waits[QUEUE_PHASE_YIELD] == 0);
+
+    consumer_producer_destroy(&test_queue);
+    printf("[TEST] PASS\n\n");
+}
+
+/* Producer for the wait test: a little slower than the consumer */
+void* paced_producer_func(void* arg) {
+    (void)arg;
+    for (int i = 0; i < 20; i++) {
+        usleep(1000);
+        const char* err = consumer_producer_put(&test_queue, "x");
+        assert(err == NULL);
+    }
+    return NULL;
+}
+
+/* Test: wait strategy parsing, and waits ending before the park phase */
+void test_wait_strategy(queue_mode_t mode) {
+    printf("[TEST] Running: Wait Strategy (%s)\n", mode == QUEUE_MODE_SPSC ? "spsc" : "locked");
+
+    queue_wait_t wait;
+    const char* err = consumer_producer_parse_wait("park", &wait);
+    assert(err == NULL);
+    assert(wait.spins == 0 && wait.yields == 0);
+    err = consumer_producer_parse_wait("spin", &wait);
+    assert(err == NULL);
+    assert(wait.spins == QUEUE_DEFAULT_SPINS && wait.yields == QUEUE_DEFAULT_YIELDS);
+    err = consumer_producer_parse_wait("spin:500:4", &wait);
+    assert(err == NULL);
+    assert(wait.spins == 500 && wait.yields == 4);
+    assert(consumer_producer_parse_wait("spin:-1", &wait) != NULL);
+    assert(consumer_producer_parse_wait("spinning", &wait) != NULL);
+    assert(consumer_producer_parse_wait("spin:1:2:3", &wait) != NULL);
+
+    /* Yielding for far longer than the producer's pace: nobody parks */
+    err = consumer_producer_init_mode(&test_queue, 4, mode);
+    assert(err == NULL);
+    wait.spins = 100;
+    wait.yields = 1000000;
+    consumer_producer_set_wait(&test_queue, &wait);
+
+    pthread_t producer;
+    pthread_create(&producer, NULL, paced_producer_func, NULL);
+    for (int i = 0; i < 20; i++) {
+        free(consumer_producer_get(&test_queue));
+    }
+    pthread_join(producer, NULL);
+
+    queue_stats_t stats;
+    consumer_producer_get_stats(&test_queue, &stats);
+    printf("  [TEST] Consumer waits: %zu spin, %zu yield, %zu park\n",
+           stats.get_waits[QUEUE_PHASE_SPIN], stats.get_waits[QUEUE_PHASE_YIELD],
+           stats.get_waits[QUEUE_PHASE_PARK]);
+    assert(stats.get_waits[QUEUE_PHASE_PARK] == 0);
+    assert(stats.get_waits[QUEUE_PHASE_SPIN] + stats.get_waits[QUEUE_PHASE_YIELD] >= 1);
+
+    consumer_producer_destroy(&test_queue);
+    printf("[TEST] PASS\n\n");
+}
+
+/* Producer for the resize test: blocks on a full queue until it grows */
+void* blocked_producer_func(void* arg) {
+    const char* err = consumer_producer_put(&test_queue, "late");
+    assert(err == NULL);
+    *(int*)arg = 1;
+    return NULL;
+}
+
+/* Test: resizing while in use keeps FIFO order and wakes blocked producers */
+void test_resize(queue_mode_t mode) {
+    printf("[TEST] Running: Resize While Running (%s)\n", mode == QUEUE_MODE_SPSC ? "spsc" : "locked");
+
+    const char* err = consumer_producer_init_mode(&test_queue, 2, mode);
+    assert(err == NULL);
+    err = consumer_producer_reserve(&test_queue, 64);
+    assert(err == NULL);
+    err = consumer_producer_put(&test_queue, "a");
+    assert(err == NULL);
+    err = consumer_producer_put(&test_queue, "b");
+    assert(err == NULL);
+
+    /* Growing lets the blocked producer in */
+    int done = 0;
+    pthread_t producer;
+    pthread_create(&producer, NULL, blocked_producer_func, &done);
+    usleep(20000);
+    assert(!done);
+    err = consumer_producer_resize(&test_queue, 4);
+    assert(err == NULL);
+    pthread_join(producer, NULL);
+    assert(done);
+
+    /* Shrinking below the depth keeps the items; producers wait for the drain */
+    err = consumer_producer_resize(&test_queue, 1);
+    assert(err == NULL);
+    queue_stats_t stats;
+    consumer_producer_get_stats(&test_queue, &stats);
+    assert(stats.capacity == 1 && stats.depth == 3);
+    done = 0;
+    pthread_create(&producer, NULL, blocked_producer_func, &done);
+    const char* expected[] = { "a", "b", "late" };
+    for (int i = 0; i < 3; i++) {
+        usleep(5000);
+        assert(!done);
+        char* item = consumer_producer_get(&test_queue);
+        assert(strcmp(item, expected[i]) == 0);
+        free(item);
+    }
+    pthread_join(producer, NULL);
+    assert(done);
+    char* item = consumer_producer_get(&test_queue);
+    assert(strcmp(item, "late") == 0);
+    free(item);
+    if (mode == QUEUE_MODE_SPSC) {
+        err = consumer_producer_resize(&test_queue, 65);
+        assert(err != NULL);
+    }
+    err = consumer_producer_resize(&test_queue, 0);
+    assert(err != NULL);
+
+    /* Order survives resizes racing with a producer and a consumer */
+    pthread_create(&producer, NULL, spsc_producer_func, NULL);
+    int next = 0;
+    while (1) {
+        if (next % 1000 == 0) {
+            err = consumer_producer_resize(&test_queue, 1 + next / 1000 % 64);
+            assert(err == NULL);
+        }
+        item = consumer_producer_get(&test_queue);
+        if (strcmp(item, "<END>") == 0) {
+            free(item);
+            break;
+        }
+        assert(atoi(item) == next);
+        next++;
+        free(item);
+    }
+    pthread_join(producer, NULL);
+    assert(next == SPSC_ITEMS);
+
+    consumer_producer_destroy(&test_queue);
+    printf("[TEST] PASS\n\n");
+}
+
+/* Lengths travel with the items, across a resize, and NUL bytes survive */
+void test_slices(queue_mode_t mode) {
+    printf("[TEST] Running: Items With Lengths (%s)\n", mode == QUEUE_MODE_SPSC ? "spsc" : "locked");
+    const char* err = consumer_producer_init_mode(&test_queue, 4, mode);
+    assert(err == NULL);
+    err = consumer_producer_reserve(&test_queue, 8);
+    assert(err == NULL);
+
+    char* items[3];
+    size_t lens[3] = { 3, 0, 5 };
+    items[0] = malloc(4);
+    memcpy(items[0], "a\0b", 4);
+    items[1] = strdup("");
+    items[2] = malloc(6);
+    memcpy(items[2], "\0\0xyz", 6);
+    consumer_producer_put_slices(&test_queue, items, lens, 3);
+    err = consumer_producer_resize(&test_queue, 8);
+    assert(err == NULL);
+
+    /* Items moved in without lengths are measured */
+    char* plain = strdup("four");
+    consumer_producer_put_owned_many(&test_queue, &plain, 1);
+
+    char* out[4];
+    size_t out_lens[4];
+    size_t first_seq;
+    int n = consumer_producer_get_slices(&test_queue, out, out_lens, 4, &first_seq);
+    assert(n == 4 && first_seq == 0);
+    assert(out_lens[0] == 3 && memcmp(out[0], "a\0b", 3) == 0);
+    assert(out_lens[1] == 0);
+    assert(out_lens[2] == 5 && memcmp(out[2], "\0\0xyz", 5) == 0);
+    assert(out_lens[3] == 4 && strcmp(out[3], "four") == 0);
+    for (int i = 0; i < n; i++) {
+        free(out[i]);
+    }
+
+    consumer_producer_destroy(&test_queue);
+    printf("[TEST] PASS\n\n");
+}
+
+void test_control(queue_mode_t mode) {
+    printf("[TEST] Running: Control Items (%s)\n", mode == QUEUE_MODE_SPSC ? "spsc" : "locked");
+    const char* err = consumer_producer_init_mode(&test_queue, 2, mode);
+    assert(err == NULL);
+    err = consumer_producer_reserve(&test_queue, 8);
+    assert(err == NULL);
+
+    /* A line that reads "<END>" is only data */
+    err = consumer_producer_put(&test_queue, "<END>");
+    assert(err == NULL);
+    consumer_producer_put_control(&test_queue, CP_ITEM_FLUSH);
+    err = consumer_producer_resize(&test_queue, 8);
+    assert(err == NULL);
+    consumer_producer_put_control(&test_queue, CP_ITEM_BARRIER);
+    consumer_producer_put_control(&test_queue, CP_ITEM_END);
+
+    char* out[4];
+    size_t lens[4];
+    size_t first_seq;
+    int n = consumer_producer_get_slices(&test_queue, out, lens, 4, &first_seq);
+    assert(n == 4);
+    assert(cp_item_kind(lens[0]) == CP_ITEM_DATA && lens[0] == 5);
+    assert(cp_item_kind(lens[1]) == CP_ITEM_FLUSH && out[1] == NULL);
+    assert(cp_item_kind(lens[2]) == CP_ITEM_BARRIER && out[2] == NULL);
+    assert(cp_item_kind(lens[3]) == CP_ITEM_END && out[3] == NULL);
+    free(out[0]);
+
+    /* Left in the queue at shutdown, control items need no freeing */
+    consumer_producer_put_control(&test_queue, CP_ITEM_END);
+    consumer_producer_destroy(&test_queue);
+    printf("[TEST] PASS\n\n");
+}
 
 int main() {
     printf("--- Running Consumer-Producer Unit Tests ---\n\n");
     
     test_multi_producer_consumer();
+    test_spsc_ordering(1);
+    test_spsc_ordering(5);
+    test_spsc_ordering(64);
+    test_batch_api(QUEUE_MODE_LOCKED);
+    test_batch_api(QUEUE_MODE_SPSC);
+    test_stats(QUEUE_MODE_LOCKED);
+    test_stats(QUEUE_MODE_SPSC);
+    test_wait_strategy(QUEUE_MODE_LOCKED);
+    test_wait_strategy(QUEUE_MODE_SPSC);
+    test_resize(QUEUE_MODE_LOCKED);
+    test_resize(QUEUE_MODE_SPSC);
+    test_slices(QUEUE_MODE_LOCKED);
+    test_slices(QUEUE_MODE_SPSC);
+    test_control(QUEUE_MODE_LOCKED);
+    test_control(QUEUE_MODE_SPSC);
     
     printf("--- All Consumer-Producer Tests Passed ---\n");
     return 0;
@@ -0,0 +1,250 @@
+/* */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "executor.h"
+#include <sched.h>
+#include <stdlib.h>
+
+/* Add a task at the newest end of a worker's deque and wake a sleeping worker */
+static void push(executor_t* executor, executor_worker_t* worker, executor_task_t* task) {
+    pthread_mutex_lock(&worker->lock);
+    worker->tasks[(worker->head + worker->count) % executor->max_tasks] = task;
+    worker->count++;
+    pthread_mutex_unlock(&worker->lock);
+
+    /*
+     * A worker going to sleep announces itself in sleeping before it
+     * checks queued, so one of the two sides sees the other
+     */
+    atomic_fetch_add(&executor->queued, 1);
+    if (atomic_load(&executor->sleeping) > 0) {
+        pthread_mutex_lock(&executor->idle_lock);
+        pthread_cond_signal(&executor->work);
+        pthread_mutex_unlock(&executor->idle_lock);
+    }
+}
+
+/* Take the newest task of our own deque, or steal the oldest of another one */
+static executor_task_t* take(executor_t* executor, executor_worker_t* self) {
+    executor_task_t* task = NULL;
+    pthread_mutex_lock(&self->lock);
+    if (self->count > 0) {
+        task = self->tasks[(self->head + --self->count) % executor->max_tasks];
+    }
+    pthread_mutex_unlock(&self->lock);
+
+    int index = (int)(self - executor->workers);
+    for (int i = 1; !task && i < executor->num_workers; i++) {
+        executor_worker_t* victim = &executor->workers[(index + i) % executor->num_workers];
+        pthread_mutex_lock(&victim->lock);
+        if (victim->count > 0) {
+            task = victim->tasks[victim->head];
+            victim->head = (victim->head + 1) % executor->max_tasks;
+            victim->count--;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    if (task) {
+        atomic_fetch_sub(&executor->queued, 1);
+    }
+    return task;
+}
+
+/* Remove a queued task from whichever deque holds it */
+static int unqueue(executor_t* executor, executor_task_t* task) {
+    for (int w = 0; w < executor->num_workers; w++) {
+        executor_worker_t* worker = &executor->workers[w];
+        pthread_mutex_lock(&worker->lock);
+        for (int i = 0; i < worker->count; i++) {
+            if (worker->tasks[(worker->head + i) % executor->max_tasks] != task) {
+                continue;
+            }
+            for (int j = i + 1; j < worker->count; j++) {
+                worker->tasks[(worker->head + j - 1) % executor->max_tasks] =
+                    worker->tasks[(worker->head + j) % executor->max_tasks];
+            }
+            worker->count--;
+            pthread_mutex_unlock(&worker->lock);
+            atomic_fetch_sub(&executor->queued, 1);
+            return 1;
+        }
+        pthread_mutex_unlock(&worker->lock);
+    }
+    return 0;
+}
+
+/* Queue a task on the calling worker's deque, or spread them from other threads */
+static void enqueue(executor_task_t* task) {
+    executor_t* executor = task->executor;
+    executor_worker_t* worker = pthread_getspecific(executor->current);
+    if (!worker) {
+        unsigned next = atomic_fetch_add_explicit(&executor->next_worker, 1, memory_order_relaxed);
+        worker = &executor->workers[next % (unsigned)executor->num_workers];
+    }
+    push(executor, worker, task);
+}
+
+/* Run a task taken off a deque; queue it again if it was notified meanwhile */
+static void run(executor_task_t* task) {
+    atomic_store(&task->state, EXECUTOR_RUNNING);
+    task->run(task->arg);
+
+    int state = EXECUTOR_RUNNING;
+    if (!atomic_compare_exchange_strong(&task->state, &state, EXECUTOR_IDLE)) {
+        atomic_store(&task->state, EXECUTOR_QUEUED);
+        enqueue(task);
+    }
+}
+
+/* Worker thread: run tasks until the pool stops */
+static void* worker_thread(void* arg) {
+    executor_worker_t* self = (executor_worker_t*)arg;
+    executor_t* executor = self->executor;
+    pthread_setspecific(executor->current, self);
+
+    while (1) {
+        executor_task_t* task = take(executor, self);
+        if (task) {
+            run(task);
+            continue;
+        }
+
+        pthread_mutex_lock(&executor->idle_lock);
+        atomic_fetch_add(&executor->sleeping, 1);
+        while (atomic_load(&executor->queued) == 0 && !executor->stopping) {
+            pthread_cond_wait(&executor->work, &executor->idle_lock);
+        }
+        atomic_fetch_sub(&executor->sleeping, 1);
+        int stop = executor->stopping && atomic_load(&executor->queued) == 0;
+        pthread_mutex_unlock(&executor->idle_lock);
+        if (stop) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Stop and join the first count workers, then free everything */
+static void release(executor_t* executor, int count) {
+    pthread_mutex_lock(&executor->idle_lock);
+    executor->stopping = 1;
+    pthread_cond_broadcast(&executor->work);
+    pthread_mutex_unlock(&executor->idle_lock);
+    for (int i = 0; i < count; i++) {
+        pthread_join(executor->workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < executor->num_workers; i++) {
+        pthread_mutex_destroy(&executor->workers[i].lock);
+        free(executor->workers[i].tasks);
+    }
+    free(executor->workers);
+    pthread_cond_destroy(&executor->work);
+    pthread_mutex_destroy(&executor->idle_lock);
+    pthread_key_delete(executor->current);
+}
+
+const char* executor_init(executor_t* executor, int num_workers, int max_tasks,
+                          const int* cpus, int num_cpus) { /* */
+    if (num_workers <= 0 || max_tasks <= 0) {
+        return "Executor needs at least one worker and one task.";
+    }
+    executor->num_workers = num_workers;
+    executor->max_tasks = max_tasks;
+    executor->stopping = 0;
+    atomic_init(&executor->num_tasks, 0);
+    atomic_init(&executor->queued, 0);
+    atomic_init(&executor->sleeping, 0);
+    atomic_init(&executor->next_worker, 0);
+
+    executor->workers = calloc(num_workers, sizeof(executor_worker_t));
+    if (!executor->workers) {
+        return "Failed to allocate memory for executor workers.";
+    }
+    if (pthread_key_create(&executor->current, NULL) != 0) {
+        free(executor->workers);
+        return "Failed to create executor thread key.";
+    }
+    pthread_mutex_init(&executor->idle_lock, NULL);
+    pthread_cond_init(&executor->work, NULL);
+
+    for (int i = 0; i < num_workers; i++) {
+        executor_worker_t* worker = &executor->workers[i];
+        worker->executor = executor;
+        worker->cpu = cpus && num_cpus > 0 ? cpus[i % num_cpus] : -1;
+        worker->tasks = malloc(sizeof(executor_task_t*) * max_tasks);
+        pthread_mutex_init(&worker->lock, NULL);
+        if (!worker->tasks) {
+            release(executor, 0);
+            return "Failed to allocate memory for executor deques.";
+        }
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        executor_worker_t* worker = &executor->workers[i];
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (worker->cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(worker->cpu, &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        int failed = pthread_create(&worker->thread, &attr, worker_thread, worker);
+        pthread_attr_destroy(&attr);
+        if (failed) {
+            release(executor, i);
+            return "Failed to create executor thread.";
+        }
+    }
+    return NULL;
+}
+
+const char* executor_task_init(executor_t* executor, executor_task_t* task,
+                               void (*run) (void*), void* arg) { /* */
+    if (atomic_fetch_add(&executor->num_tasks, 1) >= executor->max_tasks) {
+        atomic_fetch_sub(&executor->num_tasks, 1);
+        return "Too many tasks for the executor.";
+    }
+    task->run = run;
+    task->arg = arg;
+    task->executor = executor;
+    atomic_init(&task->state, EXECUTOR_IDLE);
+    return NULL;
+}
+
+void executor_notify(executor_task_t* task) { /* */
+    int state = atomic_load(&task->state);
+    while (1) {
+        if (state == EXECUTOR_IDLE) {
+            if (atomic_compare_exchange_weak(&task->state, &state, EXECUTOR_QUEUED)) {
+                enqueue(task);
+                return;
+            }
+        } else if (state == EXECUTOR_RUNNING) {
+            if (atomic_compare_exchange_weak(&task->state, &state, EXECUTOR_RUNNING_AGAIN)) {
+                return;
+            }
+        } else {
+            return;  /* Already going to run */
+        }
+    }
+}
+
+/*
+ * The state says queued before the task reaches a deque; if it is not
+ * there yet, the caller waits a little and tries again
+ */
+int executor_help(executor_task_t* task) { /* */
+    if (atomic_load(&task->state) != EXECUTOR_QUEUED || !unqueue(task->executor, task)) {
+        return 0;
+    }
+    run(task);
+    return 1;
+}
+
+void executor_destroy(executor_t* executor) { /* */
+    release(executor, executor->num_workers);
+}
@@ -0,0 +1,111 @@
+/* */
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+/* Scheduling states of a task */
+#define EXECUTOR_IDLE 0            /* Not queued or running */
+#define EXECUTOR_QUEUED 1          /* In exactly one worker's deque */
+#define EXECUTOR_RUNNING 2         /* Being run by one thread */
+#define EXECUTOR_RUNNING_AGAIN 3   /* Being run, and notified meanwhile: queued again after */
+
+struct executor;
+
+/**
+ * A unit of work the executor runs whenever it is notified, e.g. a stage
+ * whose queue received items. A task runs on one thread at a time, so
+ * everything it does stays in order; run should do a bounded amount of
+ * work and notify the task again if more is left.
+ */
+typedef struct executor_task
+{
+    void (*run) (void* arg);       /* */
+    void* arg;                     /* */
+    struct executor* executor;     /* */
+    atomic_int state;              /* EXECUTOR_IDLE ... EXECUTOR_RUNNING_AGAIN */
+} executor_task_t;
+
+/**
+ * One worker thread and its deque of queued tasks. The worker takes the
+ * task it queued last (its data is likely still in cache); other workers
+ * with nothing to do steal the oldest one.
+ */
+typedef struct
+{
+    struct executor* executor;     /* */
+    pthread_t thread;              /* */
+    int cpu;                       /* CPU the thread is pinned to, -1 if none */
+    executor_task_t** tasks;       /* Ring of queued tasks */
+    int head;                      /* Oldest task (stolen first) */
+    int count;                     /* */
+    pthread_mutex_t lock;          /* Guards the ring */
+} executor_worker_t;
+
+/**
+ * Fixed pool of threads running tasks with per-worker deques and work
+ * stealing. A task is queued at most once at a time, so a deque never
+ * holds more than max_tasks entries.
+ */
+typedef struct executor
+{
+    executor_worker_t* workers;    /* */
+    int num_workers;               /* */
+    int max_tasks;                 /* */
+    atomic_int num_tasks;          /* Tasks set up so far */
+    atomic_int queued;             /* Tasks in all deques */
+    atomic_int sleeping;           /* Workers waiting for a task */
+    atomic_uint next_worker;       /* Deque for tasks queued from outside the pool */
+    int stopping;                  /* */
+    pthread_key_t current;         /* Worker running on the calling thread */
+    pthread_mutex_t idle_lock;     /* Guards stopping; held to sleep and wake */
+    pthread_cond_t work;           /* A task was queued, or the pool stops */
+} executor_t;
+
+/**
+ * Start a pool of worker threads
+ * @param executor Executor to initialize
+ * @param num_workers Number of threads
+ * @param max_tasks Most tasks that will be set up on it
+ * @param cpus CPU to pin each worker to (worker i takes cpus[i % num_cpus]), or NULL
+ * @param num_cpus Number of CPUs in cpus
+ * @return NULL on success, error message on failure
+ */
+const char* executor_init(executor_t* executor, int num_workers, int max_tasks,
+                          const int* cpus, int num_cpus); /* */
+
+/**
+ * Set up a task on an executor
+ * @param executor Executor
+ * @param task Task to initialize
+ * @param run Called with arg each time the task runs
+ * @param arg Passed to run
+ * @return NULL on success, error message if max_tasks are already set up
+ */
+const char* executor_task_init(executor_t* executor, executor_task_t* task,
+                               void (*run) (void*), void* arg); /* */
+
+/**
+ * Have a task run (again). Safe from any thread, also from the task
+ * itself; notifications that arrive while it is queued add nothing.
+ * @param task Task
+ */
+void executor_notify(executor_task_t* task); /* */
+
+/**
+ * Run a queued task on the calling thread right away, e.g. while waiting
+ * for it to make room in its queue
+ * @param task Task
+ * @return Nonzero if it was run, 0 if it was not queued (idle, or running elsewhere)
+ */
+int executor_help(executor_task_t* task); /* */
+
+/**
+ * Stop the workers once no task is queued, and free the executor. No
+ * task may be notified any more.
+ * @param executor Executor
+ */
+void executor_destroy(executor_t* executor); /* */
+
+#endif // EXECUTOR_H
@@ -0,0 +1,178 @@
+/* * Unit test application for executor.c
+ */
+#include "executor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <sched.h>
+
+#define NUM_TASKS 16
+#define NOTIFIERS 4
+#define ROUNDS 20000
+
+/* A task that counts its runs and fails if two threads ever run it at once */
+typedef struct {
+    executor_task_t task;
+    atomic_int inside;
+    atomic_int runs;
+    atomic_int pending;   /* Notifications its runs have not caught up with yet */
+} counted_t;
+
+void counted_run(void* arg) {
+    counted_t* c = (counted_t*)arg;
+    int others = atomic_fetch_add(&c->inside, 1);
+    assert(others == 0);
+    atomic_fetch_add(&c->runs, 1);
+    atomic_store(&c->pending, 0);
+    others = atomic_fetch_sub(&c->inside, 1) - 1;
+    assert(others == 0);
+}
+
+typedef struct {
+    counted_t* tasks;
+    int seed;
+} notifier_args_t;
+
+void* notifier(void* arg) {
+    notifier_args_t* args = (notifier_args_t*)arg;
+    unsigned seed = (unsigned)args->seed;
+    for (int i = 0; i < ROUNDS; i++) {
+        counted_t* c = &args->tasks[rand_r(&seed) % NUM_TASKS];
+        atomic_store(&c->pending, 1);
+        executor_notify(&c->task);
+    }
+    return NULL;
+}
+
+void test_notify_from_many_threads() {
+    printf("[TEST 1] Running: Tasks Run One Thread at a Time and Miss No Notification\n");
+    executor_t executor;
+    const char* err = executor_init(&executor, 4, NUM_TASKS, NULL, 0);
+    assert(err == NULL);
+    counted_t* tasks = calloc(NUM_TASKS, sizeof(counted_t));
+    for (int i = 0; i < NUM_TASKS; i++) {
+        err = executor_task_init(&executor, &tasks[i].task, counted_run, &tasks[i]);
+        assert(err == NULL);
+    }
+
+    /* The pool was sized for NUM_TASKS */
+    executor_task_t extra;
+    err = executor_task_init(&executor, &extra, counted_run, NULL);
+    assert(err != NULL);
+
+    pthread_t threads[NOTIFIERS];
+    notifier_args_t args[NOTIFIERS];
+    for (int i = 0; i < NOTIFIERS; i++) {
+        args[i].tasks = tasks;
+        args[i].seed = i + 1;
+        pthread_create(&threads[i], NULL, notifier, &args[i]);
+    }
+    for (int i = 0; i < NOTIFIERS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    /* Destroy waits until nothing is queued; every last notification ran */
+    executor_destroy(&executor);
+    int total = 0;
+    for (int i = 0; i < NUM_TASKS; i++) {
+        assert(atomic_load(&tasks[i].pending) == 0);
+        assert(atomic_load(&tasks[i].task.state) == EXECUTOR_IDLE);
+        total += atomic_load(&tasks[i].runs);
+    }
+    assert(total > 0 && total <= NOTIFIERS * ROUNDS);
+    free(tasks);
+    printf("[TEST 1] Passed.\n\n");
+}
+
+/* Keeps the only worker busy until released */
+typedef struct {
+    executor_task_t task;
+    atomic_int started;
+    atomic_int release;
+} blocker_t;
+
+void blocker_run(void* arg) {
+    blocker_t* b = (blocker_t*)arg;
+    atomic_store(&b->started, 1);
+    while (!atomic_load(&b->release)) {
+        sched_yield();
+    }
+}
+
+void test_help() {
+    printf("[TEST 2] Running: Help Runs a Queued Task on the Caller\n");
+    executor_t executor;
+    const char* err = executor_init(&executor, 1, 2, NULL, 0);
+    assert(err == NULL);
+    blocker_t blocker = { 0 };
+    counted_t counted = { 0 };
+    err = executor_task_init(&executor, &blocker.task, blocker_run, &blocker);
+    assert(err == NULL);
+    err = executor_task_init(&executor, &counted.task, counted_run, &counted);
+    assert(err == NULL);
+
+    /* Not queued: nothing to help with */
+    int ran = executor_help(&counted.task);
+    assert(ran == 0);
+
+    /* With the worker held up, the queued task runs here instead */
+    executor_notify(&blocker.task);
+    while (!atomic_load(&blocker.started)) {
+        sched_yield();
+    }
+    executor_notify(&counted.task);
+    assert(atomic_load(&counted.task.state) == EXECUTOR_QUEUED);
+    ran = executor_help(&counted.task);
+    assert(ran == 1);
+    assert(atomic_load(&counted.runs) == 1);
+    assert(atomic_load(&counted.task.state) == EXECUTOR_IDLE);
+
+    /* Running elsewhere: help leaves it alone */
+    ran = executor_help(&blocker.task);
+    assert(ran == 0);
+    atomic_store(&blocker.release, 1);
+    executor_destroy(&executor);
+    assert(atomic_load(&counted.runs) == 1);
+    printf("[TEST 2] Passed.\n\n");
+}
+
+/* Runs itself again until a count is used up, like a stage with a long queue */
+typedef struct {
+    executor_task_t task;
+    int left;
+    int runs;
+} chained_t;
+
+void chained_run(void* arg) {
+    chained_t* c = (chained_t*)arg;
+    c->runs++;
+    if (--c->left > 0) {
+        executor_notify(&c->task);
+    }
+}
+
+void test_renotify_from_task() {
+    printf("[TEST 3] Running: Task Notifying Itself Runs Again\n");
+    executor_t executor;
+    const char* err = executor_init(&executor, 2, 1, NULL, 0);
+    assert(err == NULL);
+    chained_t chained = { .left = 1000 };
+    err = executor_task_init(&executor, &chained.task, chained_run, &chained);
+    assert(err == NULL);
+    executor_notify(&chained.task);
+    executor_destroy(&executor);
+    assert(chained.runs == 1000);
+    assert(chained.left == 0);
+    printf("[TEST 3] Passed.\n\n");
+}
+
+int main() {
+    printf("--- Running Executor Unit Tests ---\n\n");
+
+    test_notify_from_many_threads();
+    test_help();
+    test_renotify_from_task();
+
+    printf("--- All Executor Tests Passed ---\n");
+    return 0;
+}
@@ -0,0 +1,139 @@
+/* */
+#include "reorder_buffer.h"
+#include "consumer_producer.h"
+#include <stdlib.h>
+
+const char* reorder_buffer_init(reorder_buffer_t* rb, size_t window) { /* */
+    if (window == 0) {
+        return "Reorder window must be positive.";
+    }
+    rb->slots = calloc(window, sizeof(char*));
+    rb->filled = calloc(window, 1);
+    rb->scratch = malloc(sizeof(char*) * window);
+    rb->lens = malloc(sizeof(size_t) * window);
+    rb->scratch_lens = malloc(sizeof(size_t) * window);
+    if (!rb->slots || !rb->filled || !rb->scratch || !rb->lens || !rb->scratch_lens) {
+        free(rb->slots);
+        free(rb->filled);
+        free(rb->scratch);
+        free(rb->lens);
+        free(rb->scratch_lens);
+        return "Failed to allocate memory for reorder buffer.";
+    }
+    rb->window = window;
+    rb->next_seq = 0;
+    rb->emitting = 0;
+
+    if (pthread_mutex_init(&rb->mutex, NULL) != 0) {
+        free(rb->slots);
+        free(rb->filled);
+        free(rb->scratch);
+        free(rb->lens);
+        free(rb->scratch_lens);
+        return "Failed to initialize reorder buffer mutex.";
+    }
+    if (pthread_cond_init(&rb->changed, NULL) != 0) {
+        pthread_mutex_destroy(&rb->mutex);
+        free(rb->slots);
+        free(rb->filled);
+        free(rb->scratch);
+        free(rb->lens);
+        free(rb->scratch_lens);
+        return "Failed to initialize reorder buffer condition.";
+    }
+    return NULL;
+}
+
+void reorder_buffer_destroy(reorder_buffer_t* rb) { /* */
+    for (size_t i = 0; i < rb->window; i++) {
+        free(rb->slots[i]);
+    }
+    free(rb->slots);
+    free(rb->filled);
+    free(rb->scratch);
+    free(rb->lens);
+    free(rb->scratch_lens);
+    pthread_mutex_destroy(&rb->mutex);
+    pthread_cond_destroy(&rb->changed);
+}
+
+/* Take the ready run starting at next_seq into scratch. Caller holds the mutex. */
+static int take_ready(reorder_buffer_t* rb, int* released) {
+    int n = 0;
+    *released = 0;
+    while (rb->filled[rb->next_seq % rb->window]) {
+        size_t slot = rb->next_seq % rb->window;
+        if (rb->slots[slot] || cp_item_kind(rb->lens[slot]) != CP_ITEM_DATA) {
+            rb->scratch_lens[n] = rb->lens[slot];
+            rb->scratch[n++] = rb->slots[slot];
+        }
+        rb->slots[slot] = NULL;
+        rb->filled[slot] = 0;
+        rb->next_seq++;
+        (*released)++;
+    }
+    return n;
+}
+
+/*
+ * Release ready runs unless another thread is already doing so.
+ * Caller holds the mutex; it is dropped while emit runs.
+ */
+static void drain(reorder_buffer_t* rb, reorder_emit_fn emit, void* ctx) {
+    if (rb->emitting) {
+        return;
+    }
+    rb->emitting = 1;
+
+    int released;
+    int n = take_ready(rb, &released);
+    while (released > 0) {
+        /* Freed slots may unblock depositors while we emit */
+        pthread_cond_broadcast(&rb->changed);
+        pthread_mutex_unlock(&rb->mutex);
+        if (n > 0) {
+            emit(ctx, rb->scratch, rb->scratch_lens, n);
+        }
+        pthread_mutex_lock(&rb->mutex);
+        n = take_ready(rb, &released);
+    }
+
+    rb->emitting = 0;
+    pthread_cond_broadcast(&rb->changed);
+}
+
+void reorder_buffer_put(reorder_buffer_t* rb, size_t first_seq, char** items,
+                        const size_t* lens, int count, reorder_emit_fn emit, void* ctx) { /* */
+    pthread_mutex_lock(&rb->mutex);
+
+    for (int i = 0; i < count; i++) {
+        size_t seq = first_seq + i;
+
+        /*
+         * Wait for the window to reach this sequence number. Our own
+         * earlier items may be what is holding it back, so release them
+         * if nobody else is.
+         */
+        while (seq >= rb->next_seq + rb->window) {
+            if (!rb->emitting && rb->filled[rb->next_seq % rb->window]) {
+                drain(rb, emit, ctx);
+            } else {
+                pthread_cond_wait(&rb->changed, &rb->mutex);
+            }
+        }
+        rb->slots[seq % rb->window] = items[i];
+        rb->lens[seq % rb->window] = lens[i];
+        rb->filled[seq % rb->window] = 1;
+    }
+
+    drain(rb, emit, ctx);
+    pthread_mutex_unlock(&rb->mutex);
+}
+
+void reorder_buffer_wait_released(reorder_buffer_t* rb, size_t seq) { /* */
+    pthread_mutex_lock(&rb->mutex);
+    while (rb->next_seq < seq || rb->emitting) {
+        pthread_cond_wait(&rb->changed, &rb->mutex);
+    }
+    pthread_mutex_unlock(&rb->mutex);
+}
@@ -0,0 +1,79 @@
+/* */
+#ifndef REORDER_BUFFER_H
+#define REORDER_BUFFER_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+/**
+ * Callback that receives released items in sequence order
+ * @param ctx Opaque pointer given to reorder_buffer_put
+ * @param items Consecutive items, oldest first (callee owns them)
+ * @param lens Their lengths
+ * @param count Number of items
+ */
+typedef void (*reorder_emit_fn)(void* ctx, char** items, size_t* lens, int count);
+
+/**
+ * Reorder buffer structure
+ * Workers deposit results tagged with the sequence number of their input in
+ * any order; results are released strictly in sequence order. At most
+ * `window` sequence numbers can be pending at once, which bounds memory
+ * when one worker falls behind.
+ */
+typedef struct
+{
+    char** slots;             /* Result per sequence number, seq % window */
+    size_t* lens;             /* Length of each slot's result */
+    unsigned char* filled;    /* Whether the slot holds a deposited result */
+    char** scratch;           /* Run of items handed to the emit callback */
+    size_t* scratch_lens;     /* Their lengths */
+    size_t window;            /* */
+    size_t next_seq;          /* Next sequence number to release */
+    int emitting;             /* A thread is currently running the callback */
+    pthread_mutex_t mutex;    /* */
+    pthread_cond_t changed;   /* Slots were freed or the emitter finished */
+} reorder_buffer_t;
+
+/**
+ * Initialize a reorder buffer
+ * @param rb Pointer to reorder buffer structure
+ * @param window Maximum number of sequence numbers in flight
+ * @return NULL on success, error message on failure
+ */
+const char* reorder_buffer_init(reorder_buffer_t* rb, size_t window); /* */
+
+/**
+ * Destroy a reorder buffer and free any unreleased results
+ * @param rb Pointer to reorder buffer structure
+ */
+void reorder_buffer_destroy(reorder_buffer_t* rb); /* */
+
+/**
+ * Deposit results for sequence numbers first_seq .. first_seq + count - 1.
+ * A NULL item marks a dropped result: it keeps its place but is not emitted,
+ * unless its length marks a control item (see cp_item_kind_t).
+ * Blocks while a sequence number is beyond the window. If the deposit makes
+ * the oldest pending results ready, this thread becomes the emitter and
+ * calls emit (outside the lock) until nothing more is ready; emit is never
+ * called concurrently.
+ * @param rb Pointer to reorder buffer structure
+ * @param first_seq Sequence number of items[0]
+ * @param items Results to deposit (ownership passes to the buffer)
+ * @param lens Their lengths
+ * @param count Number of items
+ * @param emit Callback receiving released runs
+ * @param ctx Passed to emit
+ */
+void reorder_buffer_put(reorder_buffer_t* rb, size_t first_seq, char** items,
+                        const size_t* lens, int count, reorder_emit_fn emit, void* ctx); /* */
+
+/**
+ * Wait until every sequence number below seq has been released and the
+ * emit callback for it has returned
+ * @param rb Pointer to reorder buffer structure
+ * @param seq Sequence number to wait for
+ */
+void reorder_buffer_wait_released(reorder_buffer_t* rb, size_t seq); /* */
+
+#endif // REORDER_BUFFER_H
@@ -0,0 +1,145 @@
+/* * Unit test application for reorder_buffer.c
+ */
+#include "reorder_buffer.h"
+#include "consumer_producer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <assert.h>
+#include <string.h>
+
+#define NUM_WORKERS 4
+#define TOTAL_ITEMS 20000
+#define CHUNK 7
+
+reorder_buffer_t test_rb;
+pthread_mutex_t next_mutex = PTHREAD_MUTEX_INITIALIZER;
+int next_item = 0;
+int emitted_count = 0;
+int order_ok = 1;
+
+/* Emit callback: checks items arrive as 0, 1, 2... with their lengths */
+void check_order(void* ctx, char** items, size_t* lens, int count) {
+    (void)ctx;
+    for (int i = 0; i < count; i++) {
+        if (atoi(items[i]) != emitted_count || lens[i] != strlen(items[i])) {
+            order_ok = 0;
+        }
+        emitted_count++;
+        free(items[i]);
+    }
+}
+
+/* Worker: claims chunks of sequence numbers and deposits them out of order */
+void* worker_func(void* arg) {
+    (void)arg;
+    while (1) {
+        pthread_mutex_lock(&next_mutex);
+        int first = next_item;
+        next_item += CHUNK;
+        pthread_mutex_unlock(&next_mutex);
+        if (first >= TOTAL_ITEMS) {
+            break;
+        }
+
+        int count = (first + CHUNK > TOTAL_ITEMS) ? TOTAL_ITEMS - first : CHUNK;
+        char* items[CHUNK];
+        size_t lens[CHUNK];
+        for (int i = 0; i < count; i++) {
+            char buf[32];
+            lens[i] = (size_t)snprintf(buf, sizeof(buf), "%d", first + i);
+            items[i] = strdup(buf);
+        }
+        reorder_buffer_put(&test_rb, first, items, lens, count, check_order, NULL);
+    }
+    return NULL;
+}
+
+/* Test 1: concurrent out-of-order deposits are released in order */
+void test_concurrent_order() {
+    printf("[TEST 1] Running: Concurrent Deposits Released In Order\n");
+    const char* err = reorder_buffer_init(&test_rb, 16);
+    assert(err == NULL);
+
+    pthread_t workers[NUM_WORKERS];
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        pthread_create(&workers[i], NULL, worker_func, NULL);
+    }
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    reorder_buffer_wait_released(&test_rb, TOTAL_ITEMS);
+
+    printf("  [TEST 1] Emitted %d items\n", emitted_count);
+    assert(order_ok);
+    assert(emitted_count == TOTAL_ITEMS);
+    reorder_buffer_destroy(&test_rb);
+    printf("[TEST 1] PASS\n\n");
+}
+
+/* Test 2: a NULL result keeps its place but is not emitted */
+void test_dropped_items() {
+    printf("[TEST 2] Running: Dropped Items Are Skipped\n");
+    const char* err = reorder_buffer_init(&test_rb, 4);
+    assert(err == NULL);
+    emitted_count = 0;
+    order_ok = 1;
+
+    char* late[] = { strdup("0") };
+    char* early[] = { NULL, strdup("1") };
+    size_t lens[] = { 0, 1 };
+
+    /* Deposit 1..2 first: nothing can be released before 0 arrives */
+    reorder_buffer_put(&test_rb, 1, early, lens, 2, check_order, NULL);
+    assert(emitted_count == 0);
+
+    reorder_buffer_put(&test_rb, 0, late, lens + 1, 1, check_order, NULL);
+    reorder_buffer_wait_released(&test_rb, 3);
+    assert(emitted_count == 2);
+    assert(order_ok);
+
+    reorder_buffer_destroy(&test_rb);
+    printf("[TEST 2] PASS\n\n");
+}
+
+/* Emit callback: records the kind of each item */
+cp_item_kind_t kinds[8];
+void record_kinds(void* ctx, char** items, size_t* lens, int count) {
+    (void)ctx;
+    for (int i = 0; i < count; i++) {
+        kinds[emitted_count++] = cp_item_kind(lens[i]);
+        free(items[i]);
+    }
+}
+
+void test_control_items() {
+    printf("[TEST 3] Running: Control Items Are Released In Place\n");
+    const char* err = reorder_buffer_init(&test_rb, 4);
+    assert(err == NULL);
+    emitted_count = 0;
+
+    /* A dropped result and a flush are both NULL; only the flush comes out */
+    char* later[] = { NULL, NULL, strdup("b") };
+    size_t later_lens[] = { 0, CP_CONTROL_LEN(CP_ITEM_FLUSH), 1 };
+    char* first[] = { strdup("a") };
+    size_t first_lens[] = { 1 };
+    reorder_buffer_put(&test_rb, 1, later, later_lens, 3, record_kinds, NULL);
+    reorder_buffer_put(&test_rb, 0, first, first_lens, 1, record_kinds, NULL);
+    reorder_buffer_wait_released(&test_rb, 4);
+    assert(emitted_count == 3);
+    assert(kinds[0] == CP_ITEM_DATA && kinds[1] == CP_ITEM_FLUSH && kinds[2] == CP_ITEM_DATA);
+
+    reorder_buffer_destroy(&test_rb);
+    printf("[TEST 3] PASS\n\n");
+}
+
+int main() {
+    printf("--- Running Reorder Buffer Unit Tests ---\n\n");
+
+    test_concurrent_order();
+    test_dropped_items();
+    test_control_items();
+
+    printf("--- All Reorder Buffer Tests Passed ---\n");
+    return 0;
+}
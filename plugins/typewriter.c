@@ -3,31 +3,32 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
-#include <unistd.h> /* For usleep */
 
 /**
- * Transformation function for the typewriter.
- * Simulates a typewriter effect with a 100ms delay per character.
+ * Transformation function for the typewriter, on len bytes.
+ * Simulates a typewriter effect with a delay per character (100ms by
+ * default, see the "type_rate" option). The pacing is done by the output
+ * sink's timer, so the line is forwarded without waiting for it.
  */
-const char* plugin_transform(const char* input) {
+const char* plugin_transform_slice(const char* input, size_t len, size_t* out_len) {
     /* Format: [typewriter] LLEHO */
-    printf("[typewriter] ");
-    fflush(stdout); /* Ensure prefix prints before delay */
-    
-    for (size_t i = 0; input[i]; i++) {
-        putchar(input[i]);
-        fflush(stdout);
-        usleep(100000); /* 100ms delay */
-    }
-    printf("\n");
-    fflush(stdout);
+    plugin_output_typed("[typewriter] ", input, len);
     
-    return strdup(input);
+    /* The line is unchanged: pass the same buffer on instead of a copy */
+    *out_len = len;
+    return plugin_retain_slice(input, len);
 }
 
+const char* plugin_transform(const char* input) {
+    size_t len;
+    return plugin_transform_slice(input, strlen(input), &len);
+}
+
+PLUGIN_DECLARE_POOLED()
+
 /**
  * Initialization function for the typewriter plugin.
  */
 const char* plugin_init(int queue_size) { /* */
     return common_plugin_init(plugin_transform, "typewriter", queue_size); /* */
-}
\ No newline at end of file
+}
@@ -1,29 +1,52 @@
 /* */
 #include "plugin_common.h"
+#include "simd/text_kernels.h"
 #include <string.h>
 #include <stdlib.h>
-#include <ctype.h>
 
 /**
- * Transformation function for the uppercaser.
+ * In-place transformation for the uppercaser, on len bytes.
+ * Converts all alphabetic characters in the buffer to uppercase.
+ * The analyzer runs in the C locale, where toupper only maps a-z, so the
+ * vectorized ASCII kernel gives the same result.
+ */
+void plugin_transform_inplace_slice(char* str, size_t len) {
+    text_kernels()->upper(str, len); /* */
+}
+
+void plugin_transform_inplace(char* str) {
+    plugin_transform_inplace_slice(str, strlen(str));
+}
+
+/**
+ * Transformation function for the uppercaser, on len bytes.
  * Converts all alphabetic characters in the string to uppercase.
  */
-const char* plugin_transform(const char* input) {
-    char* new_str = strdup(input);
+const char* plugin_transform_slice(const char* input, size_t len, size_t* out_len) {
+    char* new_str = plugin_memdup(input, len);
     if (!new_str) {
         return NULL; /* Common infrastructure will handle this */
     }
     
-    for (int i = 0; new_str[i]; i++) {
-        new_str[i] = toupper(new_str[i]); /* */
-    }
-    
+    plugin_transform_inplace_slice(new_str, len);
+    *out_len = len;
     return new_str;
 }
 
+const char* plugin_transform(const char* input) {
+    size_t len;
+    return plugin_transform_slice(input, strlen(input), &len);
+}
+
+PLUGIN_DECLARE_STATELESS()
+PLUGIN_DECLARE_PURE()
+
+PLUGIN_DECLARE_POOLED()
+
 /**
  * Initialization function for the uppercaser plugin.
  */
 const char* plugin_init(int queue_size) { /* */
-    return common_plugin_init(plugin_transform, "uppercaser", queue_size); /* */
-}
\ No newline at end of file
+    return common_plugin_init_inplace(plugin_transform, plugin_transform_inplace,
+                                      "uppercaser", queue_size); /* */
+}
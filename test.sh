@@ -208,12 +208,11 @@ run_test "Test 18: Max Length String (1024 chars)" \
 # Generate a 1025-char string (b...b)
 OVER_STRING=$(printf 'b%.0s' {1..1025})
 # Create the expected output strings
-# The line buffer is 1026, so fgets reads all 1025 chars at once.
-# The 2nd read will be '\n', which main.c strips to "".
+# Input lines have no length limit, so the whole line arrives as one item.
 EXPECTED_B_1025=$(printf 'B%.0s' {1..1025})
 run_test "Test 19: Oversized String (1025 chars)" \
          "echo -e '${OVER_STRING}\n<END>' | ./output/analyzer 10 uppercaser logger" \
-         "[logger] ${EXPECTED_B_1025}\n[logger] \nPipeline shutdown complete" \
+         "[logger] ${EXPECTED_B_1025}\nPipeline shutdown complete" \
          ""
 
 run_test "Test 20: All Plugins Chain" \
@@ -221,6 +220,249 @@ run_test "Test 20: All Plugins Chain" \
          "CONTAINS:Pipeline shutdown complete" \
          ""
 
+# --- Option Tests ---
+
+run_test "Test 21: Batch Size Option (ordering across batches)" \
+         "printf 'a\\nb\\nc\\nd\\ne\\n<END>\\n' | ./output/analyzer --batch 2 3 uppercaser rotator logger" \
+         "[logger] A\n[logger] B\n[logger] C\n[logger] D\n[logger] E\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 22: Invalid Batch Size" \
+         "./output/analyzer --batch 0 10 logger" \
+         "CONTAINS:Usage:" \
+         "Error: --batch must be a positive integer."
+
+run_test "Test 23: In-place Transforms Chain (rotator -> flipper -> uppercaser)" \
+         "echo -e 'abcd\n\nx\n<END>' | ./output/analyzer 2 rotator flipper uppercaser logger" \
+         "[logger] CBAD\n[logger] \n[logger] X\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 24: Stage Fusion (PDF Example)" \
+         "echo -e 'hello\n<END>' | ./output/analyzer --fuse 20 uppercaser rotator logger flipper typewriter" \
+         "[logger] OHELL\n[typewriter] LLEHO\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 25: Stage Fusion (fused repeated plugins)" \
+         "echo -e 'abc\n\n<END>' | ./output/analyzer --fuse 1 rotator rotator expander logger" \
+         "[logger] b c a\n[logger] \nPipeline shutdown complete" \
+         ""
+
+run_test "Test 26: Parallel Workers Keep Input Order (expander@3)" \
+         "printf 'one\\ntwo\\nthree\\nfour\\nfive\\n<END>\\n' | ./output/analyzer --batch 1 1 uppercaser expander@3 logger" \
+         "[logger] O N E\n[logger] T W O\n[logger] T H R E E\n[logger] F O U R\n[logger] F I V E\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 27: Parallel Workers Rejected for Side-effecting Plugin" \
+         "./output/analyzer 10 logger@2" \
+         "CONTAINS:Usage:" \
+         "Error: plugin logger cannot run with multiple workers."
+
+# --- Input File Tests ---
+
+printf 'first\n\n%s\nlast' "$(printf 'c%.0s' {1..5000})" > input_test.txt
+EXPECTED_C_5000=$(printf 'C%.0s' {1..5000})
+run_test "Test 28: Mapped Input File (long line, no trailing newline)" \
+         "./output/analyzer --input input_test.txt 10 uppercaser logger" \
+         "[logger] FIRST\n[logger] \n[logger] ${EXPECTED_C_5000}\n[logger] LAST\nPipeline shutdown complete" \
+         ""
+
+printf 'one\n<END>\ntwo\n' > input_test.txt
+run_test "Test 29: Mapped Input File (<END> stops reading)" \
+         "./output/analyzer --input input_test.txt 10 logger" \
+         "[logger] one\nPipeline shutdown complete" \
+         ""
+rm -f input_test.txt
+
+run_test "Test 30: Missing Input File" \
+         "./output/analyzer --input does_not_exist.txt 10 logger" \
+         "CONTAINS:Usage:" \
+         "Error: Cannot open input file does_not_exist.txt."
+
+run_test "Test 31: Line-flushed Output Sink (PDF Example)" \
+         "echo -e 'hello\n<END>' | ./output/analyzer --flush line 20 uppercaser rotator logger flipper typewriter" \
+         "[logger] OHELL\n[typewriter] LLEHO\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 32: Time-flushed Output Sink (no printouts lost)" \
+         "echo -e 'one\ntwo\n<END>' | ./output/analyzer --flush time:10 10 logger uppercaser logger | LC_ALL=C sort" \
+         "Pipeline shutdown complete\n[logger] ONE\n[logger] TWO\n[logger] one\n[logger] two" \
+         ""
+
+run_test "Test 33: Invalid Flush Policy" \
+         "./output/analyzer --flush sometimes 10 logger" \
+         "CONTAINS:Usage:" \
+         "Error: --flush: flush policy must be line, size:<bytes> or time:<ms>."
+
+run_test "Test 34: Typewriter Pacing Disabled (--type-rate 0)" \
+         "echo -e 'hello\nworld\n<END>' | ./output/analyzer --type-rate 0 10 typewriter uppercaser typewriter" \
+         "CONTAINS:[typewriter] WORLD" \
+         ""
+
+run_test "Test 35: Typed Lines Stay Whole Across Typewriters" \
+         "echo -e 'ab\ncd\n<END>' | ./output/analyzer --type-rate 1000 10 typewriter logger typewriter | LC_ALL=C sort" \
+         "Pipeline shutdown complete\n[logger] ab\n[logger] cd\n[typewriter] ab\n[typewriter] ab\n[typewriter] cd\n[typewriter] cd" \
+         ""
+
+run_test "Test 36: Invalid Type Rate" \
+         "./output/analyzer --type-rate -5 10 typewriter" \
+         "CONTAINS:Usage:" \
+         "Error: --type-rate must be a non-negative integer."
+
+run_test "Test 37: Repeated Plugins Share One Library (instances)" \
+         "echo -e 'abc\n<END>' | ./output/analyzer 10 logger uppercaser logger rotator logger" \
+         "[logger] abc\n[logger] ABC\n[logger] CAB\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 38: Stage Metrics Report (--metrics -)" \
+         "echo -e 'a\nb\n<END>' | ./output/analyzer --metrics - 10 uppercaser logger 2>&1 >/dev/null | grep -o '\"name\":\"[a-z]*\",\"items_in\":[0-9]*'" \
+         "\"name\":\"uppercaser\",\"items_in\":2\n\"name\":\"logger\",\"items_in\":2" \
+         ""
+
+run_test "Test 39: Invalid Metrics File" \
+         "./output/analyzer --metrics /nonexistent/m.txt 10 logger" \
+         "CONTAINS:Usage:" \
+         "Error: Cannot open metrics file /nonexistent/m.txt."
+
+run_test "Test 40: Buffer Pool Modes Give the Same Output" \
+         "for m in off on huge; do echo -e 'abc\nhello world\n<END>' | ./output/analyzer --pool \$m 10 uppercaser logger expander rotator logger | LC_ALL=C sort | md5sum; done | uniq | wc -l" \
+         "1" \
+         ""
+
+run_test "Test 41: Invalid Pool Mode" \
+         "./output/analyzer --pool big 10 logger" \
+         "CONTAINS:Usage:" \
+         "Error: --pool must be on, off or huge."
+
+run_test "Test 42: Pass-through Stages Share a 100 KB Line" \
+         "(printf '%100000s\n<END>\n' '' | tr ' ' x) | ./output/analyzer --type-rate 0 10 logger typewriter logger uppercaser logger | awk '{print \$1, substr(\$2, 1, 3), length(\$2)}' | LC_ALL=C sort" \
+         "Pipeline shu 8\n[logger] XXX 100000\n[logger] xxx 100000\n[logger] xxx 100000\n[typewriter] xxx 100000" \
+         ""
+
+run_test "Test 43: Spin-then-park Queue Waits" \
+         "echo -e 'abc\ndef\n<END>' | ./output/analyzer --wait spin:50:2 10 uppercaser rotator@2 logger" \
+         "[logger] CAB\n[logger] FDE\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 44: Invalid Wait Strategy" \
+         "./output/analyzer --wait spinning 10 logger < /dev/null" \
+         "" \
+         "Error configuring plugin logger: wait strategy must be park, spin, spin:<spins> or spin:<spins>:<yields>"
+
+run_test "Test 45: Pinned Stages (--pin auto, per-stage cpu=)" \
+         "echo -e 'abc\ndef\n<END>' | ./output/analyzer --pin auto 10 uppercaser:cpu=0 rotator@2 logger" \
+         "[logger] CAB\n[logger] FDE\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 46: Invalid CPU List" \
+         "./output/analyzer --pin 0-x 10 logger" \
+         "CONTAINS:Usage:" \
+         "Error: --pin: CPU lists look like 0,2,4-7."
+
+run_test "Test 47: Unknown Stage Option" \
+         "./output/analyzer 10 logger:speed=2" \
+         "CONTAINS:Usage:" \
+         "Error: logger: speed=2: unknown stage option."
+
+run_test "Test 48: Per-stage Queue Sizes (name:q=N)" \
+         "echo -e 'abc\ndef\n<END>' | ./output/analyzer 10 uppercaser:q=1 expander@2:q=3 logger" \
+         "[logger] A B C\n[logger] D E F\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 49: Queues Resized Within a Budget Give the Same Output" \
+         "for b in 0 1; do seq 1 50000 | ( [ \$b = 1 ] && ./output/analyzer --queue-budget 512 2 uppercaser:q=1 flipper logger || ./output/analyzer 2 uppercaser:q=1 flipper logger ) | md5sum; done | uniq | wc -l" \
+         "1" \
+         ""
+
+run_test "Test 50: Queue Budget Below the Starting Capacities" \
+         "./output/analyzer --queue-budget 10 8 uppercaser logger" \
+         "CONTAINS:Usage:" \
+         "Error: --queue-budget: budget is smaller than the queues' starting capacities."
+
+run_test "Test 51: Fan-out to Several Branches" \
+         "echo -e 'abc\\n<END>' | ./output/analyzer 10 'uppercaser -> {logger, flipper -> logger}' | sort" \
+         "Pipeline shutdown complete\n[logger] ABC\n[logger] CBA" \
+         ""
+
+run_test "Test 52: Ordered Fan-in Keeps Each Line's Results Together" \
+         "echo -e 'abc\\nde\\n<END>' | ./output/analyzer 10 uppercaser '->' '{flipper, rotator}' '->' logger" \
+         "[logger] CBA\n[logger] CAB\n[logger] ED\n[logger] ED\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 53: Unordered Fan-in (merge=any) Has the Same Lines as Ordered" \
+         "for m in ordered any; do seq 1 20000 | ./output/analyzer 4 \"uppercaser -> {flipper@2, rotator} -> logger:merge=\$m\" | sort | md5sum; done | uniq | wc -l; seq 1 20000 | ./output/analyzer 4 'uppercaser -> {flipper, rotator} -> logger:merge=any' | grep -c logger" \
+         "1\n40000" \
+         ""
+
+run_test "Test 54: Topology Syntax Error" \
+         "./output/analyzer 10 'uppercaser -> {logger, flipper'" \
+         "CONTAINS:Usage:" \
+         "Error: topology: expected , or }."
+
+run_test "Test 55: Pipeline Server Keeps Running Across Clients" \
+         "rm -f output/test.sock; ./output/analyzer --serve output/test.sock 10 'uppercaser -> {logger, flipper -> logger}' > output/serve.log & pid=\$!; echo abc | ./output/analyzer --connect output/test.sock; echo -e 'de\\n<END>\\nfg' | ./output/analyzer --connect output/test.sock; kill -TERM \$pid; wait \$pid; cat output/serve.log; rm -f output/serve.log; [ -e output/test.sock ] || echo removed" \
+         "[logger] ABC\n[logger] CBA\n[logger] DE\n[logger] ED\nPipeline shutdown complete\nremoved" \
+         ""
+
+run_test "Test 56: Client Without a Server" \
+         "./output/analyzer --connect output/missing.sock" \
+         "" \
+         "Error: --connect: Failed to connect to socket."
+
+run_test "Test 57: Lines Across Read Blocks, Empty Lines, No Final Newline" \
+         "( head -c 2500000 /dev/zero | tr '\\0' x; printf '\\n\\nab\\ncd' ) | ./output/analyzer 10 uppercaser logger | awk '{ print length(\$0) }'" \
+         "2500009\n9\n11\n11\n26" \
+         ""
+
+run_test "Test 58: <END> Stops Reading a Pipe That Stays Open" \
+         "( echo -e 'abc\\n<END>'; sleep 3 ) | ( timeout 2 ./output/analyzer 10 uppercaser logger; echo status \$? )" \
+         "[logger] ABC\nPipeline shutdown complete\nstatus 0" \
+         ""
+
+run_test "Test 59: Records With NUL Bytes Pass Whole Through the Slice ABI" \
+         "printf 'a\\0b\\nx\\0\\0yz\\n' | ./output/analyzer 10 uppercaser rotator flipper logger | tr '\\0' @" \
+         "[logger] @AB\n[logger] Y@@XZ\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 60: A Transform Result <END> Is Data, Not the End" \
+         "echo -e '>DNE<\nabc' | ./output/analyzer 10 flipper logger" \
+         "[logger] <END>\n[logger] cba\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 61: Barriers Time the Drain Through Every Branch" \
+         "seq 1000 | ./output/analyzer --metrics - 10 'uppercaser -> {logger, flipper -> logger}' 2>&1 >/dev/null | grep -o '^drain: [1-9][0-9]* barriers\|\"drain\":{\"barriers\":[1-9]' | sed 's/[0-9][0-9]*/N/'" \
+         "drain: N barriers\n\"drain\":{\"barriers\":N" \
+         ""
+
+run_test "Test 62: Executor Gives the Same Output as a Thread per Stage" \
+         "for e in '' '--executor 2' '--executor 1'; do seq 1 5000 | ./output/analyzer \$e 1 'uppercaser -> rotator -> flipper -> expander -> {logger, rotator -> logger}' | sort | md5sum; done | uniq | wc -l" \
+         "1" \
+         ""
+
+run_test "Test 63: Executor Runs a Chain Far Longer Than Its Threads" \
+         "seq 1 2000 | ./output/analyzer --executor 2 4 \$(for i in \$(seq 1 200); do echo -n 'rotator '; done) flipper@2 logger | tail -1" \
+         "Pipeline shutdown complete" \
+         ""
+
+run_test "Test 64: Executor Needs at Least One Thread" \
+         "./output/analyzer --executor 0 10 logger" \
+         "CONTAINS:Usage:" \
+         "Error: --executor must be auto or a positive integer."
+
+run_test "Test 65: Inline Mode Gives the Same Output as a Thread per Stage" \
+         "for f in '' '--inline' '--inline --fuse' '--inline --pool off'; do seq 1 5000 | ./output/analyzer \$f --type-rate 0 1 uppercaser expander logger rotator flipper typewriter | sort | md5sum; done | uniq | wc -l" \
+         "1" \
+         ""
+
+run_test "Test 66: Inline Typewriter Still Types Each Line" \
+         "echo -e 'ab\ncd\n<END>\nef' | ./output/analyzer --inline --type-rate 1000 10 uppercaser typewriter" \
+         "[typewriter] AB\n[typewriter] CD\nPipeline shutdown complete" \
+         ""
+
+run_test "Test 67: Inline Mode Needs a Linear Chain" \
+         "./output/analyzer --inline 10 'uppercaser -> {logger, flipper}'" \
+         "CONTAINS:Usage:" \
+         "Error: --inline: needs a linear chain of plugins with the instance ABI."
+
 # --- Summary ---
 echo ""
 echo "--- Test Summary ---"